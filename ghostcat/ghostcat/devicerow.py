@@ -1,6 +1,6 @@
 # SPDX-License-Identifier: GPL-2.0-or-later
 
-from ghostcat.svg import get_svg
+from ghostcat.svg import get_svg_handle
 
 import sys
 
@@ -9,7 +9,7 @@ import gi
 from .ghostcatd import RatbagdDevice
 
 gi.require_version("Gtk", "3.0")
-from gi.repository import GdkPixbuf, GObject, Gtk, Rsvg  # noqa
+from gi.repository import GdkPixbuf, GObject, Gtk  # noqa
 
 
 @Gtk.Template(resource_path="/org/freedesktop/GhostCAT/ui/DeviceRow.ui")
@@ -26,6 +26,10 @@ class DeviceRow(Gtk.ListBoxRow):
         Gtk.ListBoxRow.__init__(self, *args, **kwargs)
         self._device = device
 
+        self.show_all()
+        device.load_async(self._on_device_loaded)
+
+    def _on_device_loaded(self, device: RatbagdDevice) -> None:
         fw_version = device.firmware_version
         if fw_version:
             self.title.set_markup(
@@ -35,12 +39,7 @@ class DeviceRow(Gtk.ListBoxRow):
             self.title.set_text(device.name)
 
         try:
-            svg_bytes = get_svg(device.model)
-            assert svg_bytes is not None
-            handle = Rsvg.Handle.new_from_data(svg_bytes)
-            assert handle is not None
-            svg = handle.get_pixbuf_sub("#Device")
-            handle.close()
+            svg = get_svg_handle(device.model).get_pixbuf_sub("#Device")
             if svg is None:
                 print(
                     f"Device {device.name}'s SVG is incompatible",
@@ -58,7 +57,8 @@ class DeviceRow(Gtk.ListBoxRow):
                 file=sys.stderr,
             )
 
-        self.show_all()
+        # The list is sorted by name.
+        self.changed()
 
     @GObject.Property
     def device(self) -> RatbagdDevice:
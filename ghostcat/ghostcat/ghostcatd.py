@@ -140,10 +140,28 @@ EXCEPTION_TABLE = {
 }
 
 
+def load_all_async(objects, callback):
+    """Creates the proxies of all objects in parallel without blocking and
+    invokes callback() once all of them are ready."""
+    pending = len(objects)
+    if pending == 0:
+        callback()
+        return
+
+    def on_ready(obj):
+        nonlocal pending
+        pending -= 1
+        if pending == 0:
+            callback()
+
+    for obj in objects:
+        obj.load_async(on_ready)
+
+
 class _RatbagdDBus(GObject.GObject):
     _dbus = None
 
-    def __init__(self, interface, object_path):
+    def __init__(self, interface, object_path, lazy=False):
         super().__init__()
 
         if _RatbagdDBus._dbus is None:
@@ -159,27 +177,93 @@ class _RatbagdDBus(GObject.GObject):
         if object_path is None:
             object_path = "/" + ratbag1.replace(".", "/")
 
+        self._name = ratbag1
         self._object_path = object_path
         self._interface = f"{ratbag1}.{interface}"
 
-        try:
-            self._proxy = Gio.DBusProxy.new_sync(
-                _RatbagdDBus._dbus,
-                Gio.DBusProxyFlags.NONE,
-                None,
-                ratbag1,
-                object_path,
-                self._interface,
-                None,
-            )
-        except GLib.Error as e:
-            raise RatbagdUnavailableError(e.message) from e
+        # Lazy objects create their proxy with load_async() or, failing
+        # that, on first use.
+        self._proxy_obj = None
+        self._ready_callbacks = []
+        if not lazy:
+            self._proxy
 
-        if self._proxy.get_name_owner() is None:
-            raise RatbagdUnavailableError(f"No one currently owns {ratbag1}")
+    @property
+    def _proxy(self):
+        if self._proxy_obj is None:
+            try:
+                proxy = Gio.DBusProxy.new_sync(
+                    _RatbagdDBus._dbus,
+                    Gio.DBusProxyFlags.NONE,
+                    None,
+                    self._name,
+                    self._object_path,
+                    self._interface,
+                    None,
+                )
+            except GLib.Error as e:
+                raise RatbagdUnavailableError(e.message) from e
+            self._set_proxy(proxy)
+        return self._proxy_obj
+
+    def _set_proxy(self, proxy):
+        if proxy.get_name_owner() is None:
+            raise RatbagdUnavailableError(f"No one currently owns {self._name}")
+
+        self._proxy_obj = proxy
+        proxy.connect("g-properties-changed", self._on_properties_changed)
+        proxy.connect("g-signal", self._on_signal_received)
+        self._on_proxy_ready()
+
+    def load_async(self, callback):
+        """Creates the proxy without blocking the main loop and invokes
+        callback(self) once it is ready. Property reads on this object are
+        served from the cache once it is."""
+        if self._proxy_obj is not None:
+            callback(self)
+            return
+
+        self._ready_callbacks.append(callback)
+        if len(self._ready_callbacks) > 1:
+            return
+
+        Gio.DBusProxy.new(
+            _RatbagdDBus._dbus,
+            Gio.DBusProxyFlags.NONE,
+            None,
+            self._name,
+            self._object_path,
+            self._interface,
+            None,
+            self._on_proxy_new_finished,
+        )
+
+    def _on_proxy_new_finished(self, source, result):
+        try:
+            proxy = Gio.DBusProxy.new_finish(result)
+            if self._proxy_obj is None:
+                self._set_proxy(proxy)
+        except (GLib.Error, RatbagdUnavailableError) as e:
+            # The callbacks still run, the proxy is then created on first use.
+            print(e, file=sys.stderr)
+
+        callbacks, self._ready_callbacks = self._ready_callbacks, []
+        for callback in callbacks:
+            callback(self)
+
+    def _on_proxy_ready(self):
+        # Implement this in derived classes to read the initial property
+        # values.
+        pass
 
-        self._proxy.connect("g-properties-changed", self._on_properties_changed)
-        self._proxy.connect("g-signal", self._on_signal_received)
+    def __getattr__(self, name):
+        # Only called for attributes that do not exist, e.g. the values
+        # _on_proxy_ready() caches of a lazy object that was never loaded.
+        # Creating the proxy now blocks but fills them in.
+        if name.startswith("__") or self.__dict__.get("_proxy_obj", True) is not None:
+            raise AttributeError(name)
+        self._proxy
+        return super().__getattribute__(name)
 
     def _on_properties_changed(self, proxy, changed_props, invalidated_props):
         # Implement this in derived classes to respond to property changes.
@@ -220,41 +304,63 @@ class _RatbagdDBus(GObject.GObject):
         val = GLib.Variant(f"{type}", value)
         if readwrite:
             pval = GLib.Variant("(ssv)", (self._interface, property, val))
-            self._proxy.call_sync(
+            self._proxy.call(
                 "org.freedesktop.DBus.Properties.Set",
                 pval,
                 Gio.DBusCallFlags.NO_AUTO_START,
                 2000,
                 None,
+                self._on_dbus_call_finished,
+                (None, None),
             )
 
         # This is our local copy, so we don't have to wait for the async
         # update
         self._proxy.set_cached_property(property, val)
 
-    def _dbus_call(self, method, type, *value):
-        # Calls a method synchronously on the bus, using the given method name,
-        # type signature and values.
+    def _dbus_call(self, method, type, *value, callback=None, error_callback=None):
+        # Calls a method asynchronously on the bus, using the given method
+        # name, type signature and values. Once the daemon answered,
+        # callback is invoked with the result.
         #
-        # If the result is valid, it is returned. Invalid results raise the
-        # appropriate RatbagError* or RatbagdDBus* exception, or GLib.Error if
-        # it is an unexpected exception that probably shouldn't be passed up to
-        # the UI.
+        # The call returns before the daemon answered, so callers cannot
+        # catch its errors. The RatbagError* matching the daemon's error
+        # code, or the GLib.Error of a failed call, is passed to
+        # error_callback instead. Without one the error is printed, the
+        # daemon emits Resync for the errors that change the device state.
         val = GLib.Variant(f"({type})", value)
+        self._proxy.call(
+            method,
+            val,
+            Gio.DBusCallFlags.NO_AUTO_START,
+            2000,
+            None,
+            self._on_dbus_call_finished,
+            (callback, error_callback),
+        )
+
+    def _on_dbus_call_finished(self, proxy, result, callbacks):
+        callback, error_callback = callbacks
         try:
-            res = self._proxy.call_sync(
-                method, val, Gio.DBusCallFlags.NO_AUTO_START, 2000, None
-            )
-            if res in EXCEPTION_TABLE:
-                raise EXCEPTION_TABLE[res]
-            return res.unpack()[0]  # Result is always a tuple
+            res = proxy.call_finish(result).unpack()
         except GLib.Error as e:
-            if e.code == Gio.IOErrorEnum.TIMED_OUT:
-                raise RatbagdDBusTimeoutError(e.message) from e
-
-            # Unrecognized error code.
-            print(e.message, file=sys.stderr)
-            raise
+            if error_callback is not None:
+                error_callback(e)
+            else:
+                print(e.message, file=sys.stderr)
+            return
+
+        # Result is always a tuple
+        res = res[0] if res else None
+        if res in EXCEPTION_TABLE:
+            error = EXCEPTION_TABLE[res]()
+            if error_callback is not None:
+                error_callback(error)
+            else:
+                print(error.__doc__, file=sys.stderr)
+            return
+        if callback is not None:
+            callback(res)
 
     def __eq__(self, other):
         return other and self._object_path == other._object_path
@@ -287,7 +393,7 @@ class Ratbagd(_RatbagdDBus):
             )
         if self.api_version != api_version:
             raise RatbagdIncompatibleError(self.api_version or -1, api_version)
-        self._devices = [RatbagdDevice(objpath) for objpath in result or []]
+        self._devices = [RatbagdDevice(objpath, lazy=True) for objpath in result or []]
         self._proxy.connect("notify::g-name-owner", self._on_name_owner_changed)
 
     def _on_name_owner_changed(self, *kwargs):
@@ -303,7 +409,7 @@ class Ratbagd(_RatbagdDBus):
             object_paths = [d._object_path for d in self._devices]
             for object_path in new_device_object_paths:
                 if object_path not in object_paths:
-                    device = RatbagdDevice(object_path)
+                    device = RatbagdDevice(object_path, lazy=True)
                     self._devices.append(device)
                     self.emit("device-added", device)
             for device in self.devices:
@@ -347,18 +453,26 @@ class RatbagdDevice(_RatbagdDBus):
         "resync": (GObject.SignalFlags.RUN_FIRST, None, ()),
     }
 
-    def __init__(self, object_path):
-        super().__init__("Device", object_path)
+    def __init__(self, object_path, lazy=False):
+        super().__init__("Device", object_path, lazy)
+
+        # Use a SHA1 of our object path as our device's ID
+        self._id = hashlib.sha1(object_path.encode("utf-8")).hexdigest()
 
+    def _on_proxy_ready(self):
         # FIXME: if we start adding and removing objects from this list,
         # things will break!
         result = self._get_dbus_property("Profiles") or []
-        self._profiles = [RatbagdProfile(objpath) for objpath in result]
+        self._profiles = [RatbagdProfile(objpath, lazy=True) for objpath in result]
         for profile in self._profiles:
             profile.connect("notify::is-active", self._on_active_profile_changed)
 
-        # Use a SHA1 of our object path as our device's ID
-        self._id = hashlib.sha1(object_path.encode("utf-8")).hexdigest()
+    def load_profiles_async(self, callback):
+        """Creates the proxies of the device and all its profiles without
+        blocking and invokes callback(self) once they are ready."""
+        self.load_async(
+            lambda _: load_all_async(self._profiles, lambda: callback(self))
+        )
 
     def _on_signal_received(self, proxy, sender_name, signal_name, parameters):
         if signal_name == "Resync":
@@ -435,8 +549,10 @@ class RatbagdProfile(_RatbagdDBus):
     CAP_DISABLE = 102
     CAP_WRITE_ONLY = 103
 
-    def __init__(self, object_path):
-        super().__init__("Profile", object_path)
+    def __init__(self, object_path, lazy=False):
+        super().__init__("Profile", object_path, lazy)
+
+    def _on_proxy_ready(self):
         self._active = self._get_dbus_property("IsActive")
         self._angle_snapping = self._get_dbus_property("AngleSnapping")
         self._debounce = self._get_dbus_property("Debounce")
@@ -447,17 +563,30 @@ class RatbagdProfile(_RatbagdDBus):
         # FIXME: if we start adding and removing objects from any of these
         # lists, things will break!
         result = self._get_dbus_property("Resolutions") or []
-        self._resolutions = [RatbagdResolution(objpath) for objpath in result]
+        self._resolutions = [
+            RatbagdResolution(objpath, lazy=True) for objpath in result
+        ]
         self._subscribe_dirty(self._resolutions)
 
         result = self._get_dbus_property("Buttons") or []
-        self._buttons = [RatbagdButton(objpath) for objpath in result]
+        self._buttons = [RatbagdButton(objpath, lazy=True) for objpath in result]
         self._subscribe_dirty(self._buttons)
 
         result = self._get_dbus_property("Leds") or []
-        self._leds = [RatbagdLed(objpath) for objpath in result]
+        self._leds = [RatbagdLed(objpath, lazy=True) for objpath in result]
         self._subscribe_dirty(self._leds)
 
+    def load_children_async(self, callback):
+        """Creates the proxies of the profile and all its resolutions,
+        buttons and LEDs without blocking and invokes callback(self) once
+        they are ready."""
+        self.load_async(
+            lambda _: load_all_async(
+                self._resolutions + self._buttons + self._leds,
+                lambda: callback(self),
+            )
+        )
+
     def _subscribe_dirty(self, objects: List[GObject.GObject]):
         for obj in objects:
             obj.connect("notify", self._on_obj_notify)
@@ -664,9 +793,8 @@ class RatbagdProfile(_RatbagdDBus):
 
     def set_active(self):
         """Set this profile to be the active profile."""
-        ret = self._dbus_call("SetActive", "")
+        self._dbus_call("SetActive", "")
         self._set_dbus_property("IsActive", "b", True, readwrite=False)
-        return ret
 
 
 class RatbagdResolution(_RatbagdDBus):
@@ -675,8 +803,10 @@ class RatbagdResolution(_RatbagdDBus):
     CAP_SEPARATE_XY_RESOLUTION = 1
     CAP_DISABLE = 2
 
-    def __init__(self, object_path):
-        super().__init__("Resolution", object_path)
+    def __init__(self, object_path, lazy=False):
+        super().__init__("Resolution", object_path, lazy)
+
+    def _on_proxy_ready(self):
         self._active = self._get_dbus_property("IsActive")
         self._default = self._get_dbus_property("IsDefault")
         self._disabled = self._get_dbus_property("IsDisabled")
@@ -813,15 +943,13 @@ class RatbagdResolution(_RatbagdDBus):
 
     def set_active(self):
         """Set this resolution to be the active one."""
-        ret = self._dbus_call("SetActive", "")
+        self._dbus_call("SetActive", "")
         self._set_dbus_property("IsActive", "b", True, readwrite=False)
-        return ret
 
     def set_default(self):
         """Set this resolution to be the default."""
-        ret = self._dbus_call("SetDefault", "")
+        self._dbus_call("SetDefault", "")
         self._set_dbus_property("IsDefault", "b", True, readwrite=False)
-        return ret
 
     def set_disabled(self, disable):
         """Set this resolution to be disabled."""
@@ -829,9 +957,8 @@ class RatbagdResolution(_RatbagdDBus):
 
     def set_dpi_shift_target(self):
         """Set this resolution to be the DPI shift target."""
-        ret = self._dbus_call("SetDpiShiftTarget", "")
+        self._dbus_call("SetDpiShiftTarget", "")
         self._set_dbus_property("IsDpiShiftTarget", "b", True, readwrite=False)
-        return ret
 
 
 class RatbagdButton(_RatbagdDBus):
@@ -906,8 +1033,8 @@ class RatbagdButton(_RatbagdDBus):
         ActionSpecial.BATTERY_LEVEL: N_("Battery Level"),
     }
 
-    def __init__(self, object_path):
-        super().__init__("Button", object_path)
+    def __init__(self, object_path, lazy=False):
+        super().__init__("Button", object_path, lazy)
 
     def _on_properties_changed(self, proxy, changed_props, invalidated_props):
         if "Mapping" in changed_props.keys():
@@ -1136,9 +1263,10 @@ class RatbagdLed(_RatbagdDBus):
         Mode.BREATHING: N_("Breathing"),
     }
 
-    def __init__(self, object_path):
-        super().__init__("Led", object_path)
+    def __init__(self, object_path, lazy=False):
+        super().__init__("Led", object_path, lazy)
 
+    def _on_proxy_ready(self):
         self._brightness = self._get_dbus_property("Brightness")
         self._color = self._get_dbus_property("Color")
         self._effect_duration = self._get_dbus_property("EffectDuration")
@@ -1,13 +1,12 @@
 # SPDX-License-Identifier: GPL-2.0-or-later
 
-from typing import Any, List, Optional, Tuple
+from typing import Any, Dict, List, Optional, Tuple
 
 import cairo
 import gi
 import sys
-from lxml import etree
 
-from ghostcat.svg import get_svg
+from ghostcat.svg import get_svg_handle, get_svg_tree
 from .ghostcatd import RatbagdDevice
 
 gi.require_version("Gdk", "3.0")
@@ -108,12 +107,8 @@ class MouseMap(Gtk.Container):
         if ghostcatd_device is None:
             raise ValueError("Device cannot be None")
         try:
-            svg_bytes = get_svg(ghostcatd_device.model)
-            assert svg_bytes is not None
-            handle = Rsvg.Handle.new_from_data(svg_bytes)
-            assert handle is not None
-            self._handle: Rsvg.Handle = handle
-            self._svg_data = etree.fromstring(svg_bytes)
+            self._handle: Rsvg.Handle = get_svg_handle(ghostcatd_device.model)
+            self._svg_data = get_svg_tree(ghostcatd_device.model)
         except FileNotFoundError as e:
             raise ValueError("Device has no image or its path is invalid") from e
 
@@ -126,6 +121,31 @@ class MouseMap(Gtk.Container):
         self._children: List[_MouseMapChild] = []
         self._highlight_element: Optional[str] = None
 
+        # The styles of the SVG's rects by identifier, so we don't have to
+        # query the SVG for each child. Identifiers that are not unique map
+        # to None.
+        self._rect_styles: Dict[str, Optional[str]] = {}
+        for rect in self._svg_data.iter("{http://www.w3.org/2000/svg}rect"):
+            rect_id = rect.get("id")
+            if rect_id is None:
+                continue
+            if rect_id in self._rect_styles:
+                self._rect_styles[rect_id] = None
+            else:
+                self._rect_styles[rect_id] = rect.get("style", "")
+
+        # The position and size of SVG elements never change once loaded,
+        # so each is looked up in librsvg only once.
+        self._geometry: Dict[str, Tuple[bool, Gdk.Rectangle]] = {}
+
+        # Rendering the SVG through librsvg is slow, so the device, the
+        # paths and leaders of the children and each highlighted element are
+        # rasterized once at the current scale and only composited on draw.
+        self._render_scale = 0
+        self._device_surface: Optional[cairo.Surface] = None
+        self._overlay_surface: Optional[cairo.Surface] = None
+        self._highlight_surfaces: Dict[str, cairo.Surface] = {}
+
         # TODO: remove this when we're out of the transition to toned down SVGs
         device = self._handle.has_sub("#Device")
         buttons = self._handle.has_sub("#Buttons")
@@ -151,9 +171,10 @@ class MouseMap(Gtk.Container):
         ):
             return
 
-        is_left = self._xpath_has_style(svg_leader[1:], "text-align:end")
+        is_left = self._rect_has_style(svg_leader[1:], "text-align:end")
         child = _MouseMapChild(widget, is_left, svg_id)
         self._children.append(child)
+        self._overlay_surface = None
         widget.connect("enter-notify-event", self._on_enter, child)
         widget.connect("leave-notify-event", self._on_leave)
         widget.set_parent(self)
@@ -168,6 +189,7 @@ class MouseMap(Gtk.Container):
                 if child.widget == widget:
                     self._children.remove(child)
                     child.widget.unparent()
+                    self._overlay_surface = None
                     break
 
     def do_forall(
@@ -308,6 +330,9 @@ class MouseMap(Gtk.Container):
         scale_factor = self.get_scale_factor()
         target = cr.get_target()
         target.set_device_scale(scale_factor, scale_factor)
+        if scale_factor != self._render_scale:
+            self._invalidate_render_cache()
+            self._render_scale = scale_factor
 
         cr.save()
         x, y = self._translate_to_origin()
@@ -344,25 +369,22 @@ class MouseMap(Gtk.Container):
         self._highlight_element = None
         self._redraw_svg_element(old_highlight)
 
-    def _xpath_has_style(self, svg_id: str, style: str) -> bool:
-        # Checks if the SVG element with the given identifier has the given
+    def _rect_has_style(self, svg_id: str, style: str) -> bool:
+        # Checks if the SVG rect with the given identifier has the given
         # style attribute set.
-        namespaces = {
-            "sodipodi": "http://sodipodi.sourceforge.net/DTD/sodipodi-0.dtd",
-            "cc": "http://web.resource.org/cc/",
-            "svg": "http://www.w3.org/2000/svg",
-            "dc": "http://purl.org/dc/elements/1.1/",
-            "xlink": "http://www.w3.org/1999/xlink",
-            "rdf": "http://www.w3.org/1999/02/22-rdf-syntax-ns#",
-            "inkscape": "http://www.inkscape.org/namespaces/inkscape",
-        }
-        query = f'//svg:rect[@id="{svg_id}"][contains(@style, "{style}")]'
-        element = self._svg_data.xpath(query, namespaces=namespaces)
-        return element is not None and len(element) == 1 and element[0] is not None
+        rect_style = self._rect_styles.get(svg_id)
+        return rect_style is not None and style in rect_style
 
     def _get_svg_sub_geometry(self, svg_id: str) -> Tuple[bool, Gdk.Rectangle]:
         # Helper method to get an SVG element's x- and y-coordinates, width and
-        # height.
+        # height. The result is cached for the lifetime of the SVG.
+        geometry = self._geometry.get(svg_id)
+        if geometry is None:
+            geometry = self._lookup_svg_sub_geometry(svg_id)
+            self._geometry[svg_id] = geometry
+        return geometry
+
+    def _lookup_svg_sub_geometry(self, svg_id: str) -> Tuple[bool, Gdk.Rectangle]:
         ret = Gdk.Rectangle()
         ok, svg_pos = self._handle.get_position_sub(svg_id)
         if not ok:
@@ -424,27 +446,56 @@ class MouseMap(Gtk.Container):
         y = (allocation.height - height) / 2 + self.props.border_width
         return round(x), round(y)
 
+    def _invalidate_render_cache(self) -> None:
+        # Drops all rasterized layers, they are rendered again on the next
+        # draw.
+        self._device_surface = None
+        self._overlay_surface = None
+        self._highlight_surfaces.clear()
+
+    def _render_layer(self, target: cairo.Surface, svg_ids: List[str]) -> cairo.Surface:
+        # Rasterizes the given SVG elements into a new surface that matches
+        # the target, including its device scale.
+        surface = target.create_similar(
+            cairo.CONTENT_COLOR_ALPHA,
+            self._handle.props.width,
+            self._handle.props.height,
+        )
+        context = cairo.Context(surface)
+        for svg_id in svg_ids:
+            self._handle.render_cairo_sub(context, id=svg_id)
+        return surface
+
     def _draw_device(self, cr: cairo.Context) -> None:
         # Draws the SVG into the Cairo context. If there is an element to be
-        # highlighted, it will do as such in a separate surface which will be
-        # used as a mask over the device surface.
-        style_context = self.get_style_context()
-        style_context.save()
-        color = style_context.get_color(Gtk.StateFlags.LINK)
-        style_context.restore()
-        cr.set_source_rgba(color.red, color.green, color.blue, 0.5)
-
-        self._handle.render_cairo_sub(cr, id="#Device")
+        # highlighted, its layer is used as a mask over the device surface.
+        # All layers come from the render cache.
+        target = cr.get_target()
+        if self._device_surface is None:
+            self._device_surface = self._render_layer(target, ["#Device"])
+        if self._overlay_surface is None:
+            svg_ids = []
+            for child in self._children:
+                svg_ids += [child.svg_path, child.svg_leader]
+            self._overlay_surface = self._render_layer(target, svg_ids)
+
+        cr.set_source_surface(self._device_surface, 0, 0)
+        cr.paint()
+
         if self._highlight_element is not None:
-            svg_surface = cr.get_target()
-            highlight_surface = svg_surface.create_similar(
-                cairo.CONTENT_COLOR_ALPHA,
-                self._handle.props.width,
-                self._handle.props.height,
-            )
-            highlight_context = cairo.Context(highlight_surface)
-            self._handle.render_cairo_sub(highlight_context, self._highlight_element)
+            highlight_surface = self._highlight_surfaces.get(self._highlight_element)
+            if highlight_surface is None:
+                highlight_surface = self._render_layer(
+                    target, [self._highlight_element]
+                )
+                self._highlight_surfaces[self._highlight_element] = highlight_surface
+
+            style_context = self.get_style_context()
+            style_context.save()
+            color = style_context.get_color(Gtk.StateFlags.LINK)
+            style_context.restore()
+            cr.set_source_rgba(color.red, color.green, color.blue, 0.5)
             cr.mask_surface(highlight_surface, 0, 0)
-        for child in self._children:
-            self._handle.render_cairo_sub(cr, id=child.svg_path)
-            self._handle.render_cairo_sub(cr, id=child.svg_leader)
+
+        cr.set_source_surface(self._overlay_surface, 0, 0)
+        cr.paint()
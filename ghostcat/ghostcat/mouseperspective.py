@@ -114,6 +114,14 @@ class MousePerspective(Gtk.Overlay):
         self._select_profile_row(profile)
 
         self._profile = profile
+        profile.load_children_async(self._on_profile_loaded)
+
+    def _on_profile_loaded(self, profile: RatbagdProfile) -> None:
+        if profile is not self._profile:
+            # Another profile was selected in the meantime.
+            return
+
+        assert self._device is not None
 
         self.stack.foreach(Gtk.Widget.destroy)
         if profile.resolutions:
@@ -1,38 +1,91 @@
 # SPDX-License-Identifier: GPL-2.0-or-later
 
-from typing import Optional
-from gi.repository import Gio  # noqa
+from typing import Dict, Optional
 
 import configparser
 
+import gi
+from lxml import etree
 
-def get_svg(model: str) -> Optional[bytes]:
+gi.require_version("Rsvg", "2.0")
+from gi.repository import Gio, Rsvg  # noqa
+
+SVG_RESOURCE_PATH = "/org/freedesktop/GhostCAT/svgs"
+
+# The device match to SVG file name index, built from svg-lookup.ini on first
+# use.
+_index: Optional[Dict[str, str]] = None
+
+# The SVG documents by file name, parsed once and shared by every view that
+# shows the device.
+_handles: Dict[str, Rsvg.Handle] = {}
+_trees: Dict[str, etree._Element] = {}
+
+
+def _load_resource(filename: str) -> bytes:
     resource = Gio.resources_lookup_data(
-        "/org/freedesktop/GhostCAT/svgs/svg-lookup.ini", Gio.ResourceLookupFlags.NONE
+        f"{SVG_RESOURCE_PATH}/{filename}", Gio.ResourceLookupFlags.NONE
     )
-
     data = resource.get_data()
     assert data is not None
-    config = configparser.ConfigParser()
-    config.read_string(data.decode("utf-8"), source="svg-lookup.ini")
-    assert config.sections()
+    return data
+
+
+def _get_index() -> Dict[str, str]:
+    global _index
+
+    if _index is None:
+        config = configparser.ConfigParser()
+        config.read_string(
+            _load_resource("svg-lookup.ini").decode("utf-8"), source="svg-lookup.ini"
+        )
+        assert config.sections()
+
+        index: Dict[str, str] = {}
+        for s in config.sections():
+            for match in config[s]["DeviceMatch"].split(";"):
+                # The first section listing a match wins, as it did when
+                # the sections were searched in order.
+                index.setdefault(match, config[s]["Svg"])
+        _index = index
+
+    return _index
 
-    filename = "fallback.svg"
 
+def get_svg_filename(model: str) -> str:
     if model.startswith(("usb:", "bluetooth:")):
         bus, vid, pid, version = model.split(":")
         # Where the version is 0 (virtually all devices) we drop it. This
         # way the DeviceMatch lines are less confusing.
         usbid = ":".join([bus, vid, pid]) if int(version) == 0 else model
 
-        for s in config.sections():
-            matches = config[s]["DeviceMatch"].split(";")
-            if usbid in matches:
-                filename = config[s]["Svg"]
-                break
+        return _get_index().get(usbid, "fallback.svg")
+
+    return "fallback.svg"
+
+
+def get_svg(model: str) -> Optional[bytes]:
+    return _load_resource(get_svg_filename(model))
+
+
+def get_svg_handle(model: str) -> Rsvg.Handle:
+    """Returns the parsed SVG of the given model. The handle is shared, callers
+    must not close it."""
+    filename = get_svg_filename(model)
+    handle = _handles.get(filename)
+    if handle is None:
+        handle = Rsvg.Handle.new_from_data(_load_resource(filename))
+        assert handle is not None
+        _handles[filename] = handle
+    return handle
 
-    resource = Gio.resources_lookup_data(
-        f"/org/freedesktop/GhostCAT/svgs/{filename}", Gio.ResourceLookupFlags.NONE
-    )
 
-    return resource.get_data()
+def get_svg_tree(model: str) -> etree._Element:
+    """Returns the XML tree of the given model's SVG. The tree is shared,
+    callers must not modify it."""
+    filename = get_svg_filename(model)
+    tree = _trees.get(filename)
+    if tree is None:
+        tree = etree.fromstring(_load_resource(filename))
+        _trees[filename] = tree
+    return tree
@@ -87,8 +87,9 @@ class WelcomePerspective(Gtk.Box):
         self.emit("device-selected", row.device)
 
     def _listbox_sort_func(self, row1: DeviceRow, row2: DeviceRow) -> int:
-        name1 = row1.device.name.casefold()
-        name2 = row2.device.name.casefold()
+        # Rows of devices that are still loading have no name yet.
+        name1 = (row1.device.name or "").casefold()
+        name2 = (row2.device.name or "").casefold()
         if name1 < name2:
             return -1
         if name1 == name2:
@@ -165,7 +165,20 @@ class Window(Gtk.ApplicationWindow):
         self.stack_perspectives.set_visible_child_name(welcome_perspective.name)
 
     def _present_mouse_perspective(self, device: RatbagdDevice) -> None:
-        # Present the mouse configuration perspective for the given device.
+        # Present the mouse configuration perspective for the given device,
+        # once everything it shows right away is loaded without blocking.
+        def on_profiles_loaded(device: RatbagdDevice) -> None:
+            profile = device.active_profile
+            if profile is None:
+                self._show_mouse_perspective(device)
+            else:
+                profile.load_children_async(
+                    lambda _: self._show_mouse_perspective(device)
+                )
+
+        device.load_profiles_async(on_profiles_loaded)
+
+    def _show_mouse_perspective(self, device: RatbagdDevice) -> None:
         try:
             mouse_perspective: MousePerspective = self._get_child("mouse_perspective")  # type: ignore
             mouse_perspective.set_device(device)
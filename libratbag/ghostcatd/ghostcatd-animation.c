@@ -0,0 +1,426 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Host driven LED animations.
+ *
+ * A timer ticks at fixed points in time, start + n * interval, so a late
+ * frame does not shift the ones after it. Each tick queues a background
+ * frame job on the device; a tick that finds the previous frame still
+ * queued drops its frame instead of piling up work. The frame job renders
+ * every LED and ghostcat_device_show_leds() only writes the LEDs whose
+ * color changed since the last frame.
+ *
+ * The interval is never shorter than twice the measured cost of a frame,
+ * so at most half of the device's time goes to the animation and the
+ * other half stays available for configuration requests.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <libghostcat.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <systemd/sd-event.h>
+#include "ghostcatd.h"
+#include "shared-macro.h"
+
+#include "libghostcat-util.h"
+
+#define USEC_PER_SEC 1000000ULL
+
+struct ghostcatd_animation_track {
+	struct ghostcatd_keyframe *keyframes;	/* NULL if the LED is not animated */
+	unsigned int num_keyframes;
+	uint64_t length_usec;
+};
+
+struct ghostcatd_animation {
+	struct ghostcatd_device *device;
+	struct ghostcat_device *lib_device;
+	sd_event *event;
+	sd_event_source *timer;
+
+	unsigned int num_leds;
+	struct ghostcatd_animation_track *tracks;
+	struct ghostcat_color *base;	/* colors of the LEDs without a track */
+	struct ghostcat_color *frame;
+
+	unsigned int target_rate;
+	uint64_t interval_usec;		/* after rate limiting */
+	uint64_t start_usec;
+	uint64_t next_usec;		/* when the timer fires next */
+	bool frame_pending;		/* a frame job is queued */
+
+	struct ghostcatd_animation_stats stats;
+};
+
+static bool ghostcatd_animation_running(struct ghostcatd_animation *animation)
+{
+	return animation->timer != NULL;
+}
+
+static void ghostcatd_animation_update_interval(struct ghostcatd_animation *animation)
+{
+	uint64_t target = USEC_PER_SEC / animation->target_rate;
+
+	animation->interval_usec = max(target, 2 * animation->stats.frame_time_usec);
+	animation->stats.rate = USEC_PER_SEC / animation->interval_usec;
+}
+
+/* The static color of each LED in the active profile, shown by the LEDs
+ * that are not animated. Frames are plain colors, so a breathing or
+ * cycling LED shows its color without the effect while an animation
+ * runs. */
+static void ghostcatd_animation_read_base(struct ghostcatd_animation *animation)
+{
+	unsigned int num_profiles = ghostcat_device_get_num_profiles(animation->lib_device);
+
+	memset(animation->base, 0, animation->num_leds * sizeof(*animation->base));
+
+	for (unsigned int i = 0; i < num_profiles; i++) {
+		struct ghostcat_profile *profile;
+		bool active;
+
+		profile = ghostcat_device_get_profile(animation->lib_device, i);
+		if (!profile)
+			continue;
+
+		active = ghostcat_profile_is_active(profile);
+		for (unsigned int l = 0; active && l < animation->num_leds; l++) {
+			struct ghostcat_led *led = ghostcat_profile_get_led(profile, l);
+
+			if (!led)
+				continue;
+			if (ghostcat_led_get_mode(led) != GHOSTCAT_LED_OFF)
+				animation->base[l] = ghostcat_led_get_color(led);
+			ghostcat_led_unref(led);
+		}
+
+		ghostcat_profile_unref(profile);
+		if (active)
+			break;
+	}
+}
+
+static unsigned int lerp(unsigned int from, unsigned int to,
+			 uint64_t pos, uint64_t length)
+{
+	return (from * (length - pos) + to * pos) / length;
+}
+
+static struct ghostcat_color
+ghostcatd_animation_track_color(const struct ghostcatd_animation_track *track,
+				uint64_t t)
+{
+	const struct ghostcatd_keyframe *from, *to;
+	uint64_t pos, length;
+
+	pos = t % track->length_usec;
+
+	for (unsigned int i = 0; i < track->num_keyframes; i++) {
+		from = &track->keyframes[i];
+		length = from->duration_ms * 1000ULL;
+		if (pos >= length) {
+			pos -= length;
+			continue;
+		}
+
+		/* the last keyframe fades back into the first one */
+		to = &track->keyframes[(i + 1) % track->num_keyframes];
+
+		return (struct ghostcat_color) {
+			.red = lerp(from->color.red, to->color.red, pos, length),
+			.green = lerp(from->color.green, to->color.green, pos, length),
+			.blue = lerp(from->color.blue, to->color.blue, pos, length),
+		};
+	}
+
+	return track->keyframes[0].color;
+}
+
+static int ghostcatd_animation_tick(sd_event_source *source,
+				    uint64_t usec,
+				    void *userdata)
+{
+	struct ghostcatd_animation *animation = userdata;
+	uint64_t now, missed;
+
+	if (animation->frame_pending) {
+		animation->stats.dropped++;
+	} else {
+		animation->frame_pending = true;
+		ghostcatd_device_queue_job(animation->device,
+					   GHOSTCATD_JOB_ANIMATION_FRAME);
+	}
+
+	/* Keep the schedule: skip the ticks that already passed rather than
+	 * firing them back to back */
+	sd_event_now(animation->event, CLOCK_MONOTONIC, &now);
+	animation->next_usec += animation->interval_usec;
+	if (animation->next_usec <= now) {
+		missed = (now - animation->next_usec) / animation->interval_usec + 1;
+		animation->stats.dropped += missed;
+		animation->next_usec += missed * animation->interval_usec;
+	}
+
+	sd_event_source_set_time(source, animation->next_usec);
+	sd_event_source_set_enabled(source, SD_EVENT_ONESHOT);
+
+	return 0;
+}
+
+static int ghostcatd_animation_show_frame(struct ghostcatd_animation *animation)
+{
+	uint64_t now_usec, start_ns, transfers;
+	uint64_t cost;
+	int rc;
+
+	sd_event_now(animation->event, CLOCK_MONOTONIC, &now_usec);
+
+	for (unsigned int i = 0; i < animation->num_leds; i++) {
+		const struct ghostcatd_animation_track *track = &animation->tracks[i];
+
+		if (track->keyframes)
+			animation->frame[i] = ghostcatd_animation_track_color(track,
+									      now_usec - animation->start_usec);
+		else
+			animation->frame[i] = animation->base[i];
+	}
+
+	transfers = ghostcat_device_get_stat(animation->lib_device,
+					     GHOSTCAT_DEVICE_STAT_TRANSFERS);
+	start_ns = now(CLOCK_MONOTONIC);
+
+	rc = ghostcat_device_show_leds(animation->lib_device,
+				       animation->frame,
+				       animation->num_leds);
+	if (rc)
+		return rc;
+
+	animation->stats.frames++;
+
+	/* a frame without a change costs nothing and says nothing about the
+	 * device */
+	if (ghostcat_device_get_stat(animation->lib_device,
+				     GHOSTCAT_DEVICE_STAT_TRANSFERS) == transfers)
+		return 0;
+
+	cost = (now(CLOCK_MONOTONIC) - start_ns) / 1000;
+	if (animation->stats.frame_time_usec == 0)
+		animation->stats.frame_time_usec = cost;
+	else
+		animation->stats.frame_time_usec = (7 * animation->stats.frame_time_usec + cost) / 8;
+
+	ghostcatd_animation_update_interval(animation);
+
+	return 0;
+}
+
+static int ghostcatd_animation_start(struct ghostcatd_animation *animation)
+{
+	int r;
+
+	ghostcatd_animation_read_base(animation);
+
+	sd_event_now(animation->event, CLOCK_MONOTONIC, &animation->start_usec);
+	animation->next_usec = animation->start_usec + animation->interval_usec;
+
+	/* The first frame runs right away so a device that can't show
+	 * frames fails the request instead of the timer */
+	r = ghostcatd_animation_show_frame(animation);
+	if (r)
+		return r;
+
+	r = sd_event_add_time(animation->event,
+			      &animation->timer,
+			      CLOCK_MONOTONIC,
+			      animation->next_usec,
+			      0,
+			      ghostcatd_animation_tick,
+			      animation);
+	if (r < 0)
+		return r;
+
+	return 0;
+}
+
+void ghostcatd_animation_stop(struct ghostcatd_animation *animation)
+{
+	for (unsigned int i = 0; i < animation->num_leds; i++) {
+		animation->tracks[i].keyframes = mfree(animation->tracks[i].keyframes);
+		animation->tracks[i].num_keyframes = 0;
+	}
+
+	animation->timer = sd_event_source_unref(animation->timer);
+	if (animation->frame_pending) {
+		ghostcatd_device_cancel_jobs(animation->device,
+					     1U << GHOSTCATD_JOB_ANIMATION_FRAME);
+		animation->frame_pending = false;
+	}
+}
+
+int ghostcatd_animation_set_track(struct ghostcatd_animation *animation,
+				  unsigned int led,
+				  const struct ghostcatd_keyframe *keyframes,
+				  unsigned int num_keyframes)
+{
+	struct ghostcatd_animation_track *track;
+	bool running = ghostcatd_animation_running(animation);
+	uint64_t length = 0;
+	int r;
+
+	if (led >= animation->num_leds)
+		return -EINVAL;
+
+	for (unsigned int i = 0; i < num_keyframes; i++) {
+		if (keyframes[i].color.red > 255 ||
+		    keyframes[i].color.green > 255 ||
+		    keyframes[i].color.blue > 255)
+			return -EINVAL;
+		length += keyframes[i].duration_ms * 1000ULL;
+	}
+
+	if (num_keyframes > 0 && length == 0)
+		return -EINVAL;
+
+	track = &animation->tracks[led];
+	track->keyframes = mfree(track->keyframes);
+	track->num_keyframes = 0;
+
+	if (num_keyframes > 0) {
+		track->keyframes = zalloc(num_keyframes * sizeof(*keyframes));
+		memcpy(track->keyframes, keyframes, num_keyframes * sizeof(*keyframes));
+		track->num_keyframes = num_keyframes;
+		track->length_usec = length;
+
+		if (!running) {
+			r = ghostcatd_animation_start(animation);
+			if (r) {
+				ghostcatd_animation_stop(animation);
+				ghostcat_device_restore_leds(animation->lib_device);
+				return r;
+			}
+		}
+
+		return 0;
+	}
+
+	for (unsigned int i = 0; i < animation->num_leds; i++) {
+		if (animation->tracks[i].keyframes)
+			return 0;
+	}
+
+	/* the last track was removed */
+	if (running) {
+		ghostcatd_animation_stop(animation);
+		ghostcat_device_restore_leds(animation->lib_device);
+	}
+
+	return 0;
+}
+
+/* The LEDs of the active profile or the active profile itself changed,
+ * the LEDs without a track show the new colors from the next frame on */
+void ghostcatd_animation_refresh_base(struct ghostcatd_animation *animation)
+{
+	if (ghostcatd_animation_running(animation))
+		ghostcatd_animation_read_base(animation);
+}
+
+void ghostcatd_animation_set_rate(struct ghostcatd_animation *animation,
+				  unsigned int rate)
+{
+	animation->target_rate = min(max(rate, 1U), (unsigned int)GHOSTCATD_ANIMATION_RATE_MAX);
+	ghostcatd_animation_update_interval(animation);
+}
+
+unsigned int ghostcatd_animation_get_rate(struct ghostcatd_animation *animation)
+{
+	return animation->target_rate;
+}
+
+void ghostcatd_animation_run_frame(struct ghostcatd_animation *animation)
+{
+	int rc;
+
+	animation->frame_pending = false;
+
+	if (!ghostcatd_animation_running(animation))
+		return;
+
+	rc = ghostcatd_animation_show_frame(animation);
+	if (rc) {
+		log_error("%s: failed to show LED frame (%d), stopping the animation\n",
+			  ghostcatd_device_get_sysname(animation->device), rc);
+		ghostcatd_animation_stop(animation);
+	}
+}
+
+void ghostcatd_animation_get_stats(struct ghostcatd_animation *animation,
+				   struct ghostcatd_animation_stats *stats)
+{
+	*stats = animation->stats;
+}
+
+void ghostcatd_animation_reset_stats(struct ghostcatd_animation *animation)
+{
+	animation->stats.frames = 0;
+	animation->stats.dropped = 0;
+}
+
+struct ghostcatd_animation *ghostcatd_animation_new(struct ghostcatd_device *device,
+						    sd_event *event,
+						    struct ghostcat_device *lib_device)
+{
+	struct ghostcatd_animation *animation;
+
+	animation = zalloc(sizeof(*animation));
+	animation->device = device;
+	animation->event = event;
+	animation->lib_device = lib_device;
+	animation->num_leds = ghostcat_device_get_num_leds(lib_device);
+	animation->tracks = zalloc(animation->num_leds * sizeof(*animation->tracks));
+	animation->base = zalloc(animation->num_leds * sizeof(*animation->base));
+	animation->frame = zalloc(animation->num_leds * sizeof(*animation->frame));
+
+	ghostcatd_animation_set_rate(animation, GHOSTCATD_ANIMATION_RATE_DEFAULT);
+
+	return animation;
+}
+
+/* Does not restore the LEDs, the device may be gone already */
+struct ghostcatd_animation *ghostcatd_animation_free(struct ghostcatd_animation *animation)
+{
+	if (!animation)
+		return NULL;
+
+	ghostcatd_animation_stop(animation);
+
+	free(animation->tracks);
+	free(animation->base);
+	free(animation->frame);
+
+	return mfree(animation);
+}
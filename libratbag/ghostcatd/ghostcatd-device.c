@@ -53,6 +53,52 @@ struct ghostcatd_device {
 	sd_bus_slot *profile_enum_slot;
 	unsigned int n_profiles;
 	struct ghostcatd_profile **profiles;
+
+	/* device I/O queue, see ghostcatd_device_queue_job() */
+	sd_event_source *queue_source;
+	unsigned int queue_pending;			/* mask of enum ghostcatd_job */
+	uint64_t queue_since[GHOSTCATD_JOB_COUNT];	/* when a pending job was queued */
+	struct ghostcatd_queue_stats queue_stats;
+	bool queue_running;		/* a library job is in flight */
+	sd_bus_message **held;		/* requests that arrived meanwhile */
+	size_t n_held;
+
+	struct ghostcatd_animation *animation;
+};
+
+static void ghostcatd_device_run_commit(struct ghostcatd_device *device);
+static void ghostcatd_device_run_poll_active_resolution(struct ghostcatd_device *device);
+static void ghostcatd_device_run_animation_frame(struct ghostcatd_device *device);
+static void ghostcatd_device_run_show_keys(struct ghostcatd_device *device);
+static void ghostcatd_device_arm_queue(struct ghostcatd_device *device);
+
+/* Commits and polls run as asynchronous library jobs, see
+ * ghostcatd_device_start_job(). LED and key frames are one short write
+ * each and run right from the queue. */
+static const struct {
+	enum ghostcatd_priority priority;
+	void (*run)(struct ghostcatd_device *device);
+	unsigned int supersedes;	/* mask of pending jobs this one cancels */
+} ghostcatd_jobs[GHOSTCATD_JOB_COUNT] = {
+	[GHOSTCATD_JOB_COMMIT] = {
+		.priority = GHOSTCATD_PRIORITY_INTERACTIVE,
+		.run = ghostcatd_device_run_commit,
+		/* the commit writes what a poll would read back */
+		.supersedes = (1U << GHOSTCATD_JOB_POLL_ACTIVE_RESOLUTION),
+	},
+	[GHOSTCATD_JOB_POLL_ACTIVE_RESOLUTION] = {
+		.priority = GHOSTCATD_PRIORITY_BACKGROUND,
+		.run = ghostcatd_device_run_poll_active_resolution,
+	},
+	[GHOSTCATD_JOB_ANIMATION_FRAME] = {
+		.priority = GHOSTCATD_PRIORITY_BACKGROUND,
+		.run = ghostcatd_device_run_animation_frame,
+	},
+	[GHOSTCATD_JOB_SHOW_KEYS] = {
+		/* key frames set while this is pending go out in one upload */
+		.priority = GHOSTCATD_PRIORITY_BACKGROUND,
+		.run = ghostcatd_device_run_show_keys,
+	},
 };
 
 #define ghostcatd_device_from_node(_ptr) \
@@ -188,22 +234,122 @@ static int ghostcatd_device_get_profiles(sd_bus *bus,
 	return 0;
 }
 
-static void ghostcatd_device_commit_pending(void *data)
+/* Hand requests that arrived while a job was in flight back to the bus,
+ * in the order they arrived */
+static void ghostcatd_device_release_held(struct ghostcatd_device *device)
 {
-	struct ghostcatd_device *device = data;
 	int r;
 
-	r = ghostcat_device_commit(device->lib_device);
+	for (size_t i = 0; i < device->n_held; i++) {
+		r = sd_bus_enqueue_for_read(device->ctx->bus, device->held[i]);
+		if (r < 0) {
+			errno = -r;
+			log_error("%s: failed to requeue request: %m\n",
+				  device->sysname);
+		}
+		sd_bus_message_unref(device->held[i]);
+	}
+
+	device->held = mfree(device->held);
+	device->n_held = 0;
+}
+
+static void ghostcatd_device_job_done(struct ghostcatd_device *device)
+{
+	device->queue_running = false;
+	device->ctx->n_jobs--;
+
+	ghostcatd_device_release_held(device);
+	ghostcatd_device_arm_queue(device);
+	ghostcatd_device_unref(device);
+}
+
+/* Runs the library I/O in the background, the queue stays stopped and
+ * requests for the device are held until the callback */
+static void ghostcatd_device_start_job(struct ghostcatd_device *device,
+				       enum ghostcat_error_code (*start)(struct ghostcat_device *device,
+									 ghostcat_device_callback callback,
+									 void *userdata),
+				       ghostcat_device_callback done)
+{
+	int r;
+
+	r = start(device->lib_device, done, ghostcatd_device_ref(device));
+	if (r) {
+		log_error("%s: failed to start job (%d)\n", device->sysname, r);
+		ghostcatd_device_unref(device);
+		return;
+	}
+
+	device->queue_running = true;
+	device->ctx->n_jobs++;
+	ghostcatd_device_arm_queue(device);
+}
+
+static void ghostcatd_device_commit_done(struct ghostcat_device *lib_device,
+					 int r,
+					 void *userdata)
+{
+	struct ghostcatd_device *device = userdata;
+
 	if (r)
 		log_error("error committing device (%d)\n", r);
-	if (r < 0)
-		ghostcatd_device_resync(device, device->ctx->bus);
 
-	ghostcatd_for_each_profile_signal(device->ctx->bus,
-					device,
-					ghostcatd_profile_notify_dirty);
+	if (ghostcatd_device_linked(device)) {
+		if (r < 0)
+			ghostcatd_device_resync(device, device->ctx->bus);
 
-	ghostcatd_device_unref(device);
+		ghostcatd_device_leds_changed(device);
+
+		ghostcatd_for_each_profile_signal(device->ctx->bus,
+						device,
+						ghostcatd_profile_notify_dirty);
+	}
+
+	ghostcatd_device_job_done(device);
+}
+
+static void ghostcatd_device_run_commit(struct ghostcatd_device *device)
+{
+	ghostcatd_device_start_job(device,
+				   ghostcat_device_commit_async,
+				   ghostcatd_device_commit_done);
+}
+
+static void ghostcatd_device_poll_done(struct ghostcat_device *lib_device,
+				       int changed,
+				       void *userdata)
+{
+	struct ghostcatd_device *device = userdata;
+
+	/* Active resolution changed, emit signals */
+	if (changed > 0 && ghostcatd_device_linked(device))
+		ghostcatd_for_each_profile_signal(device->ctx->bus, device,
+						ghostcatd_profile_resync);
+
+	ghostcatd_device_job_done(device);
+}
+
+static void ghostcatd_device_run_poll_active_resolution(struct ghostcatd_device *device)
+{
+	ghostcatd_device_start_job(device,
+				   ghostcat_device_refresh_active_resolution_async,
+				   ghostcatd_device_poll_done);
+}
+
+static void ghostcatd_device_run_animation_frame(struct ghostcatd_device *device)
+{
+	ghostcatd_animation_run_frame(device->animation);
+}
+
+static void ghostcatd_device_run_show_keys(struct ghostcatd_device *device)
+{
+	int r;
+
+	r = ghostcat_device_show_keys(device->lib_device);
+	if (r)
+		log_error("%s: failed to show key frame (%d)\n",
+			  device->sysname, r);
 }
 
 static int ghostcatd_device_commit(sd_bus_message *m,
@@ -212,15 +358,274 @@ static int ghostcatd_device_commit(sd_bus_message *m,
 {
 	struct ghostcatd_device *device = userdata;
 
-	ghostcatd_schedule_task(device->ctx,
-			      ghostcatd_device_commit_pending,
-			      ghostcatd_device_ref(device));
+	ghostcatd_device_queue_job(device, GHOSTCATD_JOB_COMMIT);
+
+	CHECK_CALL(sd_bus_reply_method_return(m, "u", 0));
+
+	return 0;
+}
+
+static int ghostcatd_device_save_image(sd_bus_message *m,
+				     void *userdata,
+				     sd_bus_error *error)
+{
+	struct ghostcatd_device *device = userdata;
+	_cleanup_free_ uint8_t *data = NULL;
+	_cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+	size_t size;
+	int r;
+
+	r = ghostcat_device_save_image(device->lib_device, &data, &size);
+	if (r == GHOSTCAT_ERROR_CAPABILITY)
+		return sd_bus_error_set(error, SD_BUS_ERROR_NOT_SUPPORTED,
+					"Device does not support images");
+	if (r)
+		return sd_bus_error_setf(error, SD_BUS_ERROR_FAILED,
+					 "Failed to read image from device (%d)", r);
+
+	CHECK_CALL(sd_bus_message_new_method_return(m, &reply));
+	CHECK_CALL(sd_bus_message_append_array(reply, 'y', data, size));
+
+	return sd_bus_send(NULL, reply, NULL);
+}
+
+static int ghostcatd_device_apply_image(sd_bus_message *m,
+				      void *userdata,
+				      sd_bus_error *error)
+{
+	sd_bus *bus = sd_bus_message_get_bus(m);
+	struct ghostcatd_device *device = userdata;
+	const void *data;
+	size_t size;
+	int r;
+
+	CHECK_CALL(sd_bus_message_read_array(m, 'y', &data, &size));
+
+	r = ghostcat_device_apply_image(device->lib_device, data, size);
+
+	/* even a failed apply may have written some of the image */
+	ghostcatd_device_resync(device, bus);
+
+	if (r == GHOSTCAT_ERROR_VALUE)
+		return sd_bus_error_set(error, SD_BUS_ERROR_INVALID_ARGS,
+					"Image does not match this device");
+	if (r == GHOSTCAT_ERROR_CAPABILITY)
+		return sd_bus_error_set(error, SD_BUS_ERROR_NOT_SUPPORTED,
+					"Device does not support images");
+	if (r)
+		return sd_bus_error_setf(error, SD_BUS_ERROR_FAILED,
+					 "Failed to write image to device (%d)", r);
+
+	CHECK_CALL(sd_bus_reply_method_return(m, "u", 0));
+
+	return 0;
+}
+
+static int ghostcatd_device_set_led_animation(sd_bus_message *m,
+					     void *userdata,
+					     sd_bus_error *error)
+{
+	struct ghostcatd_device *device = userdata;
+	_cleanup_free_ struct ghostcatd_keyframe *keyframes = NULL;
+	struct ghostcatd_keyframe keyframe;
+	unsigned int num_keyframes = 0;
+	unsigned int led;
+	int r;
+
+	CHECK_CALL(sd_bus_message_read(m, "u", &led));
+	CHECK_CALL(sd_bus_message_enter_container(m, 'a', "(uuuu)"));
+	while ((r = sd_bus_message_read(m, "(uuuu)",
+					&keyframe.duration_ms,
+					&keyframe.color.red,
+					&keyframe.color.green,
+					&keyframe.color.blue)) > 0) {
+		struct ghostcatd_keyframe *tmp;
+
+		tmp = realloc(keyframes, (num_keyframes + 1) * sizeof(*keyframes));
+		if (!tmp)
+			return -ENOMEM;
+		keyframes = tmp;
+		keyframes[num_keyframes++] = keyframe;
+	}
+	if (r < 0)
+		return r;
+	CHECK_CALL(sd_bus_message_exit_container(m));
+
+	r = ghostcatd_animation_set_track(device->animation, led,
+					  keyframes, num_keyframes);
+	if (r == -EINVAL)
+		return sd_bus_error_set(error, SD_BUS_ERROR_INVALID_ARGS,
+					"Invalid LED or keyframes");
+	if (r == GHOSTCAT_ERROR_CAPABILITY)
+		return sd_bus_error_set(error, SD_BUS_ERROR_NOT_SUPPORTED,
+					"Device does not support LED animations");
+	if (r)
+		return sd_bus_error_setf(error, SD_BUS_ERROR_FAILED,
+					 "Failed to show LED frame (%d)", r);
+
+	CHECK_CALL(sd_bus_reply_method_return(m, "u", 0));
+
+	return 0;
+}
+
+static int ghostcatd_device_set_key_colors(sd_bus_message *m,
+					   void *userdata,
+					   sd_bus_error *error)
+{
+	struct ghostcatd_device *device = userdata;
+	_cleanup_free_ struct ghostcat_color *colors = NULL;
+	struct ghostcat_color color;
+	unsigned int x, y, width, height;
+	unsigned int num_colors = 0;
+	int r;
+
+	CHECK_CALL(sd_bus_message_read(m, "uuuu", &x, &y, &width, &height));
+
+	if (width == 0 || height == 0 ||
+	    width > ghostcat_device_get_key_frame_width(device->lib_device) ||
+	    height > ghostcat_device_get_key_frame_height(device->lib_device))
+		return sd_bus_error_set(error, SD_BUS_ERROR_INVALID_ARGS,
+					"Invalid key rectangle");
+
+	colors = zalloc(width * height * sizeof(*colors));
+
+	CHECK_CALL(sd_bus_message_enter_container(m, 'a', "(uuu)"));
+	while ((r = sd_bus_message_read(m, "(uuu)",
+					&color.red,
+					&color.green,
+					&color.blue)) > 0) {
+		if (num_colors == width * height)
+			return sd_bus_error_set(error, SD_BUS_ERROR_INVALID_ARGS,
+						"Too many key colors");
+		colors[num_colors++] = color;
+	}
+	if (r < 0)
+		return r;
+	CHECK_CALL(sd_bus_message_exit_container(m));
+
+	if (num_colors != width * height)
+		return sd_bus_error_set(error, SD_BUS_ERROR_INVALID_ARGS,
+					"Too few key colors");
+
+	r = ghostcat_device_set_key_colors(device->lib_device, x, y,
+					   width, height, colors);
+	if (r == GHOSTCAT_ERROR_VALUE)
+		return sd_bus_error_set(error, SD_BUS_ERROR_INVALID_ARGS,
+					"Invalid key rectangle or color");
+	if (r == GHOSTCAT_ERROR_CAPABILITY)
+		return sd_bus_error_set(error, SD_BUS_ERROR_NOT_SUPPORTED,
+					"Device does not support per-key lighting");
+
+	ghostcatd_device_queue_job(device, GHOSTCATD_JOB_SHOW_KEYS);
 
 	CHECK_CALL(sd_bus_reply_method_return(m, "u", 0));
 
 	return 0;
 }
 
+static int
+ghostcatd_device_get_key_frame_width(sd_bus *bus,
+				     const char *path,
+				     const char *interface,
+				     const char *property,
+				     sd_bus_message *reply,
+				     void *userdata,
+				     sd_bus_error *error)
+{
+	struct ghostcatd_device *device = userdata;
+
+	return sd_bus_message_append(reply, "u",
+				     ghostcat_device_get_key_frame_width(device->lib_device));
+}
+
+static int
+ghostcatd_device_get_key_frame_height(sd_bus *bus,
+				      const char *path,
+				      const char *interface,
+				      const char *property,
+				      sd_bus_message *reply,
+				      void *userdata,
+				      sd_bus_error *error)
+{
+	struct ghostcatd_device *device = userdata;
+
+	return sd_bus_message_append(reply, "u",
+				     ghostcat_device_get_key_frame_height(device->lib_device));
+}
+
+static int
+ghostcatd_device_get_key_cells(sd_bus *bus,
+			       const char *path,
+			       const char *interface,
+			       const char *property,
+			       sd_bus_message *reply,
+			       void *userdata,
+			       sd_bus_error *error)
+{
+	struct ghostcatd_device *device = userdata;
+	struct ghostcat_device *lib_device = device->lib_device;
+	unsigned int width = ghostcat_device_get_key_frame_width(lib_device),
+		     height = ghostcat_device_get_key_frame_height(lib_device);
+
+	CHECK_CALL(sd_bus_message_open_container(reply, 'a', "b"));
+
+	for (unsigned int y = 0; y < height; y++) {
+		for (unsigned int x = 0; x < width; x++) {
+			int has_key = ghostcat_device_has_key(lib_device, x, y);
+
+			CHECK_CALL(sd_bus_message_append(reply, "b", has_key));
+		}
+	}
+
+	CHECK_CALL(sd_bus_message_close_container(reply));
+
+	return 0;
+}
+
+static int
+ghostcatd_device_get_led_animation_rate(sd_bus *bus,
+				      const char *path,
+				      const char *interface,
+				      const char *property,
+				      sd_bus_message *reply,
+				      void *userdata,
+				      sd_bus_error *error)
+{
+	struct ghostcatd_device *device = userdata;
+
+	return sd_bus_message_append(reply, "u",
+				     ghostcatd_animation_get_rate(device->animation));
+}
+
+static int
+ghostcatd_device_set_led_animation_rate(sd_bus *bus,
+				      const char *path,
+				      const char *interface,
+				      const char *property,
+				      sd_bus_message *m,
+				      void *userdata,
+				      sd_bus_error *error)
+{
+	struct ghostcatd_device *device = userdata;
+	unsigned int rate;
+	int r;
+
+	r = sd_bus_message_read(m, "u", &rate);
+	if (r < 0)
+		return r;
+
+	/* clamped to 1..GHOSTCATD_ANIMATION_RATE_MAX */
+	ghostcatd_animation_set_rate(device->animation, rate);
+
+	sd_bus_emit_properties_changed(bus,
+				       device->path,
+				       GHOSTCATD_NAME_ROOT ".Device",
+				       "LedAnimationRate",
+				       NULL);
+
+	return 0;
+}
+
 static int
 ghostcatd_device_get_model(sd_bus *bus,
 			 const char *path,
@@ -271,10 +676,194 @@ const sd_bus_vtable ghostcatd_device_vtable[] = {
 	SD_BUS_PROPERTY("FirmwareVersion", "s", ghostcatd_device_get_firmware_version, 0, SD_BUS_VTABLE_PROPERTY_CONST),
 	SD_BUS_PROPERTY("Profiles", "ao", ghostcatd_device_get_profiles, 0, SD_BUS_VTABLE_PROPERTY_CONST),
 	SD_BUS_METHOD("Commit", "", "u", ghostcatd_device_commit, SD_BUS_VTABLE_UNPRIVILEGED),
+	SD_BUS_METHOD("SaveImage", "", "ay", ghostcatd_device_save_image, SD_BUS_VTABLE_UNPRIVILEGED),
+	SD_BUS_METHOD("ApplyImage", "ay", "u", ghostcatd_device_apply_image, SD_BUS_VTABLE_UNPRIVILEGED),
+	SD_BUS_METHOD("SetLedAnimation", "ua(uuuu)", "u", ghostcatd_device_set_led_animation, SD_BUS_VTABLE_UNPRIVILEGED),
+	SD_BUS_WRITABLE_PROPERTY("LedAnimationRate", "u",
+				 ghostcatd_device_get_led_animation_rate,
+				 ghostcatd_device_set_led_animation_rate, 0,
+				 SD_BUS_VTABLE_UNPRIVILEGED|SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+	SD_BUS_METHOD("SetKeyColors", "uuuua(uuu)", "u", ghostcatd_device_set_key_colors, SD_BUS_VTABLE_UNPRIVILEGED),
+	SD_BUS_PROPERTY("KeyFrameWidth", "u", ghostcatd_device_get_key_frame_width, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+	SD_BUS_PROPERTY("KeyFrameHeight", "u", ghostcatd_device_get_key_frame_height, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+	SD_BUS_PROPERTY("KeyCells", "ab", ghostcatd_device_get_key_cells, 0, SD_BUS_VTABLE_PROPERTY_CONST),
 	SD_BUS_SIGNAL("Resync", "", 0),
 	SD_BUS_VTABLE_END,
 };
 
+static const struct {
+	const char *property;
+	enum ghostcat_device_stat stat;
+} ghostcatd_device_stats[] = {
+	{ "Transfers", GHOSTCAT_DEVICE_STAT_TRANSFERS },
+	{ "BytesSent", GHOSTCAT_DEVICE_STAT_BYTES_SENT },
+	{ "BytesReceived", GHOSTCAT_DEVICE_STAT_BYTES_RECEIVED },
+	{ "Retries", GHOSTCAT_DEVICE_STAT_RETRIES },
+	{ "Timeouts", GHOSTCAT_DEVICE_STAT_TIMEOUTS },
+	{ "Errors", GHOSTCAT_DEVICE_STAT_ERRORS },
+	{ "ProbeTime", GHOSTCAT_DEVICE_STAT_PROBE_TIME_US },
+	{ "Commits", GHOSTCAT_DEVICE_STAT_COMMITS },
+	{ "CommitTime", GHOSTCAT_DEVICE_STAT_COMMIT_TIME_US },
+	{ "CommitTimeTotal", GHOSTCAT_DEVICE_STAT_COMMIT_TIME_TOTAL_US },
+};
+
+static int
+ghostcatd_device_get_stat(sd_bus *bus,
+			const char *path,
+			const char *interface,
+			const char *property,
+			sd_bus_message *reply,
+			void *userdata,
+			sd_bus_error *error)
+{
+	struct ghostcatd_device *device = userdata;
+
+	for (size_t i = 0; i < ARRAY_LENGTH(ghostcatd_device_stats); i++) {
+		if (!streq(property, ghostcatd_device_stats[i].property))
+			continue;
+
+		return sd_bus_message_append(reply, "t",
+					     ghostcat_device_get_stat(device->lib_device,
+								      ghostcatd_device_stats[i].stat));
+	}
+
+	return -EINVAL;
+}
+
+static int
+ghostcatd_device_get_latency(sd_bus *bus,
+			   const char *path,
+			   const char *interface,
+			   const char *property,
+			   sd_bus_message *reply,
+			   void *userdata,
+			   sd_bus_error *error)
+{
+	struct ghostcatd_device *device = userdata;
+	uint64_t count, limit;
+
+	CHECK_CALL(sd_bus_message_open_container(reply, 'a', "(tt)"));
+
+	for (unsigned int i = 0; i < GHOSTCAT_DEVICE_LATENCY_BUCKETS; i++) {
+		count = ghostcat_device_get_latency_histogram(device->lib_device,
+							      i, &limit);
+		CHECK_CALL(sd_bus_message_append(reply, "(tt)", limit, count));
+	}
+
+	CHECK_CALL(sd_bus_message_close_container(reply));
+
+	return 0;
+}
+
+static int
+ghostcatd_device_get_queue_stat(sd_bus *bus,
+			      const char *path,
+			      const char *interface,
+			      const char *property,
+			      sd_bus_message *reply,
+			      void *userdata,
+			      sd_bus_error *error)
+{
+	struct ghostcatd_device *device = userdata;
+	const struct ghostcatd_queue_stats *stats = &device->queue_stats;
+
+	if (streq(property, "QueueDepth"))
+		return sd_bus_message_append(reply, "u",
+					     __builtin_popcount(device->queue_pending));
+	if (streq(property, "QueueJobs"))
+		return sd_bus_message_append(reply, "t", stats->jobs);
+	if (streq(property, "QueueMerged"))
+		return sd_bus_message_append(reply, "t", stats->merged);
+	if (streq(property, "QueueCancelled"))
+		return sd_bus_message_append(reply, "t", stats->cancelled);
+	if (streq(property, "InteractiveWaitMax"))
+		return sd_bus_message_append(reply, "t",
+					     stats->wait_max_usec[GHOSTCATD_PRIORITY_INTERACTIVE]);
+	if (streq(property, "InteractiveWaitTotal"))
+		return sd_bus_message_append(reply, "t",
+					     stats->wait_total_usec[GHOSTCATD_PRIORITY_INTERACTIVE]);
+	if (streq(property, "BackgroundWaitMax"))
+		return sd_bus_message_append(reply, "t",
+					     stats->wait_max_usec[GHOSTCATD_PRIORITY_BACKGROUND]);
+	if (streq(property, "BackgroundWaitTotal"))
+		return sd_bus_message_append(reply, "t",
+					     stats->wait_total_usec[GHOSTCATD_PRIORITY_BACKGROUND]);
+
+	return -EINVAL;
+}
+
+static int
+ghostcatd_device_get_animation_stat(sd_bus *bus,
+				  const char *path,
+				  const char *interface,
+				  const char *property,
+				  sd_bus_message *reply,
+				  void *userdata,
+				  sd_bus_error *error)
+{
+	struct ghostcatd_device *device = userdata;
+	struct ghostcatd_animation_stats stats;
+
+	ghostcatd_animation_get_stats(device->animation, &stats);
+
+	if (streq(property, "AnimationFrames"))
+		return sd_bus_message_append(reply, "t", stats.frames);
+	if (streq(property, "AnimationFramesDropped"))
+		return sd_bus_message_append(reply, "t", stats.dropped);
+	if (streq(property, "AnimationFrameTime"))
+		return sd_bus_message_append(reply, "t", stats.frame_time_usec);
+	if (streq(property, "AnimationRate"))
+		return sd_bus_message_append(reply, "u", stats.rate);
+
+	return -EINVAL;
+}
+
+static int ghostcatd_device_reset_stats(sd_bus_message *m,
+				      void *userdata,
+				      sd_bus_error *error)
+{
+	struct ghostcatd_device *device = userdata;
+
+	ghostcat_device_reset_stats(device->lib_device);
+	device->queue_stats = (struct ghostcatd_queue_stats){0};
+	ghostcatd_animation_reset_stats(device->animation);
+
+	CHECK_CALL(sd_bus_reply_method_return(m, ""));
+
+	return 0;
+}
+
+/* The counters change with every transfer, so none of them signal a
+ * change. Reading them costs nothing on the device side. */
+const sd_bus_vtable ghostcatd_device_stats_vtable[] = {
+	SD_BUS_VTABLE_START(0),
+	SD_BUS_PROPERTY("Transfers", "t", ghostcatd_device_get_stat, 0, 0),
+	SD_BUS_PROPERTY("BytesSent", "t", ghostcatd_device_get_stat, 0, 0),
+	SD_BUS_PROPERTY("BytesReceived", "t", ghostcatd_device_get_stat, 0, 0),
+	SD_BUS_PROPERTY("Retries", "t", ghostcatd_device_get_stat, 0, 0),
+	SD_BUS_PROPERTY("Timeouts", "t", ghostcatd_device_get_stat, 0, 0),
+	SD_BUS_PROPERTY("Errors", "t", ghostcatd_device_get_stat, 0, 0),
+	SD_BUS_PROPERTY("ProbeTime", "t", ghostcatd_device_get_stat, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+	SD_BUS_PROPERTY("Commits", "t", ghostcatd_device_get_stat, 0, 0),
+	SD_BUS_PROPERTY("CommitTime", "t", ghostcatd_device_get_stat, 0, 0),
+	SD_BUS_PROPERTY("CommitTimeTotal", "t", ghostcatd_device_get_stat, 0, 0),
+	SD_BUS_PROPERTY("Latency", "a(tt)", ghostcatd_device_get_latency, 0, 0),
+	SD_BUS_PROPERTY("QueueDepth", "u", ghostcatd_device_get_queue_stat, 0, 0),
+	SD_BUS_PROPERTY("QueueJobs", "t", ghostcatd_device_get_queue_stat, 0, 0),
+	SD_BUS_PROPERTY("QueueMerged", "t", ghostcatd_device_get_queue_stat, 0, 0),
+	SD_BUS_PROPERTY("QueueCancelled", "t", ghostcatd_device_get_queue_stat, 0, 0),
+	SD_BUS_PROPERTY("InteractiveWaitMax", "t", ghostcatd_device_get_queue_stat, 0, 0),
+	SD_BUS_PROPERTY("InteractiveWaitTotal", "t", ghostcatd_device_get_queue_stat, 0, 0),
+	SD_BUS_PROPERTY("BackgroundWaitMax", "t", ghostcatd_device_get_queue_stat, 0, 0),
+	SD_BUS_PROPERTY("BackgroundWaitTotal", "t", ghostcatd_device_get_queue_stat, 0, 0),
+	SD_BUS_PROPERTY("AnimationFrames", "t", ghostcatd_device_get_animation_stat, 0, 0),
+	SD_BUS_PROPERTY("AnimationFramesDropped", "t", ghostcatd_device_get_animation_stat, 0, 0),
+	SD_BUS_PROPERTY("AnimationFrameTime", "t", ghostcatd_device_get_animation_stat, 0, 0),
+	SD_BUS_PROPERTY("AnimationRate", "u", ghostcatd_device_get_animation_stat, 0, 0),
+	SD_BUS_METHOD("Reset", "", "", ghostcatd_device_reset_stats, SD_BUS_VTABLE_UNPRIVILEGED),
+	SD_BUS_VTABLE_END,
+};
+
 int ghostcatd_device_new(struct ghostcatd_device **out,
 		       struct ghostcatd *ctx,
 		       const char *sysname,
@@ -296,6 +885,7 @@ int ghostcatd_device_new(struct ghostcatd_device **out,
 	device->lib_device = ghostcat_device_ref(lib_device);
 
 	device->sysname = strdup_safe(sysname);
+	device->animation = ghostcatd_animation_new(device, ctx->event, lib_device);
 
 	r = sd_bus_path_encode(GHOSTCATD_OBJ_ROOT "/device",
 			       device->sysname,
@@ -342,15 +932,20 @@ static void ghostcatd_device_free(struct ghostcatd_device *device)
 
 	assert(!ghostcatd_device_linked(device));
 
+	device->animation = ghostcatd_animation_free(device->animation);
+	device->queue_source = sd_event_source_unref(device->queue_source);
+
 	for (i = 0; i < device->n_profiles; ++i)
 		device->profiles[i] = ghostcatd_profile_free(device->profiles[i]);
 
 	device->profiles = mfree(device->profiles);
+	/* a finishing job may still hold the library device, see
+	 * ghostcatd_device_job_done(), the library drops it right after */
 	device->lib_device = ghostcat_device_unref(device->lib_device);
 	device->path = mfree(device->path);
 	device->sysname = mfree(device->sysname);
 
-	assert(!device->lib_device); /* ratbag yields !NULL if still pinned */
+	assert(device->n_held == 0);
 
 	mfree(device);
 }
@@ -403,6 +998,8 @@ int ghostcatd_device_resync(struct ghostcatd_device *device, sd_bus *bus)
 	assert(device);
 	assert(bus);
 
+	ghostcatd_device_leds_changed(device);
+
 	ghostcatd_for_each_profile_signal(bus, device,
 					ghostcatd_profile_resync);
 
@@ -413,20 +1010,12 @@ int ghostcatd_device_resync(struct ghostcatd_device *device, sd_bus *bus)
 				  NULL);
 }
 
-int ghostcatd_device_poll_active_resolution(struct ghostcatd_device *device, sd_bus *bus)
+/* Called whenever the active profile or its LEDs may have changed on the
+ * device, i.e. after a commit or a resync, so a running LED animation
+ * doesn't paint the old colors over them */
+void ghostcatd_device_leds_changed(struct ghostcatd_device *device)
 {
-	int changed;
-
-	assert(device);
-
-	changed = ghostcat_device_refresh_active_resolution(device->lib_device);
-	if (changed > 0) {
-		/* Active resolution changed, emit signals */
-		ghostcatd_for_each_profile_signal(bus, device,
-						ghostcatd_profile_resync);
-	}
-
-	return changed;
+	ghostcatd_animation_refresh_base(device->animation);
 }
 
 bool ghostcatd_device_linked(struct ghostcatd_device *device)
@@ -524,6 +1113,9 @@ void ghostcatd_device_unlink(struct ghostcatd_device *device)
 	if (!ghostcatd_device_linked(device))
 		return;
 
+	ghostcatd_animation_stop(device->animation);
+	ghostcatd_device_cancel_jobs(device, ~0U);
+
 	device->profile_enum_slot = sd_bus_slot_unref(device->profile_enum_slot);
 	device->profile_vtable_slot = sd_bus_slot_unref(device->profile_vtable_slot);
 
@@ -578,6 +1170,173 @@ struct ghostcatd_device *ghostcatd_device_next(struct ghostcatd_device *device)
 	return node ? ghostcatd_device_from_node(node) : NULL;
 }
 
+/* The pending job that runs next: interactive before background, in the
+ * order they were queued within a priority */
+static int ghostcatd_device_next_job(struct ghostcatd_device *device)
+{
+	int next = -1;
+
+	for (int job = 0; job < GHOSTCATD_JOB_COUNT; job++) {
+		if (!(device->queue_pending & (1U << job)))
+			continue;
+
+		if (next < 0 ||
+		    ghostcatd_jobs[job].priority < ghostcatd_jobs[next].priority ||
+		    (ghostcatd_jobs[job].priority == ghostcatd_jobs[next].priority &&
+		     device->queue_since[job] < device->queue_since[next]))
+			next = job;
+	}
+
+	return next;
+}
+
+/* Let the event loop dispatch D-Bus messages before background jobs, so
+ * an interactive request can overtake them */
+static void ghostcatd_device_arm_queue(struct ghostcatd_device *device)
+{
+	int next = ghostcatd_device_next_job(device);
+
+	/* one job at a time, ghostcatd_device_job_done() re-arms */
+	if (next < 0 || device->queue_running) {
+		sd_event_source_set_enabled(device->queue_source, SD_EVENT_OFF);
+		return;
+	}
+
+	sd_event_source_set_priority(device->queue_source,
+				     ghostcatd_jobs[next].priority == GHOSTCATD_PRIORITY_INTERACTIVE ?
+				     SD_EVENT_PRIORITY_NORMAL : SD_EVENT_PRIORITY_IDLE);
+	sd_event_source_set_enabled(device->queue_source, SD_EVENT_ON);
+}
+
+/* Runs one job per event loop iteration */
+static int ghostcatd_device_queue_handler(sd_event_source *s, void *userdata)
+{
+	struct ghostcatd_device *device = userdata;
+	struct ghostcatd_queue_stats *stats = &device->queue_stats;
+	enum ghostcatd_priority priority;
+	uint64_t now, wait;
+	int job;
+
+	job = ghostcatd_device_next_job(device);
+	if (job < 0) {
+		sd_event_source_set_enabled(s, SD_EVENT_OFF);
+		return 0;
+	}
+
+	sd_event_now(device->ctx->event, CLOCK_MONOTONIC, &now);
+	wait = now - device->queue_since[job];
+	priority = ghostcatd_jobs[job].priority;
+
+	stats->jobs++;
+	stats->wait_total_usec[priority] += wait;
+	stats->wait_max_usec[priority] = max(stats->wait_max_usec[priority], wait);
+
+	device->queue_pending &= ~(1U << job);
+	ghostcatd_device_arm_queue(device);
+
+	/* the job may drop the last other reference to the device */
+	ghostcatd_device_ref(device);
+	ghostcatd_jobs[job].run(device);
+	ghostcatd_device_unref(device);
+
+	return 0;
+}
+
+void ghostcatd_device_queue_job(struct ghostcatd_device *device,
+			       enum ghostcatd_job job)
+{
+	unsigned int superseded;
+	int r;
+
+	assert(job < GHOSTCATD_JOB_COUNT);
+
+	if (!ghostcatd_device_linked(device))
+		return;
+
+	/* already queued, the pending job will do the same work */
+	if (device->queue_pending & (1U << job)) {
+		device->queue_stats.merged++;
+		return;
+	}
+
+	superseded = device->queue_pending & ghostcatd_jobs[job].supersedes;
+	ghostcatd_device_cancel_jobs(device, superseded);
+
+	if (!device->queue_source) {
+		r = sd_event_add_defer(device->ctx->event,
+				       &device->queue_source,
+				       ghostcatd_device_queue_handler,
+				       device);
+		if (r < 0) {
+			errno = -r;
+			log_error("%s: failed to allocate job queue: %m\n",
+				  device->sysname);
+			return;
+		}
+	}
+
+	device->queue_pending |= (1U << job);
+	sd_event_now(device->ctx->event, CLOCK_MONOTONIC, &device->queue_since[job]);
+	ghostcatd_device_arm_queue(device);
+}
+
+/* The objects of a device all live at <root>/<kind>/<sysname>[/...]:
+ * the device itself and its profiles, resolutions, buttons and LEDs. */
+static bool ghostcatd_device_owns_path(struct ghostcatd_device *device,
+				      const char *path)
+{
+	const char *root = GHOSTCATD_OBJ_ROOT "/";
+	const char *sysname = device->path + strlen(GHOSTCATD_OBJ_ROOT "/device/");
+	size_t len = strlen(sysname);
+
+	if (strncmp(path, root, strlen(root)) != 0)
+		return false;
+
+	path = strchr(path + strlen(root), '/');
+	if (!path)
+		return false;
+	path++;
+
+	return strncmp(path, sysname, len) == 0 &&
+	       (path[len] == '\0' || path[len] == '/');
+}
+
+/* Requests for a device hold back while a job is in flight, the library
+ * device must not be touched until it is done. The manager and other
+ * devices are served meanwhile. */
+bool ghostcatd_device_hold_message(struct ghostcatd_device *device,
+				  sd_bus_message *m)
+{
+	const char *path = sd_bus_message_get_path(m);
+	sd_bus_message **held;
+
+	if (!device->queue_running || !path ||
+	    !ghostcatd_device_owns_path(device, path))
+		return false;
+
+	held = realloc(device->held, (device->n_held + 1) * sizeof(*held));
+	if (!held)
+		return false;
+
+	device->held = held;
+	device->held[device->n_held++] = sd_bus_message_ref(m);
+
+	return true;
+}
+
+void ghostcatd_device_cancel_jobs(struct ghostcatd_device *device,
+				unsigned int jobs)
+{
+	unsigned int cancelled = device->queue_pending & jobs;
+
+	if (!cancelled)
+		return;
+
+	device->queue_stats.cancelled += __builtin_popcount(cancelled);
+	device->queue_pending &= ~cancelled;
+	ghostcatd_device_arm_queue(device);
+}
+
 int ghostcatd_for_each_profile_signal(sd_bus *bus,
 				    struct ghostcatd_device *device,
 				    int (*func)(sd_bus *bus,
@@ -25,6 +25,7 @@
    change at any time, but basically looks like this:
 
    {
+     "commit_delay": int, # milliseconds each commit takes
      "profiles": [
        {
          "is_active": bool,
@@ -64,6 +65,10 @@
    ratbagd uses a minimum sane device (1 profile, 1 resolution, etc.) and any
    JSON instructions get merged into that device. Which means you usually
    only need to set those bits you care about being checked.
+
+   The root may also be an array of such objects, one per device:
+
+   [ { "profiles": [ ... ] }, { "profiles": [ ... ] }, ... ]
  */
 
 #include "libghostcat-util.h"
@@ -502,29 +507,15 @@ static void parse_profile(JsonNode *node,
 	json_object_foreach_member(obj, parse_profile_member, profile);
 }
 
-/* declared here because this isn't really public API, we just need to
- * access it from the tests */
-int ghostcatd_parse_json(const char *data, struct ghostcat_test_device *device)
+static int parse_device(JsonNode *root, struct ghostcat_test_device *device)
 {
-	g_autoptr(JsonParser) parser = NULL;
-	JsonNode *root;
 	JsonObject *obj;
 	JsonArray *arr;
 	int r = -EINVAL;
-	g_autoptr(GError) error = NULL;
 	g_autoptr(GList) list = NULL;
 
-	error = 0;
-	parser = json_parser_new();
-	if (!json_parser_load_from_data(parser, data, strlen(data), &error)) {
-		log_error("Failed to load JSON: %s\n", error->message);
-		r = -EINVAL;
-		goto out;
-	}
-
-	log_verbose("json: data: %s\n", data);
+	parse_error = 0;
 
-	root = json_parser_get_root(parser);
 	if (JSON_NODE_TYPE(root) != JSON_NODE_OBJECT)
 		parser_error("root");
 
@@ -533,6 +524,16 @@ int ghostcatd_parse_json(const char *data, struct ghostcat_test_device *device)
 	if (!arr)
 		parser_error("profiles");
 
+	if (json_array_get_length(arr) > GHOSTCAT_TEST_MAX_PROFILES)
+		parser_error("profiles");
+
+	if (json_object_has_member(obj, "commit_delay")) {
+		gint v = json_object_get_int_member(obj, "commit_delay");
+		if (v < 0)
+			parser_error("commit_delay");
+		device->commit_delay_ms = v;
+	}
+
 	/* Our test device is preloaded with sane defaults, let's keep those */
 	num_resolutions = device->num_resolutions;
 	num_buttons = device->num_buttons;
@@ -545,7 +546,7 @@ int ghostcatd_parse_json(const char *data, struct ghostcat_test_device *device)
 		log_verbose("json: processing profile %d\n", idx);
 		parse_profile(l->data, &device->profiles[idx]);
 		if (parse_error != 0)
-			goto out;;
+			goto out;
 		l = g_list_next(l);
 		idx++;
 	}
@@ -558,3 +559,52 @@ int ghostcatd_parse_json(const char *data, struct ghostcat_test_device *device)
 out:
 	return r;
 }
+
+/* declared here because this isn't really public API, we just need to
+ * access it from the tests */
+int ghostcatd_parse_json(const char *data,
+			 const struct ghostcat_test_device *dflt,
+			 struct ghostcat_test_device **devices_out)
+{
+	g_autoptr(JsonParser) parser = NULL;
+	g_autoptr(GError) error = NULL;
+	struct ghostcat_test_device *devices = NULL;
+	JsonNode *root;
+	JsonArray *arr = NULL;
+	unsigned int count = 1;
+	int r;
+
+	parser = json_parser_new();
+	if (!json_parser_load_from_data(parser, data, strlen(data), &error)) {
+		log_error("Failed to load JSON: %s\n", error->message);
+		return -EINVAL;
+	}
+
+	log_verbose("json: data: %s\n", data);
+
+	root = json_parser_get_root(parser);
+	if (JSON_NODE_TYPE(root) == JSON_NODE_ARRAY) {
+		arr = json_node_get_array(root);
+		count = json_array_get_length(arr);
+		if (count == 0) {
+			log_error("json: no devices given\n");
+			return -EINVAL;
+		}
+	}
+
+	devices = zalloc(count * sizeof(*devices));
+	for (unsigned int i = 0; i < count; i++) {
+		log_verbose("json: processing device %u\n", i);
+		devices[i] = *dflt;
+		r = parse_device(arr ? json_array_get_element(arr, i) : root,
+				 &devices[i]);
+		if (r != 0) {
+			free(devices);
+			return r;
+		}
+	}
+
+	*devices_out = devices;
+
+	return count;
+}
@@ -25,4 +25,13 @@
 
 #include "libghostcat-test.h"
 
-int ghostcatd_parse_json(const char *data, struct ghostcat_test_device *device);
+/**
+ * Parse a test device, or an array of test devices, from JSON. Each device
+ * starts as a copy of dflt. On success, devices is an allocated array the
+ * caller must free.
+ *
+ * @return the number of devices or a negative errno
+ */
+int ghostcatd_parse_json(const char *data,
+			 const struct ghostcat_test_device *dflt,
+			 struct ghostcat_test_device **devices);
@@ -30,53 +30,65 @@
 #include <systemd/sd-event.h>
 
 #include "libghostcat-test.h"
+#include "libghostcat-util.h"
 #include "ghostcatd-json.h"
 
-static int load_test_device(sd_bus_message *m,
-			    struct ghostcatd *ctx,
-			    const struct ghostcat_test_device *source)
+/* The devices of the last LoadTestDevice call, replaced by the next one */
+static struct ghostcatd_device **test_devices;
+static unsigned int num_test_devices;
+
+static void unload_test_devices(void)
+{
+	for (unsigned int i = 0; i < num_test_devices; i++) {
+		ghostcatd_device_unlink(test_devices[i]);
+		ghostcatd_device_unref(test_devices[i]);
+	}
+
+	free(test_devices);
+	test_devices = NULL;
+	num_test_devices = 0;
+}
+
+static int load_test_devices(struct ghostcatd *ctx,
+			     const struct ghostcat_test_device *sources,
+			     unsigned int count)
 {
-	static int count;
-	static struct ghostcatd_device *ghostcatd_test_device = NULL;
+	static int devicenum;
+	struct ghostcatd_device *ghostcatd_test_device;
 	struct ghostcat_device *device;
-	int r;
 	char devicename[64];
+	int r = 0;
 
-	if (ghostcatd_test_device) {
-		ghostcatd_device_unlink(ghostcatd_test_device);
-		ghostcatd_device_unref(ghostcatd_test_device);
+	unload_test_devices();
 
-		(void) sd_bus_emit_properties_changed(ctx->bus,
-						      GHOSTCATD_OBJ_ROOT,
-						      GHOSTCATD_NAME_ROOT ".Manager",
-						      "Devices",
-						      NULL);
-	}
+	test_devices = zalloc(count * sizeof(*test_devices));
 
-	device = ghostcat_device_new_test_device(ctx->lib_ctx, source);
+	for (unsigned int i = 0; i < count; i++) {
+		device = ghostcat_device_new_test_device(ctx->lib_ctx, &sources[i]);
 
-	snprintf(devicename, sizeof(devicename), "testdevice%d", count++);
-	r = ghostcatd_device_new(&ghostcatd_test_device, ctx, devicename, device);
+		snprintf(devicename, sizeof(devicename), "testdevice%d", devicenum++);
+		r = ghostcatd_device_new(&ghostcatd_test_device, ctx, devicename, device);
 
-	/* the ghostcatd_device takes its own reference, drop ours */
-	ghostcat_device_unref(device);
+		/* the ghostcatd_device takes its own reference, drop ours */
+		ghostcat_device_unref(device);
 
-	if (r < 0) {
-		log_error("Cannot track test device\n");
-		return r;
-	}
+		if (r < 0) {
+			log_error("Cannot track test device\n");
+			break;
+		}
 
-	ghostcatd_device_link(ghostcatd_test_device);
-	if (m) {
-		sd_bus_reply_method_return(m, "u", r);
-		(void) sd_bus_emit_properties_changed(ctx->bus,
-						      GHOSTCATD_OBJ_ROOT,
-						      GHOSTCATD_NAME_ROOT ".Manager",
-						      "Devices",
-						      NULL);
+		ghostcatd_device_link(ghostcatd_test_device);
+		test_devices[num_test_devices++] = ghostcatd_test_device;
 	}
 
-	return 0;
+	/* once per load, not per device, clients re-read the whole list */
+	(void) sd_bus_emit_properties_changed(ctx->bus,
+					      GHOSTCATD_OBJ_ROOT,
+					      GHOSTCATD_NAME_ROOT ".Manager",
+					      "Devices",
+					      NULL);
+
+	return r < 0 ? r : 0;
 }
 
 static const struct ghostcat_test_device default_device_descr = {
@@ -112,18 +124,32 @@ int ghostcatd_load_test_device(sd_bus_message *m,
 			     sd_bus_error *error)
 {
 	struct ghostcatd *ctx = userdata;
-	struct ghostcat_test_device td = default_device_descr;
+	struct ghostcat_test_device *devices = NULL;
 	char *data;
-	int r = 0;
+	int r;
 
 	CHECK_CALL(sd_bus_message_read(m, "s", &data));
 
-	r = ghostcatd_parse_json(data, &td);
-	if (r != 0) {
+	r = ghostcatd_parse_json(data, &default_device_descr, &devices);
+	if (r < 0) {
 		log_error("Failed to parse JSON data\n");
 	} else {
-		r = load_test_device(m, ctx, &td);
+		r = load_test_devices(ctx, devices, r);
+		free(devices);
 	}
+
+	return sd_bus_reply_method_return(m, "i", r);
+}
+
+int ghostcatd_reset_test_device(sd_bus_message *m,
+			      void *userdata,
+			      sd_bus_error *error)
+{
+	struct ghostcatd *ctx = userdata;
+	int r;
+
+	r = load_test_devices(ctx, &default_device_descr, 1);
+
 	return sd_bus_reply_method_return(m, "i", r);
 }
 
@@ -134,7 +160,7 @@ void ghostcatd_init_test_device(struct ghostcatd *ctx)
 #ifdef GHOSTCAT_DEVELOPER_EDITION
 	setenv("GHOSTCAT_TEST", "1", 0);
 
-	load_test_device(NULL, ctx, &default_device_descr);
+	load_test_devices(ctx, &default_device_descr, 1);
 #endif
 }
 
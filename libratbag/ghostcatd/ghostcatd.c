@@ -32,6 +32,7 @@
 #include <libgen.h>
 #include <libghostcat.h>
 #include <libudev.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/resource.h>
@@ -171,6 +172,7 @@ static const sd_bus_vtable ghostcatd_vtable[] = {
 	SD_BUS_PROPERTY("Devices", "ao", ghostcatd_get_devices, 0, SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
 #ifdef GHOSTCAT_DEVELOPER_EDITION
 	SD_BUS_METHOD("LoadTestDevice", "s", "i", ghostcatd_load_test_device, SD_BUS_VTABLE_UNPRIVILEGED),
+	SD_BUS_METHOD("ResetTestDevice", "", "i", ghostcatd_reset_test_device, SD_BUS_VTABLE_UNPRIVILEGED),
 #endif /* GHOSTCAT_DEVELOPER_EDITION */
 	SD_BUS_VTABLE_END,
 };
@@ -276,6 +278,37 @@ static const struct ghostcat_interface ghostcatd_lib_interface = {
 	.close_restricted	= ghostcatd_lib_close_restricted,
 };
 
+static int ghostcatd_lib_event(sd_event_source *source,
+			       int fd,
+			       uint32_t mask,
+			       void *userdata)
+{
+	struct ghostcatd *ctx = userdata;
+
+	ghostcat_dispatch(ctx->lib_ctx);
+
+	return 0;
+}
+
+/* Holds back requests for devices with a job in flight */
+static int ghostcatd_filter(sd_bus_message *m,
+			    void *userdata,
+			    sd_bus_error *error)
+{
+	struct ghostcatd *ctx = userdata;
+	struct ghostcatd_device *device;
+
+	if (ctx->n_jobs == 0 || !sd_bus_message_is_method_call(m, NULL, NULL))
+		return 0;
+
+	GHOSTCATD_DEVICE_FOREACH(device, ctx) {
+		if (ghostcatd_device_hold_message(device, m))
+			return 1;
+	}
+
+	return 0;
+}
+
 static struct ghostcatd *ghostcatd_free(struct ghostcatd *ctx)
 {
 	struct ghostcatd_device *device, *tmp;
@@ -283,6 +316,19 @@ static struct ghostcatd *ghostcatd_free(struct ghostcatd *ctx)
 	if (!ctx)
 		return NULL;
 
+	/* library jobs hold their devices, let them finish */
+	while (ctx->n_jobs > 0) {
+		struct pollfd fd = {
+			.fd = ghostcat_get_fd(ctx->lib_ctx),
+			.events = POLLIN,
+		};
+
+		if (poll(&fd, 1, -1) < 0 && errno != EINTR)
+			break;
+
+		ghostcat_dispatch(ctx->lib_ctx);
+	}
+
 	GHOSTCATD_DEVICE_FOREACH_SAFE(device, tmp, ctx) {
 		ghostcatd_device_unlink(device);
 		ghostcatd_device_unref(device);
@@ -291,6 +337,7 @@ static struct ghostcatd *ghostcatd_free(struct ghostcatd *ctx)
 	ctx->bus = sd_bus_flush_close_unref(ctx->bus);
 	ctx->monitor_source = sd_event_source_unref(ctx->monitor_source);
 	ctx->monitor = udev_monitor_unref(ctx->monitor);
+	ctx->lib_source = sd_event_source_unref(ctx->lib_source);
 	ctx->lib_ctx = ghostcat_unref(ctx->lib_ctx);
 	ctx->event = sd_event_unref(ctx->event);
 
@@ -372,6 +419,15 @@ static int ghostcatd_new(struct ghostcatd **out)
 		ghostcat_log_set_priority(ctx->lib_ctx,
 					GHOSTCAT_LOG_PRIORITY_DEBUG);
 
+	r = sd_event_add_io(ctx->event,
+			    &ctx->lib_source,
+			    ghostcat_get_fd(ctx->lib_ctx),
+			    EPOLLIN,
+			    ghostcatd_lib_event,
+			    ctx);
+	if (r < 0)
+		return r;
+
 	r = ghostcatd_init_monitor(ctx);
 	if (r < 0)
 		return r;
@@ -380,6 +436,10 @@ static int ghostcatd_new(struct ghostcatd **out)
 	if (r < 0)
 		return r;
 
+	r = sd_bus_add_filter(ctx->bus, NULL, ghostcatd_filter, ctx);
+	if (r < 0)
+		return r;
+
 	r = sd_bus_add_object_vtable(ctx->bus,
 				     NULL,
 				     GHOSTCATD_OBJ_ROOT,
@@ -399,6 +459,16 @@ static int ghostcatd_new(struct ghostcatd **out)
 	if (r < 0)
 		return r;
 
+	r = sd_bus_add_fallback_vtable(ctx->bus,
+				       NULL,
+				       GHOSTCATD_OBJ_ROOT "/device",
+				       GHOSTCATD_NAME_ROOT ".Stats",
+				       ghostcatd_device_stats_vtable,
+				       ghostcatd_find_device,
+				       ctx);
+	if (r < 0)
+		return r;
+
 	r = sd_bus_add_node_enumerator(ctx->bus,
 				       NULL,
 				       GHOSTCATD_OBJ_ROOT "/device",
@@ -479,7 +549,8 @@ static int on_poll_active_resolution(sd_event_source *s, uint64_t usec, void *us
 	uint64_t now;
 
 	GHOSTCATD_DEVICE_FOREACH(device, ctx) {
-		ghostcatd_device_poll_active_resolution(device, ctx->bus);
+		ghostcatd_device_queue_job(device,
+					  GHOSTCATD_JOB_POLL_ACTIVE_RESOLUTION);
 	}
 
 	/* Re-arm the timer */
@@ -704,35 +775,3 @@ exit:
 
 	return EXIT_SUCCESS;
 }
-
-struct ghostcatd_callback
-{
-	ghostcatd_callback_t callback;
-	void *userdata;
-};
-
-static int ghostcatd_callback_handler(sd_event_source *s, void *userdata)
-{
-	struct ghostcatd_callback *cb = userdata;
-
-	cb->callback(cb->userdata);
-
-	sd_event_source_set_enabled(s, SD_EVENT_OFF);
-	sd_event_source_unref(s);
-	free(cb);
-
-	return 0;
-}
-
-void ghostcatd_schedule_task(struct ghostcatd *ctx,
-			   ghostcatd_callback_t callback,
-			   void *userdata)
-{
-	struct ghostcatd_callback *cb = zalloc(sizeof *cb);
-	sd_event_source *source;
-
-	cb->callback = callback;
-	cb->userdata = userdata;
-
-	sd_event_add_defer(ctx->event, &source, ghostcatd_callback_handler, cb);
-}
@@ -164,7 +164,34 @@ DEFINE_TRIVIAL_CLEANUP_FUNC(struct ghostcatd_led *, ghostcatd_led_free);
  * Devices
  */
 
+/* Device I/O runs from a per-device queue. Interactive jobs run before
+ * background jobs, and each job is queued at most once. Commits and polls
+ * run in the background through the library's asynchronous API, requests
+ * for that device wait meanwhile, see ghostcatd_device_hold_message(). */
+enum ghostcatd_priority {
+	GHOSTCATD_PRIORITY_INTERACTIVE,
+	GHOSTCATD_PRIORITY_BACKGROUND,
+	GHOSTCATD_PRIORITY_COUNT,
+};
+
+enum ghostcatd_job {
+	GHOSTCATD_JOB_COMMIT,
+	GHOSTCATD_JOB_POLL_ACTIVE_RESOLUTION,
+	GHOSTCATD_JOB_ANIMATION_FRAME,
+	GHOSTCATD_JOB_SHOW_KEYS,
+	GHOSTCATD_JOB_COUNT,
+};
+
+struct ghostcatd_queue_stats {
+	uint64_t jobs;		/* jobs run */
+	uint64_t merged;	/* jobs queued while already pending */
+	uint64_t cancelled;	/* jobs dropped before they ran */
+	uint64_t wait_max_usec[GHOSTCATD_PRIORITY_COUNT];
+	uint64_t wait_total_usec[GHOSTCATD_PRIORITY_COUNT];
+};
+
 extern const sd_bus_vtable ghostcatd_device_vtable[];
+extern const sd_bus_vtable ghostcatd_device_stats_vtable[];
 
 int ghostcatd_device_new(struct ghostcatd_device **out,
 		       struct ghostcatd *ctx,
@@ -177,7 +204,13 @@ const char *ghostcatd_device_get_path(struct ghostcatd_device *device);
 unsigned int ghostcatd_device_get_num_buttons(struct ghostcatd_device *device);
 unsigned int ghostcatd_device_get_num_leds(struct ghostcatd_device *device);
 int ghostcatd_device_resync(struct ghostcatd_device *device, sd_bus *bus);
-int ghostcatd_device_poll_active_resolution(struct ghostcatd_device *device, sd_bus *bus);
+void ghostcatd_device_leds_changed(struct ghostcatd_device *device);
+void ghostcatd_device_queue_job(struct ghostcatd_device *device,
+			       enum ghostcatd_job job);
+void ghostcatd_device_cancel_jobs(struct ghostcatd_device *device,
+				unsigned int jobs);
+bool ghostcatd_device_hold_message(struct ghostcatd_device *device,
+				   sd_bus_message *m);
 
 bool ghostcatd_device_linked(struct ghostcatd_device *device);
 void ghostcatd_device_link(struct ghostcatd_device *device);
@@ -202,6 +235,48 @@ struct ghostcatd_device *ghostcatd_device_next(struct ghostcatd_device *device);
 	     _device = (_safe),				\
 	     _safe = (_safe) ? ghostcatd_device_next(_safe) : NULL)
 
+/*
+ * LED animations
+ *
+ * Keyframed colors per LED, rendered by the host at a fixed rate and
+ * shown with ghostcat_device_show_leds(). Frames run as background jobs
+ * of the device queue, so configuration requests overtake them.
+ */
+struct ghostcatd_animation;
+
+struct ghostcatd_keyframe {
+	uint32_t duration_ms;	/* time to fade to the next keyframe */
+	struct ghostcat_color color;
+};
+
+struct ghostcatd_animation_stats {
+	uint64_t frames;		/* frames rendered */
+	uint64_t dropped;		/* frames skipped because the last one was late */
+	uint64_t frame_time_usec;	/* average cost of a frame that was written */
+	unsigned int rate;		/* frames per second after rate limiting */
+};
+
+#define GHOSTCATD_ANIMATION_RATE_DEFAULT	30
+#define GHOSTCATD_ANIMATION_RATE_MAX		120
+
+struct ghostcatd_animation *ghostcatd_animation_new(struct ghostcatd_device *device,
+						    sd_event *event,
+						    struct ghostcat_device *lib_device);
+struct ghostcatd_animation *ghostcatd_animation_free(struct ghostcatd_animation *animation);
+int ghostcatd_animation_set_track(struct ghostcatd_animation *animation,
+				  unsigned int led,
+				  const struct ghostcatd_keyframe *keyframes,
+				  unsigned int num_keyframes);
+void ghostcatd_animation_stop(struct ghostcatd_animation *animation);
+void ghostcatd_animation_refresh_base(struct ghostcatd_animation *animation);
+void ghostcatd_animation_set_rate(struct ghostcatd_animation *animation,
+				  unsigned int rate);
+unsigned int ghostcatd_animation_get_rate(struct ghostcatd_animation *animation);
+void ghostcatd_animation_run_frame(struct ghostcatd_animation *animation);
+void ghostcatd_animation_get_stats(struct ghostcatd_animation *animation,
+				   struct ghostcatd_animation_stats *stats);
+void ghostcatd_animation_reset_stats(struct ghostcatd_animation *animation);
+
 /* Verify that _val is not -1. This traps DBus API errors where we end up
  * sending a valid-looking index across and then fail on the other side.
  *
@@ -226,6 +301,8 @@ struct ghostcatd {
 	struct udev_monitor *monitor;
 	sd_event_source *timeout_source;
 	sd_event_source *monitor_source;
+	sd_event_source *lib_source;	/* ghostcat_get_fd() */
+	unsigned int n_jobs;		/* library jobs in flight */
 	sd_bus *bus;
 
 	RBTree device_map;
@@ -234,11 +311,5 @@ struct ghostcatd {
 	const char **themes; /* NULL-terminated */
 };
 
-typedef void (*ghostcatd_callback_t)(void *userdata);
-
-void ghostcatd_schedule_task(struct ghostcatd *ctx,
-			   ghostcatd_callback_t callback,
-			   void *userdata);
-
 int ghostcatd_profile_notify_dirty(sd_bus *bus,
 				 struct ghostcatd_profile *profile);
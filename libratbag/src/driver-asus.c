@@ -64,8 +64,23 @@ struct asus_data {
 	int button_mapping[ASUS_MAX_NUM_BUTTON * ASUS_MAX_NUM_BUTTON_GROUP];
 	int button_indices[ASUS_MAX_NUM_BUTTON * ASUS_MAX_NUM_BUTTON_GROUP];
 	int led_modes[ASUS_MAX_NUM_LED_MODES];
+
+	/* the bindings the device has, ASUS_MAX_NUM_BUTTON_GROUP per profile */
+	union asus_binding_data *bindings;
 };
 
+static inline struct _asus_binding *
+asus_driver_get_binding(struct asus_data *drv_data, unsigned int profile,
+			int asus_index)
+{
+	union asus_binding_data *group;
+
+	group = &drv_data->bindings[profile * ASUS_MAX_NUM_BUTTON_GROUP +
+				    asus_index / ASUS_MAX_NUM_BUTTON];
+
+	return &group->data.binding[asus_index % ASUS_MAX_NUM_BUTTON];
+}
+
 static int
 asus_driver_load_profile(struct ghostcat_device *device, struct ghostcat_profile *profile, int dpi_preset)
 {
@@ -76,8 +91,6 @@ asus_driver_load_profile(struct ghostcat_device *device, struct ghostcat_profile
 	struct ghostcat_button *button;
 	struct ghostcat_led *led;
 	struct ghostcat_resolution *resolution;
-	union asus_binding_data binding_data;
-	union asus_binding_data binding_data_secondary;
 	union asus_led_data led_data;
 	union asus_resolution_data resolution_data;
 	union asus_resolution_data xy_resolution_data;
@@ -89,12 +102,14 @@ asus_driver_load_profile(struct ghostcat_device *device, struct ghostcat_profile
 	/* get buttons */
 
 	log_debug(device->ratbag, "Loading buttons data\n");
-	rc = asus_get_binding_data(device, &binding_data, 0);
-	if (rc)
-		return rc;
+	for (unsigned int group = 0; group < ASUS_MAX_NUM_BUTTON_GROUP; group++) {
+		union asus_binding_data *binding_data =
+			&drv_data->bindings[profile->index * ASUS_MAX_NUM_BUTTON_GROUP + group];
 
-	if (quirks & ASUS_QUIRK_BUTTONS_SECONDARY) {
-		rc = asus_get_binding_data(device, &binding_data_secondary, 1);
+		if (group > 0 && !(quirks & ASUS_QUIRK_BUTTONS_SECONDARY))
+			break;
+
+		rc = asus_get_binding_data(device, binding_data, group);
 		if (rc)
 			return rc;
 	}
@@ -106,11 +121,7 @@ asus_driver_load_profile(struct ghostcat_device *device, struct ghostcat_profile
 			continue;
 		}
 
-		if (asus_index < ASUS_MAX_NUM_BUTTON) {
-			asus_binding = &binding_data.data.binding[asus_index];
-		} else {
-			asus_binding = &binding_data_secondary.data.binding[asus_index % ASUS_MAX_NUM_BUTTON];
-		}
+		asus_binding = asus_driver_get_binding(drv_data, profile->index, asus_index);
 
 		/* disabled */
 		if (asus_binding->action == ASUS_BUTTON_CODE_DISABLED) {
@@ -245,6 +256,116 @@ asus_driver_load_profile(struct ghostcat_device *device, struct ghostcat_profile
 	return 0;
 }
 
+/*
+ * The binding the button's action maps to.
+ *
+ * @return 0 on success, -ENOENT if the button is not mapped to an ASUS code
+ * or -EINVAL if the action can't be bound.
+ */
+static int
+asus_driver_button_to_binding(struct ghostcat_device *device,
+			      struct ghostcat_button *button,
+			      uint8_t *asus_code_src,
+			      struct _asus_binding *binding)
+{
+	struct asus_data *drv_data = ghostcat_get_drv_data(device);
+	const struct asus_button *asus_button = NULL;
+	int asus_index = drv_data->button_indices[button->index];
+	int rc;
+
+	if (asus_index == -1 || drv_data->button_mapping[asus_index] == -1) {
+		log_debug(device->ratbag, "No mapping for button %d\n", button->index);
+		return -ENOENT;
+	}
+
+	*asus_code_src = (uint8_t)drv_data->button_mapping[asus_index];
+
+	switch (button->action.type) {
+	case GHOSTCAT_BUTTON_ACTION_TYPE_NONE:
+		binding->action = ASUS_BUTTON_CODE_DISABLED;
+		binding->type = ASUS_BUTTON_ACTION_TYPE_BUTTON;
+		return 0;
+
+	case GHOSTCAT_BUTTON_ACTION_TYPE_KEY:
+		/* Linux code to ASUS code */
+		rc = asus_find_key_code(button->action.action.key);
+		if (rc == -1)
+			return -EINVAL;
+
+		binding->action = (uint8_t)rc;
+		binding->type = ASUS_BUTTON_ACTION_TYPE_KEY;
+		return 0;
+
+	case GHOSTCAT_BUTTON_ACTION_TYPE_BUTTON:
+	case GHOSTCAT_BUTTON_ACTION_TYPE_SPECIAL:
+		/* ratbag action to ASUS code */
+		if (asus_code_is_joystick(*asus_code_src))
+			asus_button = asus_find_button_by_action(button->action, true);
+		if (asus_button == NULL)
+			asus_button = asus_find_button_by_action(button->action, false);
+		if (asus_button == NULL)
+			return -EINVAL;
+
+		binding->action = asus_button->asus_code;
+		binding->type = ASUS_BUTTON_ACTION_TYPE_BUTTON;
+		return 0;
+
+	default:
+		return -EINVAL;
+	}
+}
+
+/*
+ * Whether committing the profile sends anything to the device. Buttons set
+ * to the binding the device already has don't count.
+ */
+static bool
+asus_driver_profile_has_changes(struct ghostcat_device *device, struct ghostcat_profile *profile)
+{
+	struct asus_data *drv_data = ghostcat_get_drv_data(device);
+	struct ghostcat_button *button;
+	struct ghostcat_resolution *resolution;
+	struct ghostcat_led *led;
+
+	if (profile->dirty & (GHOSTCAT_PROFILE_DIRTY_RATE |
+			      GHOSTCAT_PROFILE_DIRTY_ANGLE_SNAPPING |
+			      GHOSTCAT_PROFILE_DIRTY_DEBOUNCE))
+		return true;
+
+	ghostcat_profile_for_each_resolution(profile, resolution) {
+		if (resolution->dirty)
+			return true;
+	}
+
+	ghostcat_profile_for_each_led(profile, led) {
+		if (led->dirty)
+			return true;
+	}
+
+	ghostcat_profile_for_each_button(profile, button) {
+		struct _asus_binding binding;
+		const struct _asus_binding *current;
+		uint8_t asus_code_src;
+		int rc;
+
+		if (!button->dirty)
+			continue;
+
+		rc = asus_driver_button_to_binding(device, button, &asus_code_src, &binding);
+		if (rc == -ENOENT)
+			continue;
+		if (rc)
+			return true;  /* let the commit report the error */
+
+		current = asus_driver_get_binding(drv_data, profile->index,
+						  drv_data->button_indices[button->index]);
+		if (current->action != binding.action || current->type != binding.type)
+			return true;
+	}
+
+	return false;
+}
+
 static int
 asus_driver_save_profile(struct ghostcat_device *device, struct ghostcat_profile *profile)
 {
@@ -255,93 +376,51 @@ asus_driver_save_profile(struct ghostcat_device *device, struct ghostcat_profile
 	struct asus_data *drv_data = ghostcat_get_drv_data(device);
 	uint32_t quirks = ghostcat_device_data_asus_get_quirks(device->data);
 
-	/* set buttons */
+	/* set buttons, skipping those the device already has */
 	ghostcat_profile_for_each_button(profile, button) {
+		struct _asus_binding binding;
+		struct _asus_binding *current;
+		uint8_t asus_code_src;
+
 		if (!button->dirty)
 			continue;
 
-		int asus_index = drv_data->button_indices[button->index];
-		if (asus_index == -1) {
-			log_debug(device->ratbag, "No mapping for button %d\n", button->index);
+		rc = asus_driver_button_to_binding(device, button, &asus_code_src, &binding);
+		if (rc == -ENOENT)
 			continue;
-		}
-
-		const struct asus_button *asus_button;
-		uint8_t asus_code_src;
-		uint8_t asus_code_dst;
-		bool is_joystick;
+		if (rc)
+			return rc;
 
-		rc = drv_data->button_mapping[asus_index];
-		if (rc == -1) {
-			log_debug(device->ratbag, "No mapping for button %d\n", button->index);
+		current = asus_driver_get_binding(drv_data, profile->index,
+						  drv_data->button_indices[button->index]);
+		if (current->action == binding.action && current->type == binding.type)
 			continue;
-		}
 
-		asus_code_src = (uint8_t)rc;
 		log_debug(device->ratbag, "Button %d (%02x) changed\n",
 			  button->index, asus_code_src);
 
-		switch (button->action.type) {
-		case GHOSTCAT_BUTTON_ACTION_TYPE_NONE:
-			rc = asus_set_button_action(
-				device, asus_code_src, ASUS_BUTTON_CODE_DISABLED,
-				ASUS_BUTTON_ACTION_TYPE_BUTTON);
-			break;
-
-		case GHOSTCAT_BUTTON_ACTION_TYPE_KEY:
-			/* Linux code to ASUS code */
-			rc = asus_find_key_code(button->action.action.key);
-			if (rc != -1) {
-				asus_code_dst = (uint8_t)rc;
-				rc = asus_set_button_action(
-					device, asus_code_src, asus_code_dst,
-					ASUS_BUTTON_ACTION_TYPE_KEY);
-			}
-			break;
-
-		case GHOSTCAT_BUTTON_ACTION_TYPE_BUTTON:
-		case GHOSTCAT_BUTTON_ACTION_TYPE_SPECIAL:
-			/* ratbag action to ASUS code */
-			is_joystick = asus_code_is_joystick(asus_code_src);
-			if (is_joystick) {
-				asus_button = asus_find_button_by_action(button->action, true);
-				if (asus_button != NULL) {  /* found button to bind to */
-					rc = asus_set_button_action(
-						device, asus_code_src, asus_button->asus_code,
-						ASUS_BUTTON_ACTION_TYPE_BUTTON);
-					break;
-				}
-			}
-
-			asus_button = asus_find_button_by_action(button->action, false);
-			if (asus_button != NULL)  /* found button to bind to */
-				rc = asus_set_button_action(
-					device, asus_code_src, asus_button->asus_code,
-					ASUS_BUTTON_ACTION_TYPE_BUTTON);
-			break;
-
-		default:
-			break;
-		}
-
+		rc = asus_set_button_action(device, asus_code_src,
+					    binding.action, binding.type);
 		if (rc)
 			return rc;
+
+		*current = binding;
 	}
 
 	/* set extra settings */
-	if (profile->rate_dirty) {
+	if (profile->dirty & GHOSTCAT_PROFILE_DIRTY_RATE) {
 		log_debug(device->ratbag, "Polling rate changed to %d Hz\n", profile->hz);
 		rc = asus_set_polling_rate(device, profile->hz);
 		if (rc)
 			return rc;
 	}
-	if (profile->angle_snapping_dirty) {
+	if (profile->dirty & GHOSTCAT_PROFILE_DIRTY_ANGLE_SNAPPING) {
 		log_debug(device->ratbag, "Angle snapping changed to %d\n", profile->angle_snapping);
 		rc = asus_set_angle_snapping(device, profile->angle_snapping);
 		if (rc)
 			return rc;
 	}
-	if (profile->debounce_dirty) {
+	if (profile->dirty & GHOSTCAT_PROFILE_DIRTY_DEBOUNCE) {
 		log_debug(device->ratbag, "Debounce time changed to %d\n", profile->debounce);
 		rc = asus_set_button_response(device, profile->debounce);
 		if (rc)
@@ -420,18 +499,25 @@ asus_driver_load_profiles(struct ghostcat_device *device)
 		profile_data.version_secondary_minor,
 		profile_data.version_secondary_build);
 
-	/* read ratbag profiles */
+	/* read the selected profile first, then switch to each other one */
 	ghostcat_device_for_each_profile(device, profile) {
-		if (profile->index == current_profile_id) {  /* profile is already selected */
-			profile->is_active = true;
-		} else {  /* switch profile */
-			profile->is_active = false;
+		profile->is_active = profile->index == current_profile_id;
+		if (!profile->is_active)
+			continue;
 
-			log_debug(device->ratbag, "Switching to profile %d\n", profile->index);
-			rc = asus_set_profile(device, profile->index);
-			if (rc)
-				return rc;
-		}
+		rc = asus_driver_load_profile(device, profile, profile_data.dpi_preset);
+		if (rc)
+			return rc;
+	}
+
+	ghostcat_device_for_each_profile(device, profile) {
+		if (profile->is_active)
+			continue;
+
+		log_debug(device->ratbag, "Switching to profile %d\n", profile->index);
+		rc = asus_set_profile(device, profile->index);
+		if (rc)
+			return rc;
 
 		rc = asus_driver_load_profile(device, profile, profile_data.dpi_preset);
 		if (rc)
@@ -449,13 +535,29 @@ asus_driver_load_profiles(struct ghostcat_device *device)
 	return 0;
 }
 
+static int
+asus_driver_write_profile(struct ghostcat_device *device, struct ghostcat_profile *profile)
+{
+	int rc;
+
+	rc = asus_driver_save_profile(device, profile);
+	if (rc)
+		return rc;
+
+	/* save profile */
+	log_debug(device->ratbag, "Saving profile\n");
+	return asus_save_profile(device);
+}
+
 static int
 asus_driver_save_profiles(struct ghostcat_device *device)
 {
 	int rc;
 	struct asus_profile_data profile_data;
 	struct ghostcat_profile *profile;
+	struct ghostcat_profile *current_profile = NULL;
 	unsigned int current_profile_id = 0;
+	bool switched = false;
 
 	/* get current profile id */
 	if (device->num_profiles > 1) {
@@ -467,39 +569,54 @@ asus_driver_save_profiles(struct ghostcat_device *device)
 		log_debug(device->ratbag, "Initial profile is %d\n", current_profile_id);
 	}
 
+	/*
+	 * The device is only written through its active profile. Write the
+	 * other profiles first and the current one last, so there is a single
+	 * switch back, and never switch for a profile without changes.
+	 */
 	ghostcat_device_for_each_profile(device, profile) {
 		if (!profile->dirty)
 			continue;
 
-		log_debug(device->ratbag, "Profile %d changed\n", profile->index);
+		if (profile->index == current_profile_id) {
+			current_profile = profile;
+			continue;
+		}
 
-		/* switch profile */
-		if (profile->index != current_profile_id) {
-			log_debug(device->ratbag, "Switching to profile %d\n", profile->index);
-			rc = asus_set_profile(device, profile->index);
-			if (rc)
-				return rc;
+		if (!asus_driver_profile_has_changes(device, profile)) {
+			log_debug(device->ratbag, "Profile %d is unchanged\n", profile->index);
+			continue;
 		}
 
-		rc = asus_driver_save_profile(device, profile);
+		log_debug(device->ratbag, "Profile %d changed\n", profile->index);
+
+		log_debug(device->ratbag, "Switching to profile %d\n", profile->index);
+		rc = asus_set_profile(device, profile->index);
 		if (rc)
 			return rc;
+		switched = true;
 
-		/* save profile */
-		log_debug(device->ratbag, "Saving profile\n");
-		rc = asus_save_profile(device);
+		rc = asus_driver_write_profile(device, profile);
 		if (rc)
 			return rc;
 	}
 
 	/* back to initial profile */
-	if (device->num_profiles > 1) {
+	if (switched) {
 		log_debug(device->ratbag, "Switching back to initial profile %d\n", current_profile_id);
 		rc = asus_set_profile(device, current_profile_id);
 		if (rc)
 			return rc;
 	}
 
+	if (current_profile && asus_driver_profile_has_changes(device, current_profile)) {
+		log_debug(device->ratbag, "Profile %d changed\n", current_profile->index);
+
+		rc = asus_driver_write_profile(device, current_profile);
+		if (rc)
+			return rc;
+	}
+
 	return 0;
 }
 
@@ -582,6 +699,9 @@ asus_driver_probe(struct ghostcat_device *device)
 		max(button_count, 8),
 		max(led_count, 0));
 
+	drv_data->bindings = zalloc(device->num_profiles * ASUS_MAX_NUM_BUTTON_GROUP *
+				    sizeof(*drv_data->bindings));
+
 	/* setup profiles */
 	ghostcat_device_for_each_profile(device, profile) {
 		if (profile->index == 0) {
@@ -608,6 +728,7 @@ asus_driver_probe(struct ghostcat_device *device)
 		log_error(
 			device->ratbag, "Can't talk to the mouse: '%s' (%d)\n",
 			strerror(-rc), rc);
+		free(drv_data->bindings);
 		free(drv_data);
 		ghostcat_set_drv_data(device, NULL);
 		return -ENODEV;
@@ -619,8 +740,12 @@ asus_driver_probe(struct ghostcat_device *device)
 static void
 asus_driver_remove(struct ghostcat_device *device)
 {
+	struct asus_data *drv_data = ghostcat_get_drv_data(device);
+
 	ghostcat_close_hidraw(device);
-	free(ghostcat_get_drv_data(device));
+	if (drv_data)
+		free(drv_data->bindings);
+	free(drv_data);
 }
 
 static int
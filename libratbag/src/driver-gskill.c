@@ -23,6 +23,7 @@
 #include "config.h"
 
 #include "libghostcat-private.h"
+#include "libghostcat-checksum.h"
 #include "libghostcat-hidraw.h"
 
 #include <errno.h>
@@ -51,6 +52,15 @@
 
 #define GSKILL_CHECKSUM_OFFSET 3
 
+#define GSKILL_MAX_RETRIES 10
+
+/* The mouse returns nonsense when polled sooner than this after a command */
+#define GSKILL_CMD_DELAY_MS 20
+
+/* How long the mouse takes to switch to a profile or macro selected for
+ * writing. Nothing tells us when it's done, see gskill_select_profile() */
+#define GSKILL_SELECT_WRITE_DELAY_MS 200
+
 /* Command status codes */
 #define GSKILL_CMD_SUCCESS     0xb0
 #define GSKILL_CMD_IN_PROGRESS 0xb1
@@ -297,6 +307,8 @@ static const struct gskill_button_function_mapping gskill_button_function_mappin
 
 struct gskill_profile_data {
 	struct gskill_profile_report report;
+	/* what the device has, to skip writing an unchanged report */
+	struct gskill_profile_report device_report;
 	uint8_t res_idx_to_dev_idx[GSKILL_NUM_DPI];
 
 	struct gskill_macro_report macros[GSKILL_BUTTON_MAX];
@@ -344,15 +356,15 @@ gskill_button_function_from_action(const struct ghostcat_button_action *action)
 static uint8_t
 gskill_calculate_checksum(const uint8_t *buf, size_t len)
 {
-	uint8_t checksum = 0;
-	unsigned i;
+	uint8_t checksum;
 
-	for (i = GSKILL_CHECKSUM_OFFSET + 1; i < len; i++)
-		checksum += buf[i];
+	if (len <= GSKILL_CHECKSUM_OFFSET + 1)
+		return 0;
 
-	checksum = ~checksum + 1;
+	checksum = ghostcat_checksum_sum(buf + GSKILL_CHECKSUM_OFFSET + 1,
+					 len - GSKILL_CHECKSUM_OFFSET - 1);
 
-	return checksum;
+	return ~checksum + 1;
 }
 
 static int
@@ -373,13 +385,14 @@ gskill_general_cmd(struct ghostcat_device *device,
 	}
 
 	rc = -EAGAIN;
-	for (retries = 0; retries < 10 && rc == -EAGAIN; retries++) {
+	for (retries = 0; retries < GSKILL_MAX_RETRIES && rc == -EAGAIN; retries++) {
 		/*
-		 * Wait for the device to be ready
-		 * Spec says this should be 10ms, but 20ms seems to get the
-		 * mouse to return slightly less nonsense responses
+		 * Poll at the pace of the device, backing off while the
+		 * command is in progress. Spec says the mouse is ready after
+		 * 10ms, but it returns slightly less nonsense after 20ms.
 		 */
-		msleep(20);
+		msleep(max(GSKILL_CMD_DELAY_MS,
+			   ghostcat_rtt_delay_ms(&device->rtt, retries)));
 
 		rc = ghostcat_hidraw_raw_request(device, 0, buf,
 					       GSKILL_REPORT_SIZE_CMD,
@@ -547,6 +560,58 @@ gskill_select_profile(struct ghostcat_device *device, unsigned index, bool write
 	return 0;
 }
 
+/*
+ * The profile and macro selections can't be acknowledged, see
+ * gskill_select_profile(), and the mouse answers with the previous
+ * selection until it has switched. The profile and macro reports carry
+ * their number at the same offset, so the read is repeated at the pace of
+ * the device until the report has the number we selected. If it never
+ * does, the last report is returned and the caller sees the wrong number.
+ */
+static int
+gskill_read_selected(struct ghostcat_device *device, uint8_t reportnum,
+		     uint8_t *buf, size_t len, uint8_t num)
+{
+	int rc = -ETIMEDOUT;
+	int retries;
+
+	_Static_assert(offsetof(struct gskill_profile_report, profile_num) ==
+		       offsetof(struct gskill_macro_report, macro_num),
+		       "report numbers at different offsets");
+
+	for (retries = 0; retries < GSKILL_MAX_RETRIES; retries++) {
+		msleep(max(GSKILL_CMD_DELAY_MS,
+			   ghostcat_rtt_delay_ms(&device->rtt, retries)));
+
+		rc = ghostcat_hidraw_raw_request(device, reportnum, buf, len,
+					       HID_FEATURE_REPORT,
+					       HID_REQ_GET_REPORT);
+		if (rc == (int)len &&
+		    buf[offsetof(struct gskill_profile_report, profile_num)] == num)
+			return rc;
+
+		log_debug(device->ratbag,
+			  "Device not switched to %d for report %#x (%d), retrying\n",
+			  num, reportnum, rc);
+	}
+
+	return rc;
+}
+
+/*
+ * A write can't be confirmed like a read, it goes out once the mouse had
+ * the time to switch to the selected profile or macro.
+ */
+static int
+gskill_write_selected(struct ghostcat_device *device, uint8_t reportnum,
+		      uint8_t *buf, size_t len)
+{
+	msleep(GSKILL_SELECT_WRITE_DELAY_MS);
+
+	return ghostcat_hidraw_raw_request(device, reportnum, buf, len,
+					 HID_FEATURE_REPORT, HID_REQ_SET_REPORT);
+}
+
 /*
  * Instructs the mouse to reload the data from a profile we've just written to
  * it.
@@ -570,10 +635,15 @@ gskill_reload_profile_data(struct ghostcat_device *device)
 	return 0;
 }
 
+/*
+ * Returns 0 if the device already has this report, 1 if it was written or a
+ * negative errno
+ */
 static int
 gskill_write_profile(struct ghostcat_device *device,
-		     struct gskill_profile_report *report)
+		     struct gskill_profile_data *pdata)
 {
+	struct gskill_profile_report *report = &pdata->report;
 	uint8_t *buf = (uint8_t*)report;
 	int rc;
 
@@ -595,23 +665,28 @@ gskill_write_profile(struct ghostcat_device *device,
 
 	report->checksum = gskill_calculate_checksum(buf, sizeof(*report));
 
+	if (memcmp(report, &pdata->device_report, sizeof(*report)) == 0) {
+		log_debug(device->ratbag,
+			  "Profile %d is unchanged, not writing it\n",
+			  report->profile_num);
+		return 0;
+	}
+
 	rc = gskill_select_profile(device, report->profile_num, true);
 	if (rc)
 		return rc;
 
-	/* Wait for the device to be ready */
-	msleep(200);
-
-	rc = ghostcat_hidraw_raw_request(device, GSKILL_GET_SET_PROFILE,
-				       buf, sizeof(*report), HID_FEATURE_REPORT,
-				       HID_REQ_SET_REPORT);
+	rc = gskill_write_selected(device, GSKILL_GET_SET_PROFILE,
+				   buf, sizeof(*report));
 	if (rc != sizeof(*report)) {
 		log_error(device->ratbag,
 			  "Error while writing profile: %d\n", rc);
 		return rc < 0 ? rc : -EPROTO;
 	}
 
-	return 0;
+	pdata->device_report = *report;
+
+	return 1;
 }
 
 static int
@@ -903,12 +978,9 @@ gskill_read_button_macro(struct ghostcat_device *device,
 	if (rc)
 		return NULL;
 
-	/* Wait for the device to be ready */
-	msleep(100);
-
-	rc = ghostcat_hidraw_raw_request(device, GSKILL_GET_SET_MACRO,
-				       (uint8_t*)report, sizeof(*report),
-				       HID_FEATURE_REPORT, HID_REQ_GET_REPORT);
+	rc = gskill_read_selected(device, GSKILL_GET_SET_MACRO,
+				  (uint8_t*)report, sizeof(*report),
+				  profile * 10 + button);
 	if (rc < (signed)sizeof(*report)) {
 		log_error(device->ratbag,
 			  "Failed to retrieve macro for profile %d for button %d: %d\n",
@@ -916,6 +988,13 @@ gskill_read_button_macro(struct ghostcat_device *device,
 		return NULL;
 	}
 
+	if (report->macro_num != profile * 10 + button) {
+		log_error(device->ratbag,
+			  "Mouse sent macro %d instead of profile %d button %d\n",
+			  report->macro_num, profile, button);
+		return NULL;
+	}
+
 	checksum = gskill_calculate_checksum((uint8_t*)report, sizeof(*report));
 	if (checksum != report->checksum) {
 		log_error(device->ratbag,
@@ -935,26 +1014,22 @@ gskill_write_button_macro(struct ghostcat_device *device,
 	unsigned int button = report->macro_num % 10;
 	int rc;
 
-	rc = gskill_select_macro(device, profile, button, true);
-	if (rc)
-		return rc;
-
-	/* Wait for the device to be ready */
-	msleep(200);
-
 	memset(&report->header, 0, sizeof(report->header));
 	report->header.write.report_id = 0x4;
 	report->checksum = gskill_calculate_checksum((uint8_t*)report,
 						     sizeof(*report));
 
-	rc = ghostcat_hidraw_raw_request(device, GSKILL_GET_SET_MACRO,
-				       (uint8_t*)report, sizeof(*report),
-				       HID_FEATURE_REPORT, HID_REQ_SET_REPORT);
-	if (rc < 0) {
+	rc = gskill_select_macro(device, profile, button, true);
+	if (rc)
+		return rc;
+
+	rc = gskill_write_selected(device, GSKILL_GET_SET_MACRO,
+				   (uint8_t*)report, sizeof(*report));
+	if (rc != sizeof(*report)) {
 		log_error(device->ratbag,
 			  "Failed to write macro for profile %d button %d to mouse: %d\n",
 			  profile, button, rc);
-		return rc;
+		return rc < 0 ? rc : -EPROTO;
 	}
 
 	return 0;
@@ -1044,14 +1119,9 @@ gskill_read_profile(struct ghostcat_profile *profile)
 		if (rc < 0)
 			return;
 
-		/* Wait for the device to be ready */
-		msleep(100);
-
-		rc = ghostcat_hidraw_raw_request(device, GSKILL_GET_SET_PROFILE,
-					       (uint8_t*)report,
-					       sizeof(*report),
-					       HID_FEATURE_REPORT,
-					       HID_REQ_GET_REPORT);
+		rc = gskill_read_selected(device, GSKILL_GET_SET_PROFILE,
+					  (uint8_t*)report, sizeof(*report),
+					  profile->index);
 		if (rc < (signed)sizeof(*report)) {
 			log_error(device->ratbag,
 				  "Error while requesting profile: %d\n", rc);
@@ -1072,6 +1142,8 @@ gskill_read_profile(struct ghostcat_profile *profile)
 			  profile->index, report->checksum, checksum);
 	}
 
+	pdata->device_report = *report;
+
 	gskill_read_resolutions(profile, report);
 	gskill_read_profile_name(device, report);
 }
@@ -1320,14 +1392,18 @@ gskill_update_button(struct ghostcat_button *button)
 			bcfg->params.consumer.code = code;
 		}
 		break;
-	case GHOSTCAT_BUTTON_ACTION_TYPE_MACRO:
+	case GHOSTCAT_BUTTON_ACTION_TYPE_MACRO: {
+		struct gskill_macro_report *macro_report;
+
 		bcfg->type = GSKILL_BUTTON_FUNCTION_MACRO;
-		gskill_write_button_macro(
-		    device, gskill_macro_to_report(device, macro,
-						   profile->index,
-						   button->index));
+		macro_report = gskill_macro_to_report(device, macro,
+						      profile->index,
+						      button->index);
+		if (!macro_report)
+			return -EINVAL;
 
-		break;
+		return gskill_write_button_macro(device, macro_report);
+	}
 	case GHOSTCAT_BUTTON_ACTION_TYPE_NONE:
 		bcfg->type = GSKILL_BUTTON_FUNCTION_DISABLE;
 		break;
@@ -1338,6 +1414,10 @@ gskill_update_button(struct ghostcat_button *button)
 	return 0;
 }
 
+/*
+ * Returns 0 if the device already has this profile, 1 if the profile report
+ * was written or a negative errno
+ */
 static int
 gskill_update_profile(struct ghostcat_profile *profile)
 {
@@ -1347,7 +1427,11 @@ gskill_update_profile(struct ghostcat_profile *profile)
 	struct gskill_profile_report *report = &pdata->report;
 	int rc;
 
-	gskill_update_resolutions(profile);
+	if (profile->dirty & GHOSTCAT_PROFILE_DIRTY_RATE && profile->hz)
+		report->polling_rate = GSKILL_MAX_POLLING_RATE / profile->hz - 1;
+
+	if (profile->dirty & GHOSTCAT_PROFILE_DIRTY_RESOLUTIONS)
+		gskill_update_resolutions(profile);
 
 	list_for_each(button, &profile->buttons, link) {
 		if (!button->dirty)
@@ -1358,11 +1442,7 @@ gskill_update_profile(struct ghostcat_profile *profile)
 			return rc;
 	}
 
-	rc = gskill_write_profile(device, report);
-	if (rc)
-		return rc;
-
-	return 0;
+	return gskill_write_profile(device, pdata);
 }
 
 static int
@@ -1458,7 +1538,7 @@ gskill_commit(struct ghostcat_device *device)
 			  "Profile %d remapped to %d\n",
 			  profile->index, new_idx);
 
-		profile->dirty = true;
+		profile->dirty |= GHOSTCAT_PROFILE_DIRTY_ALL;
 		report->profile_num = new_idx;
 	}
 
@@ -1467,19 +1547,27 @@ gskill_commit(struct ghostcat_device *device)
 		if (rc < 0)
 			return rc;
 		drv_data->profile_count = profile_count;
+		reload = true;
 	}
 
+	/*
+	 * Our copy of each profile is what we just wrote, so there is no
+	 * need to read anything back. The mouse only needs to reload its
+	 * profile data when the profile it is running from changed.
+	 */
 	list_for_each(profile, &device->profiles, link) {
 		if (!profile->is_enabled || !profile->dirty)
 			continue;
 
 		log_debug(device->ratbag,
 			  "Profile %d changed, rewriting\n", profile->index);
-		reload = true;
 
 		rc = gskill_update_profile(profile);
-		if (rc)
+		if (rc < 0)
 			return rc;
+
+		if (rc > 0 && profile->is_active)
+			reload = true;
 	}
 
 	if (reload) {
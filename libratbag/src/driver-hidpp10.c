@@ -487,73 +487,96 @@ hidpp10_log(void *userdata, enum hidpp_log_priority priority, const char *format
 }
 
 static int
-hidpp10drv_commit(struct ghostcat_device *device)
+hidpp10drv_write_profile(struct ghostcat_profile *profile)
 {
+	struct ghostcat_device *device = profile->device;
 	struct hidpp10drv_data *drv_data = ghostcat_get_drv_data(device);
 	struct hidpp10_device *dev = drv_data->dev;
-	struct ghostcat_profile *profile;
 	struct ghostcat_button *button;
 	struct ghostcat_led *led;
 	struct ghostcat_resolution *resolution;
-	struct ghostcat_resolution *active_resolution = NULL;
 	struct hidpp10_profile p;
 	int rc;
 
-	list_for_each(profile, &device->profiles, link) {
-		if (!profile->dirty)
-			continue;
+	rc = hidpp10_get_profile(dev, profile->index, &p);
+	if (rc)
+		return rc;
 
-		rc = hidpp10_get_profile(dev, profile->index, &p);
-		if (rc)
-			return rc;
+	p.enabled = profile->is_enabled;
+	if (profile->name != NULL)
+		strncpy_safe((char*)p.name, profile->name, 24);
 
-		p.enabled = profile->is_enabled;
-		if (profile->name != NULL)
-			strncpy_safe((char*)p.name, profile->name, 24);
+	ghostcat_profile_for_each_resolution(profile, resolution) {
+		p.dpi_modes[resolution->index].xres = resolution->dpi_x;
+		p.dpi_modes[resolution->index].yres = resolution->dpi_y;
+	}
 
-		ghostcat_profile_for_each_resolution(profile, resolution) {
-			p.dpi_modes[resolution->index].xres = resolution->dpi_x;
-			p.dpi_modes[resolution->index].yres = resolution->dpi_y;
+	list_for_each(button, &profile->buttons, link) {
+		struct ghostcat_button_action action = button->action;
 
-			if (profile->is_active && resolution->is_active)
-				active_resolution = resolution;
-		}
+		if (!button->dirty)
+			continue;
 
-		list_for_each(button, &profile->buttons, link) {
-			struct ghostcat_button_action action = button->action;
+		rc = hidpp10drv_write_button(&p, button, &action);
+		if (rc) {
+			log_error(device->ratbag, "hidpp10: failed to update buttons (%d)\n", rc);
+			return GHOSTCAT_ERROR_DEVICE;
+		}
+	}
 
-			if (!button->dirty)
-				continue;
+	ghostcat_profile_for_each_led(profile, led) {
+		if (led->dirty)
+			hidpp10drv_write_led(&p, led);
+	}
 
-			rc = hidpp10drv_write_button(&p, button, &action);
-			if (rc) {
-				log_error(device->ratbag, "hidpp10: failed to update buttons (%d)\n", rc);
-				return GHOSTCAT_ERROR_DEVICE;
-			}
+	if (dev->profile_type != HIDPP10_PROFILE_UNKNOWN) {
+		rc = hidpp10_set_profile(dev, profile->index, &p);
+		if (rc) {
+			log_error(device->ratbag, "hidpp10: failed to set profile (%d)\n", rc);
+			return GHOSTCAT_ERROR_DEVICE;
 		}
+	}
 
-		ghostcat_profile_for_each_led(profile, led)
-			hidpp10drv_write_led(&p, led);
+	return 0;
+}
 
-		if (dev->profile_type != HIDPP10_PROFILE_UNKNOWN) {
-			rc = hidpp10_set_profile(dev, profile->index, &p);
-			if (rc) {
-				log_error(device->ratbag, "hidpp10: failed to set profile (%d)\n", rc);
-				return GHOSTCAT_ERROR_DEVICE;
-			}
+static int
+hidpp10drv_commit(struct ghostcat_device *device)
+{
+	struct hidpp10drv_data *drv_data = ghostcat_get_drv_data(device);
+	struct hidpp10_device *dev = drv_data->dev;
+	struct ghostcat_profile *profile;
+	struct ghostcat_resolution *resolution;
+	bool page_dirty;
+	int rc;
+
+	list_for_each(profile, &device->profiles, link) {
+		if (!profile->dirty)
+			continue;
+
+		page_dirty = ghostcat_profile_has_stored_changes(profile);
+		if (page_dirty) {
+			rc = hidpp10drv_write_profile(profile);
+			if (rc)
+				return rc;
 		}
 
+		if (!profile->is_active)
+			continue;
+
 		/* Update the current resolution in case it changed */
-		if (active_resolution) {
+		ghostcat_profile_for_each_resolution(profile, resolution) {
+			if (!resolution->is_active ||
+			    (!page_dirty && !resolution->dirty))
+				continue;
+
 			rc = hidpp10_set_current_resolution(dev,
-						       active_resolution->dpi_x,
-						       active_resolution->dpi_y);
+						       resolution->dpi_x,
+						       resolution->dpi_y);
 			if (rc) {
 				log_error(device->ratbag, "hidpp10: failed to set active resolution (%d)\n", rc);
 				return GHOSTCAT_ERROR_DEVICE;
 			}
-
-			active_resolution = NULL;
 		}
 	}
 
@@ -577,8 +600,10 @@ hidpp10drv_probe(struct ghostcat_device *device)
 		goto err;
 
 	drv_data = zalloc(sizeof(*drv_data));
-	hidpp_device_init(&base, device->hidraw[0].fd);
+	ghostcat_hidraw_init_hidpp_device(device, &base);
 	hidpp_device_set_log_handler(&base, hidpp10_log, HIDPP_LOG_PRIORITY_RAW, device);
+	base.rtt = &device->rtt;
+	base.stats = &device->stats;
 
 	typestr = ghostcat_device_data_hidpp10_get_profile_type(device->data);
 	if (typestr) {
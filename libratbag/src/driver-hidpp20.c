@@ -36,8 +36,10 @@
 #include "config.h"
 
 #include <linux/types.h>
+#include <assert.h>
 #include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
@@ -46,6 +48,7 @@
 #include "libghostcat-private.h"
 #include "libghostcat-hidraw.h"
 #include "libghostcat-data.h"
+#include "libghostcat-image.h"
 
 #define HIDPP_CAP_RESOLUTION_2200			(1 << 0)
 #define HIDPP_CAP_SWITCHABLE_RESOLUTION_2201		(1 << 1)
@@ -58,6 +61,8 @@
 #define HIDPP_CAP_ADJUSTABLE_REPORT_RATE_8060		(1 << 8)
 #define HIDPP_CAP_BATTERY_VOLTAGE_1001			(1 << 9)
 #define HIDPP_CAP_RGB_EFFECTS_8071			(1 << 10)
+#define HIDPP_CAP_EXTENDED_REPORT_RATE_8061		(1 << 11)
+#define HIDPP_CAP_PER_KEY_LIGHTING_8081			(1 << 12)
 
 #define HIDPP_HIDDEN_FEATURE				(1 << 6)
 
@@ -72,13 +77,17 @@ struct hidpp20drv_data {
 	struct hidpp20_led *leds;
 	union hidpp20_generic_led_zone_info led_infos;
 
-	unsigned int report_rates[4];
+	unsigned int report_rates[8];
 	unsigned int num_report_rates;
+	unsigned int extended_report_rate; /* current rate from 0x8061 in Hz */
 
 	unsigned int num_profiles;
 	unsigned int num_resolutions;
 	unsigned int num_buttons;
 	unsigned int num_leds;
+
+	/* bitmap of the 0x8081 zones */
+	uint8_t key_zones[HIDPP20_PER_KEY_LIGHTING_MAX_ZONES / 8];
 };
 
 static void
@@ -238,9 +247,9 @@ hidpp20drv_read_button_8100(struct ghostcat_button *button)
 		button->action.action.special = hidpp20_onboard_profiles_get_special(profile->buttons[button->index].special.special);
 		break;
 	case HIDPP20_BUTTON_MACRO:
-		rc = hidpp20drv_read_macro_8100(button, profile, &profile->buttons[button->index]);
-		if (rc)
-			button->action.type = GHOSTCAT_BUTTON_ACTION_TYPE_NONE;
+		/* the macro events are read by hidpp20drv_load_macro() */
+		button->action.type = GHOSTCAT_BUTTON_ACTION_TYPE_MACRO;
+		button->macro_needs_load = true;
 		break;
 	default:
 		button->action.type = GHOSTCAT_BUTTON_ACTION_TYPE_UNKNOWN;
@@ -266,6 +275,26 @@ hidpp20drv_read_button_8100(struct ghostcat_button *button)
 	ghostcat_button_enable_action_type(button, GHOSTCAT_BUTTON_ACTION_TYPE_MACRO);
 }
 
+static int
+hidpp20drv_load_macro(struct ghostcat_button *button)
+{
+	struct ghostcat_device *device = button->profile->device;
+	struct hidpp20drv_data *drv_data = ghostcat_get_drv_data(device);
+	struct hidpp20_profile *profile;
+	int rc;
+
+	profile = &drv_data->profiles->profiles[button->profile->index];
+
+	rc = hidpp20_onboard_profiles_load_macro(drv_data->dev,
+						 drv_data->profiles,
+						 button->profile->index,
+						 button->index);
+	if (rc < 0)
+		return rc;
+
+	return hidpp20drv_read_macro_8100(button, profile, &profile->buttons[button->index]);
+}
+
 static void
 hidpp20drv_read_button(struct ghostcat_button *button)
 {
@@ -731,7 +760,8 @@ hidpp20drv_update_led_8070_8071(struct ghostcat_led *led, struct ghostcat_profil
 		if (drv_data->capabilities & HIDPP_CAP_COLOR_LED_EFFECTS_8070)
 			hidpp20_color_led_effects_set_zone_effect(drv_data->dev,
 								  led->index,
-								  h_led_val);
+								  h_led_val,
+								  true);
 	}
 
 	return GHOSTCAT_SUCCESS;
@@ -754,6 +784,29 @@ hidpp20drv_update_led(struct ghostcat_led *led)
 	return GHOSTCAT_ERROR_CAPABILITY;
 }
 
+static int
+hidpp20drv_update_report_rate_8061(struct ghostcat_device *device, unsigned int hz)
+{
+	struct hidpp20drv_data *drv_data = ghostcat_get_drv_data(device);
+	uint8_t rate;
+	int rc;
+
+	for (rate = 0; rate <= HIDPP20_EXTENDED_REPORT_RATE_MAX; rate++) {
+		if (hidpp20_extended_report_rate_to_hz(rate) == hz)
+			break;
+	}
+	if (rate > HIDPP20_EXTENDED_REPORT_RATE_MAX)
+		return -EINVAL;
+
+	rc = hidpp20_extended_report_rate_set_report_rate(drv_data->dev, rate);
+	if (rc)
+		return rc;
+
+	drv_data->extended_report_rate = hz;
+
+	return GHOSTCAT_SUCCESS;
+}
+
 static int
 hidpp20drv_set_current_profile(struct ghostcat_device *device, unsigned int index)
 {
@@ -770,12 +823,24 @@ hidpp20drv_set_current_profile(struct ghostcat_device *device, unsigned int inde
 	h_profile = &drv_data->profiles->profiles[index];
 	if (!h_profile->enabled) {
 		h_profile->enabled = 1;
+		h_profile->dirty = 1;
 		rc = hidpp20_onboard_profiles_commit(drv_data->dev, drv_data->profiles);
 		if (rc)
 			return rc;
 	}
 
-	return hidpp20_onboard_profiles_set_current_profile(drv_data->dev, index);
+	rc = hidpp20_onboard_profiles_set_current_profile(drv_data->dev, index);
+	if (rc)
+		return rc;
+
+	/* switching profiles resets the rate to what the profile can store */
+	if (drv_data->capabilities & HIDPP_CAP_EXTENDED_REPORT_RATE_8061) {
+		if (h_profile->report_rate > 1000)
+			return hidpp20drv_update_report_rate_8061(device, h_profile->report_rate);
+		drv_data->extended_report_rate = h_profile->report_rate;
+	}
+
+	return 0;
 }
 
 static int
@@ -880,6 +945,46 @@ hidpp20drv_read_report_rate_8060(struct ghostcat_device *device)
 	return 0;
 }
 
+static int
+hidpp20drv_read_report_rate_8061(struct ghostcat_device *device)
+{
+	struct hidpp20drv_data *drv_data = ghostcat_get_drv_data(device);
+	struct ghostcat *ratbag = device->ratbag;
+	struct ghostcat_profile *profile;
+	uint16_t bitflags;
+	unsigned int nrates = 0;
+	uint8_t rate;
+	int rc;
+
+	rc = hidpp20_extended_report_rate_get_report_rate_list(drv_data->dev,
+							       &bitflags);
+	if (rc < 0)
+		return rc;
+
+	for (rate = 0; rate <= HIDPP20_EXTENDED_REPORT_RATE_MAX; rate++) {
+		if (!(bitflags & (1 << rate)))
+			continue;
+		if (nrates >= ARRAY_LENGTH(drv_data->report_rates))
+			break;
+		drv_data->report_rates[nrates++] = hidpp20_extended_report_rate_to_hz(rate);
+	}
+
+	drv_data->num_report_rates = nrates;
+
+	if (!hidpp20_extended_report_rate_get_report_rate(drv_data->dev, &rate)) {
+		drv_data->extended_report_rate = hidpp20_extended_report_rate_to_hz(rate);
+		if (drv_data->extended_report_rate) {
+			log_debug(ratbag, "report rate is %u\n", drv_data->extended_report_rate);
+			ghostcat_device_for_each_profile(device, profile)
+				profile->hz = drv_data->extended_report_rate;
+		}
+	}
+
+	log_debug(ratbag, "device has %d extended report rates\n", nrates);
+
+	return 0;
+}
+
 static int
 hidpp20drv_read_resolution_dpi(struct ghostcat_profile *profile)
 {
@@ -933,7 +1038,15 @@ hidpp20drv_read_resolution_dpi(struct ghostcat_profile *profile)
 			ghostcat_resolution_set_dpi_list(res, &default_dpi, 1);
 	}
 
-	if (drv_data->capabilities & HIDPP_CAP_ADJUSTABLE_REPORT_RATE_8060) {
+	if (drv_data->capabilities & HIDPP_CAP_EXTENDED_REPORT_RATE_8061) {
+		rc = hidpp20drv_read_report_rate_8061(device);
+		if (rc < 0 && drv_data->report_rates[0] == 0)
+			return rc;
+
+		ghostcat_profile_set_report_rate_list(profile,
+						    drv_data->report_rates,
+						    drv_data->num_report_rates);
+	} else if (drv_data->capabilities & HIDPP_CAP_ADJUSTABLE_REPORT_RATE_8060) {
 		rc = hidpp20drv_read_report_rate_8060(device);
 		if (rc < 0 && drv_data->report_rates[0] == 0)
 			return rc;
@@ -1057,6 +1170,16 @@ hidpp20drv_update_report_rate(struct ghostcat_profile *profile, int hz)
 	if (drv_data->capabilities & HIDPP_CAP_ONBOARD_PROFILES_8100)
 		return hidpp20drv_update_report_rate_8100(profile, hz);
 
+	if (drv_data->capabilities & HIDPP_CAP_EXTENDED_REPORT_RATE_8061) {
+		rc = hidpp20drv_update_report_rate_8061(profile->device, hz);
+
+		/* re-populate the profile with the correct value if we fail */
+		if (rc)
+			hidpp20drv_read_report_rate_8061(profile->device);
+
+		return rc;
+	}
+
 	if (drv_data->capabilities & HIDPP_CAP_ADJUSTABLE_REPORT_RATE_8060) {
 		rc = hidpp20drv_update_report_rate_8060(profile, hz);
 
@@ -1185,6 +1308,21 @@ hidpp20drv_read_leds(struct ghostcat_device *device)
 	return rc;
 }
 
+/* The flags are only ever set while reading a profile, so they are
+ * cleared before a profile is read again */
+static void
+hidpp20drv_clear_resolution_flags(struct ghostcat_profile *profile)
+{
+	struct ghostcat_resolution *res;
+
+	ghostcat_profile_for_each_resolution(profile, res) {
+		res->is_active = false;
+		res->is_default = false;
+		res->is_dpi_shift_target = false;
+		res->is_disabled = false;
+	}
+}
+
 static void
 hidpp20drv_read_profile_8100(struct ghostcat_profile *profile)
 {
@@ -1209,6 +1347,8 @@ hidpp20drv_read_profile_8100(struct ghostcat_profile *profile)
 	if (dpi_index < 0 || dpi_index > 4)
 		dpi_index = p->default_dpi;
 
+	hidpp20drv_clear_resolution_flags(profile);
+
 	ghostcat_profile_for_each_resolution(profile, res) {
 		struct hidpp20_sensor *sensor;
 
@@ -1243,6 +1383,10 @@ hidpp20drv_read_profile_8100(struct ghostcat_profile *profile)
 					    drv_data->report_rates,
 					    drv_data->num_report_rates);
 	profile->hz = p->report_rate;
+
+	/* rates above 1000Hz are not stored in the profile */
+	if (profile->is_active && drv_data->extended_report_rate > p->report_rate)
+		profile->hz = drv_data->extended_report_rate;
 }
 
 static int
@@ -1329,6 +1473,75 @@ hidpp20drv_read_profile(struct ghostcat_profile *profile)
 		hidpp20drv_read_button(button);
 }
 
+/* Fills in what a client can see without reading the profile from the
+ * device, the rest is read by hidpp20drv_load_profile() on first access.
+ * LED and button capabilities are the same for every profile, so they
+ * are copied from an already read one. */
+static void
+hidpp20drv_defer_profile_8100(struct ghostcat_profile *profile,
+			      struct ghostcat_profile *loaded)
+{
+	struct ghostcat_device *device = profile->device;
+	struct hidpp20drv_data *drv_data = ghostcat_get_drv_data(device);
+	struct hidpp20_sensor *sensor = &drv_data->sensors[0];
+	struct ghostcat_resolution *res;
+	struct ghostcat_button *button, *b;
+	struct ghostcat_led *led, *l;
+
+	profile->is_enabled = drv_data->profiles->profiles[profile->index].enabled;
+	profile->is_active = false;
+	ghostcat_profile_set_cap(profile, GHOSTCAT_PROFILE_CAP_DISABLE);
+
+	ghostcat_profile_for_each_resolution(profile, res) {
+		ghostcat_resolution_set_cap(res, GHOSTCAT_RESOLUTION_CAP_DISABLE);
+		ghostcat_resolution_set_dpi_list_from_range(res,
+							  sensor->dpi_min,
+							  sensor->dpi_max);
+	}
+
+	ghostcat_profile_set_report_rate_list(profile,
+					    drv_data->report_rates,
+					    drv_data->num_report_rates);
+
+	ghostcat_profile_for_each_led(profile, led) {
+		ghostcat_profile_for_each_led(loaded, l) {
+			if (l->index != led->index)
+				continue;
+			led->colordepth = l->colordepth;
+			led->modes = l->modes;
+		}
+	}
+
+	ghostcat_profile_for_each_button(profile, button) {
+		ghostcat_profile_for_each_button(loaded, b) {
+			if (b->index == button->index)
+				button->action_caps = b->action_caps;
+		}
+	}
+
+	profile->needs_load = true;
+}
+
+static int
+hidpp20drv_load_profile(struct ghostcat_profile *profile)
+{
+	struct ghostcat_device *device = profile->device;
+	struct hidpp20drv_data *drv_data = ghostcat_get_drv_data(device);
+	int rc;
+
+	log_debug(device->ratbag, "loading profile %d\n", profile->index);
+
+	rc = hidpp20_onboard_profiles_load_profile(drv_data->dev,
+						   drv_data->profiles,
+						   profile->index);
+	if (rc < 0)
+		return rc;
+
+	hidpp20drv_read_profile(profile);
+
+	return 0;
+}
+
 static int
 hidpp20drv_init_feature(struct ghostcat_device *device, uint16_t feature)
 {
@@ -1423,6 +1636,10 @@ hidpp20drv_init_feature(struct ghostcat_device *device, uint16_t feature)
 
 		/* we read the profile once to get the correct number of
 		 * supported report rates. */
+		/* 0x8061 supersedes this feature */
+		if (drv_data->capabilities & HIDPP_CAP_EXTENDED_REPORT_RATE_8061)
+			break;
+
 		rc = hidpp20drv_read_report_rate_8060(device);
 		if (rc < 0)
 			return 0; /* this is not a hard failure */
@@ -1430,6 +1647,16 @@ hidpp20drv_init_feature(struct ghostcat_device *device, uint16_t feature)
 		drv_data->capabilities |= HIDPP_CAP_ADJUSTABLE_REPORT_RATE_8060;
 		break;
 	}
+	case HIDPP_PAGE_EXTENDED_ADJUSTABLE_REPORT_RATE: {
+		log_debug(ratbag, "device has extended adjustable report rate\n");
+
+		rc = hidpp20drv_read_report_rate_8061(device);
+		if (rc < 0)
+			return 0; /* this is not a hard failure */
+
+		drv_data->capabilities |= HIDPP_CAP_EXTENDED_REPORT_RATE_8061;
+		break;
+	}
 	case HIDPP_PAGE_COLOR_LED_EFFECTS: {
 		/* The 8070 feature implemented in the G602 doesn't follow the spec,
 		 * so we ignore it */
@@ -1457,6 +1684,16 @@ hidpp20drv_init_feature(struct ghostcat_device *device, uint16_t feature)
 
 		break;
 	}
+	case HIDPP_PAGE_PER_KEY_LIGHTING: {
+		rc = hidpp20_per_key_lighting_get_zones(drv_data->dev,
+							drv_data->key_zones);
+		if (rc)
+			return 0; /* this is not a hard failure */
+
+		log_debug(ratbag, "device has per-key lighting\n");
+		drv_data->capabilities |= HIDPP_CAP_PER_KEY_LIGHTING_8081;
+		break;
+	}
 	case HIDPP_PAGE_ONBOARD_PROFILES: {
 		log_debug(ratbag, "device has onboard profiles\n");
 		drv_data->capabilities |= HIDPP_CAP_ONBOARD_PROFILES_8100;
@@ -1482,11 +1719,16 @@ hidpp20drv_commit(struct ghostcat_device *device)
 	struct ghostcat_resolution *resolution;
 	int rc;
 
+	/* libghostcat keeps the changes until the device reconnects */
+	rc = hidpp20_device_check_link(drv_data->dev);
+	if (rc)
+		return rc;
+
 	list_for_each(profile, &device->profiles, link) {
 		if (!profile->dirty)
 			continue;
 
-		if (profile->rate_dirty) {
+		if (profile->dirty & GHOSTCAT_PROFILE_DIRTY_RATE) {
 			rc = hidpp20drv_update_report_rate(profile, profile->hz);
 			if (rc) {
 				log_error(device->ratbag, "hidpp20: failed to update report rate (%d)\n", rc);
@@ -1495,6 +1737,9 @@ hidpp20drv_commit(struct ghostcat_device *device)
 		}
 
 		ghostcat_profile_for_each_resolution(profile, resolution) {
+			if (!resolution->dirty)
+				continue;
+
 			rc = hidpp20drv_update_resolution_dpi(resolution,
 							      resolution->dpi_x,
 							      resolution->dpi_y);
@@ -1528,20 +1773,41 @@ hidpp20drv_commit(struct ghostcat_device *device)
 	}
 
 	if (drv_data->capabilities & HIDPP_CAP_ONBOARD_PROFILES_8100) {
-		list_for_each(profile, &device->profiles, link)
-			drv_data->profiles->profiles[profile->index].enabled = profile->is_enabled;
+		list_for_each(profile, &device->profiles, link) {
+			struct hidpp20_profile *h_profile = &drv_data->profiles->profiles[profile->index];
+
+			h_profile->enabled = profile->is_enabled;
+			if (ghostcat_profile_has_stored_changes(profile))
+				h_profile->dirty = 1;
+		}
 
 		rc = hidpp20_onboard_profiles_commit(drv_data->dev,
 						     drv_data->profiles);
 		if (rc) {
 			log_error(device->ratbag, "hidpp20: failed to commit profile (%d)\n", rc);
+			/* we don't know how far the write got, the next
+			 * commit compares against what is on the device */
+			hidpp20_onboard_profiles_drop_cache(drv_data->profiles);
 			return GHOSTCAT_ERROR_DEVICE;
 		}
 
 		list_for_each(profile, &device->profiles, link) {
 			if (profile->is_active) {
+				/* the profile caps out at 1000Hz, set the real
+				 * rate once the profile has been written */
+				if ((drv_data->capabilities & HIDPP_CAP_EXTENDED_REPORT_RATE_8061) &&
+				    (profile->dirty & GHOSTCAT_PROFILE_DIRTY_RATE)) {
+					rc = hidpp20drv_update_report_rate_8061(device, profile->hz);
+					if (rc)
+						log_error(device->ratbag, "hidpp20: failed to update report rate (%d)\n", rc);
+				}
+
+				/* writing the profile resets the current
+				 * resolution to the default one */
 				ghostcat_profile_for_each_resolution(profile, resolution) {
-					if (resolution->is_active)
+					if (resolution->is_active &&
+					    (ghostcat_profile_has_stored_changes(profile) ||
+					     resolution->dirty & GHOSTCAT_RESOLUTION_DIRTY_ACTIVE))
 						hidpp20_onboard_profiles_set_current_dpi_index(drv_data->dev,
 											       resolution->index);
 				}
@@ -1629,11 +1895,83 @@ hidpp20drv_remove(struct ghostcat_device *device)
 	free(drv_data);
 }
 
+/*
+ * The 0x8081 zones of a full-size keyboard laid out like the keys: the
+ * zone is the key's HID usage - 3, the modifiers are 104-111. Columns 0-14
+ * are the main block, 15-17 the navigation block and 18-21 the keypad.
+ * Tenkeyless and smaller keyboards lack some of these zones, their cells
+ * stay empty.
+ */
+#define HIDPP20_KEY_GRID_WIDTH 22
+#define HIDPP20_KEY_GRID_HEIGHT 6
+
+static const uint8_t hidpp20drv_key_grid[HIDPP20_KEY_GRID_HEIGHT][HIDPP20_KEY_GRID_WIDTH] = {
+	/* Esc, F1-F12, PrtSc, ScrLk, Pause */
+	{ 38, 0, 55, 56, 57, 58, 59, 60, 61, 62, 63, 64, 65, 66, 0, 67, 68, 69, 0, 0, 0, 0 },
+	/* `, 1-0, -, =, Backspace, Ins, Home, PgUp, NumLk, /, *, - */
+	{ 50, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 42, 43, 39, 0, 70, 71, 72, 80, 81, 82, 83 },
+	/* Tab, Q-P, [, ], \, Del, End, PgDn, 7, 8, 9, + */
+	{ 40, 17, 23, 5, 18, 20, 25, 21, 9, 15, 16, 44, 45, 46, 0, 73, 74, 75, 92, 93, 94, 84 },
+	/* Caps, A-L, ;, ', ISO #, Enter, 4, 5, 6 */
+	{ 54, 1, 19, 4, 6, 7, 8, 10, 11, 12, 48, 49, 47, 37, 0, 0, 0, 0, 89, 90, 91, 0 },
+	/* LShift, ISO \, Z-M, ",", ., /, RShift, Up, 1, 2, 3, Enter */
+	{ 105, 97, 26, 24, 3, 22, 2, 14, 13, 51, 52, 53, 109, 0, 0, 0, 79, 0, 86, 87, 88, 85 },
+	/* LCtrl, LGui, LAlt, Space, RAlt, RGui, Menu, RCtrl, Left, Down, Right, 0, . */
+	{ 104, 107, 106, 0, 0, 0, 41, 0, 0, 0, 110, 111, 98, 108, 0, 77, 78, 76, 95, 0, 96, 0 },
+};
+
+static inline bool
+hidpp20drv_has_key_zone(struct hidpp20drv_data *drv_data, unsigned int zone)
+{
+	return zone != 0 && (drv_data->key_zones[zone / 8] & (1 << (zone % 8)));
+}
+
+/* Lays the keys of the device out in the grid above, zones not in the
+ * grid (logo, media keys, G-keys...) are appended in extra rows */
+static void
+hidpp20drv_init_keys(struct ghostcat_device *device,
+		     struct hidpp20drv_data *drv_data)
+{
+	uint16_t layout[HIDPP20_PER_KEY_LIGHTING_MAX_ZONES +
+			HIDPP20_KEY_GRID_WIDTH * HIDPP20_KEY_GRID_HEIGHT] = {0};
+	bool in_grid[HIDPP20_PER_KEY_LIGHTING_MAX_ZONES] = {false};
+	unsigned int cell = 0, num_keys = 0, height;
+
+	for (unsigned int y = 0; y < HIDPP20_KEY_GRID_HEIGHT; y++) {
+		for (unsigned int x = 0; x < HIDPP20_KEY_GRID_WIDTH; x++, cell++) {
+			uint8_t zone = hidpp20drv_key_grid[y][x];
+
+			if (!hidpp20drv_has_key_zone(drv_data, zone))
+				continue;
+
+			layout[cell] = zone;
+			in_grid[zone] = true;
+			num_keys++;
+		}
+	}
+
+	for (unsigned int zone = 1; zone < HIDPP20_PER_KEY_LIGHTING_MAX_ZONES; zone++) {
+		if (!hidpp20drv_has_key_zone(drv_data, zone) || in_grid[zone])
+			continue;
+
+		layout[cell++] = zone;
+		num_keys++;
+	}
+
+	if (num_keys == 0)
+		return;
+
+	height = (cell + HIDPP20_KEY_GRID_WIDTH - 1) / HIDPP20_KEY_GRID_WIDTH;
+
+	log_debug(device->ratbag, "%d keys with per-key lighting\n", num_keys);
+	ghostcat_device_init_keys(device, HIDPP20_KEY_GRID_WIDTH, height, layout);
+}
+
 static void
 hidpp20drv_init_device(struct ghostcat_device *device,
 		       struct hidpp20drv_data *drv_data)
 {
-	struct ghostcat_profile *profile;
+	struct ghostcat_profile *profile, *loaded = NULL;
 	bool active_profile = false;
 	int num;
 
@@ -1655,8 +1993,28 @@ hidpp20drv_init_device(struct ghostcat_device *device,
 				    drv_data->num_buttons,
 				    drv_data->num_leds);
 
-	ghostcat_device_for_each_profile(device, profile)
+	/* With onboard profiles only the active profile was read during
+	 * probe, the others are deferred until a client touches them */
+	ghostcat_device_for_each_profile(device, profile) {
+		if (drv_data->capabilities & HIDPP_CAP_ONBOARD_PROFILES_8100 &&
+		    !drv_data->profiles->profiles[profile->index].loaded)
+			continue;
+
 		hidpp20drv_read_profile(profile);
+		if (!loaded)
+			loaded = profile;
+	}
+
+	ghostcat_device_for_each_profile(device, profile) {
+		if (!(drv_data->capabilities & HIDPP_CAP_ONBOARD_PROFILES_8100) ||
+		    drv_data->profiles->profiles[profile->index].loaded)
+			continue;
+
+		if (loaded)
+			hidpp20drv_defer_profile_8100(profile, loaded);
+		else
+			hidpp20drv_load_profile(profile);
+	}
 
 	if (drv_data->capabilities & HIDPP_CAP_ONBOARD_PROFILES_8100) {
 		/* Fallback to the first profile if no profile is active */
@@ -1669,6 +2027,9 @@ hidpp20drv_init_device(struct ghostcat_device *device,
 			profile->is_active = true;
 		}
 	}
+
+	if (drv_data->capabilities & HIDPP_CAP_PER_KEY_LIGHTING_8081)
+		hidpp20drv_init_keys(device, drv_data);
 }
 
 static int
@@ -1686,8 +2047,10 @@ hidpp20drv_probe(struct ghostcat_device *device)
 
 	drv_data = zalloc(sizeof(*drv_data));
 	ghostcat_set_drv_data(device, drv_data);
-	hidpp_device_init(&base, device->hidraw[0].fd);
+	ghostcat_hidraw_init_hidpp_device(device, &base);
 	hidpp_device_set_log_handler(&base, hidpp20_log, HIDPP_LOG_PRIORITY_RAW, device);
+	base.rtt = &device->rtt;
+	base.stats = &device->stats;
 
 	device_idx = ghostcat_device_data_hidpp20_get_index(device->data);
 	if (device_idx == -1)
@@ -1743,6 +2106,9 @@ hidpp20drv_refresh_active_resolution(struct ghostcat_device *device)
 	int dpi_index;
 	int changed = 0;
 
+	if (hidpp20_device_check_link(drv_data->dev))
+		return 0;
+
 	if (!(drv_data->capabilities & HIDPP_CAP_ONBOARD_PROFILES_8100))
 		return 0;
 
@@ -1770,6 +2136,298 @@ hidpp20drv_refresh_active_resolution(struct ghostcat_device *device)
 	return changed;
 }
 
+static int
+hidpp20drv_save_image(struct ghostcat_device *device,
+		      struct ghostcat_image *image)
+{
+	struct hidpp20drv_data *drv_data = ghostcat_get_drv_data(device);
+	struct hidpp20_profiles *profiles = drv_data->profiles;
+	_cleanup_free_ uint8_t *data = NULL;
+	unsigned int i;
+	uint16_t sector;
+	int rc;
+
+	if (!(drv_data->capabilities & HIDPP_CAP_ONBOARD_PROFILES_8100))
+		return -ENOTSUP;
+
+	rc = hidpp20_device_check_link(drv_data->dev);
+	if (rc)
+		return rc;
+
+	data = hidpp20_onboard_profiles_allocate_sector(profiles);
+
+	/* The directory goes last so that applying the image never points
+	 * it at profiles that have not been written yet */
+	for (i = 1; i <= profiles->sector_count; i++) {
+		sector = i % profiles->sector_count;
+
+		rc = hidpp20_onboard_profiles_read_image_sector(drv_data->dev,
+								profiles,
+								sector,
+								data);
+		/* unused sectors have no valid CRC or can't be read at all */
+		if (rc == -ENODATA || rc > 0) {
+			log_debug(device->ratbag, "hidpp20: skipping sector 0x%04x\n", sector);
+			continue;
+		}
+		if (rc)
+			return rc;
+
+		ghostcat_image_add_blob(image, GHOSTCAT_IMAGE_BLOB_HIDPP20_SECTOR,
+					sector, data, profiles->sector_size);
+	}
+
+	return 0;
+}
+
+static int
+hidpp20drv_apply_image(struct ghostcat_device *device,
+		       struct ghostcat_image *image)
+{
+	struct hidpp20drv_data *drv_data = ghostcat_get_drv_data(device);
+	struct hidpp20_profiles *profiles = drv_data->profiles;
+	struct ghostcat_image_blob blob;
+	struct ghostcat_profile *profile;
+	unsigned int written = 0, skipped = 0;
+	int rc;
+
+	if (!(drv_data->capabilities & HIDPP_CAP_ONBOARD_PROFILES_8100))
+		return -ENOTSUP;
+
+	rc = hidpp20_device_check_link(drv_data->dev);
+	if (rc)
+		return rc;
+
+	/* blobs are skipped if they match the device, not what we last
+	 * read from it */
+	hidpp20_onboard_profiles_drop_cache(profiles);
+
+	while ((rc = ghostcat_image_next_blob(image, &blob)) > 0) {
+		if (blob.type != GHOSTCAT_IMAGE_BLOB_HIDPP20_SECTOR ||
+		    blob.size != profiles->sector_size ||
+		    blob.id >= profiles->sector_count) {
+			log_error(device->ratbag, "hidpp20: invalid image blob %u/0x%04x\n",
+				  blob.type, blob.id);
+			return -EINVAL;
+		}
+
+		rc = hidpp20_onboard_profiles_apply_sector(drv_data->dev,
+							   profiles,
+							   blob.id,
+							   blob.data);
+		if (rc < 0) {
+			log_error(device->ratbag, "hidpp20: failed to write sector 0x%04x (%d)\n",
+				  blob.id, rc);
+			return rc;
+		}
+
+		if (rc)
+			written++;
+		else
+			skipped++;
+	}
+	if (rc < 0)
+		return rc;
+
+	log_debug(device->ratbag, "hidpp20: image applied, %u sectors written, %u up to date\n",
+		  written, skipped);
+
+	rc = hidpp20_onboard_profiles_initialize(drv_data->dev, profiles);
+	if (rc < 0)
+		return rc;
+
+	list_for_each(profile, &device->profiles, link) {
+		if (profiles->profiles[profile->index].loaded) {
+			hidpp20drv_read_profile(profile);
+			profile->needs_load = false;
+			continue;
+		}
+
+		profile->is_enabled = profiles->profiles[profile->index].enabled;
+		profile->is_active = false;
+		hidpp20drv_clear_resolution_flags(profile);
+		profile->needs_load = true;
+	}
+
+	return 0;
+}
+
+static int
+hidpp20drv_show_leds(struct ghostcat_device *device,
+		     const struct ghostcat_color *colors,
+		     uint32_t changed)
+{
+	struct hidpp20drv_data *drv_data = ghostcat_get_drv_data(device);
+	struct ghostcat_profile *profile;
+	struct ghostcat_led *led;
+	int rc;
+
+	/* 0x8071 and 0x1300 have no single-zone RAM write we could use */
+	if (!(drv_data->capabilities & HIDPP_CAP_COLOR_LED_EFFECTS_8070))
+		return -ENOTSUP;
+
+	/* The zones are written to RAM only, the flash would wear out and
+	 * a reset brings back the configured effect anyway */
+	if (colors) {
+		for (unsigned int i = 0; i < device->num_leds; i++) {
+			struct hidpp20_led h_led = {
+				.mode = HIDPP20_LED_ON,
+				.color.red = colors[i].red,
+				.color.green = colors[i].green,
+				.color.blue = colors[i].blue,
+				.brightness = 100,
+			};
+
+			if (!(changed & (1U << i)))
+				continue;
+
+			rc = hidpp20_color_led_effects_set_zone_effect(drv_data->dev, i,
+								       h_led, false);
+			if (rc)
+				return rc;
+		}
+
+		return 0;
+	}
+
+	list_for_each(profile, &device->profiles, link) {
+		if (!profile->is_active)
+			continue;
+
+		ghostcat_profile_for_each_led(profile, led) {
+			struct hidpp20_led h_led = {
+				.color.red = led->color.red,
+				.color.green = led->color.green,
+				.color.blue = led->color.blue,
+				.period = led->ms,
+				.brightness = led->brightness * 100 / 255,
+			};
+
+			switch (led->mode) {
+			case GHOSTCAT_LED_ON:
+				h_led.mode = HIDPP20_LED_ON;
+				break;
+			case GHOSTCAT_LED_CYCLE:
+				h_led.mode = HIDPP20_LED_CYCLE;
+				break;
+			case GHOSTCAT_LED_BREATHING:
+				h_led.mode = HIDPP20_LED_BREATHING;
+				break;
+			default:
+				h_led.mode = HIDPP20_LED_OFF;
+				break;
+			}
+
+			rc = hidpp20_color_led_effects_set_zone_effect(drv_data->dev,
+								       led->index,
+								       h_led, false);
+			if (rc)
+				return rc;
+		}
+	}
+
+	return 0;
+}
+
+static int
+hidpp20drv_compare_key_colors(const void *a, const void *b)
+{
+	const struct ghostcat_key_color *ka = a, *kb = b;
+
+	if (ka->color.red != kb->color.red)
+		return ka->color.red < kb->color.red ? -1 : 1;
+	if (ka->color.green != kb->color.green)
+		return ka->color.green < kb->color.green ? -1 : 1;
+	if (ka->color.blue != kb->color.blue)
+		return ka->color.blue < kb->color.blue ? -1 : 1;
+
+	return ka->key - kb->key;
+}
+
+/*
+ * Keys that share a color go out in 13-key single value writes, what's
+ * left is packed 4 keys per individual write. A solid frame of 105 keys
+ * takes 9 writes and the frame end, one of distinct colors 27.
+ */
+static int
+hidpp20drv_write_keys(struct ghostcat_device *device,
+		      const struct ghostcat_key_color *keys,
+		      unsigned int num_keys)
+{
+	struct hidpp20drv_data *drv_data = ghostcat_get_drv_data(device);
+	struct ghostcat_key_color sorted[HIDPP20_PER_KEY_LIGHTING_MAX_ZONES];
+	struct hidpp20_key_color individual[HIDPP20_PER_KEY_LIGHTING_INDIVIDUAL_MAX];
+	uint8_t zones[HIDPP20_PER_KEY_LIGHTING_SINGLE_VALUE_MAX];
+	unsigned int num_individual = 0;
+	unsigned int i = 0;
+	int rc;
+
+	assert(num_keys <= ARRAY_LENGTH(sorted));
+
+	memcpy(sorted, keys, num_keys * sizeof(*keys));
+	qsort(sorted, num_keys, sizeof(*sorted), hidpp20drv_compare_key_colors);
+
+	while (i < num_keys) {
+		struct hidpp20_color color = {
+			.red = sorted[i].color.red,
+			.green = sorted[i].color.green,
+			.blue = sorted[i].color.blue,
+		};
+		unsigned int run = 1;
+
+		while (i + run < num_keys &&
+		       sorted[i + run].color.red == sorted[i].color.red &&
+		       sorted[i + run].color.green == sorted[i].color.green &&
+		       sorted[i + run].color.blue == sorted[i].color.blue)
+			run++;
+
+		/* a single value write pays off once it replaces a full
+		 * individual write */
+		while (run >= HIDPP20_PER_KEY_LIGHTING_INDIVIDUAL_MAX) {
+			unsigned int n = min(run, (unsigned int)HIDPP20_PER_KEY_LIGHTING_SINGLE_VALUE_MAX);
+
+			for (unsigned int k = 0; k < n; k++)
+				zones[k] = sorted[i + k].key;
+
+			rc = hidpp20_per_key_lighting_set_single_value(drv_data->dev,
+								       color,
+								       zones, n);
+			if (rc)
+				return rc;
+
+			i += n;
+			run -= n;
+		}
+
+		for (; run > 0; run--, i++) {
+			individual[num_individual++] = (struct hidpp20_key_color) {
+				.zone = sorted[i].key,
+				.color = color,
+			};
+
+			if (num_individual < HIDPP20_PER_KEY_LIGHTING_INDIVIDUAL_MAX)
+				continue;
+
+			rc = hidpp20_per_key_lighting_set_individual(drv_data->dev,
+								     individual,
+								     num_individual);
+			if (rc)
+				return rc;
+			num_individual = 0;
+		}
+	}
+
+	if (num_individual > 0) {
+		rc = hidpp20_per_key_lighting_set_individual(drv_data->dev,
+							     individual,
+							     num_individual);
+		if (rc)
+			return rc;
+	}
+
+	return hidpp20_per_key_lighting_frame_end(drv_data->dev);
+}
+
 struct ghostcat_driver hidpp20_driver = {
 	.name = "Logitech HID++2.0",
 	.id = "hidpp20",
@@ -1778,4 +2436,10 @@ struct ghostcat_driver hidpp20_driver = {
 	.commit = hidpp20drv_commit,
 	.set_active_profile = hidpp20drv_set_current_profile,
 	.refresh_active_resolution = hidpp20drv_refresh_active_resolution,
+	.load_profile = hidpp20drv_load_profile,
+	.load_macro = hidpp20drv_load_macro,
+	.save_image = hidpp20drv_save_image,
+	.apply_image = hidpp20drv_apply_image,
+	.show_leds = hidpp20drv_show_leds,
+	.write_keys = hidpp20drv_write_keys,
 };
@@ -30,7 +30,7 @@ marsgaming_commit_led(struct ghostcat_led *led)
 static int
 marsgaming_commit_profile_report_rate(struct ghostcat_profile *profile)
 {
-	if (!profile->rate_dirty)
+	if (!(profile->dirty & GHOSTCAT_PROFILE_DIRTY_RATE))
 		return 0;
 
 	uint8_t polling_interval = 1000 / ghostcat_profile_get_report_rate(profile);
@@ -34,48 +34,14 @@
  */
 
 #include "config.h"
-#include <assert.h>
 #include <errno.h>
-#include <libevdev/libevdev.h>
 #include <linux/input.h>
-#include <stdlib.h>
 #include <stdint.h>
-#include <string.h>
-#include <math.h>
 
-#include "libghostcat-enums.h"
-#include "libghostcat-private.h"
-#include "libghostcat-hidraw.h"
-#include "libghostcat.h"
-#include "shared-macro.h"
+#include "roccat.h"
 
-#define ROCCAT_PROFILE_MAX          5
-#define ROCCAT_BUTTON_MAX           11 * 2 // (Easy Shift)
-#define ROCCAT_NUM_DPI              5
-#define ROCCAT_LED_MAX              4
-
-#define ROCCAT_MAX_RETRY_READY      10
-
-#define ROCCAT_REPORT_ID_CONFIGURE_PROFILE  4
-#define ROCCAT_REPORT_ID_PROFILE            5
-#define ROCCAT_REPORT_ID_SETTINGS           6
-#define ROCCAT_REPORT_ID_KEY_MAPPING        7
-#define ROCCAT_REPORT_ID_MACRO              8
-
-#define ROCCAT_MAGIC_NUMBER_SETTINGS        0x29
-#define ROCCAT_MAGIC_NUMBER_KEY_MAPPING     0x47
-
-#define ROCCAT_BANK_ID_1    1
-#define ROCCAT_BANK_ID_2    2
-#define ROCCAT_REPORT_SIZE_MACRO_BANK       1026
-
-#define ROCCAT_MACRO_GROUP_NAME_LENGTH  40
-#define ROCCAT_MACRO_NAME_LENGTH        32
-
-#define ROCCAT_CONFIG_SETTINGS      0x80 // (LED and mouse configuration)
-#define ROCCAT_CONFIG_KEY_MAPPING   0x90 // (Buttons configuration)
-
-#define ROCCAT_MAX_MACRO_LENGTH     480
+#define ROCCAT_NUM_DPI  5
+#define ROCCAT_LED_MAX  4
 
 #define ROCCAT_MIN_DPI  100
 #define ROCCAT_MAX_DPI  12000
@@ -85,7 +51,7 @@
 #define ROCCAT_LED_BREATHING        0x03
 #define ROCCAT_LED_PULSING          0x04
 
-unsigned int report_rates[] = { 125, 250, 500, 1000 };
+static unsigned int report_rates[] = { 125, 250, 500, 1000 };
 
 struct color {
 	uint8_t r;
@@ -93,7 +59,7 @@ struct color {
 	uint8_t b;
 } __attribute__((packed));
 
-struct color predefined_led_colors[] = { 
+static const struct color predefined_led_colors[] = {
 	{ 179, 0, 0 }, { 255, 0, 0 }, { 255, 71, 0}, { 255, 106, 0 },
 	{ 255, 157, 71 }, { 248, 232, 0 }, { 246, 255, 78 }, { 201, 255, 78 },
 	{ 185, 255, 78 }, { 132, 255, 78 }, { 0, 255, 0 }, { 0, 207, 55 },
@@ -101,7 +67,7 @@ struct color predefined_led_colors[] = {
 	{ 41, 197, 255 }, { 37, 162, 233 }, { 99, 158, 239 }, { 37, 132, 233 },
 	{ 0, 72, 255 }, { 15, 15, 255 }, { 15, 15, 188 }, { 89, 7, 255 },
 	{ 121, 12, 255 }, { 161, 12, 255 }, { 170, 108, 232 }, { 181, 10, 216 },
-	{ 205, 10, 217 }, { 217, 10, 125 } 
+	{ 205, 10, 217 }, { 217, 10, 125 }
 };
 
 struct led_data {
@@ -130,50 +96,7 @@ struct roccat_settings_report {
 } __attribute__((packed));
 #define ROCCAT_REPORT_SIZE_SETTINGS sizeof(struct roccat_settings_report)
 
-struct roccat_macro {
-	uint8_t reportID;                           // 0x08
-	uint8_t bank;                               // 0x01 or 0x02
-	uint8_t profile;
-	uint8_t button_index;
-	uint8_t repeats;                            // Number of repetition for this macro
-	char group[ROCCAT_MACRO_GROUP_NAME_LENGTH]; // Folder name
-	char name[ROCCAT_MACRO_NAME_LENGTH];
-	uint16_t length;
-	struct {
-		uint8_t keycode;
-		uint8_t flag;                           // Pressed (0x01) or released (0x02)
-		uint16_t time;
-	} keys[ROCCAT_MAX_MACRO_LENGTH];
-} __attribute__((packed));
-
-
-struct button {
-	uint8_t keycode;
-	uint8_t undetermined1;
-	uint8_t undetermined2;
-} __attribute__((packed));
-
-struct roccat_buttons {
-	uint8_t reportID;               // 0x07
-	uint8_t magic_num;              // 0x47
-	uint8_t profile;
-	struct button keys[ROCCAT_BUTTON_MAX];
-	uint16_t checksum;
-} __attribute__((packed));
-#define ROCCAT_REPORT_SIZE_BUTTONS sizeof(struct roccat_buttons)
-
-struct roccat_data {
-	struct roccat_buttons buttons[(ROCCAT_PROFILE_MAX)];
-	struct roccat_settings_report settings[(ROCCAT_PROFILE_MAX)];
-	struct roccat_macro macros[(ROCCAT_PROFILE_MAX)][(ROCCAT_BUTTON_MAX + 1)];
-};
-
-struct roccat_button_mapping {
-	uint8_t raw;
-	struct ghostcat_button_action action;
-};
-
-static struct roccat_button_mapping roccat_button_mapping[] = {
+static const struct roccat_button_mapping roccat_emp_button_mapping[] = {
 	{ 0, BUTTON_ACTION_NONE },
 	{ 1, BUTTON_ACTION_BUTTON(1) },
 	{ 2, BUTTON_ACTION_BUTTON(2) },
@@ -294,566 +217,9 @@ static struct roccat_button_mapping roccat_button_mapping[] = {
 /* FIXME:   { 195, Set profile 5 }, */
 };
 
-static const struct ghostcat_button_action*
-roccat_raw_to_button_action(uint8_t data)
-{
-	struct roccat_button_mapping *mapping;
-
-	ARRAY_FOR_EACH(roccat_button_mapping, mapping) {
-		if (mapping->raw == data)
-			return &mapping->action;
-	}
-
-	return NULL;
-}
-
-static uint8_t
-roccat_button_action_to_raw(const struct ghostcat_button_action *action)
-{
-	struct roccat_button_mapping *mapping;
-
-	ARRAY_FOR_EACH(roccat_button_mapping, mapping) {
-		if (ghostcat_button_action_match(&mapping->action, action))
-			return mapping->raw;
-	}
-
-	return 0;
-}
-
-static inline uint16_t
-roccat_get_unaligned_u16(uint8_t *buf)
-{
-	return (buf[1] << 8) | buf[0];
-}
-
-/**
- * Compute the CRC from buf
- * len should be the length of buf, including the two bytes used for CRC
- */
-static inline uint16_t
-roccat_compute_crc(uint8_t *buf, unsigned int len)
-{
-	unsigned i;
-	uint16_t crc = 0;
-
-	if (len < 3)
-		return 0;
-
-	for (i = 0; i < len - 2; i++) {
-		crc += buf[i];
-	}
-
-	return crc;
-}
-
-/**
- * Returns if the CRC in buf is valid.
- * The CRC is expected to be the last two bytes of buf
- * len should be the length of buf, including the CRC
- */
-static inline int
-roccat_crc_is_valid(struct ghostcat_device *device, uint8_t *buf, unsigned int len)
-{
-	uint16_t crc;
-	uint16_t given_crc;
-
-	if (len < 3)
-		return 0;
-
-	crc = roccat_compute_crc(buf, len);
-
-	given_crc = roccat_get_unaligned_u16(&buf[len - 2]);
-
-	log_debug(device->ratbag,
-		"checksum computed: 0x%04x, checksum given: 0x%04x - %s\n",
-		crc,
-		given_crc,
-		crc == given_crc ? "OK" : "FAIL");
-
-
-	return crc == given_crc;
-}
-
-static int
-roccat_is_ready(struct ghostcat_device *device)
-{
-	uint8_t buf[3] = { 0 };
-	int rc;
-
-	rc = ghostcat_hidraw_get_feature_report(device, ROCCAT_REPORT_ID_CONFIGURE_PROFILE,
-						  buf, sizeof(buf));
-	if (rc < 0)
-		return rc;
-	if (rc != sizeof(buf))
-		return -EIO;
-
-	if (buf[1] == 0x03)
-		msleep(100);
-
-	if (buf[1] == 0x02)
-		return 2;
-
-	return buf[1] == 0x01;
-}
-
-static int
-roccat_wait_ready(struct ghostcat_device *device)
-{
-	unsigned count = 0;
-	int rc;
-
-	msleep(10);
-	while (count < ROCCAT_MAX_RETRY_READY) {
-		rc = roccat_is_ready(device);
-		if (rc < 0)
-			return rc;
-
-		if (rc == 1)
-			return 0;
-
-		if (rc == 2)
-			return 2;
-
-		msleep(10);
-		count++;
-	}
-
-	return -ETIMEDOUT;
-}
-
-static int
-roccat_current_profile(struct ghostcat_device *device)
-{
-	uint8_t buf[3];
-	int ret;
-
-	ret = ghostcat_hidraw_get_feature_report(device, ROCCAT_REPORT_ID_PROFILE, buf,
-						   sizeof(buf));
-	if (ret < 0)
-		return ret;
-
-	if (ret != 3)
-		return -EIO;
-
-	return buf[2];
-}
-
-static int
-roccat_set_current_profile(struct ghostcat_device *device, unsigned int index)
-{
-
-	log_debug(device->ratbag,
-		"'%s' Setting profile %d as active\n",
-		ghostcat_device_get_name(device),
-		index);
-
-	uint8_t buf[] = {ROCCAT_REPORT_ID_PROFILE, 0x03, index};
-	int ret;
-
-	if (index > ROCCAT_PROFILE_MAX)
-		return -EINVAL;
-
-	ret = ghostcat_hidraw_set_feature_report(device, buf[0], buf,
-						   sizeof(buf));
-
-	if (ret < 0)
-		return ret;
-
-	if (ret != sizeof(buf))
-		return -EIO;
-
-	ret = roccat_wait_ready(device);
-	if (ret)
-		log_error(device->ratbag,
-			  "Error while waiting for the device to be ready: %s (%d)\n",
-			  strerror(-ret), ret);
-
-	return ret;
-}
-
-/**
- * Sets the profile and which information we want to get from the mouse
- *
- * @param profile is the index of the profile from which you want the info. But, it is also used as a memory bank
- * identifier when querying a macro. In this case, the first bank can be queried by adding 0x10 to the profile index,
- * and the second bank, by adding 0x20.
- * @param type can be either which information you need (ROCCAT_CONFIG_SETTINGS or ROCCAT_CONFIG_KEY_MAPPING) or
- * it can be used to specify the button from which you want to get the macro.
- */
-static int
-roccat_set_config_profile(struct ghostcat_device *device, uint8_t profile, uint8_t type)
-{
-	uint8_t buf[] = {ROCCAT_REPORT_ID_CONFIGURE_PROFILE, profile, type};
-	int ret;
-/*
-	if (profile > ROCCAT_PROFILE_MAX)
-		return -EINVAL;
-*/
-	ret = ghostcat_hidraw_set_feature_report(device, buf[0], buf,
-						   sizeof(buf));
-	if (ret < 0)
-		return ret;
-
-	if (ret != sizeof(buf))
-		return -EIO;
-
-	ret = roccat_wait_ready(device);
-	if (ret < 0)
-		log_error(device->ratbag,
-			  "Error while waiting for the device to be ready: %s (%d)\n",
-			  strerror(-ret), ret);
-
-	return ret;
-}
-
-static const struct ghostcat_button_action *
-roccat_button_to_action(struct ghostcat_profile *profile,
-			  unsigned int button_index)
-{
-	struct ghostcat_device *device = profile->device;
-	struct roccat_data *drv_data = ghostcat_get_drv_data(device);
-	uint8_t data;
-
-	data = drv_data->buttons[profile->index].keys[button_index].keycode;
-	return roccat_raw_to_button_action(data);
-}
-
-static unsigned int roccat_report_rate_to_index(unsigned int rate) {
-	for(unsigned int i = 0 ; i < ARRAY_LENGTH(report_rates) ; i++) {
-		if(report_rates[i] == rate) {
-			return i;
-		}
-	}
-	return 0;
-}
-
-static int
-roccat_write_profile(struct ghostcat_profile *profile)
-{
-	struct ghostcat_device *device = profile->device;
-	unsigned int index = profile->index;
-	struct ghostcat_resolution *resolution;
-	struct ghostcat_led *led;
-	struct ghostcat_button *button;
-	struct roccat_data *drv_data = ghostcat_get_drv_data(device);
-	struct roccat_settings_report* report;
-	struct roccat_buttons* buttons;
-	struct roccat_macro* macro;
-	uint8_t bank_buf[ROCCAT_REPORT_SIZE_MACRO_BANK] = { 0 };
-	int rc = 0;
-	int i = 0, count = 0;
-
-
-	assert(index <= ROCCAT_PROFILE_MAX);
-
-	report = &drv_data->settings[profile->index];
-	report->reportID = ROCCAT_REPORT_ID_SETTINGS;
-	report->magic_num = ROCCAT_MAGIC_NUMBER_SETTINGS;
-	report->report_rate = roccat_report_rate_to_index(profile->hz);
-
-	report->dpi_mask = 0;
-	ghostcat_profile_for_each_resolution(profile, resolution) {
-		report->xres[resolution->index] = (resolution->dpi_x - 100) / 100;
-		report->yres[resolution->index] = (resolution->dpi_y - 100) / 100;
-
-		if(resolution->is_active) {
-			report->current_dpi = resolution->index;
-		}
-
-		if(resolution->dpi_x != 0 && resolution->dpi_y != 0) {
-			report->dpi_mask += (1 << resolution->index);
-		}
-	}
-	
-	ghostcat_profile_for_each_led(profile, led) {
-		report->leds[led->index].predefined = ROCCAT_USER_DEFINED_COLOR; // Always user defined with libratbag (easier)
-		report->leds[led->index].color.r = led->color.red;
-		report->leds[led->index].color.g = led->color.green;
-		report->leds[led->index].color.b = led->color.blue;
-	
-		// Last LED sets the profile values
-		switch(led->mode) {
-			case GHOSTCAT_LED_OFF:
-				report->led_status = 0xf0;
-				break;
-			case GHOSTCAT_LED_ON:
-				report->led_status = 0xff;
-				break;
-			case GHOSTCAT_LED_CYCLE:
-				report->led_status = 0xff;
-				report->lighting_flow = 1;
-				report->effect_speed = led->ms / 1000;
-				break;
-			case GHOSTCAT_LED_BREATHING:
-				report->led_status = 0xff;
-				report->lighting_effect = ROCCAT_LED_BREATHING;
-				report->effect_speed = led->ms / 1000;
-		}
-	}
-	report->checksum = roccat_compute_crc((uint8_t*)report, ROCCAT_REPORT_SIZE_SETTINGS);
-
-
-	buttons = &drv_data->buttons[profile->index];
-	buttons->reportID = ROCCAT_REPORT_ID_KEY_MAPPING;
-	buttons->magic_num = ROCCAT_MAGIC_NUMBER_KEY_MAPPING;
-	ghostcat_profile_for_each_button(profile, button) {
-		buttons->keys[button->index].keycode = roccat_button_action_to_raw(&button->action);
-		if(button->action.type == GHOSTCAT_BUTTON_ACTION_TYPE_MACRO) {
-			macro = &drv_data->macros[profile->index][button->index];
-			memset(macro, 0, sizeof(struct roccat_macro));
-
-			macro->reportID = ROCCAT_REPORT_ID_MACRO;
-			macro->bank = ROCCAT_BANK_ID_1;
-			macro->profile = profile->index;
-			macro->button_index = button->index;
-			macro->repeats = 0; // No repeats in libratbag
-
-			if(button->action.macro->group) {
-				// Seems no use of group in libratbag
-				strncpy(macro->group, button->action.macro->group, ROCCAT_MACRO_GROUP_NAME_LENGTH); 
-			} else {
-				strncpy(macro->group, "libratbag macros", ROCCAT_MACRO_GROUP_NAME_LENGTH); 
-			}
-			strncpy(macro->name, button->action.macro->name, ROCCAT_MACRO_NAME_LENGTH); 
-
-			for (i = 0; i < MAX_MACRO_EVENTS && count < ROCCAT_MAX_MACRO_LENGTH; i++) {
-				if (button->action.macro->events[i].type == GHOSTCAT_MACRO_EVENT_INVALID)
-					return -EINVAL; /* should not happen, ever */
-
-				if (button->action.macro->events[i].type == GHOSTCAT_MACRO_EVENT_NONE)
-					break;
-
-				/* ignore the first wait */
-				if (button->action.macro->events[i].type == GHOSTCAT_MACRO_EVENT_WAIT &&
-					!count)
-					continue;
-
-				if (button->action.macro->events[i].type == GHOSTCAT_MACRO_EVENT_KEY_PRESSED ||
-					button->action.macro->events[i].type == GHOSTCAT_MACRO_EVENT_KEY_RELEASED) {
-					macro->keys[count].keycode = ghostcat_hidraw_get_keyboard_usage_from_keycode(device, button->action.macro->events[i].event.key);
-				}
-
-				switch (button->action.macro->events[i].type) {
-				case GHOSTCAT_MACRO_EVENT_KEY_PRESSED:
-					macro->keys[count].flag = 0x01;
-					break;
-				case GHOSTCAT_MACRO_EVENT_KEY_RELEASED:
-					macro->keys[count].flag = 0x02;
-					break;
-				case GHOSTCAT_MACRO_EVENT_WAIT:
-					macro->keys[--count].time = button->action.macro->events[i].event.timeout;
-					break;
-				case GHOSTCAT_MACRO_EVENT_INVALID:
-				case GHOSTCAT_MACRO_EVENT_NONE:
-					/* should not happen */
-					log_error(device->ratbag,
-						"something went wrong while writing a macro.\n");
-				}
-				count++;
-			}
-			macro->length = count;
-			
-
-			// Macro has to be send in two packets
-			memcpy(bank_buf, macro, ROCCAT_REPORT_SIZE_MACRO_BANK);
-
-			rc = ghostcat_hidraw_set_feature_report(device, ROCCAT_REPORT_ID_MACRO,
-						  bank_buf, ROCCAT_REPORT_SIZE_MACRO_BANK);    
-			if (rc < 0)
-				return rc;
-
-			if (rc != ROCCAT_REPORT_SIZE_MACRO_BANK)
-				return -EIO;
-
-			rc = roccat_wait_ready(device);
-			if (rc)
-				log_error(device->ratbag,
-					"Error while waiting for the device to be ready: %s (%d)\n",
-					strerror(-rc), rc);
-
-			bank_buf[0] = ROCCAT_REPORT_ID_MACRO;
-			bank_buf[1] = ROCCAT_BANK_ID_2;
-			// The remaining macro structure is not big enough to fill the second bank
-			// Write the remaining, fill the end with 0 
-			unsigned int remaining_to_write = sizeof(struct roccat_macro)-ROCCAT_REPORT_SIZE_MACRO_BANK;
-			memcpy(bank_buf+2, &((uint8_t*)macro)[ROCCAT_REPORT_SIZE_MACRO_BANK], remaining_to_write);
-			memset(bank_buf+2+remaining_to_write, 0, ROCCAT_REPORT_SIZE_MACRO_BANK-(2+remaining_to_write));
-
-			rc = ghostcat_hidraw_set_feature_report(device, ROCCAT_REPORT_ID_MACRO,
-				bank_buf, ROCCAT_REPORT_SIZE_MACRO_BANK);
-			if (rc < 0)
-				return rc;
-
-			if (rc != ROCCAT_REPORT_SIZE_MACRO_BANK)
-				return -EIO;
-
-			rc = roccat_wait_ready(device);
-			if (rc)
-				log_error(device->ratbag,
-					"Error while waiting for the device to be ready: %s (%d)\n",
-					strerror(-rc), rc);
-		}
-	}
-	buttons->checksum = roccat_compute_crc((uint8_t*)buttons, ROCCAT_REPORT_SIZE_BUTTONS);
-
-
-	rc = ghostcat_hidraw_set_feature_report(device, ROCCAT_REPORT_ID_SETTINGS,
-						  (uint8_t*)report, ROCCAT_REPORT_SIZE_SETTINGS);
-
-	if (rc < 0)
-		return rc;
-
-	if (rc != ROCCAT_REPORT_SIZE_SETTINGS)
-		return -EIO;
-
-	rc = roccat_wait_ready(device);
-	if (rc) {
-		log_error(device->ratbag,
-			  "Error while waiting for the device to be ready: %s (%d)\n",
-			  strerror(-rc), rc);
-	}
-
-	rc = ghostcat_hidraw_set_feature_report(device, ROCCAT_REPORT_ID_KEY_MAPPING,
-						  (uint8_t*)buttons, ROCCAT_REPORT_SIZE_BUTTONS);
-
-	if (rc < 0)
-		return rc;
-
-	if (rc != ROCCAT_REPORT_SIZE_BUTTONS)
-		return -EIO;
-
-	rc = roccat_wait_ready(device);
-	if (rc) {
-		log_error(device->ratbag,
-			  "Error while waiting for the device to be ready: %s (%d)\n",
-			  strerror(-rc), rc);
-	}
-
-	log_debug(device->ratbag, "profile: %d written %s:%d\n",
-		profile->index,
-		__FILE__, __LINE__);
-
-	return rc;
-}
-
-static void roccat_read_macro(struct roccat_macro* macro, struct ghostcat_button* button) {
-	struct ghostcat_button_macro *m = NULL;
-	unsigned j, time;
-
-	char name[ROCCAT_MACRO_NAME_LENGTH+1] = { '\0' };
-	strncpy(name, macro->name, ROCCAT_MACRO_NAME_LENGTH);
-
-	m = ghostcat_button_macro_new(name);
-	// libratbag does offer API for macro groups
-	m->macro.group = (char*)zalloc(ROCCAT_MACRO_GROUP_NAME_LENGTH+1);
-	strncpy(m->macro.group, macro->group, ROCCAT_MACRO_GROUP_NAME_LENGTH);
-
-	log_debug(button->profile->device->ratbag,
-		"macro on button %d of profile %d is named '%s' (from folder '%s'), and contains %d events:\n",
-		button->index, button->profile->index,
-		name, m->macro.group, macro->length);
-	// libratbag can't keep track of the whole macro (MAX_MACRO_EVENTS)
-	// In libratbag, each event is implemented as two separate (KEY_PRESS/KEY_RELEASE and WAIT)
-	for (j = 0; j < macro->length && j < MAX_MACRO_EVENTS/2; j++) {
-		unsigned int keycode = ghostcat_hidraw_get_keycode_from_keyboard_usage(button->profile->device,
-						macro->keys[j].keycode);
-		ghostcat_button_macro_set_event(m,
-							j * 2,
-							macro->keys[j].flag & 0x01 ? GHOSTCAT_MACRO_EVENT_KEY_PRESSED : GHOSTCAT_MACRO_EVENT_KEY_RELEASED,
-							keycode);
-		if (macro->keys[j].time)
-			time = macro->keys[j].time;
-		else
-			time = macro->keys[j].flag & 0x01 ? 10 : 50;
-		ghostcat_button_macro_set_event(m,
-							j * 2 + 1,
-							GHOSTCAT_MACRO_EVENT_WAIT,
-							time);
-
-		log_debug(button->profile->device->ratbag,
-			"    - %s %s\n",
-			libevdev_event_code_get_name(EV_KEY, keycode),
-			macro->keys[j].flag == 0x02 ? "released" : "pressed");
-	}
-	ghostcat_button_copy_macro(button, m);
-	ghostcat_button_macro_unref(m);
-}
-
 static void
-roccat_read_button(struct ghostcat_button *button)
-{
-	const struct ghostcat_button_action *action;
-	struct ghostcat_device *device = button->profile->device;
-	struct roccat_data *drv_data = ghostcat_get_drv_data(device);
-	struct roccat_macro *macro;
-	int rc;
-
-	action = roccat_button_to_action(button->profile, button->index);
-	if (action)
-		ghostcat_button_set_action(button, action);
-//  if (action == NULL)
-//      log_error(device->ratbag, "button: %d -> %d %s:%d\n",
-//          button->index, drv_data->profiles[button->profile->index][3 + button->index * 3],
-//          __FILE__, __LINE__);
-
-	ghostcat_button_enable_action_type(button, GHOSTCAT_BUTTON_ACTION_TYPE_BUTTON);
-	ghostcat_button_enable_action_type(button, GHOSTCAT_BUTTON_ACTION_TYPE_SPECIAL);
-	ghostcat_button_enable_action_type(button, GHOSTCAT_BUTTON_ACTION_TYPE_MACRO);
-
-	if (action && action->type == GHOSTCAT_BUTTON_ACTION_TYPE_MACRO) {
-		macro = &drv_data->macros[button->profile->index][button->index];
-
-		// Macros are available through two packets
-		// We read the second one first, to overwrite some useless data (report id) in the final structure
-		roccat_set_config_profile(device,
-					  button->profile->index,
-					  0);
-		roccat_set_config_profile(device,
-					  button->profile->index + 0x20, // When setting for a specific button, the Profile ID is 0x10 (or 0x20 for second bank) * Profile ID + 1
-					  button->index);
-
-		// I know that the second bank will not fit in internal structure, so reducing the data read
-		rc = ghostcat_hidraw_get_feature_report(device, ROCCAT_REPORT_ID_MACRO,
-							  (uint8_t*)macro + ROCCAT_REPORT_SIZE_MACRO_BANK - 2, sizeof(struct roccat_macro) - (ROCCAT_REPORT_SIZE_MACRO_BANK - 2));
-		if (rc != sizeof(struct roccat_macro) - (ROCCAT_REPORT_SIZE_MACRO_BANK - 2)) {
-			log_error(device->ratbag,
-				  "Unable to retrieve the second bank for macro for button %d of profile %d: %s (%d)\n",
-				  button->index, button->profile->index,
-				  rc < 0 ? strerror(-rc) : "not read enough", rc);
-			goto out_macro;
-		}
-
-		roccat_set_config_profile(device,
-					  button->profile->index + 0x10, // When setting for a specific button, the Profile ID is 0x10 * Profile ID + 1
-					  button->index);
-		rc = ghostcat_hidraw_get_feature_report(device, ROCCAT_REPORT_ID_MACRO,
-							  (uint8_t*)macro, ROCCAT_REPORT_SIZE_MACRO_BANK);
-		if (rc != ROCCAT_REPORT_SIZE_MACRO_BANK) {
-			log_error(device->ratbag,
-				  "Unable to retrieve the first bank for macro for button %d of profile %d: %s (%d)\n",
-				  button->index, button->profile->index,
-				  rc < 0 ? strerror(-rc) : "not read enough", rc);
-			goto out_macro;
-		} 
-		
-		if (macro->reportID != ROCCAT_REPORT_ID_MACRO) {
-			log_error(device->ratbag,
-					"Error while reading the macro of button %d of profile %d.\n",
-					button->index,
-					button->profile->index);
-			goto out_macro;
-		}
-		// No checksum for macros
-
-		roccat_read_macro(macro, button);       
-
-out_macro:
-		msleep(10);
-	}
-}
-
-static void
-roccat_read_dpi(struct roccat_settings_report* settings, struct ghostcat_profile* profile)
+roccat_emp_read_dpi(const struct roccat_settings_report *settings,
+		    struct ghostcat_profile *profile)
 {
 	struct ghostcat_resolution *resolution;
 	int dpi_x = 0, dpi_y = 0;
@@ -892,7 +258,8 @@ roccat_read_dpi(struct roccat_settings_report* settings, struct ghostcat_profile
 }
 
 static void
-roccat_read_led(struct roccat_settings_report* settings, struct ghostcat_led *led)
+roccat_emp_read_led(const struct roccat_settings_report *settings,
+		    struct ghostcat_led *led)
 {
 	if(settings->led_status == 0) {
 		led->mode = GHOSTCAT_LED_OFF;
@@ -926,158 +293,113 @@ roccat_read_led(struct roccat_settings_report* settings, struct ghostcat_led *le
 }
 
 static void
-roccat_read_profile(struct ghostcat_profile *profile)
+roccat_emp_read_settings(struct ghostcat_profile *profile,
+			 const uint8_t *report)
 {
-	struct ghostcat_device *device = profile->device;
-	struct roccat_data *drv_data = ghostcat_get_drv_data(device);
-	struct ghostcat_button *button;
+	const struct roccat_settings_report *settings =
+		(const struct roccat_settings_report *)report;
 	struct ghostcat_led *led;
-	struct roccat_settings_report *settings;
-	struct roccat_buttons* buttons;
-	int rc; 
 
-	assert(profile->index <= ROCCAT_PROFILE_MAX);
-
-	// Read data from the mouse
-	settings = &drv_data->settings[profile->index];
-	roccat_set_config_profile(device, profile->index, ROCCAT_CONFIG_SETTINGS);
-	rc = ghostcat_hidraw_get_feature_report(device, ROCCAT_REPORT_ID_SETTINGS,
-						  (uint8_t*)settings, ROCCAT_REPORT_SIZE_SETTINGS);
-
-	if (rc < (int)ROCCAT_REPORT_SIZE_SETTINGS) {
-		return;
-	}
-
-	if (!roccat_crc_is_valid(device, (uint8_t*)settings, ROCCAT_REPORT_SIZE_SETTINGS)) {
-		log_error(device->ratbag,
-			  "Error while reading settings from profile %d, checksum invalid, continuing...\n",
-			  profile->index);
-	}
-
-	buttons = &drv_data->buttons[profile->index];
-	roccat_set_config_profile(device, profile->index, ROCCAT_CONFIG_KEY_MAPPING);
-	rc = ghostcat_hidraw_get_feature_report(device, ROCCAT_REPORT_ID_KEY_MAPPING,
-						  (uint8_t*)buttons, ROCCAT_REPORT_SIZE_BUTTONS);
-
-	if (rc < (int)ROCCAT_REPORT_SIZE_BUTTONS) {
-		return;
-	}
-
-	if (!roccat_crc_is_valid(device, (uint8_t*)buttons, ROCCAT_REPORT_SIZE_BUTTONS)) {
-		log_error(device->ratbag,
-			  "Error while reading buttons from profile %d, checksum invalid, continuing...\n",
-			  profile->index);
-	}
+	roccat_emp_read_dpi(settings, profile);
+	ghostcat_profile_for_each_led(profile, led)
+		roccat_emp_read_led(settings, led);
+}
 
-	// Feed libratbag with the data
-	roccat_read_dpi(settings, profile);
-	ghostcat_profile_for_each_led(profile, led) {
-		roccat_read_led(settings, led);
+static unsigned int
+roccat_report_rate_to_index(unsigned int rate)
+{
+	for (unsigned int i = 0; i < ARRAY_LENGTH(report_rates); i++) {
+		if (report_rates[i] == rate)
+			return i;
 	}
 
-	// Buttons were read from the buffer that was yet un-initialized with the device data.
-	ghostcat_profile_for_each_button(profile, button)
-		roccat_read_button(button);
-
-	
-	log_debug(device->ratbag, "profile: %d %s:%d\n",
-		settings->profile,
-		__FILE__, __LINE__);
+	return 0;
 }
 
 static int
-roccat_probe(struct ghostcat_device *device)
+roccat_emp_write_settings(struct ghostcat_profile *profile, uint8_t *report)
 {
-	int rc;
-	struct ghostcat_profile *profile;
-	struct roccat_data *drv_data;
-	int active_idx;
+	struct roccat_settings_report *settings =
+		(struct roccat_settings_report *)report;
+	struct ghostcat_resolution *resolution;
+	struct ghostcat_led *led;
 
-	rc = ghostcat_open_hidraw(device);
-	if (rc)
-		return rc;
+	settings->report_rate = roccat_report_rate_to_index(profile->hz);
 
-	if (!ghostcat_hidraw_has_report(device, ROCCAT_REPORT_ID_KEY_MAPPING)) {
-		ghostcat_close_hidraw(device);
-		return -ENODEV;
-	}
+	settings->dpi_mask = 0;
+	ghostcat_profile_for_each_resolution(profile, resolution) {
+		if (resolution->is_active)
+			settings->current_dpi = resolution->index;
 
-	drv_data = zalloc(sizeof(*drv_data));
-	ghostcat_set_drv_data(device, drv_data);
+		/* a disabled resolution keeps its last value */
+		if (resolution->dpi_x == 0 || resolution->dpi_y == 0)
+			continue;
 
-	ghostcat_device_init_profiles(device,
-					ROCCAT_PROFILE_MAX,
-					ROCCAT_NUM_DPI,
-					ROCCAT_BUTTON_MAX,
-					ROCCAT_LED_MAX);
+		if (resolution->dpi_x < ROCCAT_MIN_DPI || resolution->dpi_x > ROCCAT_MAX_DPI ||
+		    resolution->dpi_y < ROCCAT_MIN_DPI || resolution->dpi_y > ROCCAT_MAX_DPI)
+			return -EINVAL;
 
-	ghostcat_device_for_each_profile(device, profile) {
-		roccat_read_profile(profile);
+		settings->xres[resolution->index] = (resolution->dpi_x - 100) / 100;
+		settings->yres[resolution->index] = (resolution->dpi_y - 100) / 100;
+		settings->dpi_mask |= 1 << resolution->index;
 	}
 
-	active_idx = roccat_current_profile(device);
-	if (active_idx < 0) {
-		log_error(device->ratbag,
-			  "Can't talk to the mouse: '%s' (%d)\n",
-			  strerror(-active_idx),
-			  active_idx);
-		rc = -ENODEV;
-		goto err;
-	}
+	ghostcat_profile_for_each_led(profile, led) {
+		settings->leds[led->index].predefined = ROCCAT_USER_DEFINED_COLOR; // Always user defined with libratbag (easier)
+		settings->leds[led->index].color.r = led->color.red;
+		settings->leds[led->index].color.g = led->color.green;
+		settings->leds[led->index].color.b = led->color.blue;
 
-	ghostcat_device_for_each_profile(device, profile) {
-		if (profile->index == (unsigned int)active_idx) {
-			profile->is_active = true;
+		// Last LED sets the profile values
+		switch (led->mode) {
+		case GHOSTCAT_LED_OFF:
+			settings->led_status = 0xf0;
+			break;
+		case GHOSTCAT_LED_ON:
+			settings->led_status = 0xff;
+			break;
+		case GHOSTCAT_LED_CYCLE:
+			settings->led_status = 0xff;
+			settings->lighting_flow = 1;
+			settings->effect_speed = led->ms / 1000;
+			break;
+		case GHOSTCAT_LED_BREATHING:
+			settings->led_status = 0xff;
+			settings->lighting_effect = ROCCAT_LED_BREATHING;
+			settings->effect_speed = led->ms / 1000;
 			break;
 		}
 	}
 
-	log_debug(device->ratbag,
-		"'%s' is in profile %d\n",
-		ghostcat_device_get_name(device),
-		profile->index);
-
 	return 0;
-
-err:
-	free(drv_data);
-	ghostcat_set_drv_data(device, NULL);
-	return rc;
 }
 
-static int
-roccat_commit(struct ghostcat_device *device)
-{
-	struct ghostcat_profile *profile;
-	int rc = 0;
-
-	list_for_each(profile, &device->profiles, link) {
-		if (!profile->dirty)
-			continue;
-
-		log_debug(device->ratbag,
-			  "Profile %d changed, rewriting\n", profile->index);
-
-		rc = roccat_write_profile(profile);
-		if (rc)
-			return rc;
-	}
-
-	return 0;
-}
+static const struct roccat_model roccat_emp_model = {
+	.num_profiles = 5,
+	.num_buttons = 11 * 2, /* (Easy Shift) */
+	.num_resolutions = ROCCAT_NUM_DPI,
+	.num_leds = ROCCAT_LED_MAX,
+	.settings_size = ROCCAT_REPORT_SIZE_SETTINGS,
+	.settings_checksum = true,
+	.macro_format = ROCCAT_MACRO_FORMAT_BANKED,
+	.button_mapping = roccat_emp_button_mapping,
+	.num_button_mapping = ARRAY_LENGTH(roccat_emp_button_mapping),
+	.read_settings = roccat_emp_read_settings,
+	.write_settings = roccat_emp_write_settings,
+};
 
-static void
-roccat_remove(struct ghostcat_device *device)
+static int
+roccat_emp_probe(struct ghostcat_device *device)
 {
-	ghostcat_close_hidraw(device);
-	free(ghostcat_get_drv_data(device));
+	return roccat_probe(device, &roccat_emp_model);
 }
 
 struct ghostcat_driver roccat_emp_driver = {
 	.name = "Roccat Kone EMP",
 	.id = "roccat-kone-emp",
-	.probe = roccat_probe,
+	.probe = roccat_emp_probe,
 	.remove = roccat_remove,
 	.commit = roccat_commit,
-	.set_active_profile = roccat_set_current_profile,
+	.set_active_profile = roccat_set_active_profile,
+	.load_macro = roccat_load_macro,
 };
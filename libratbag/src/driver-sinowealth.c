@@ -26,6 +26,7 @@
 #include "libghostcat-data.h"
 #include "libghostcat-private.h"
 #include "libghostcat-hidraw.h"
+#include "libghostcat-image.h"
 #include "shared-macro.h"
 
 enum sinowealth_report_id {
@@ -132,10 +133,6 @@ static const unsigned int SINOWEALTH_DEBOUNCE_TIMES[] = {
 	4, 6, 8, 10, 12, 14, 16
 };
 
-static const unsigned int SINOWEALTH_REPORT_RATES[] = {
-	125, 250, 500, 1000
-};
-
 /* Bit mask for @ref sinowealth_config_report.config.
  *
  * This naming may be incorrect as it's not actually known what the other bits do.
@@ -483,6 +480,7 @@ struct sinowealth_data {
 	unsigned int config_size;
 	unsigned int led_count;
 	unsigned int profile_count;
+	unsigned int max_report_rate;
 	bool button_key_action_instead_of_macro[SINOWEALTH_NUM_BUTTONS_MAX];
 	struct sinowealth_button_report buttons[SINOWEALTH_NUM_PROFILES_MAX];
 	struct sinowealth_config_report configs[SINOWEALTH_NUM_PROFILES_MAX];
@@ -665,6 +663,10 @@ static const struct sinowealth_report_rate_mapping sinowealth_report_rate_map[]
 	{ 0x2, 250 },
 	{ 0x3, 500 },
 	{ 0x4, 1000 },
+	/* Only on devices with `MaxReportRate` set in the device file. */
+	{ 0x5, 2000 },
+	{ 0x6, 4000 },
+	{ 0x7, 8000 },
 };
 
 /* @return Internal report rate representation or 0 on error. */
@@ -1794,6 +1796,18 @@ sinowealth_init_profile(struct ghostcat_device *device)
 
 	drv_data->led_type = device_data->led_type;
 
+	rc = device_data->max_report_rate;
+	if (rc == -1) {
+		drv_data->max_report_rate = 1000;
+	} else if (sinowealth_report_rate_to_raw((unsigned int)rc) == 0) {
+		log_error(device->ratbag,
+			  "Device file for firmware version %s specifies unsupported maximum report rate: %d\n",
+			  fw_version, rc);
+		return -EINVAL;
+	} else {
+		drv_data->max_report_rate = (unsigned int)rc;
+	}
+
 	log_info(device->ratbag, "Found device: %s\n", device_data->device_name);
 	log_debug(device->ratbag, "Sensor type: %#x\n", config->sensor_type);
 
@@ -1848,6 +1862,15 @@ sinowealth_init_profile(struct ghostcat_device *device)
 		dpis[i] = SINOWEALTH_DPI_MIN + i * SINOWEALTH_DPI_STEP;
 	}
 
+	/* Generate report rate list */
+	unsigned int report_rates[ARRAY_LENGTH(sinowealth_report_rate_map)];
+	size_t num_report_rates = 0;
+	const struct sinowealth_report_rate_mapping *rate_mapping = NULL;
+	ARRAY_FOR_EACH(sinowealth_report_rate_map, rate_mapping) {
+		if (rate_mapping->report_rate <= drv_data->max_report_rate)
+			report_rates[num_report_rates++] = rate_mapping->report_rate;
+	}
+
 	ghostcat_device_for_each_profile(device, profile) {
 		ghostcat_profile_for_each_button(profile, button) {
 			ghostcat_button_enable_action_type(button, GHOSTCAT_BUTTON_ACTION_TYPE_NONE);
@@ -1864,7 +1887,7 @@ sinowealth_init_profile(struct ghostcat_device *device)
 		}
 
 		/* Set up available report rates. */
-		ghostcat_profile_set_report_rate_list(profile, SINOWEALTH_REPORT_RATES, ARRAY_LENGTH(SINOWEALTH_REPORT_RATES));
+		ghostcat_profile_set_report_rate_list(profile, report_rates, num_report_rates);
 
 		/* Set up LED capabilities */
 		if (drv_data->led_count > 0) {
@@ -1902,61 +1925,55 @@ sinowealth_test_hidraw(struct ghostcat_device *device)
 	return 0;
 }
 
-/* Write raw button configuration data in drv_data to the mouse.
+/* Write raw button configuration data of profile `profile_index` in drv_data to the mouse.
  *
  * @return 0 on success or a negative errno.
  */
 static int
-sinowealth_write_buttons(struct ghostcat_device *device)
+sinowealth_write_buttons(struct ghostcat_device *device, size_t profile_index)
 {
 	int rc = 0;
 
 	struct sinowealth_data *drv_data = device->drv_data;
+	struct sinowealth_button_report *buttons = &drv_data->buttons[profile_index];
 
 	const uint8_t config_report_id = drv_data->is_long ? SINOWEALTH_REPORT_ID_CONFIG_LONG : SINOWEALTH_REPORT_ID_CONFIG;
 
-	for (size_t profile_index = 0; profile_index < drv_data->profile_count; ++profile_index) {
-		struct sinowealth_button_report *buttons = &drv_data->buttons[profile_index];
-
-		buttons->report_id = config_report_id;
-		buttons->command_id = sinowealth_get_buttons_command(profile_index);
-		buttons->config_write = SINOWEALTH_BUTTON_SIZE - 8;
+	buttons->report_id = config_report_id;
+	buttons->command_id = sinowealth_get_buttons_command(profile_index);
+	buttons->config_write = SINOWEALTH_BUTTON_SIZE - 8;
 
-		rc = sinowealth_query_write(device, (uint8_t*)buttons, sizeof(*buttons));
-		if (rc < 0) {
-			log_error(device->ratbag, "Error while writing buttons: %s (%d)\n", strerror(-rc), rc);
-			return rc;
-		}
+	rc = sinowealth_query_write(device, (uint8_t*)buttons, sizeof(*buttons));
+	if (rc < 0) {
+		log_error(device->ratbag, "Error while writing buttons: %s (%d)\n", strerror(-rc), rc);
+		return rc;
 	}
 
 	return 0;
 }
 
-/* Write raw configuration data in drv_data to the mouse.
+/* Write raw configuration data of profile `profile_index` in drv_data to the mouse.
  *
  * @return 0 on success or a negative errno.
  */
 static int
-sinowealth_write_configs(struct ghostcat_device *device)
+sinowealth_write_config(struct ghostcat_device *device, size_t profile_index)
 {
 	int rc = 0;
 
 	struct sinowealth_data *drv_data = device->drv_data;
+	struct sinowealth_config_report *config = &drv_data->configs[profile_index];
 
 	const uint8_t config_report_id = drv_data->is_long ? SINOWEALTH_REPORT_ID_CONFIG_LONG : SINOWEALTH_REPORT_ID_CONFIG;
 
-	for (size_t profile_index = 0; profile_index < drv_data->profile_count; ++profile_index) {
-		struct sinowealth_config_report *config = &drv_data->configs[profile_index];
-
-		config->report_id = config_report_id;
-		config->command_id = sinowealth_get_config_command(profile_index);
-		config->config_write = (uint8_t)drv_data->config_size - 8;
+	config->report_id = config_report_id;
+	config->command_id = sinowealth_get_config_command(profile_index);
+	config->config_write = (uint8_t)drv_data->config_size - 8;
 
-		rc = sinowealth_query_write(device, (uint8_t*)config, sizeof(*config));
-		if (rc < 0) {
-			log_error(device->ratbag, "Error while writing config %zu: %s (%d)\n", profile_index, strerror(-rc), rc);
-			return rc;
-		}
+	rc = sinowealth_query_write(device, (uint8_t*)config, sizeof(*config));
+	if (rc < 0) {
+		log_error(device->ratbag, "Error while writing config %zu: %s (%d)\n", profile_index, strerror(-rc), rc);
+		return rc;
 	}
 
 	return 0;
@@ -2065,7 +2082,7 @@ sinowealth_update_config_from_profile(struct ghostcat_profile *profile)
 
 	/* Update report rate. */
 	uint8_t reported_rate = sinowealth_report_rate_to_raw(profile->hz);
-	if (reported_rate == 0) {
+	if (reported_rate == 0 || profile->hz > drv_data->max_report_rate) {
 		log_error(device->ratbag, "Incorrect report rate %u was requested\n", profile->hz);
 		return -EINVAL;
 	}
@@ -2142,29 +2159,36 @@ sinowealth_commit(struct ghostcat_device *device)
 	int rc = 0;
 	struct ghostcat_profile *profile = NULL;
 
+	/* Report rate, resolutions and lighting share the config report,
+	 * buttons have a report of their own. Only write what changed. */
 	ghostcat_device_for_each_profile(device, profile) {
-		rc = sinowealth_update_config_from_profile(profile);
-		if (rc)
-			return rc;
-		rc = sinowealth_update_buttons_from_profile(profile);
-		if (rc)
-			return rc;
-	}
-
-	rc = sinowealth_write_configs(device);
-	if (rc)
-		return rc;
+		if (profile->dirty & (GHOSTCAT_PROFILE_DIRTY_RATE |
+				      GHOSTCAT_PROFILE_DIRTY_RESOLUTIONS |
+				      GHOSTCAT_PROFILE_DIRTY_LEDS)) {
+			rc = sinowealth_update_config_from_profile(profile);
+			if (rc)
+				return rc;
+			rc = sinowealth_write_config(device, profile->index);
+			if (rc)
+				return rc;
+		}
 
-	rc = sinowealth_write_buttons(device);
-	if (rc)
-		return rc;
+		if (profile->dirty & GHOSTCAT_PROFILE_DIRTY_BUTTONS) {
+			rc = sinowealth_update_buttons_from_profile(profile);
+			if (rc)
+				return rc;
+			rc = sinowealth_write_buttons(device, profile->index);
+			if (rc)
+				return rc;
+		}
+	}
 
 	rc = sinowealth_write_macros(device);
 	if (rc)
 		return rc;
 
 	ghostcat_device_for_each_profile(device, profile) {
-		if (profile->debounce_dirty) {
+		if (profile->dirty & GHOSTCAT_PROFILE_DIRTY_DEBOUNCE) {
 			rc = sinowealth_set_debounce_time(device, profile->debounce);
 			if (rc)
 				return rc;
@@ -2175,6 +2199,103 @@ sinowealth_commit(struct ghostcat_device *device)
 	return 0;
 }
 
+static int
+sinowealth_save_image(struct ghostcat_device *device, struct ghostcat_image *image)
+{
+	struct sinowealth_data *drv_data = device->drv_data;
+
+	/* The reports are what we read at probe time, not any uncommitted
+	 * changes, those only make it into drv_data on commit. */
+	for (size_t profile_index = 0; profile_index < drv_data->profile_count; ++profile_index) {
+		ghostcat_image_add_blob(image, GHOSTCAT_IMAGE_BLOB_SINOWEALTH_CONFIG, profile_index,
+					&drv_data->configs[profile_index],
+					sizeof(drv_data->configs[profile_index]));
+		ghostcat_image_add_blob(image, GHOSTCAT_IMAGE_BLOB_SINOWEALTH_BUTTONS, profile_index,
+					&drv_data->buttons[profile_index],
+					sizeof(drv_data->buttons[profile_index]));
+	}
+
+	return 0;
+}
+
+/* Write one config or button report from an image unless drv_data already
+ * holds the same data. The first bytes of a report select the command and
+ * differ between reads and writes, so they are not compared.
+ *
+ * @return 0 on success or a negative errno.
+ */
+static int
+sinowealth_apply_report(struct ghostcat_device *device, uint8_t *report, size_t size,
+			const struct ghostcat_image_blob *blob, uint8_t command_id, uint8_t config_write)
+{
+	struct sinowealth_data *drv_data = device->drv_data;
+	const size_t header_size = offsetof(struct sinowealth_button_report, unknown2);
+	int rc;
+
+	if (blob->size != size)
+		return -EINVAL;
+
+	if (memcmp(report + header_size, blob->data + header_size, size - header_size) == 0)
+		return 0;
+
+	memcpy(report, blob->data, size);
+	report[0] = drv_data->is_long ? SINOWEALTH_REPORT_ID_CONFIG_LONG : SINOWEALTH_REPORT_ID_CONFIG;
+	report[1] = command_id;
+	report[3] = config_write;
+
+	rc = sinowealth_query_write(device, report, size);
+	if (rc < 0) {
+		log_error(device->ratbag, "Error while writing image report %u/%u: %s (%d)\n",
+			  blob->type, blob->id, strerror(-rc), rc);
+		return rc;
+	}
+
+	return 0;
+}
+
+static int
+sinowealth_apply_image(struct ghostcat_device *device, struct ghostcat_image *image)
+{
+	struct sinowealth_data *drv_data = device->drv_data;
+	struct ghostcat_image_blob blob;
+	struct ghostcat_profile *profile = NULL;
+	int rc;
+
+	while ((rc = ghostcat_image_next_blob(image, &blob)) > 0) {
+		if (blob.id >= drv_data->profile_count)
+			return -EINVAL;
+
+		switch (blob.type) {
+		case GHOSTCAT_IMAGE_BLOB_SINOWEALTH_CONFIG:
+			rc = sinowealth_apply_report(device, (uint8_t*)&drv_data->configs[blob.id],
+						     sizeof(drv_data->configs[blob.id]), &blob,
+						     sinowealth_get_config_command(blob.id),
+						     (uint8_t)drv_data->config_size - 8);
+			break;
+		case GHOSTCAT_IMAGE_BLOB_SINOWEALTH_BUTTONS:
+			rc = sinowealth_apply_report(device, (uint8_t*)&drv_data->buttons[blob.id],
+						     sizeof(drv_data->buttons[blob.id]), &blob,
+						     sinowealth_get_buttons_command(blob.id),
+						     SINOWEALTH_BUTTON_SIZE - 8);
+			break;
+		default:
+			rc = -EINVAL;
+			break;
+		}
+		if (rc < 0)
+			return rc;
+	}
+	if (rc < 0)
+		return rc;
+
+	ghostcat_device_for_each_profile(device, profile) {
+		sinowealth_update_profile_from_config(profile);
+		sinowealth_update_profile_from_buttons(profile);
+	}
+
+	return 0;
+}
+
 static void
 sinowealth_remove(struct ghostcat_device *device)
 {
@@ -2189,4 +2310,6 @@ struct ghostcat_driver sinowealth_driver = {
 	.remove = sinowealth_remove,
 	.commit = sinowealth_commit,
 	.set_active_profile = sinowealth_set_active_profile,
+	.save_image = sinowealth_save_image,
+	.apply_image = sinowealth_apply_image,
 };
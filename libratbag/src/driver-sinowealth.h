@@ -39,6 +39,7 @@ struct sinowealth_device_data {
 	enum sinowealth_led_format led_type;
 	int button_count;
 	int profile_count;
+	int max_report_rate;
 
 	struct list link;
 };
@@ -1003,7 +1003,7 @@ steelseries_write_profile(struct ghostcat_profile *profile)
 	int rc;
 	bool buttons_dirty = false;
 
-	if (profile->rate_dirty) {
+	if (profile->dirty & GHOSTCAT_PROFILE_DIRTY_RATE) {
 		log_debug(device->ratbag,
 			  "Report rate changed, rewriting\n");
 
@@ -1107,6 +1107,43 @@ steelseries_commit(struct ghostcat_device *device)
 	return 0;
 }
 
+static int
+steelseries_show_leds(struct ghostcat_device *device,
+		      const struct ghostcat_color *colors,
+		      uint32_t changed)
+{
+	struct ghostcat_profile *profile;
+	struct ghostcat_led *led;
+	int rc;
+
+	/* Without steelseries_write_save() the LEDs go back to the saved
+	 * settings on the next power cycle, so nothing here wears the
+	 * flash */
+	list_for_each(profile, &device->profiles, link) {
+		if (!profile->is_active)
+			continue;
+
+		ghostcat_profile_for_each_led(profile, led) {
+			struct ghostcat_led shown = *led;
+
+			if (colors) {
+				if (!(changed & (1U << led->index)))
+					continue;
+
+				shown.mode = GHOSTCAT_LED_ON;
+				shown.color = colors[led->index];
+				shown.brightness = 255;
+			}
+
+			rc = steelseries_write_led(&shown);
+			if (rc)
+				return rc;
+		}
+	}
+
+	return 0;
+}
+
 static void
 steelseries_remove(struct ghostcat_device *device)
 {
@@ -1120,4 +1157,5 @@ struct ghostcat_driver steelseries_driver = {
 	.probe = steelseries_probe,
 	.remove = steelseries_remove,
 	.commit = steelseries_commit,
+	.show_leds = steelseries_show_leds,
 };
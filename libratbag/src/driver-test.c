@@ -240,6 +240,12 @@ test_probe(struct ghostcat_device *device, const void *data)
 	ghostcat_device_for_each_profile(device, profile)
 		test_read_profile(profile);
 
+	if (test_device->key_layout)
+		ghostcat_device_init_keys(device,
+					  test_device->key_width,
+					  test_device->key_height,
+					  test_device->key_layout);
+
 	return 0;
 }
 
@@ -259,8 +265,39 @@ test_remove(struct ghostcat_device *device)
 static int
 test_commit(struct ghostcat_device *device)
 {
+	struct ghostcat_test_device *d = ghostcat_get_drv_data(device);
+
 	/* check if the device is still valid */
-	assert(ghostcat_get_drv_data(device) != NULL);
+	assert(d != NULL);
+
+	if (d->commit_delay_ms)
+		msleep(d->commit_delay_ms);
+
+	return 0;
+}
+
+static int
+test_show_leds(struct ghostcat_device *device,
+	       const struct ghostcat_color *colors,
+	       uint32_t changed)
+{
+	struct ghostcat_test_device *d = ghostcat_get_drv_data(device);
+
+	if (d->leds_shown)
+		d->leds_shown(device, colors, changed, d->leds_shown_data);
+
+	return 0;
+}
+
+static int
+test_write_keys(struct ghostcat_device *device,
+		const struct ghostcat_key_color *keys,
+		unsigned int num_keys)
+{
+	struct ghostcat_test_device *d = ghostcat_get_drv_data(device);
+
+	if (d->keys_written)
+		d->keys_written(device, keys, num_keys, d->keys_written_data);
 
 	return 0;
 }
@@ -273,4 +310,6 @@ struct ghostcat_driver test_driver = {
 	.remove = test_remove,
 	.commit = test_commit,
 	.set_active_profile = test_set_active_profile,
+	.show_leds = test_show_leds,
+	.write_keys = test_write_keys,
 };
@@ -241,41 +241,226 @@ hidpp_write_command(struct hidpp_device *dev, uint8_t *cmd, int size)
 		return -EINVAL;
 
 	hidpp_log_buf_raw(dev, "hidpp write: ", cmd, size);
-	res = write(fd, cmd, size);
-	if (res < 0) {
-		res = -errno;
-		hidpp_log_error(dev, "Error: %s (%d)\n", strerror(-res), -res);
+	if (dev->transport) {
+		res = dev->transport->write(dev->transport_data, cmd, size);
+	} else {
+		res = write(fd, cmd, size);
+		if (res < 0)
+			res = -errno;
 	}
+	if (res < 0)
+		hidpp_log_error(dev, "Error: %s (%d)\n", strerror(-res), -res);
+
+	if (dev->stats)
+		ghostcat_stats_add_transfer(dev->stats, size, 0, res);
 
 	return res < 0 ? res : 0;
 }
 
+/**
+ * Wait up to timeout_ms for a report and read it, through the transport
+ * if there is one.
+ *
+ * @return the length of the report, -ETIMEDOUT or a negative errno
+ */
+static int
+hidpp_device_read(struct hidpp_device *dev, uint8_t *buf, size_t size,
+		  int timeout_ms)
+{
+	struct pollfd fds = {
+		.fd = dev->hidraw_fd,
+		.events = POLLIN,
+	};
+	int rc;
+
+	if (dev->transport)
+		return dev->transport->read(dev->transport_data, buf, size,
+					    timeout_ms);
+
+	rc = poll(&fds, 1, timeout_ms);
+	if (rc == 0)
+		return -ETIMEDOUT;
+	if (rc > 0)
+		rc = read(dev->hidraw_fd, buf, size);
+
+	return rc >= 0 ? rc : -errno;
+}
+
 int
-hidpp_read_response(struct hidpp_device *dev, uint8_t *buf, size_t size)
+hidpp_read_response_timeout(struct hidpp_device *dev, uint8_t *buf, size_t size,
+			    int timeout_ms)
 {
 	int fd = dev->hidraw_fd;
-	struct pollfd fds;
 	int rc;
 
 	if (size < 1 || !buf || fd < 0)
 		return -EINVAL;
 
-	fds.fd = fd;
-	fds.events = POLLIN;
+	rc = hidpp_device_read(dev, buf, size, timeout_ms);
+	if (rc == -ETIMEDOUT) {
+		if (dev->stats)
+			ghostcat_stats_add(dev->stats, timeouts, 1);
+		return rc;
+	}
 
-	rc = poll(&fds, 1, 1000);
-	if (rc == -1)
-		return -errno;
+	if (rc > 0)
+		hidpp_log_buf_raw(dev, "hidpp read:  ", buf, rc);
 
-	if (rc == 0)
-		return -ETIMEDOUT;
+	if (dev->stats) {
+		if (rc < 0)
+			ghostcat_stats_add(dev->stats, errors, 1);
+		else
+			ghostcat_stats_add(dev->stats, bytes_received, rc);
+	}
 
-	rc = read(fd, buf, size);
+	return rc;
+}
 
-	if (rc > 0)
-		hidpp_log_buf_raw(dev, "hidpp read:  ", buf, rc);
+/**
+ * Read the next report from the device. The timeout is derived from the
+ * round-trip time of the device and doubled while the response is late,
+ * so a lost packet costs a few round trips rather than seconds.
+ *
+ * Commands that keep the device busy for a while, like flash writes,
+ * pass a min_timeout_ms the timeout never goes below, 0 otherwise.
+ */
+int
+hidpp_read_response(struct hidpp_device *dev, uint8_t *buf, size_t size,
+		    unsigned int min_timeout_ms)
+{
+	unsigned int attempt = 0;
+	int rc;
 
-	return rc >= 0 ? rc : -errno;
+	do {
+		if (attempt > 0 && dev->stats)
+			ghostcat_stats_add(dev->stats, retries, 1);
+		rc = hidpp_read_response_timeout(dev, buf, size,
+						 max(min_timeout_ms,
+						     ghostcat_rtt_timeout_ms(dev->rtt, attempt)));
+	} while (rc == -ETIMEDOUT && attempt++ < HIDPP_READ_RETRIES);
+
+	return rc;
+}
+
+/**
+ * Account for the round-trip time of a request written at start_ns.
+ */
+void
+hidpp_device_update_rtt(struct hidpp_device *dev, uint64_t start_ns)
+{
+	uint64_t rtt_us;
+
+	if (!dev->rtt)
+		return;
+
+	rtt_us = ghostcat_rtt_update(dev->rtt, start_ns);
+	if (dev->stats)
+		ghostcat_stats_add_latency(dev->stats, rtt_us);
+}
+
+static void
+hidpp_device_set_offline(struct hidpp_device *dev, bool offline)
+{
+	if (dev->offline && !offline)
+		dev->reconnects++;
+
+	dev->offline = offline;
+}
+
+/**
+ * Account for the result of a request. A wireless device that failed to
+ * answer HIDPP_OFFLINE_TIMEOUTS requests in a row is considered offline
+ * until it shows up again.
+ */
+void
+hidpp_device_update_link(struct hidpp_device *dev, int rc)
+{
+	if (!dev->wireless)
+		return;
+
+	if (rc != -ETIMEDOUT) {
+		dev->timeouts = 0;
+		return;
+	}
+
+	if (++dev->timeouts >= HIDPP_OFFLINE_TIMEOUTS && !dev->offline) {
+		hidpp_log_info(dev, "hidpp: device does not respond, assuming it is asleep\n");
+		hidpp_device_set_offline(dev, true);
+	}
+}
+
+/**
+ * Update the link state from a connection notification the receiver
+ * forwards to the device's hidraw node. On a hidraw node dedicated to
+ * the device, device_idx is HIDPP_RECEIVER_IDX and the notification
+ * carries the actual pairing slot.
+ *
+ * @return true if buf is a connection notification for device_idx
+ */
+bool
+hidpp_handle_link_notification(struct hidpp_device *dev, uint8_t device_idx,
+			       const uint8_t *buf, int len)
+{
+	bool offline;
+
+	if (len < SHORT_MESSAGE_LENGTH ||
+	    buf[0] != REPORT_ID_SHORT ||
+	    buf[2] != DEVICE_CONNECTION_NOTIF ||
+	    buf[1] == HIDPP_RECEIVER_IDX ||
+	    (device_idx != HIDPP_RECEIVER_IDX && buf[1] != device_idx))
+		return false;
+
+	/* params[0] bit 6: link not established */
+	offline = !!(buf[4] & 0x40);
+	if (offline != dev->offline)
+		hidpp_log_debug(dev, "hidpp: device %s\n",
+				offline ? "went to sleep" : "reconnected");
+
+	dev->wireless = true;
+	hidpp_device_set_offline(dev, offline);
+	dev->timeouts = 0;
+
+	return true;
+}
+
+/**
+ * Read all reports pending on the hidraw node without blocking and
+ * update the link state. Any report of this device other than a
+ * link-down notification means the device is awake. A receiver's node
+ * carries the reports of every paired device, those of the others say
+ * nothing about this one.
+ *
+ * @return 0 if the device is online, -ENOTCONN if it is offline or a
+ * negative errno on error
+ */
+int
+hidpp_process_link_notifications(struct hidpp_device *dev, uint8_t device_idx)
+{
+	uint8_t buf[LONG_MESSAGE_LENGTH];
+	int rc;
+
+	if (!dev->wireless)
+		return 0;
+
+	while ((rc = hidpp_device_read(dev, buf, sizeof(buf), 0)) != -ETIMEDOUT) {
+		if (rc < 0)
+			return rc;
+		if (rc == 0)
+			break;
+
+		if (hidpp_handle_link_notification(dev, device_idx, buf, rc))
+			continue;
+
+		/* HID++ and DJ reports carry the device index after the
+		 * report ID */
+		if (device_idx == HIDPP_RECEIVER_IDX ||
+		    (rc >= 2 && buf[1] == device_idx)) {
+			hidpp_device_set_offline(dev, false);
+			dev->timeouts = 0;
+		}
+	}
+
+	return dev->offline ? -ENOTCONN : 0;
 }
 
 void
@@ -363,6 +548,14 @@ hidpp_device_init(struct hidpp_device *dev, int fd)
 	dev->hidraw_fd = fd;
 	hidpp_device_set_log_handler(dev, simple_log, HIDPP_LOG_PRIORITY_INFO, NULL);
 	dev->supported_report_types = 0;
+	dev->wireless = false;
+	dev->offline = false;
+	dev->timeouts = 0;
+	dev->reconnects = 0;
+	dev->rtt = NULL;
+	dev->stats = NULL;
+	dev->transport = NULL;
+	dev->transport_data = NULL;
 }
 
 void
@@ -375,30 +568,3 @@ hidpp_device_set_log_handler(struct hidpp_device *dev,
 	dev->log_priority = priority;
 	dev->userdata = userdata;
 }
-
-/*
- * The following crc computation has been provided by Logitech
- */
-#define CRC_CCITT_SEED	0xFFFF
-
-uint16_t
-hidpp_crc_ccitt(uint8_t *data, unsigned int length)
-{
-	uint16_t crc, temp, quick;
-	unsigned int i;
-
-	crc = CRC_CCITT_SEED;
-
-	for (i = 0; i < length; i++) {
-		temp = (crc >> 8) ^ (*data++);
-		crc <<= 8;
-		quick = temp ^ (temp >> 4);
-		crc ^= quick;
-		quick <<= 5;
-		crc ^= quick;
-		quick <<= 7;
-		crc ^= quick;
-	}
-
-	return crc;
-}
@@ -28,6 +28,7 @@
 
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdarg.h>
 #include <stddef.h>
@@ -52,6 +53,7 @@
 #define GET_LONG_REGISTER_REQ			0x83
 #define GET_LONG_REGISTER_RSP			0x83
 #define __ERROR_MSG				0x8F
+#define DEVICE_CONNECTION_NOTIF			0x41
 
 #define HIDPP10_ERR_SUCCESS				0x00
 #define HIDPP10_ERR_INVALID_SUBID			0x01
@@ -101,14 +103,52 @@ struct hidpp_hid_report {
 	unsigned int usage;
 };
 
+/**
+ * Replaces the read() and write() calls on hidraw_fd, e.g. to record the
+ * traffic. Both return the length transferred or a negative errno,
+ * read returns -ETIMEDOUT when no report arrives within timeout_ms.
+ */
+struct hidpp_transport {
+	int (*write)(void *userdata, const uint8_t *buf, size_t len);
+	int (*read)(void *userdata, uint8_t *buf, size_t len, int timeout_ms);
+};
+
 struct hidpp_device {
 	int hidraw_fd;
 	void *userdata;
 	hidpp_log_handler log_handler;
 	enum hidpp_log_priority log_priority;
 	unsigned supported_report_types;
+
+	/* link state of a device behind a receiver */
+	bool wireless;
+	bool offline;
+	unsigned timeouts;
+	unsigned reconnects; /* times the device came back after being offline */
+
+	/* round-trip time statistics, owned by the caller so they outlive
+	 * this struct, may be NULL */
+	struct ghostcat_rtt *rtt;
+	/* transfer counters, owned by the caller like rtt, may be NULL */
+	struct ghostcat_stats *stats;
+
+	/* may be NULL to use hidraw_fd directly */
+	const struct hidpp_transport *transport;
+	void *transport_data;
 };
 
+/* number of consecutive unanswered requests after which a wireless
+ * device is considered asleep */
+#define HIDPP_OFFLINE_TIMEOUTS			2
+
+/* number of times a late response is waited for again, with a doubled
+ * timeout each time */
+#define HIDPP_READ_RETRIES			3
+
+/* Erasing or writing the flash can take far longer than the round-trip
+ * time, responses to those commands are waited for at least this long */
+#define HIDPP_FLASH_TIMEOUT_MS			1000
+
 #define HIDPP_REPORT_SHORT	(1 << 0)
 #define HIDPP_REPORT_LONG	(1 << 1)
 
@@ -142,7 +182,25 @@ int
 hidpp_write_command(struct hidpp_device *dev, uint8_t *cmd, int size);
 
 int
-hidpp_read_response(struct hidpp_device *dev, uint8_t *buf, size_t size);
+hidpp_read_response_timeout(struct hidpp_device *dev, uint8_t *buf, size_t size,
+			    int timeout_ms);
+
+int
+hidpp_read_response(struct hidpp_device *dev, uint8_t *buf, size_t size,
+		    unsigned int min_timeout_ms);
+
+void
+hidpp_device_update_rtt(struct hidpp_device *dev, uint64_t start_ns);
+
+void
+hidpp_device_update_link(struct hidpp_device *dev, int rc);
+
+bool
+hidpp_handle_link_notification(struct hidpp_device *dev, uint8_t device_idx,
+			       const uint8_t *buf, int len);
+
+int
+hidpp_process_link_notifications(struct hidpp_device *dev, uint8_t device_idx);
 
 void
 hidpp_get_supported_report_types(struct hidpp_device *dev,
@@ -175,8 +233,6 @@ hidpp_log_buffer(struct hidpp_device *dev,
 #define hidpp_log_buf_info(li_, h_, buf_, len_) hidpp_log_buffer(li_, HIDPP_LOG_PRIORITY_INFO, h_, buf_, len_)
 #define hidpp_log_buf_error(li_, h_, buf_, len_) hidpp_log_buffer(li_, HIDPP_LOG_PRIORITY_ERROR, h_, buf_, len_)
 
-uint16_t hidpp_crc_ccitt(uint8_t *data, unsigned int length);
-
 static inline uint16_t
 hidpp_be_u16_to_cpu(uint16_t data)
 {
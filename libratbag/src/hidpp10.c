@@ -44,6 +44,7 @@
 #include "hidpp10.h"
 
 #include "libghostcat-util.h"
+#include "libghostcat-checksum.h"
 #include "libghostcat-hidraw.h"
 
 struct _hidpp10_message {
@@ -161,8 +162,14 @@ hidpp10_build_dpi_table_from_dpi_info(struct hidpp10_device *dev,
 	return 0;
 }
 
+/**
+ * Send msg and wait for its answer, at least min_timeout_ms for each read
+ * (0 to use only the round-trip time of the device).
+ */
 static int
-hidpp10_request_command(struct hidpp10_device *dev, union hidpp10_message *msg)
+hidpp10_request_command_timeout(struct hidpp10_device *dev,
+				union hidpp10_message *msg,
+				unsigned int min_timeout_ms)
 {
 	union hidpp10_message read_buffer;
 	union hidpp10_message expected_header;
@@ -170,6 +177,7 @@ hidpp10_request_command(struct hidpp10_device *dev, union hidpp10_message *msg)
 	int ret;
 	uint8_t hidpp_err = 0;
 	int command_size;
+	uint64_t start;
 	_cleanup_free_ char *rxdata = NULL, *txdata = NULL;
 
 	switch (msg->msg.report_id) {
@@ -202,6 +210,7 @@ hidpp10_request_command(struct hidpp10_device *dev, union hidpp10_message *msg)
 #endif
 
 	/* Send the message to the Device */
+	start = now(CLOCK_MONOTONIC);
 	ret = hidpp_write_command(&dev->base, msg->data, command_size);
 	if (ret)
 		goto out_err;
@@ -211,13 +220,8 @@ hidpp10_request_command(struct hidpp10_device *dev, union hidpp10_message *msg)
 	 * loop until we get the actual answer or an error code.
 	 */
 	do {
-		ret = hidpp_read_response(&dev->base, read_buffer.data, LONG_MESSAGE_LENGTH);
-
-		/* Wait and retry if the USB timed out */
-		if (ret == -ETIMEDOUT) {
-			msleep(10);
-			ret = hidpp_read_response(&dev->base, read_buffer.data, LONG_MESSAGE_LENGTH);
-		}
+		ret = hidpp_read_response(&dev->base, read_buffer.data,
+					  LONG_MESSAGE_LENGTH, min_timeout_ms);
 
 		/* Overwrite the return device index with ours. The kernel
 		 * sets our device index on write, but gives us the real
@@ -243,6 +247,9 @@ hidpp10_request_command(struct hidpp10_device *dev, union hidpp10_message *msg)
 		}
 	} while (ret > 0);
 
+	if (ret > 0)
+		hidpp_device_update_rtt(&dev->base, start);
+
 	if (ret < 0) {
 		hidpp_log_error(&dev->base, "    USB error: %s (%d)\n", strerror(-ret), -ret);
 		perror("write");
@@ -267,6 +274,13 @@ hidpp10_request_command(struct hidpp10_device *dev, union hidpp10_message *msg)
 out_err:
 	return ret;
 }
+
+static int
+hidpp10_request_command(struct hidpp10_device *dev, union hidpp10_message *msg)
+{
+	return hidpp10_request_command_timeout(dev, msg, 0);
+}
+
 /* -------------------------------------------------------------------------- */
 /* HID++ 1.0 commands 10                                                      */
 /* -------------------------------------------------------------------------- */
@@ -391,6 +405,54 @@ hidpp10_set_individual_features(struct hidpp10_device *dev,
 	return res;
 }
 
+/* -------------------------------------------------------------------------- */
+/* 0x02: Connection State                                                     */
+/* -------------------------------------------------------------------------- */
+
+#define __CMD_CONNECTION_STATE			0x02
+#define CONNECTION_STATE_FAKE_DEVICE_ARRIVAL		0x02
+
+#define CMD_CONNECTION_STATE(idx, sub)	{ \
+	.msg = { \
+		.report_id = REPORT_ID_SHORT, \
+		.device_idx = idx, \
+		.sub_id = sub, \
+		.address = __CMD_CONNECTION_STATE, \
+		.parameters = {0x00, 0x00, 0x00 }, \
+	} \
+}
+
+int
+hidpp10_get_connection_state(struct hidpp10_device *dev)
+{
+	unsigned idx = dev->index;
+	union hidpp10_message state = CMD_CONNECTION_STATE(idx, GET_REGISTER_REQ);
+	int res;
+
+	hidpp_log_raw(&dev->base, "Fetching connection state (%#02x)\n",
+		      __CMD_CONNECTION_STATE);
+
+	res = hidpp10_request_command(dev, &state);
+	if (res)
+		return res > 0 ? -EIO : res;
+
+	return state.msg.parameters[1];
+}
+
+int
+hidpp10_trigger_device_arrival(struct hidpp10_device *dev)
+{
+	unsigned idx = dev->index;
+	union hidpp10_message state = CMD_CONNECTION_STATE(idx, SET_REGISTER_REQ);
+
+	hidpp_log_raw(&dev->base, "Triggering device arrival (%#02x)\n",
+		      __CMD_CONNECTION_STATE);
+
+	state.msg.parameters[0] = CONNECTION_STATE_FAKE_DEVICE_ARRIVAL;
+
+	return hidpp10_request_command(dev, &state);
+}
+
 /* -------------------------------------------------------------------------- */
 /* 0x07: Battery status                                                       */
 /* -------------------------------------------------------------------------- */
@@ -721,38 +783,10 @@ hidpp10_write_profile_directory(struct hidpp10_device *dev)
 		++index;
 	}
 
-	crc = hidpp_crc_ccitt(bytes, HIDPP10_PAGE_SIZE - 2);
+	crc = ghostcat_crc_ccitt(bytes, HIDPP10_PAGE_SIZE - 2);
 	set_unaligned_be_u16(&bytes[HIDPP10_PAGE_SIZE - 2], crc);
 
-	res = hidpp10_send_hot_payload(dev,
-				       0x00, 0x0000, /* destination: RAM */
-				       bytes,
-				       HIDPP10_PAGE_SIZE / 2);
-	if (res < 0)
-		return res;
-
-	res = hidpp10_erase_memory(dev, 0x01);
-	if (res < 0)
-		return res;
-
-	res = hidpp10_write_flash(dev,
-				  0x00, 0x0000,
-				  0x01, 0x0000,
-				  HIDPP10_PAGE_SIZE / 2);
-	if (res < 0)
-		return res;
-
-	res = hidpp10_send_hot_payload(dev,
-				       0x00, 0x0000, /* destination: RAM */
-				       bytes + HIDPP10_PAGE_SIZE / 2,
-				       HIDPP10_PAGE_SIZE / 2);
-	if (res < 0)
-		return res;
-
-	res = hidpp10_write_flash(dev,
-				  0x00, 0x0000,
-				  0x01, HIDPP10_PAGE_SIZE / 2,
-				  HIDPP10_PAGE_SIZE / 2);
+	res = hidpp10_write_page(dev, 0x01, bytes);
 	if (res < 0)
 		return res;
 
@@ -1727,7 +1761,7 @@ hidpp10_set_profile(struct hidpp10_device *dev, uint8_t number, struct hidpp10_p
 	}
 
 	/* something went wrong */
-	if (!profile->page)
+	if (!profile->page || profile->page > HIDPP10_MAX_PAGE_NUMBER)
 		return -ENOTSUP;
 
 	memset(page_data, 0xff, sizeof(page_data));
@@ -1755,9 +1789,13 @@ hidpp10_set_profile(struct hidpp10_device *dev, uint8_t number, struct hidpp10_p
 	case HIDPP10_PROFILE_G9:
 		/* we do not know the actual values of the remaining field right now
 		 * so pre-fill with the current data */
-		res = hidpp10_read_page(dev, profile->page, page_data);
-		if (res)
-			return res;
+		if (dev->page_cache[profile->page]) {
+			memcpy(page_data, dev->page_cache[profile->page], sizeof(page_data));
+		} else {
+			res = hidpp10_read_page(dev, profile->page, page_data);
+			if (res)
+				return res;
+		}
 		break;
 	case HIDPP10_PROFILE_G700:
 		memcpy(p700->unknown1, _hidpp10_profile_700_unknown1, sizeof(p700->unknown1));
@@ -1805,9 +1843,17 @@ hidpp10_set_profile(struct hidpp10_device *dev, uint8_t number, struct hidpp10_p
 		return -ENOTSUP;
 	}
 
-	crc = hidpp_crc_ccitt(page_data, HIDPP10_PAGE_SIZE - 2);
+	crc = ghostcat_crc_ccitt(page_data, HIDPP10_PAGE_SIZE - 2);
 	set_unaligned_be_u16(&page_data[HIDPP10_PAGE_SIZE - 2], crc);
 
+	/* nothing to write, leave the flash and the current profile alone */
+	if (profile->enabled == dev->profiles[number].enabled &&
+	    hidpp10_page_is_unchanged(dev, profile->page, page_data)) {
+		hidpp_log_debug(&dev->base, "Profile %d is unchanged, not writing it\n", number);
+		dev->profiles[number] = *profile;
+		return 0;
+	}
+
 	/*
 	 * writing the data in several steps to prevent shroedinger state
 	 * if the device is unplugged while uploading the data:
@@ -1832,38 +1878,10 @@ hidpp10_set_profile(struct hidpp10_device *dev, uint8_t number, struct hidpp10_p
 			return res;
 	}
 
-	res = hidpp10_send_hot_payload(dev,
-				       0x00, 0x0000, /* destination: RAM */
-				       page_data,
-				       HIDPP10_PAGE_SIZE / 2);
-	if (res < 0)
-		return res;
-
-	page = profile->page;
 	/* according to the spec, a profile can have an offset.
 	 * For all the devices we know, they all start at 0x0000 */
-	res = hidpp10_erase_memory(dev, page);
-	if (res < 0)
-		return res;
-
-	res = hidpp10_write_flash(dev,
-				  0x00, 0x0000,
-				  page, 0x0000,
-				  HIDPP10_PAGE_SIZE / 2);
-	if (res < 0)
-		return res;
-
-	res = hidpp10_send_hot_payload(dev,
-				       0x00, 0x0000, /* destination: RAM */
-				       page_data + HIDPP10_PAGE_SIZE / 2,
-				       HIDPP10_PAGE_SIZE / 2);
-	if (res < 0)
-		return res;
-
-	res = hidpp10_write_flash(dev,
-				  0x00, 0x0000,
-				  page, HIDPP10_PAGE_SIZE / 2,
-				  HIDPP10_PAGE_SIZE / 2);
+	page = profile->page;
+	res = hidpp10_write_page(dev, page, page_data);
 	if (res < 0)
 		return res;
 
@@ -1875,6 +1893,52 @@ hidpp10_set_profile(struct hidpp10_device *dev, uint8_t number, struct hidpp10_p
 	return res;
 }
 
+/* -------------------------------------------------------------------------- */
+/* 0x40, 0x41: Device Disconnection and Connection notifications              */
+/* -------------------------------------------------------------------------- */
+
+#define DEVICE_DISCONNECTION_UNPAIRED		0x02
+#define DEVICE_CONNECTION_LINK_NOT_ESTABLISHED	(1 << 6)
+
+int
+hidpp10_parse_connection_notification(const uint8_t *data, size_t size,
+				      struct hidpp10_connection_event *event)
+{
+	const union hidpp10_message *msg = (const union hidpp10_message *)data;
+
+	if (size < SHORT_MESSAGE_LENGTH || msg->msg.report_id != REPORT_ID_SHORT)
+		return -EINVAL;
+
+	if (msg->msg.device_idx == HIDPP_RECEIVER_IDX)
+		return -EINVAL;
+
+	switch (msg->msg.sub_id) {
+	case HIDPP10_NOTIFICATION_DEVICE_DISCONNECTION:
+		/* the address byte is the disconnection type */
+		if (msg->msg.address != DEVICE_DISCONNECTION_UNPAIRED)
+			return -EINVAL;
+
+		memset(event, 0, sizeof(*event));
+		event->index = msg->msg.device_idx;
+		event->paired = false;
+		break;
+	case HIDPP10_NOTIFICATION_DEVICE_CONNECTION:
+		/* the address byte is the protocol type, the parameters are
+		 * the device info followed by the wireless PID in LE */
+		event->index = msg->msg.device_idx;
+		event->paired = true;
+		event->link_established =
+			!(msg->msg.parameters[0] & DEVICE_CONNECTION_LINK_NOT_ESTABLISHED);
+		event->device_type = msg->msg.parameters[0] & 0x0f;
+		event->wpid = get_unaligned_le_u16(&msg->msg.parameters[1]);
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
 /* -------------------------------------------------------------------------- */
 /* 0x51: LED Status                                                           */
 /* -------------------------------------------------------------------------- */
@@ -2287,7 +2351,8 @@ hidpp10_erase_memory(struct hidpp10_device *dev, uint8_t page)
 
 	hidpp_log_raw(&dev->base, "Erasing page 0x%02x\n", page);
 
-	return hidpp10_request_command(dev, &erase);
+	return hidpp10_request_command_timeout(dev, &erase,
+					       HIDPP_FLASH_TIMEOUT_MS);
 }
 
 int
@@ -2314,7 +2379,8 @@ hidpp10_write_flash(struct hidpp10_device *dev,
 		      src_page, src_offset,
 		      dst_page, dst_offset);
 
-	return hidpp10_request_command(dev, &copy);
+	return hidpp10_request_command_timeout(dev, &copy,
+					       HIDPP_FLASH_TIMEOUT_MS);
 }
 
 /* -------------------------------------------------------------------------- */
@@ -2347,11 +2413,9 @@ hidpp10_hot_ctrl_reset(struct hidpp10_device *dev)
 }
 
 static int
-hidpp10_hot_request_command(struct hidpp10_device *dev, uint8_t data[LONG_MESSAGE_LENGTH])
+hidpp10_hot_write_command(struct hidpp10_device *dev, uint8_t data[LONG_MESSAGE_LENGTH])
 {
-	uint8_t read_buffer[LONG_MESSAGE_LENGTH] = {0};
 	int ret;
-	uint8_t id = data[3];
 
 	if ((data[0] != REPORT_ID_LONG) ||
 	    ((data[2] != HOT_WRITE) && (data[2] != HOT_CONTINUE)))
@@ -2360,20 +2424,24 @@ hidpp10_hot_request_command(struct hidpp10_device *dev, uint8_t data[LONG_MESSAG
 	/* Send the message to the Device */
 	ret = hidpp_write_command(&dev->base, data, LONG_MESSAGE_LENGTH);
 	if (ret)
-		goto out_err;
+		hidpp_log_error(&dev->base, "    USB error: %s (%d)\n", strerror(-ret), -ret);
+
+	return ret;
+}
+
+static int
+hidpp10_hot_wait_notification(struct hidpp10_device *dev, uint8_t id)
+{
+	uint8_t read_buffer[LONG_MESSAGE_LENGTH] = {0};
+	int ret;
 
 	/*
 	 * Now read the answers from the device:
 	 * loop until we get the actual answer or an error code.
 	 */
 	do {
-		ret = hidpp_read_response(&dev->base, read_buffer, LONG_MESSAGE_LENGTH);
-
-		/* Wait and retry if the USB timed out */
-		if (ret == -ETIMEDOUT) {
-			msleep(10);
-			ret = hidpp_read_response(&dev->base, read_buffer, LONG_MESSAGE_LENGTH);
-		}
+		ret = hidpp_read_response(&dev->base, read_buffer,
+					  LONG_MESSAGE_LENGTH, 0);
 
 		/* actual answer */
 		if (read_buffer[2] == HOT_NOTIFICATION)
@@ -2382,21 +2450,15 @@ hidpp10_hot_request_command(struct hidpp10_device *dev, uint8_t data[LONG_MESSAG
 
 	if (ret < 0) {
 		hidpp_log_error(&dev->base, "    USB error: %s (%d)\n", strerror(-ret), -ret);
-		perror("write");
-		goto out_err;
+		return ret;
 	}
 
 	if (read_buffer[4] != id) {
-		ret = -EPROTO;
 		hidpp_log_error(&dev->base, "    Protocol error: ids do not match.\n");
-		perror("write");
-		goto out_err;
+		return -EPROTO;
 	}
 
-	ret = 0;
-
-out_err:
-	return ret;
+	return 0;
 }
 
 struct hot_header {
@@ -2414,7 +2476,7 @@ hidpp10_send_hot_chunk(struct hidpp10_device *dev,
 		       bool first,
 		       uint8_t dst_page,
 		       uint16_t dst_offset,
-		       uint8_t *data,
+		       const uint8_t *data,
 		       unsigned size)
 {
 	struct hot_header header = {0};
@@ -2450,23 +2512,31 @@ hidpp10_send_hot_chunk(struct hidpp10_device *dev,
 
 	memcpy(&buffer[offset], data, count);
 
-	res = hidpp10_hot_request_command(dev, buffer);
+	res = hidpp10_hot_write_command(dev, buffer);
 	if (res < 0)
 		return res;
 
 	return count;
 }
 
+/*
+ * The number of chunks sent ahead of their notification. Waiting for each
+ * notification before the next chunk costs a round trip per 16 bytes, but
+ * the size of the device's receive queue is unknown so keep it small.
+ */
+#define HOT_MAX_CHUNKS_IN_FLIGHT		4
+
 int
 hidpp10_send_hot_payload(struct hidpp10_device *dev,
 			 uint8_t dst_page,
 			 uint16_t dst_offset,
-			 uint8_t *data,
+			 const uint8_t *data,
 			 unsigned size)
 {
 	bool first = true;
 	unsigned int count = 0;
 	unsigned int index = 0;
+	unsigned int acked = 0;
 	int res;
 
 	res = hidpp10_hot_ctrl_reset(dev);
@@ -2474,6 +2544,12 @@ hidpp10_send_hot_payload(struct hidpp10_device *dev,
 		return res;
 
 	do {
+		if (index - acked == HOT_MAX_CHUNKS_IN_FLIGHT) {
+			res = hidpp10_hot_wait_notification(dev, acked++);
+			if (res < 0)
+				return res;
+		}
+
 		res = hidpp10_send_hot_chunk(dev, index, first,
 					     dst_page, dst_offset,
 					     data + count,
@@ -2486,6 +2562,12 @@ hidpp10_send_hot_payload(struct hidpp10_device *dev,
 		index++;
 	} while (size > count);
 
+	while (acked < index) {
+		res = hidpp10_hot_wait_notification(dev, acked++);
+		if (res < 0)
+			return res;
+	}
+
 	return 0;
 }
 
@@ -2531,6 +2613,27 @@ hidpp10_read_memory(struct hidpp10_device *dev, uint8_t page, uint16_t offset,
 	return 0;
 }
 
+static void
+hidpp10_cache_page(struct hidpp10_device *dev, uint8_t page,
+		   const uint8_t bytes[HIDPP10_PAGE_SIZE])
+{
+	assert(page <= HIDPP10_MAX_PAGE_NUMBER);
+
+	if (!dev->page_cache[page])
+		dev->page_cache[page] = zalloc(HIDPP10_PAGE_SIZE);
+
+	memcpy(dev->page_cache[page], bytes, HIDPP10_PAGE_SIZE);
+}
+
+static void
+hidpp10_uncache_page(struct hidpp10_device *dev, uint8_t page)
+{
+	assert(page <= HIDPP10_MAX_PAGE_NUMBER);
+
+	free(dev->page_cache[page]);
+	dev->page_cache[page] = NULL;
+}
+
 int
 hidpp10_read_page(struct hidpp10_device *dev, uint8_t page,
 		  uint8_t bytes[HIDPP10_PAGE_SIZE])
@@ -2545,7 +2648,10 @@ hidpp10_read_page(struct hidpp10_device *dev, uint8_t page,
 			return res;
 	}
 
-	crc = hidpp_crc_ccitt(bytes, HIDPP10_PAGE_SIZE - 2);
+	/* even with a wrong CRC this is what the flash holds */
+	hidpp10_cache_page(dev, page, bytes);
+
+	crc = ghostcat_crc_ccitt(bytes, HIDPP10_PAGE_SIZE - 2);
 	read_crc = get_unaligned_be_u16(&bytes[HIDPP10_PAGE_SIZE - 2]);
 
 	if (crc != read_crc)
@@ -2554,6 +2660,70 @@ hidpp10_read_page(struct hidpp10_device *dev, uint8_t page,
 	return 0;
 }
 
+bool
+hidpp10_page_is_unchanged(struct hidpp10_device *dev, uint8_t page,
+			  const uint8_t bytes[HIDPP10_PAGE_SIZE])
+{
+	return page <= HIDPP10_MAX_PAGE_NUMBER &&
+	       dev->page_cache[page] &&
+	       memcmp(dev->page_cache[page], bytes, HIDPP10_PAGE_SIZE) == 0;
+}
+
+int
+hidpp10_write_page(struct hidpp10_device *dev, uint8_t page,
+		   const uint8_t bytes[HIDPP10_PAGE_SIZE])
+{
+	int res;
+
+	if (page > HIDPP10_MAX_PAGE_NUMBER)
+		return -EINVAL;
+
+	if (hidpp10_page_is_unchanged(dev, page, bytes)) {
+		hidpp_log_raw(&dev->base, "Page 0x%02x is unchanged, not writing it\n", page);
+		return 0;
+	}
+
+	/* whatever happens next, the flash content is unknown until the
+	 * last write succeeds */
+	hidpp10_uncache_page(dev, page);
+
+	res = hidpp10_send_hot_payload(dev,
+				       0x00, 0x0000, /* destination: RAM */
+				       bytes,
+				       HIDPP10_PAGE_SIZE / 2);
+	if (res < 0)
+		return res;
+
+	res = hidpp10_erase_memory(dev, page);
+	if (res < 0)
+		return res;
+
+	res = hidpp10_write_flash(dev,
+				  0x00, 0x0000,
+				  page, 0x0000,
+				  HIDPP10_PAGE_SIZE / 2);
+	if (res < 0)
+		return res;
+
+	res = hidpp10_send_hot_payload(dev,
+				       0x00, 0x0000, /* destination: RAM */
+				       bytes + HIDPP10_PAGE_SIZE / 2,
+				       HIDPP10_PAGE_SIZE / 2);
+	if (res < 0)
+		return res;
+
+	res = hidpp10_write_flash(dev,
+				  0x00, 0x0000,
+				  page, HIDPP10_PAGE_SIZE / 2,
+				  HIDPP10_PAGE_SIZE / 2);
+	if (res < 0)
+		return res;
+
+	hidpp10_cache_page(dev, page, bytes);
+
+	return 1;
+}
+
 /* -------------------------------------------------------------------------- */
 /* 0xB2: Device Connection and Disconnection (Pairing)                        */
 /* -------------------------------------------------------------------------- */
@@ -2807,6 +2977,7 @@ void
 hidpp10_device_destroy(struct hidpp10_device *dev)
 {
 	union hidpp10_macro_data **macro;
+	uint8_t **page;
 	unsigned i;
 
 	free(dev->dpi_table);
@@ -2819,6 +2990,9 @@ hidpp10_device_destroy(struct hidpp10_device *dev)
 		}
 	}
 
+	ARRAY_FOR_EACH(dev->page_cache, page)
+		free(*page);
+
 	free(dev->profiles);
 	free(dev);
 }
@@ -67,6 +67,9 @@ struct hidpp10_device  {
 	enum hidpp10_profile_type profile_type;
 	struct hidpp10_profile *profiles;
 	unsigned int profile_count;
+
+	/* the flash pages as last read or written, NULL where unknown */
+	uint8_t *page_cache[HIDPP10_MAX_PAGE_NUMBER + 1];
 };
 
 int
@@ -342,6 +345,25 @@ int
 hidpp10_set_individual_features(struct hidpp10_device *dev,
 				uint32_t feature_mask);
 
+/* -------------------------------------------------------------------------- */
+/* 0x02: Connection State                                                     */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Returns the number of devices paired with the receiver or a negative
+ * error.
+ */
+int
+hidpp10_get_connection_state(struct hidpp10_device *dev);
+
+/**
+ * Makes the receiver send a HIDPP10_NOTIFICATION_DEVICE_CONNECTION for
+ * every paired device. Requires HIDPP10_NOTIFICATIONS_WIRELESS_NOTIFICATIONS
+ * to be enabled.
+ */
+int
+hidpp10_trigger_device_arrival(struct hidpp10_device *dev);
+
 /* -------------------------------------------------------------------------- */
 /* 0x07: Battery Status                                                       */
 /* -------------------------------------------------------------------------- */
@@ -553,6 +575,30 @@ hidpp10_onboard_profiles_get_special(uint8_t code);
 uint8_t
 hidpp10_onboard_profiles_get_code_from_special(enum ghostcat_button_action_special special);
 
+/* -------------------------------------------------------------------------- */
+/* 0x40, 0x41: Device Disconnection and Connection notifications              */
+/* -------------------------------------------------------------------------- */
+
+#define HIDPP10_NOTIFICATION_DEVICE_DISCONNECTION	0x40
+#define HIDPP10_NOTIFICATION_DEVICE_CONNECTION		0x41
+
+struct hidpp10_connection_event {
+	unsigned index;		/* device index on the receiver, 1-based */
+	bool paired;		/* false if the device was unpaired */
+	bool link_established;	/* false if the device is paired but asleep */
+	uint8_t device_type;
+	uint16_t wpid;
+};
+
+/**
+ * Parses a raw report read from the receiver. Returns 0 and fills in event
+ * if the report is a connection or disconnection notification, -EINVAL
+ * otherwise.
+ */
+int
+hidpp10_parse_connection_notification(const uint8_t *data, size_t size,
+				      struct hidpp10_connection_event *event);
+
 /* -------------------------------------------------------------------------- */
 /* 0x51: LED Status                                                           */
 /* -------------------------------------------------------------------------- */
@@ -657,7 +703,7 @@ int
 hidpp10_send_hot_payload(struct hidpp10_device *dev,
 			 uint8_t dst_page,
 			 uint16_t dst_offset,
-			 uint8_t *data,
+			 const uint8_t *data,
 			 unsigned size);
 
 /* -------------------------------------------------------------------------- */
@@ -676,6 +722,26 @@ int
 hidpp10_read_page(struct hidpp10_device *dev, uint8_t page,
 		  uint8_t bytes[HIDPP10_PAGE_SIZE]);
 
+/**
+ * Whether the page on the flash is known to hold the given bytes, i.e.
+ * it was last read or written with exactly this content.
+ */
+bool
+hidpp10_page_is_unchanged(struct hidpp10_device *dev, uint8_t page,
+			  const uint8_t bytes[HIDPP10_PAGE_SIZE]);
+
+/**
+ * Write a full page to the flash through the RAM buffer, one half at a
+ * time. Pages that are known to already hold the bytes are not erased
+ * or written.
+ *
+ * @return 1 if the page was written, 0 if it was unchanged or a negative
+ * errno
+ */
+int
+hidpp10_write_page(struct hidpp10_device *dev, uint8_t page,
+		   const uint8_t bytes[HIDPP10_PAGE_SIZE]);
+
 /* -------------------------------------------------------------------------- */
 /* 0xB2: Device Connection and Disconnection (Pairing)                        */
 /* -------------------------------------------------------------------------- */
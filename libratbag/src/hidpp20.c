@@ -39,6 +39,7 @@
 
 #include "hidpp20.h"
 #include "libghostcat.h"
+#include "libghostcat-checksum.h"
 #include "libghostcat-hidraw.h"
 #include "libghostcat-util.h"
 #include "libghostcat-private.h"
@@ -117,14 +118,25 @@ hidpp20_get_quirk_string(enum hidpp20_quirk quirk)
 	abort();
 }
 
+int
+hidpp20_device_check_link(struct hidpp20_device *device)
+{
+	return hidpp_process_link_notifications(&device->base, device->index);
+}
+
+/**
+ * Send msg and wait for its answer, at least min_timeout_ms for each read
+ * (0 to use only the round-trip time of the device).
+ */
 static int
 hidpp20_request_command_allow_error(struct hidpp20_device *device, union hidpp20_message *msg,
-				    bool allow_error)
+				    bool allow_error, unsigned int min_timeout_ms)
 {
 	union hidpp20_message read_buffer;
 	int ret;
 	uint8_t hidpp_err = 0;
 	size_t msg_len;
+	uint64_t start;
 
 	/* msg->address is 4 MSB: subcommand, 4 LSB: 4-bit SW identifier so
 	 * the device knows who to respond to. kernel uses 0x1 */
@@ -136,6 +148,13 @@ hidpp20_request_command_allow_error(struct hidpp20_device *device, union hidpp20
 	}
 	msg->msg.address |= DEVICE_SW_ID;
 
+	/* Don't wait for a sleeping device to time out, the receiver
+	 * tells us when it is back */
+	if (device->base.offline) {
+		hidpp_log_debug(&device->base, "hidpp20: device is offline\n");
+		return -ENOTCONN;
+	}
+
 	/* some mice don't support short reports */
 	if (msg->msg.report_id == REPORT_ID_SHORT && !(device->base.supported_report_types & HIDPP_REPORT_SHORT))
 		msg->msg.report_id = REPORT_ID_LONG;
@@ -149,6 +168,7 @@ hidpp20_request_command_allow_error(struct hidpp20_device *device, union hidpp20
 	msg_len = msg->msg.report_id == REPORT_ID_SHORT ? SHORT_MESSAGE_LENGTH : LONG_MESSAGE_LENGTH;
 
 	/* Send the message to the Device */
+	start = now(CLOCK_MONOTONIC);
 	ret = hidpp_write_command(&device->base, msg->data, msg_len);
 	if (ret)
 		goto out_err;
@@ -158,12 +178,17 @@ hidpp20_request_command_allow_error(struct hidpp20_device *device, union hidpp20
 	 * loop until we get the actual answer or an error code.
 	 */
 	do {
-		ret = hidpp_read_response(&device->base, read_buffer.data, LONG_MESSAGE_LENGTH);
-
-		/* Wait and retry if the USB timed out */
-		if (ret == -ETIMEDOUT) {
-			msleep(10);
-			ret = hidpp_read_response(&device->base, read_buffer.data, LONG_MESSAGE_LENGTH);
+		ret = hidpp_read_response(&device->base, read_buffer.data,
+					  LONG_MESSAGE_LENGTH, min_timeout_ms);
+
+		if (ret > 0 &&
+		    hidpp_handle_link_notification(&device->base, device->index,
+						   read_buffer.data, ret)) {
+			if (device->base.offline) {
+				ret = -ENOTCONN;
+				break;
+			}
+			continue;
 		}
 
 		if (read_buffer.msg.report_id != REPORT_ID_SHORT &&
@@ -197,6 +222,10 @@ hidpp20_request_command_allow_error(struct hidpp20_device *device, union hidpp20
 		}
 	} while (ret > 0);
 
+	if (ret > 0)
+		hidpp_device_update_rtt(&device->base, start);
+	hidpp_device_update_link(&device->base, ret);
+
 	if (ret < 0) {
 		hidpp_log_error(&device->base, "    USB error: %s (%d)\n", strerror(-ret), -ret);
 		perror("write");
@@ -217,7 +246,18 @@ out_err:
 int
 hidpp20_request_command(struct hidpp20_device *device, union hidpp20_message *msg)
 {
-	int ret = hidpp20_request_command_allow_error(device, msg, false);
+	int ret = hidpp20_request_command_allow_error(device, msg, false, 0);
+
+	return ret > 0 ? -EPROTO : ret;
+}
+
+/* Same as hidpp20_request_command() for commands that write the flash and
+ * may take much longer than a round trip to answer */
+static int
+hidpp20_request_flash_command(struct hidpp20_device *device, union hidpp20_message *msg)
+{
+	int ret = hidpp20_request_command_allow_error(device, msg, false,
+						      HIDPP_FLASH_TIMEOUT_MS);
 
 	return ret > 0 ? -EPROTO : ret;
 }
@@ -296,7 +336,7 @@ hidpp20_root_get_protocol_version(struct hidpp20_device *device,
 		.msg.address = CMD_ROOT_GET_PROTOCOL_VERSION,
 	};
 
-	rc = hidpp20_request_command_allow_error(device, &msg, true);
+	rc = hidpp20_request_command_allow_error(device, &msg, true, 0);
 
 	if (rc == HIDPP10_ERR_INVALID_SUBID) {
 		*major = 1;
@@ -1021,7 +1061,8 @@ hidpp20_color_led_effect_get_zone_effect_info(struct hidpp20_device *device,
 int
 hidpp20_color_led_effects_set_zone_effect(struct hidpp20_device *device,
 					  uint8_t zone_index,
-					  struct hidpp20_led led)
+					  struct hidpp20_led led,
+					  bool persist)
 {
 	uint8_t feature_index;
 	union hidpp20_message msg = {
@@ -1029,7 +1070,8 @@ hidpp20_color_led_effects_set_zone_effect(struct hidpp20_device *device,
 		.msg.address = CMD_COLOR_LED_EFFECTS_SET_ZONE_EFFECT,
 		.msg.device_idx = device->index,
 		.msg.parameters[0] = zone_index,
-		.msg.parameters[12] = 1, /* write to RAM and flash */
+		/* 1: write to RAM and flash, 0: RAM only */
+		.msg.parameters[12] = persist ? 1 : 0,
 	};
 	int rc;
 	struct hidpp20_internal_led *internal_led = (struct hidpp20_internal_led*) &msg.msg.parameters[1];
@@ -1262,6 +1304,126 @@ hidpp20_rgb_effects_get_effect_info(struct hidpp20_device *device,
 	return 0;
 }
 
+/* -------------------------------------------------------------------------- */
+/* 0x8081: Per Key Lighting                                                   */
+/* -------------------------------------------------------------------------- */
+
+#define CMD_PER_KEY_LIGHTING_GET_INFO				0x00
+#define CMD_PER_KEY_LIGHTING_SET_INDIVIDUAL_RGB_ZONES		0x10
+#define CMD_PER_KEY_LIGHTING_SET_RGB_ZONES_SINGLE_VALUE		0x60
+#define CMD_PER_KEY_LIGHTING_FRAME_END				0x70
+
+/* get info type 0 returns the zone bitmap, 14 bytes per page */
+#define PER_KEY_LIGHTING_INFO_ZONES				0x00
+#define PER_KEY_LIGHTING_ZONES_PER_PAGE				(14 * 8)
+
+static int
+hidpp20_per_key_lighting_request(struct hidpp20_device *device,
+				 union hidpp20_message *msg)
+{
+	uint8_t feature_index;
+
+	feature_index = hidpp_root_get_feature_idx(device,
+						   HIDPP_PAGE_PER_KEY_LIGHTING);
+	if (feature_index == 0)
+		return -ENOTSUP;
+
+	msg->msg.sub_id = feature_index;
+
+	return hidpp20_request_command(device, msg);
+}
+
+int
+hidpp20_per_key_lighting_get_zones(struct hidpp20_device *device,
+				   uint8_t zones[HIDPP20_PER_KEY_LIGHTING_MAX_ZONES / 8])
+{
+	unsigned int page, zone;
+	int rc;
+
+	memset(zones, 0, HIDPP20_PER_KEY_LIGHTING_MAX_ZONES / 8);
+
+	for (page = 0; page * PER_KEY_LIGHTING_ZONES_PER_PAGE < HIDPP20_PER_KEY_LIGHTING_MAX_ZONES; page++) {
+		union hidpp20_message msg = {
+			.msg.report_id = REPORT_ID_SHORT,
+			.msg.device_idx = device->index,
+			.msg.address = CMD_PER_KEY_LIGHTING_GET_INFO,
+			.msg.parameters[0] = PER_KEY_LIGHTING_INFO_ZONES,
+			.msg.parameters[1] = 0,
+			.msg.parameters[2] = page,
+		};
+
+		rc = hidpp20_per_key_lighting_request(device, &msg);
+		if (rc)
+			return rc;
+
+		for (unsigned int bit = 0; bit < PER_KEY_LIGHTING_ZONES_PER_PAGE; bit++) {
+			zone = page * PER_KEY_LIGHTING_ZONES_PER_PAGE + bit;
+			if (zone >= HIDPP20_PER_KEY_LIGHTING_MAX_ZONES)
+				break;
+
+			if (msg.msg.parameters[2 + bit / 8] & (1 << (bit % 8)))
+				zones[zone / 8] |= 1 << (zone % 8);
+		}
+	}
+
+	return 0;
+}
+
+int
+hidpp20_per_key_lighting_set_individual(struct hidpp20_device *device,
+					const struct hidpp20_key_color *keys,
+					unsigned int num_keys)
+{
+	union hidpp20_message msg = {
+		.msg.report_id = REPORT_ID_LONG,
+		.msg.device_idx = device->index,
+		.msg.address = CMD_PER_KEY_LIGHTING_SET_INDIVIDUAL_RGB_ZONES,
+	};
+
+	if (num_keys == 0 || num_keys > HIDPP20_PER_KEY_LIGHTING_INDIVIDUAL_MAX)
+		return -EINVAL;
+
+	/* unused slots stay zero, zone 0 is ignored by the device */
+	memcpy(msg.msg.parameters, keys, num_keys * sizeof(*keys));
+
+	return hidpp20_per_key_lighting_request(device, &msg);
+}
+
+int
+hidpp20_per_key_lighting_set_single_value(struct hidpp20_device *device,
+					  struct hidpp20_color color,
+					  const uint8_t *zones,
+					  unsigned int num_zones)
+{
+	union hidpp20_message msg = {
+		.msg.report_id = REPORT_ID_LONG,
+		.msg.device_idx = device->index,
+		.msg.address = CMD_PER_KEY_LIGHTING_SET_RGB_ZONES_SINGLE_VALUE,
+		.msg.parameters[0] = color.red,
+		.msg.parameters[1] = color.green,
+		.msg.parameters[2] = color.blue,
+	};
+
+	if (num_zones == 0 || num_zones > HIDPP20_PER_KEY_LIGHTING_SINGLE_VALUE_MAX)
+		return -EINVAL;
+
+	memcpy(&msg.msg.parameters[3], zones, num_zones);
+
+	return hidpp20_per_key_lighting_request(device, &msg);
+}
+
+int
+hidpp20_per_key_lighting_frame_end(struct hidpp20_device *device)
+{
+	union hidpp20_message msg = {
+		.msg.report_id = REPORT_ID_SHORT,
+		.msg.device_idx = device->index,
+		.msg.address = CMD_PER_KEY_LIGHTING_FRAME_END,
+	};
+
+	return hidpp20_per_key_lighting_request(device, &msg);
+}
+
 /* -------------------------------------------------------------------------- */
 /* 0x1b04: Special keys and mouse buttons                                     */
 /* -------------------------------------------------------------------------- */
@@ -1776,6 +1938,97 @@ int hidpp20_adjustable_report_rate_set_report_rate(struct hidpp20_device *device
 	return 0;
 }
 
+/* -------------------------------------------------------------------------- */
+/* 0x8061 - Extended Adjustable Report Rate                                   */
+/* -------------------------------------------------------------------------- */
+
+#define CMD_EXTENDED_REPORT_RATE_GET_REPORT_RATE_LIST	0x10
+#define CMD_EXTENDED_REPORT_RATE_GET_REPORT_RATE	0x20
+#define CMD_EXTENDED_REPORT_RATE_SET_REPORT_RATE	0x30
+
+int hidpp20_extended_report_rate_get_report_rate_list(struct hidpp20_device *device,
+						      uint16_t *bitflags)
+{
+	uint8_t feature_index;
+	int rc;
+	union hidpp20_message msg = {
+		.msg.report_id = REPORT_ID_SHORT,
+		.msg.device_idx = device->index,
+		.msg.address = CMD_EXTENDED_REPORT_RATE_GET_REPORT_RATE_LIST,
+	};
+
+	feature_index = hidpp_root_get_feature_idx(device,
+						   HIDPP_PAGE_EXTENDED_ADJUSTABLE_REPORT_RATE);
+	if (feature_index == 0)
+		return -ENOTSUP;
+
+	msg.msg.sub_id = feature_index;
+
+	rc = hidpp20_request_command(device, &msg);
+	if (rc)
+		return rc;
+
+	*bitflags = get_unaligned_be_u16(&msg.msg.parameters[0]);
+
+	return 0;
+}
+
+int hidpp20_extended_report_rate_get_report_rate(struct hidpp20_device *device,
+						 uint8_t *rate)
+{
+	uint8_t feature_index;
+	int rc;
+	union hidpp20_message msg = {
+		.msg.report_id = REPORT_ID_SHORT,
+		.msg.device_idx = device->index,
+		.msg.address = CMD_EXTENDED_REPORT_RATE_GET_REPORT_RATE,
+	};
+
+	feature_index = hidpp_root_get_feature_idx(device,
+						   HIDPP_PAGE_EXTENDED_ADJUSTABLE_REPORT_RATE);
+	if (feature_index == 0)
+		return -ENOTSUP;
+
+	msg.msg.sub_id = feature_index;
+
+	rc = hidpp20_request_command(device, &msg);
+	if (rc)
+		return rc;
+
+	*rate = msg.msg.parameters[0];
+
+	return 0;
+}
+
+int hidpp20_extended_report_rate_set_report_rate(struct hidpp20_device *device,
+						 uint8_t rate)
+{
+	uint8_t feature_index;
+	int rc;
+	union hidpp20_message msg = {
+		.msg.report_id = REPORT_ID_SHORT,
+		.msg.device_idx = device->index,
+		.msg.address = CMD_EXTENDED_REPORT_RATE_SET_REPORT_RATE,
+		.msg.parameters[0] = rate,
+	};
+
+	if (rate > HIDPP20_EXTENDED_REPORT_RATE_MAX)
+		return -EINVAL;
+
+	feature_index = hidpp_root_get_feature_idx(device,
+						   HIDPP_PAGE_EXTENDED_ADJUSTABLE_REPORT_RATE);
+	if (feature_index == 0)
+		return -ENOTSUP;
+
+	msg.msg.sub_id = feature_index;
+
+	rc = hidpp20_request_command(device, &msg);
+	if (rc)
+		return rc;
+
+	return 0;
+}
+
 /* -------------------------------------------------------------------------- */
 /* 0x8100 - Onboard Profiles                                                  */
 /* -------------------------------------------------------------------------- */
@@ -1871,6 +2124,34 @@ hidpp20_onboard_profiles_get_profiles_desc(struct hidpp20_device *device,
 	return 0;
 }
 
+static int
+hidpp20_onboard_profiles_read_chunk(struct hidpp20_device *device,
+				    uint8_t feature_index,
+				    uint16_t sector,
+				    uint16_t offset,
+				    uint8_t *data)
+{
+	int rc;
+	union hidpp20_message msg = {
+		.msg.report_id = REPORT_ID_LONG,
+		.msg.device_idx = device->index,
+		.msg.sub_id = feature_index,
+		.msg.address = CMD_ONBOARD_PROFILES_MEMORY_READ,
+	};
+
+	set_unaligned_be_u16(&msg.msg.parameters[0], sector);
+	set_unaligned_be_u16(&msg.msg.parameters[2], offset);
+
+	rc = hidpp20_request_command(device, &msg);
+	if (rc)
+		return rc;
+
+	/* msg.msg.parameters is guaranteed to have a size >= 16 */
+	memcpy(data, msg.msg.parameters, 16);
+
+	return 0;
+}
+
 int
 hidpp20_onboard_profiles_read_sector(struct hidpp20_device *device,
 				     uint16_t sector,
@@ -1880,12 +2161,6 @@ hidpp20_onboard_profiles_read_sector(struct hidpp20_device *device,
 	uint16_t offset;
 	uint8_t feature_index;
 	int rc = 0;
-	union hidpp20_message buf;
-	union hidpp20_message msg = {
-		.msg.report_id = REPORT_ID_LONG,
-		.msg.device_idx = device->index,
-		.msg.address = CMD_ONBOARD_PROFILES_MEMORY_READ,
-	};
 
 	hidpp_log_debug(&device->base, "Reading sector 0x%04x\n", sector);
 
@@ -1894,9 +2169,6 @@ hidpp20_onboard_profiles_read_sector(struct hidpp20_device *device,
 	if (feature_index == 0)
 		return -ENOTSUP;
 
-	msg.msg.sub_id = feature_index;
-	set_unaligned_be_u16(&msg.msg.parameters[0], sector);
-
 	for (offset = 0; offset < sector_size; offset += 16) {
 		/*
 		 * the firmware replies with an ERR_INVALID_ARGUMENT error
@@ -1904,14 +2176,11 @@ hidpp20_onboard_profiles_read_sector(struct hidpp20_device *device,
 		 * less than 16 bytes to read we need to read from sector_size - 16
 		 */
 		offset = (sector_size - offset < 16) ? sector_size - 16 : offset;
-		set_unaligned_be_u16(&msg.msg.parameters[2], offset);
-		buf = msg;
-		rc = hidpp20_request_command(device, &buf);
+		rc = hidpp20_onboard_profiles_read_chunk(device, feature_index,
+							 sector, offset,
+							 data + offset);
 		if (rc)
 			return rc;
-
-		/* msg.msg.parameters is guaranteed to have a size >= 16 */
-		memcpy(data + offset, buf.msg.parameters, 16);
 	}
 
 	return 0;
@@ -1920,11 +2189,11 @@ hidpp20_onboard_profiles_read_sector(struct hidpp20_device *device,
 static bool
 hidpp20_onboard_profiles_is_sector_valid(struct hidpp20_device *device,
 					 uint16_t sector_size,
-					 uint8_t *data)
+					 const uint8_t *data)
 {
 	uint16_t crc, read_crc;
 
-	crc = hidpp_crc_ccitt(data, sector_size - 2);
+	crc = ghostcat_crc_ccitt(data, sector_size - 2);
 	read_crc = get_unaligned_be_u16(&data[sector_size - 2]);
 
 	if (crc != read_crc)
@@ -1933,6 +2202,119 @@ hidpp20_onboard_profiles_is_sector_valid(struct hidpp20_device *device,
 	return crc == read_crc;
 }
 
+void
+hidpp20_onboard_profiles_drop_cache(struct hidpp20_profiles *profiles)
+{
+	struct hidpp20_cached_sector *cached, *tmp;
+
+	list_for_each_safe(cached, tmp, &profiles->sector_cache, link) {
+		list_remove(&cached->link);
+		free(cached);
+	}
+}
+
+/* A device that was asleep may have been changed by another host or
+ * by the user switching onboard profiles, its cache is stale */
+static void
+hidpp20_onboard_profiles_check_cache(struct hidpp20_device *device,
+				     struct hidpp20_profiles *profiles)
+{
+	if (profiles->cache_reconnects == device->base.reconnects)
+		return;
+
+	hidpp_log_debug(&device->base, "Device reconnected, dropping the sector cache\n");
+	hidpp20_onboard_profiles_drop_cache(profiles);
+	profiles->cache_reconnects = device->base.reconnects;
+}
+
+static struct hidpp20_cached_sector *
+hidpp20_onboard_profiles_find_cached_sector(struct hidpp20_device *device,
+					    struct hidpp20_profiles *profiles,
+					    uint16_t sector)
+{
+	struct hidpp20_cached_sector *cached;
+
+	hidpp20_onboard_profiles_check_cache(device, profiles);
+
+	list_for_each(cached, &profiles->sector_cache, link) {
+		if (cached->sector == sector)
+			return cached;
+	}
+
+	return NULL;
+}
+
+static void
+hidpp20_onboard_profiles_cache_sector(struct hidpp20_device *device,
+				      struct hidpp20_profiles *profiles,
+				      uint16_t sector,
+				      const uint8_t *data)
+{
+	struct hidpp20_cached_sector *cached;
+
+	hidpp20_onboard_profiles_check_cache(device, profiles);
+
+	cached = zalloc(sizeof(*cached) + profiles->sector_size);
+	cached->sector = sector;
+	memcpy(cached->data, data, profiles->sector_size);
+	list_insert(&profiles->sector_cache, &cached->link);
+}
+
+/**
+ * Same as hidpp20_onboard_profiles_read_sector() but served from the
+ * profiles' sector cache if possible. Macros of several buttons usually
+ * share a sector, this avoids reading it again for each of them.
+ *
+ * Only sectors with a valid CRC are cached, anything else is read from
+ * the device every time.
+ */
+static int
+hidpp20_onboard_profiles_read_sector_cached(struct hidpp20_device *device,
+					    struct hidpp20_profiles *profiles,
+					    uint16_t sector,
+					    uint8_t *data)
+{
+	struct hidpp20_cached_sector *cached;
+	int rc;
+
+	cached = hidpp20_onboard_profiles_find_cached_sector(device, profiles, sector);
+	if (cached) {
+		hidpp_log_debug(&device->base,
+				"Using cached sector 0x%04x\n",
+				sector);
+		memcpy(data, cached->data, profiles->sector_size);
+		return 0;
+	}
+
+	rc = hidpp20_onboard_profiles_read_sector(device,
+						  sector,
+						  profiles->sector_size,
+						  data);
+	if (rc)
+		return rc;
+
+	if (hidpp20_onboard_profiles_is_sector_valid(device,
+						     profiles->sector_size,
+						     data))
+		hidpp20_onboard_profiles_cache_sector(device, profiles, sector, data);
+
+	return 0;
+}
+
+static void
+hidpp20_onboard_profiles_invalidate_sector(struct hidpp20_profiles *profiles,
+					   uint16_t sector)
+{
+	struct hidpp20_cached_sector *cached, *tmp;
+
+	list_for_each_safe(cached, tmp, &profiles->sector_cache, link) {
+		if (cached->sector == sector) {
+			list_remove(&cached->link);
+			free(cached);
+		}
+	}
+}
+
 static int
 hidpp20_onboard_profiles_write_start(struct hidpp20_device *device,
 				     uint16_t sector,
@@ -1952,7 +2334,7 @@ hidpp20_onboard_profiles_write_start(struct hidpp20_device *device,
 	set_unaligned_be_u16(&msg.msg.parameters[2], sub_address);
 	set_unaligned_be_u16(&msg.msg.parameters[4], count);
 
-	rc = hidpp20_request_command(device, &msg);
+	rc = hidpp20_request_flash_command(device, &msg);
 	if (rc)
 		return rc;
 
@@ -1971,7 +2353,7 @@ hidpp20_onboard_profiles_write_end(struct hidpp20_device *device,
 		.msg.address = CMD_ONBOARD_PROFILES_MEMORY_WRITE_END,
 	};
 
-	rc = hidpp20_request_command(device, &msg);
+	rc = hidpp20_request_flash_command(device, &msg);
 	if (rc)
 		return rc;
 
@@ -1993,22 +2375,21 @@ hidpp20_onboard_profiles_write_data(struct hidpp20_device *device,
 
 	memcpy(msg.msg.parameters, data, 16);
 
-	rc = hidpp20_request_command(device, &msg);
+	rc = hidpp20_request_flash_command(device, &msg);
 	if (rc)
 		return rc;
 
 	return 0;
 }
 
-int
-hidpp20_onboard_profiles_write_sector(struct hidpp20_device *device,
-				      uint16_t sector,
-				      uint16_t sector_size,
-				      uint8_t *data,
-				      bool write_crc)
+static int
+hidpp20_onboard_profiles_write_range(struct hidpp20_device *device,
+				     uint16_t sector,
+				     uint16_t offset,
+				     uint16_t count,
+				     uint8_t *data)
 {
 	uint8_t feature_index;
-	uint16_t crc;
 	int rc, transferred;
 
 	feature_index = hidpp_root_get_feature_idx(device,
@@ -2016,20 +2397,15 @@ hidpp20_onboard_profiles_write_sector(struct hidpp20_device *device,
 	if (feature_index == 0)
 		return -ENOTSUP;
 
-	if (write_crc) {
-		crc = hidpp_crc_ccitt(data, sector_size - 2);
-		set_unaligned_be_u16(&data[sector_size - 2], crc);
-	}
-
 	rc = hidpp20_onboard_profiles_write_start(device,
 						  sector,
-						  0,
-						  sector_size,
+						  offset,
+						  count,
 						  feature_index);
 	if (rc)
 		return rc;
 
-	for (transferred = 0; transferred < sector_size; transferred += 16) {
+	for (transferred = 0; transferred < count; transferred += 16) {
 		rc = hidpp20_onboard_profiles_write_data(device, data, feature_index);
 		if (rc)
 			return rc;
@@ -2043,6 +2419,291 @@ hidpp20_onboard_profiles_write_sector(struct hidpp20_device *device,
 	return 0;
 }
 
+int
+hidpp20_onboard_profiles_write_sector(struct hidpp20_device *device,
+				      uint16_t sector,
+				      uint16_t sector_size,
+				      uint8_t *data,
+				      bool write_crc)
+{
+	uint16_t crc;
+
+	if (write_crc) {
+		crc = ghostcat_crc_ccitt(data, sector_size - 2);
+		set_unaligned_be_u16(&data[sector_size - 2], crc);
+	}
+
+	return hidpp20_onboard_profiles_write_range(device, sector, 0,
+						    sector_size, data);
+}
+
+/**
+ * compares the chunk of sector at offset on the device with data. The
+ * last chunk holds the CRC, so comparing it tells whether the whole
+ * sector is what we expect.
+ *
+ * returns 1 if they match, 0 if not, or a negative error.
+ */
+static int
+hidpp20_onboard_profiles_chunk_matches(struct hidpp20_device *device,
+				       uint16_t sector,
+				       uint16_t offset,
+				       const uint8_t *data)
+{
+	uint8_t feature_index;
+	uint8_t chunk[16];
+	int rc;
+
+	feature_index = hidpp_root_get_feature_idx(device,
+						   HIDPP_PAGE_ONBOARD_PROFILES);
+	if (feature_index == 0)
+		return -ENOTSUP;
+
+	rc = hidpp20_onboard_profiles_read_chunk(device, feature_index, sector,
+						 offset, chunk);
+	if (rc)
+		return rc;
+
+	return memcmp(chunk, data, sizeof(chunk)) == 0;
+}
+
+/**
+ * writes the 16-byte chunks first..last of data to sector, which must
+ * already hold the cached copy everywhere else. Only the CRC chunk of
+ * the device is checked against the cache, so a sector changed behind
+ * our back since it was cached gets a full write.
+ *
+ * returns 0 if the range was written and is in place, 1 if the caller
+ * must write the whole sector, or a negative error.
+ */
+static int
+hidpp20_onboard_profiles_write_partial(struct hidpp20_device *device,
+				       struct hidpp20_profiles *profiles,
+				       const struct hidpp20_cached_sector *cached,
+				       uint16_t first,
+				       uint16_t last,
+				       uint8_t *data)
+{
+	uint16_t sector_size = profiles->sector_size;
+	uint16_t sector = cached->sector;
+	int rc;
+
+	rc = hidpp20_onboard_profiles_chunk_matches(device, sector,
+						    sector_size - 16,
+						    cached->data + sector_size - 16);
+	if (rc < 0)
+		return rc;
+	if (rc == 0) {
+		hidpp_log_debug(&device->base,
+				"Sector 0x%04x changed on the device, rewriting it\n",
+				sector);
+		return 1;
+	}
+
+	hidpp_log_debug(&device->base,
+			"Writing sector 0x%04x bytes %u-%u\n",
+			sector, first, last - 1);
+
+	/* not every firmware takes a memWriteStart in the middle of a
+	 * sector, an error or a CRC chunk that didn't change means the
+	 * range didn't end up where we wanted it */
+	rc = hidpp20_onboard_profiles_write_range(device, sector, first,
+						  last - first, data + first);
+	if (rc == -ENOTCONN)
+		return rc;
+	if (rc == 0)
+		rc = hidpp20_onboard_profiles_chunk_matches(device, sector,
+							    sector_size - 16,
+							    data + sector_size - 16);
+	if (rc == -ENOTCONN)
+		return rc;
+	if (rc != 1) {
+		hidpp_log_info(&device->base,
+			       "Partial write of sector 0x%04x failed (%d), rewriting it\n",
+			       sector, rc);
+		return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * computes the CRC of data and writes it to sector, leaving out the
+ * 16-byte chunks at either end that match the cached copy of the
+ * sector. The CRC is in the last chunk, so a small change usually
+ * costs the chunks from that change to the end of the sector. Without
+ * a cached copy, or if the device doesn't hold the cached copy
+ * anymore, the whole sector is written.
+ *
+ * returns 0 if the sector was up to date, 1 if it was written, or a
+ * negative error.
+ */
+static int
+hidpp20_onboard_profiles_update_sector(struct hidpp20_device *device,
+				       struct hidpp20_profiles *profiles,
+				       uint16_t sector,
+				       uint8_t *data)
+{
+	uint16_t sector_size = profiles->sector_size;
+	struct hidpp20_cached_sector *cached;
+	uint16_t first = 0, last = sector_size;
+	uint16_t crc;
+	int rc = 1;
+
+	crc = ghostcat_crc_ccitt(data, sector_size - 2);
+	set_unaligned_be_u16(&data[sector_size - 2], crc);
+
+	cached = hidpp20_onboard_profiles_find_cached_sector(device, profiles, sector);
+	if (cached) {
+		while (first < sector_size &&
+		       memcmp(cached->data + first, data + first,
+			      min(16, sector_size - first)) == 0)
+			first += 16;
+
+		if (first >= sector_size) {
+			hidpp_log_debug(&device->base,
+					"Sector 0x%04x is up to date\n", sector);
+			return 0;
+		}
+
+		last = first + 16;
+		for (uint16_t offset = last; offset < sector_size; offset += 16) {
+			if (memcmp(cached->data + offset, data + offset,
+				   min(16, sector_size - offset)) != 0)
+				last = offset + 16;
+		}
+		last = min(last, sector_size);
+
+		if (first > 0 || last < sector_size)
+			rc = hidpp20_onboard_profiles_write_partial(device, profiles,
+								    cached, first,
+								    last, data);
+	}
+
+	hidpp20_onboard_profiles_invalidate_sector(profiles, sector);
+
+	if (rc < 0)
+		return rc;
+
+	if (rc == 1) {
+		rc = hidpp20_onboard_profiles_write_range(device, sector, 0,
+							  sector_size, data);
+		if (rc)
+			return rc;
+	}
+
+	hidpp20_onboard_profiles_cache_sector(device, profiles, sector, data);
+
+	return 1;
+}
+
+int
+hidpp20_onboard_profiles_read_image_sector(struct hidpp20_device *device,
+					   struct hidpp20_profiles *profiles,
+					   uint16_t sector,
+					   uint8_t *data)
+{
+	int rc;
+
+	rc = hidpp20_onboard_profiles_read_sector_cached(device, profiles,
+							 sector, data);
+	if (rc)
+		return rc;
+
+	if (!hidpp20_onboard_profiles_is_sector_valid(device,
+						      profiles->sector_size,
+						      data))
+		return -ENODATA;
+
+	return 0;
+}
+
+/**
+ * compares data with the sector on the device. The last chunk holds
+ * the CRC, so a mismatch usually shows there without reading the
+ * whole sector.
+ */
+static int
+hidpp20_onboard_profiles_sector_matches(struct hidpp20_device *device,
+					struct hidpp20_profiles *profiles,
+					uint16_t sector,
+					const uint8_t *data)
+{
+	uint16_t sector_size = profiles->sector_size;
+	struct hidpp20_cached_sector *cached;
+	_cleanup_free_ uint8_t *current = NULL;
+	uint8_t feature_index;
+	int rc;
+
+	cached = hidpp20_onboard_profiles_find_cached_sector(device, profiles, sector);
+	if (cached)
+		return memcmp(cached->data, data, sector_size) == 0;
+
+	feature_index = hidpp_root_get_feature_idx(device,
+						   HIDPP_PAGE_ONBOARD_PROFILES);
+	if (feature_index == 0)
+		return -ENOTSUP;
+
+	current = hidpp20_onboard_profiles_allocate_sector(profiles);
+
+	rc = hidpp20_onboard_profiles_read_chunk(device, feature_index, sector,
+						 sector_size - 16,
+						 current + sector_size - 16);
+	if (rc)
+		return rc;
+
+	if (memcmp(current + sector_size - 16, data + sector_size - 16, 16) != 0)
+		return 0;
+
+	rc = hidpp20_onboard_profiles_read_sector_cached(device, profiles,
+							 sector, current);
+	if (rc)
+		return rc;
+
+	return memcmp(current, data, sector_size) == 0;
+}
+
+int
+hidpp20_onboard_profiles_apply_sector(struct hidpp20_device *device,
+				      struct hidpp20_profiles *profiles,
+				      uint16_t sector,
+				      const uint8_t *data)
+{
+	_cleanup_free_ uint8_t *buffer = NULL;
+	int rc;
+
+	if (!hidpp20_onboard_profiles_is_sector_valid(device,
+						      profiles->sector_size,
+						      data))
+		return -EINVAL;
+
+	rc = hidpp20_onboard_profiles_sector_matches(device, profiles,
+						     sector, data);
+	if (rc < 0)
+		return rc;
+	if (rc) {
+		hidpp_log_debug(&device->base,
+				"Sector 0x%04x is up to date\n", sector);
+		return 0;
+	}
+
+	/* write_sector() may modify the data it is given */
+	buffer = hidpp20_onboard_profiles_allocate_sector(profiles);
+	memcpy(buffer, data, profiles->sector_size);
+
+	hidpp20_onboard_profiles_invalidate_sector(profiles, sector);
+
+	rc = hidpp20_onboard_profiles_write_sector(device, sector,
+						   profiles->sector_size,
+						   buffer, false);
+	if (rc)
+		return rc > 0 ? -EPROTO : rc;
+
+	hidpp20_onboard_profiles_cache_sector(device, profiles, sector, data);
+
+	return 1;
+}
+
 static int
 hidpp20_onboard_profiles_get_onboard_mode(struct hidpp20_device *device)
 {
@@ -2294,6 +2955,8 @@ hidpp20_onboard_profiles_allocate(struct hidpp20_device *device,
 	profiles->has_g_shift = (info.mechanical_layout & 0x03) == 0x02;
 	profiles->has_dpi_shift = ((info.mechanical_layout & 0x0c) >> 2) == 0x02;
 	profiles->active_profile_index = active_profile_index;
+	list_init(&profiles->sector_cache);
+	profiles->cache_reconnects = device->base.reconnects;
 	switch(info.various_info & 0x07) {
 	case 1:
 		profiles->corded = 1;
@@ -2389,10 +3052,10 @@ hidpp20_onboard_profiles_read_macro(struct hidpp20_device *device,
 		}
 
 		if (rc == -ENOMEM) {
-			rc = hidpp20_onboard_profiles_read_sector(device,
-								  page,
-								  profiles->sector_size,
-								  memory);
+			rc = hidpp20_onboard_profiles_read_sector_cached(device,
+									 profiles,
+									 page,
+									 memory);
 			if (rc)
 				goto out_err;
 		}
@@ -2497,6 +3160,8 @@ hidpp20_onboard_profiles_destroy(struct hidpp20_profiles *profiles_list)
 	if (!profiles_list)
 		return;
 
+	hidpp20_onboard_profiles_drop_cache(profiles_list);
+
 	for (i = 0; i < profiles_list->num_profiles; i++) {
 		profile = &profiles_list->profiles[i];
 
@@ -2541,15 +3206,16 @@ hidpp20_onboard_profiles_write_dict(struct hidpp20_device *device,
 			   hidpp20_onboard_profiles_compute_dict_size(device,
 								      profiles_list));
 
-	rc = hidpp20_onboard_profiles_write_sector(device,
-						   0x0000,
-						   sector_size,
-						   data,
-						   true);
-	if (rc)
+	rc = hidpp20_onboard_profiles_update_sector(device,
+						    profiles_list,
+						    0x0000,
+						    data);
+	if (rc < 0) {
 		hidpp_log_error(&device->base, "failed to write profile dictionary\n");
+		return rc;
+	}
 
-	return rc;
+	return 0;
 }
 
 static void
@@ -2589,15 +3255,12 @@ hidpp20_buttons_to_cpu(struct hidpp20_device *device,
 			button->special.profile = b->special.profile;
 			break;
 		case HIDPP20_BUTTON_MACRO:
+			/* the macro itself is only read on request, see
+			 * hidpp20_onboard_profiles_load_macro() */
 			if (profile->macros[i]) {
 				free(profile->macros[i]);
 				profile->macros[i] = NULL;
 			}
-			hidpp20_onboard_profiles_parse_macro(device,
-							     profiles,
-							     b->macro.page,
-							     b->macro.offset,
-							     &profile->macros[i]);
 
 			/* the actual page is stored in the 'zero' field */
 			button->macro.page = i;
@@ -2709,6 +3372,24 @@ hidpp20_onboard_profiles_read_led(struct hidpp20_led *led,
 	led->brightness = brightness;
 }
 
+/* The profile stores the report interval in ms, so it can't express
+ * more than 1000Hz. Faster rates are stored as 1ms and the driver sets
+ * the actual rate through 0x8061. */
+static unsigned int
+hidpp20_onboard_profiles_raw_to_report_rate(uint8_t raw)
+{
+	return 1000 / max(1, raw);
+}
+
+static uint8_t
+hidpp20_onboard_profiles_report_rate_to_raw(unsigned int hz)
+{
+	if (hz == 0 || hz >= 1000)
+		return 1;
+
+	return min(1000 / hz, 0xffU);
+}
+
 static int
 hidpp20_onboard_profiles_parse_profile(struct hidpp20_device *device,
 				       struct hidpp20_profiles *profiles_list,
@@ -2728,10 +3409,10 @@ hidpp20_onboard_profiles_parse_profile(struct hidpp20_device *device,
 	data = hidpp20_onboard_profiles_allocate_sector(profiles_list);
 	pdata = (union hidpp20_internal_profile *)data;
 
-	rc = hidpp20_onboard_profiles_read_sector(device,
-						  sector,
-						  profiles_list->sector_size,
-						  data);
+	rc = hidpp20_onboard_profiles_read_sector_cached(device,
+							 profiles_list,
+							 sector,
+							 data);
 	if (rc < 0)
 		return rc;
 
@@ -2743,7 +3424,7 @@ hidpp20_onboard_profiles_parse_profile(struct hidpp20_device *device,
 		}
 	}
 
-	profile->report_rate = 1000 / max(1, pdata->profile.report_rate);
+	profile->report_rate = hidpp20_onboard_profiles_raw_to_report_rate(pdata->profile.report_rate);
 	profile->default_dpi = pdata->profile.default_dpi;
 	profile->switched_dpi = pdata->profile.switched_dpi;
 
@@ -2786,27 +3467,28 @@ hidpp20_onboard_profiles_initialize(struct hidpp20_device *device,
 	unsigned i;
 	uint16_t addr;
 	bool crc_valid;
-	bool read_userdata = true;
 
 	assert(profiles);
 
 	for (i = 0; i < profiles->num_profiles; i++) {
 		profiles->profiles[i].address = 0;
 		profiles->profiles[i].enabled = 0;
+		profiles->profiles[i].loaded = 0;
 	}
+	profiles->has_user_profiles = 1;
 
 	data = hidpp20_onboard_profiles_allocate_sector(profiles);
 
-	rc = hidpp20_onboard_profiles_read_sector(device,
-						  HIDPP20_USER_PROFILES_G402,
-						  profiles->sector_size,
-						  data);
+	rc = hidpp20_onboard_profiles_read_sector_cached(device,
+							 profiles,
+							 HIDPP20_USER_PROFILES_G402,
+							 data);
 
 	if (rc && device->quirk == HIDPP20_QUIRK_G305) {
 		/* The G305 has a bug where it throws an ERR_INVALID_ARGUMENT
 		   if the sector has not been written to yet. If this happens
 		   we will read the ROM profiles.*/
-		read_userdata = false;
+		profiles->has_user_profiles = 0;
 		goto read_profiles;
 	}
 
@@ -2840,42 +3522,106 @@ hidpp20_onboard_profiles_initialize(struct hidpp20_device *device,
 	} else {
 		hidpp_log_debug(&device->base, "Profile directory has an invalid CRC... Reading ROM profiles.\n");
 
-		read_userdata = false;
+		profiles->has_user_profiles = 0;
 	}
 
 read_profiles:
-	for (i = 0; i < profiles->num_profiles; i++) {
-		if (read_userdata) {
-			hidpp_log_debug(&device->base, "Parsing profile %u\n", i);
-			rc = hidpp20_onboard_profiles_parse_profile(device,
-								    profiles,
-								    i,
-								    true);
-
-			/* on fail to read the user profile fallback to the default profile */
-			if (rc)
-				hidpp_log_debug(&device->base, "Profile %u is bad. Falling back to the ROM settings.\n", i);
-			else
-				continue;
-		}
+	/* The other profiles are read once somebody asks for them, most
+	 * callers never look past the active one. */
+	i = profiles->active_profile_index;
+	if (i >= profiles->num_profiles)
+		i = 0;
 
-		/* the number of rom profiles can be different than the number of user profiles
-		   so we if there are not enough rom profiles to populate all the user profiles
-		   we just use the first rom profile */
-		if (i + 1 > profiles->num_rom_profiles)
-			profiles->profiles[i].address = HIDPP20_ROM_PROFILES_G402 + 1;
-		else
-			profiles->profiles[i].address = HIDPP20_ROM_PROFILES_G402 + i + 1;
+	rc = hidpp20_onboard_profiles_load_profile(device, profiles, i);
+	if (rc < 0)
+		return rc;
+
+	return profiles->num_profiles;
+}
+
+int
+hidpp20_onboard_profiles_load_profile(struct hidpp20_device *device,
+				      struct hidpp20_profiles *profiles,
+				      unsigned int index)
+{
+	struct hidpp20_profile *profile;
+	int rc;
 
+	if (index >= profiles->num_profiles)
+		return -EINVAL;
+
+	profile = &profiles->profiles[index];
+	if (profile->loaded)
+		return 0;
+
+	if (profiles->has_user_profiles) {
+		hidpp_log_debug(&device->base, "Parsing profile %u\n", index);
 		rc = hidpp20_onboard_profiles_parse_profile(device,
-							profiles,
-							i,
-							false);
-		if (rc < 0)
+							    profiles,
+							    index,
+							    true);
+
+		/* on fail to read the user profile fallback to the default profile */
+		if (rc == 0) {
+			profile->loaded = 1;
+			return 0;
+		}
+
+		/* a sleeping device doesn't make the profile bad */
+		if (rc == -ENOTCONN)
 			return rc;
+
+		hidpp_log_debug(&device->base, "Profile %u is bad. Falling back to the ROM settings.\n", index);
 	}
 
-	return profiles->num_profiles;
+	/* the number of rom profiles can be different than the number of user profiles
+	   so we if there are not enough rom profiles to populate all the user profiles
+	   we just use the first rom profile */
+	if (index + 1 > profiles->num_rom_profiles)
+		profile->address = HIDPP20_ROM_PROFILES_G402 + 1;
+	else
+		profile->address = HIDPP20_ROM_PROFILES_G402 + index + 1;
+
+	rc = hidpp20_onboard_profiles_parse_profile(device,
+						    profiles,
+						    index,
+						    false);
+	if (rc < 0)
+		return rc;
+
+	profile->loaded = 1;
+
+	return 0;
+}
+
+int
+hidpp20_onboard_profiles_load_macro(struct hidpp20_device *device,
+				    struct hidpp20_profiles *profiles,
+				    unsigned int index,
+				    unsigned int button)
+{
+	struct hidpp20_profile *profile;
+	union hidpp20_button_binding *binding;
+
+	if (index >= profiles->num_profiles ||
+	    button >= profiles->num_buttons)
+		return -EINVAL;
+
+	profile = &profiles->profiles[index];
+	binding = &profile->buttons[button];
+
+	if (!profile->loaded || binding->any.type != HIDPP20_BUTTON_MACRO)
+		return -EINVAL;
+
+	if (profile->macros[button])
+		return 0;
+
+	/* the actual page is stored in the 'zero' field */
+	return hidpp20_onboard_profiles_parse_macro(device,
+						    profiles,
+						    binding->macro.zero,
+						    binding->macro.offset,
+						    &profile->macros[button]);
 }
 
 void
@@ -2932,7 +3678,6 @@ hidpp20_onboard_profiles_write_profile(struct hidpp20_device *device,
 {
 	union hidpp20_internal_profile *pdata;
 	_cleanup_free_ uint8_t *data = NULL;
-	uint16_t sector_size = profiles_list->sector_size;
 	uint16_t sector = index + 1;
 	struct hidpp20_profile *profile = &profiles_list->profiles[index];
 	unsigned i;
@@ -2941,12 +3686,17 @@ hidpp20_onboard_profiles_write_profile(struct hidpp20_device *device,
 	if (index >= profiles_list->num_profiles)
 		return -EINVAL;
 
+	/* don't overwrite a profile nobody looked at with zeroes */
+	rc = hidpp20_onboard_profiles_load_profile(device, profiles_list, index);
+	if (rc < 0)
+		return rc;
+
 	data = hidpp20_onboard_profiles_allocate_sector(profiles_list);
 	pdata = (union hidpp20_internal_profile *)data;
 
 	memset(data, 0xff, profiles_list->sector_size);
 
-	pdata->profile.report_rate = 1000 / profile->report_rate;
+	pdata->profile.report_rate = hidpp20_onboard_profiles_report_rate_to_raw(profile->report_rate);
 	pdata->profile.default_dpi = profile->default_dpi;
 	pdata->profile.switched_dpi = profile->switched_dpi;
 
@@ -2980,12 +3730,16 @@ hidpp20_onboard_profiles_write_profile(struct hidpp20_device *device,
 		pdata->profile.custom_animation_index = 0x00;
 	}
 
-	rc = hidpp20_onboard_profiles_write_sector(device, sector, sector_size, data, true);
+	rc = hidpp20_onboard_profiles_update_sector(device, profiles_list,
+						    sector, data);
 	if (rc < 0) {
 		hidpp_log_error(&device->base, "failed to write profile\n");
 		return rc;
 	}
 
+	profile->address = HIDPP20_USER_PROFILES_G402 | sector;
+	profile->dirty = 0;
+
 	return 0;
 }
 
@@ -3002,13 +3756,19 @@ hidpp20_onboard_profiles_commit(struct hidpp20_device *device,
 		profile = &profiles_list->profiles[i];
 
 		if (profile->enabled) {
+			enabled_profile = true;
+
+			/* an unchanged profile already in user memory
+			 * doesn't need to be read back or written */
+			if (!profile->dirty &&
+			    profile->address == (HIDPP20_USER_PROFILES_G402 | (i + 1)))
+				continue;
+
 			rc = hidpp20_onboard_profiles_write_profile(device,
 								    profiles_list,
 								    i);
 			if (rc < 0)
 				return rc;
-
-			enabled_profile = true;
 		}
 	}
 
@@ -3101,6 +3861,12 @@ hidpp20_device_new(const struct hidpp_device *base, unsigned int idx, struct hid
 	if (rc < 0)
 		goto err;
 
+	/* only devices behind a receiver can go to sleep on us */
+	for (unsigned int i = 0; i < dev->feature_count; i++) {
+		if (dev->feature_list[i].feature == HIDPP_PAGE_WIRELESS_DEVICE_STATUS)
+			dev->base.wireless = true;
+	}
+
 	return dev;
 err:
 	free(dev);
@@ -72,6 +72,14 @@ struct hidpp20_device {
 
 int hidpp20_request_command(struct hidpp20_device *dev, union hidpp20_message *msg);
 
+/**
+ * process the connection notifications pending for a device behind a
+ * receiver.
+ *
+ * returns 0 if the device is online, -ENOTCONN if it is asleep.
+ */
+int hidpp20_device_check_link(struct hidpp20_device *device);
+
 #define CASE_RETURN_STRING(a) case a: return #a; break
 
 const char *hidpp20_feature_get_name(uint16_t feature);
@@ -441,6 +449,37 @@ int hidpp20_adjustable_report_rate_get_report_rate(struct hidpp20_device *device
 int hidpp20_adjustable_report_rate_set_report_rate(struct hidpp20_device *device,
 						   uint8_t rate_ms);
 
+/* -------------------------------------------------------------------------- */
+/* 0x8061 - Extended Adjustable Report Rate                                   */
+/* -------------------------------------------------------------------------- */
+
+#define HIDPP_PAGE_EXTENDED_ADJUSTABLE_REPORT_RATE	0x8061
+
+/**
+ * report rates are sent as an index, 0 is 125Hz (8ms) and each step
+ * doubles the rate up to 8000Hz (125us).
+ */
+#define HIDPP20_EXTENDED_REPORT_RATE_MAX		6
+
+static inline unsigned int
+hidpp20_extended_report_rate_to_hz(uint8_t rate)
+{
+	return rate <= HIDPP20_EXTENDED_REPORT_RATE_MAX ? 125U << rate : 0;
+}
+
+/**
+ * set bitflags to the supported report rates, bit n is set if rate index
+ * n is supported.
+ */
+int hidpp20_extended_report_rate_get_report_rate_list(struct hidpp20_device *device,
+						      uint16_t *bitflags);
+
+int hidpp20_extended_report_rate_get_report_rate(struct hidpp20_device *device,
+						 uint8_t *rate);
+
+int hidpp20_extended_report_rate_set_report_rate(struct hidpp20_device *device,
+						 uint8_t rate);
+
 /* -------------------------------------------------------------------------- */
 /* 0x8070v4 - Color LED effects                                               */
 /* -------------------------------------------------------------------------- */
@@ -506,10 +545,12 @@ hidpp20_rgb_effects_get_effect_info(struct hidpp20_device *device,
 
 struct hidpp20_led;
 
+/* persist: also write the effect to flash, otherwise it is lost on reset */
 int
 hidpp20_color_led_effects_set_zone_effect(struct hidpp20_device *device,
 					  uint8_t zone_index,
-					  struct hidpp20_led led);
+					  struct hidpp20_led led,
+					  bool persist);
 
 int
 hidpp20_color_led_effects_get_zone_effect(struct hidpp20_device *device,
@@ -573,6 +614,55 @@ enum hidpp20_color_led_zone_effect {
 #define HIDPP20_RGB_EFFECTS_SLOT_INFO_EFCT_NAME_11_21	0x05
 #define HIDPP20_RGB_EFFECTS_SLOT_INFO_EFCT_NAME_21_31	0x06
 
+/* -------------------------------------------------------------------------- */
+/* 0x8081 - Per Key Lighting                                                  */
+/* -------------------------------------------------------------------------- */
+
+#define HIDPP_PAGE_PER_KEY_LIGHTING			0x8081
+
+/* zone ids are one byte, zone 0 is never a key */
+#define HIDPP20_PER_KEY_LIGHTING_MAX_ZONES		256
+
+/* keys per message of the writes below */
+#define HIDPP20_PER_KEY_LIGHTING_INDIVIDUAL_MAX		4
+#define HIDPP20_PER_KEY_LIGHTING_SINGLE_VALUE_MAX	13
+
+struct hidpp20_color;
+struct hidpp20_key_color;
+
+/**
+ * Fill zones with a bitmap of the zone ids the device has, bit n of
+ * byte n / 8 for zone n.
+ */
+int
+hidpp20_per_key_lighting_get_zones(struct hidpp20_device *device,
+				   uint8_t zones[HIDPP20_PER_KEY_LIGHTING_MAX_ZONES / 8]);
+
+/**
+ * Set up to HIDPP20_PER_KEY_LIGHTING_INDIVIDUAL_MAX keys to their own
+ * color. The keys change with the next hidpp20_per_key_lighting_frame_end().
+ */
+int
+hidpp20_per_key_lighting_set_individual(struct hidpp20_device *device,
+					const struct hidpp20_key_color *keys,
+					unsigned int num_keys);
+
+/**
+ * Set up to HIDPP20_PER_KEY_LIGHTING_SINGLE_VALUE_MAX keys to the same
+ * color. The keys change with the next hidpp20_per_key_lighting_frame_end().
+ */
+int
+hidpp20_per_key_lighting_set_single_value(struct hidpp20_device *device,
+					  struct hidpp20_color color,
+					  const uint8_t *zones,
+					  unsigned int num_zones);
+
+/**
+ * Show the keys set since the last frame end.
+ */
+int
+hidpp20_per_key_lighting_frame_end(struct hidpp20_device *device);
+
 /* -------------------------------------------------------------------------- */
 /* 0x8100 - Onboard Profiles                                                  */
 /* -------------------------------------------------------------------------- */
@@ -739,6 +829,13 @@ struct hidpp20_color {
 } __attribute__((packed));
 _Static_assert(sizeof(struct hidpp20_color) == 3, "Invalid size");
 
+/* one key of hidpp20_per_key_lighting_set_individual() */
+struct hidpp20_key_color {
+	uint8_t zone;
+	struct hidpp20_color color;
+} __attribute__((packed));
+_Static_assert(sizeof(struct hidpp20_key_color) == 4, "Invalid size");
+
 enum hidpp20_led_type {
 	HIDPP20_LED_UNKNOWN = -1,
 	HIDPP20_LED_LOGO = 0,
@@ -876,6 +973,8 @@ _Static_assert(sizeof(union hidpp20_macro_data) == 3, "Invalid size");
 struct hidpp20_profile {
 	uint16_t address;
 	uint8_t enabled;
+	uint8_t loaded;
+	uint8_t dirty; /* needs to be written by hidpp20_onboard_profiles_commit() */
 	char name[16 * 3];
 	uint16_t powersave_timeout;
 	uint16_t poweroff_timeout;
@@ -905,6 +1004,12 @@ struct hidpp20_onboard_profiles_info {
 } __attribute__((packed));
 _Static_assert(sizeof(struct hidpp20_onboard_profiles_info) == 16, "Invalid size");
 
+struct hidpp20_cached_sector {
+	struct list link;
+	uint16_t sector;
+	uint8_t data[];
+};
+
 struct hidpp20_profiles {
 	uint8_t num_profiles;
 	uint8_t num_rom_profiles;
@@ -918,7 +1023,10 @@ struct hidpp20_profiles {
 	uint8_t sector_count;
 	uint16_t sector_size;
 	uint8_t active_profile_index;
+	uint8_t has_user_profiles;
 	struct hidpp20_profile *profiles;
+	struct list sector_cache; /* struct hidpp20_cached_sector */
+	unsigned cache_reconnects; /* the device's reconnects when the cache was filled */
 };
 
 /**
@@ -945,14 +1053,49 @@ int hidpp20_onboard_profiles_allocate(struct hidpp20_device *device,
 void
 hidpp20_onboard_profiles_destroy(struct hidpp20_profiles *profiles_list);
 
+/**
+ * Forget every sector read from or written to the device, for when the
+ * flash may have changed behind our back. The cache is also dropped
+ * whenever the device reconnects.
+ */
+void
+hidpp20_onboard_profiles_drop_cache(struct hidpp20_profiles *profiles);
+
 /**
  * initialize a struct hidpp20_profiles previous allocated with
  * hidpp20_onboard_profiles_allocate().
+ *
+ * Only the profile directory and the active profile are read, the other
+ * profiles are read by hidpp20_onboard_profiles_load_profile().
  */
 int
 hidpp20_onboard_profiles_initialize(struct hidpp20_device *device,
 				    struct hidpp20_profiles *profiles);
 
+/**
+ * read the profile at the given index from the device, falling back to
+ * the ROM profile if the user profile is invalid. Does nothing if the
+ * profile is already loaded.
+ *
+ * returns 0 or a negative error.
+ */
+int
+hidpp20_onboard_profiles_load_profile(struct hidpp20_device *device,
+				      struct hidpp20_profiles *profiles,
+				      unsigned int index);
+
+/**
+ * read the macro bound to the given button of a loaded profile into
+ * profile->macros[button]. Does nothing if the macro is already read.
+ *
+ * returns 0 or a negative error.
+ */
+int
+hidpp20_onboard_profiles_load_macro(struct hidpp20_device *device,
+				    struct hidpp20_profiles *profiles,
+				    unsigned int index,
+				    unsigned int button);
+
 /**
  * return the current profile index or a negative error.
  */
@@ -986,6 +1129,10 @@ hidpp20_onboard_profiles_set_current_dpi_index(struct hidpp20_device *device,
 
 /**
  * Write the internal state of the device onto the FLASH.
+ *
+ * Only the profiles marked dirty, and enabled profiles that are not in
+ * user memory yet, are written. Chunks of a sector that match the
+ * cached copy of that sector are skipped.
  */
 int
 hidpp20_onboard_profiles_commit(struct hidpp20_device *device,
@@ -1016,6 +1163,27 @@ hidpp20_onboard_profiles_allocate_sector(struct hidpp20_profiles *profiles)
 	return zalloc(profiles->sector_size);
 }
 
+/**
+ * reads a sector for a device image. Returns -ENODATA if the sector
+ * does not hold valid data.
+ */
+int
+hidpp20_onboard_profiles_read_image_sector(struct hidpp20_device *device,
+					   struct hidpp20_profiles *profiles,
+					   uint16_t sector,
+					   uint8_t *data);
+
+/**
+ * writes a sector from a device image, data must include its CRC.
+ * Returns 1 if the sector was written, 0 if the device already held
+ * the same data or a negative errno.
+ */
+int
+hidpp20_onboard_profiles_apply_sector(struct hidpp20_device *device,
+				      struct hidpp20_profiles *profiles,
+				      uint16_t sector,
+				      const uint8_t *data);
+
 void
 hidpp20_onboard_profiles_read_led(struct hidpp20_led *led,
 				  struct hidpp20_internal_led internal_led);
@@ -0,0 +1,386 @@
+/*
+ * libghostcat asynchronous jobs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * The drivers talk to the devices synchronously, so an asynchronous job
+ * runs the synchronous code path in a thread of its own. The device is
+ * marked busy and must not be touched by the caller until the job is done,
+ * the public functions that change or talk to the device refuse meanwhile.
+ * Finished jobs are queued on the context and signaled through an eventfd,
+ * ghostcat_dispatch() then invokes the callbacks on the caller's thread.
+ *
+ * A job only touches its own device, never udev or the context:
+ * - devices are created, referenced and destroyed on the caller's thread
+ * - the hidraw nodes a probe may open are looked up in udev when the
+ *   device is created, see ghostcat_device_scan_hidraw()
+ * - log messages are kept with the job and passed to the log handler
+ *   when the job is done, at the log priority the job started with
+ * - the driver list is only read, it does not change after
+ *   ghostcat_create_context()
+ * The only state shared with the caller's thread is the done queue.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "libghostcat-private.h"
+
+enum ghostcat_job_type {
+	GHOSTCAT_JOB_PROBE,
+	GHOSTCAT_JOB_COMMIT,
+	GHOSTCAT_JOB_REFRESH,
+};
+
+struct ghostcat_job_message {
+	enum ghostcat_log_priority priority;
+	char *text;
+	struct list link;
+};
+
+struct ghostcat_job {
+	struct ghostcat *ratbag;
+	struct ghostcat_device *device; /* holds a reference */
+	enum ghostcat_job_type type;
+	union {
+		ghostcat_device_probe_callback probe;
+		ghostcat_device_callback device;
+	} callback;
+	void *userdata;
+	int result;
+
+	/* a snapshot of the context's log settings */
+	bool log_enabled;
+	enum ghostcat_log_priority log_priority;
+	struct list messages;
+
+	pthread_t thread;
+	struct list link;
+};
+
+/* the job running on this thread, NULL on the caller's thread */
+static __thread struct ghostcat_job *current_job;
+
+int
+ghostcat_jobs_init(struct ghostcat *ratbag)
+{
+	ratbag->job_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (ratbag->job_fd < 0)
+		return -errno;
+
+	pthread_mutex_init(&ratbag->job_lock, NULL);
+	list_init(&ratbag->jobs_done);
+
+	return 0;
+}
+
+void
+ghostcat_jobs_release(struct ghostcat *ratbag)
+{
+	/* every job holds a device and thus a context reference */
+	assert(list_empty(&ratbag->jobs_done));
+
+	close(ratbag->job_fd);
+	pthread_mutex_destroy(&ratbag->job_lock);
+}
+
+/**
+ * If called from a job's thread, set enabled to whether a message with
+ * the given priority would be logged and return true.
+ */
+bool
+ghostcat_job_log_enabled(enum ghostcat_log_priority priority, bool *enabled)
+{
+	if (!current_job)
+		return false;
+
+	*enabled = current_job->log_enabled &&
+		   current_job->log_priority <= priority;
+	return true;
+}
+
+/**
+ * If called from a job's thread, keep the message until the job is done
+ * and return true.
+ */
+bool
+ghostcat_job_log(enum ghostcat_log_priority priority,
+		 const char *format, va_list args)
+{
+	struct ghostcat_job_message *message;
+
+	if (!current_job)
+		return false;
+
+	message = zalloc(sizeof(*message));
+	message->priority = priority;
+	if (vasprintf(&message->text, format, args) < 0) {
+		free(message);
+		return true;
+	}
+	list_append(&current_job->messages, &message->link);
+
+	return true;
+}
+
+/**
+ * Return true if an asynchronous job is running on the device and the
+ * caller is not that job. The caller must leave the device alone then,
+ * which is logged as a client bug.
+ */
+bool
+ghostcat_device_is_busy(struct ghostcat_device *device)
+{
+	if (!device->busy || (current_job && current_job->device == device))
+		return false;
+
+	log_bug_client(device->ratbag,
+		       "%s: device used while an asynchronous job is running\n",
+		       device->name);
+	return true;
+}
+
+static void
+ghostcat_job_flush_log(struct ghostcat_job *job)
+{
+	struct ghostcat_job_message *message, *tmp;
+
+	list_for_each_safe(message, tmp, &job->messages, link) {
+		log_msg(job->ratbag, message->priority, "%s", message->text);
+		list_remove(&message->link);
+		free(message->text);
+		free(message);
+	}
+}
+
+static void *
+ghostcat_job_run(void *data)
+{
+	struct ghostcat_job *job = data;
+	struct ghostcat *ratbag = job->ratbag;
+	const uint64_t one = 1;
+
+	current_job = job;
+
+	switch (job->type) {
+	case GHOSTCAT_JOB_PROBE:
+		if (ghostcat_assign_driver(job->device, &job->device->ids, NULL))
+			job->result = GHOSTCAT_SUCCESS;
+		else
+			job->result = GHOSTCAT_ERROR_DEVICE;
+		break;
+	case GHOSTCAT_JOB_COMMIT:
+		job->result = ghostcat_device_commit(job->device);
+		break;
+	case GHOSTCAT_JOB_REFRESH:
+		job->result = ghostcat_device_refresh_active_resolution(job->device);
+		break;
+	}
+
+	current_job = NULL;
+
+	pthread_mutex_lock(&ratbag->job_lock);
+	list_append(&ratbag->jobs_done, &job->link);
+	pthread_mutex_unlock(&ratbag->job_lock);
+
+	/* this only fails if the counter overflows, and then the fd is
+	 * readable anyway */
+	(void)!write(ratbag->job_fd, &one, sizeof(one));
+
+	return NULL;
+}
+
+/**
+ * Start a job on the device, the job takes over the caller's reference
+ * to the device.
+ */
+static enum ghostcat_error_code
+ghostcat_job_start(struct ghostcat_device *device,
+		   enum ghostcat_job_type type,
+		   void *callback,
+		   void *userdata)
+{
+	struct ghostcat_job *job;
+	int rc;
+
+	if (device->busy) {
+		log_bug_client(device->ratbag,
+			       "%s: another asynchronous job is running\n",
+			       device->name);
+		ghostcat_device_unref(device);
+		return GHOSTCAT_ERROR_IMPLEMENTATION;
+	}
+
+	job = zalloc(sizeof(*job));
+	job->ratbag = device->ratbag;
+	job->device = device;
+	job->type = type;
+	if (type == GHOSTCAT_JOB_PROBE)
+		job->callback.probe = callback;
+	else
+		job->callback.device = callback;
+	job->userdata = userdata;
+	job->log_enabled = device->ratbag->log_handler != NULL;
+	job->log_priority = device->ratbag->log_priority;
+	list_init(&job->messages);
+
+	device->busy = true;
+
+	rc = pthread_create(&job->thread, NULL, ghostcat_job_run, job);
+	if (rc != 0) {
+		log_error(device->ratbag, "%s: failed to start job: %s\n",
+			  device->name, strerror(rc));
+		device->busy = false;
+		ghostcat_device_unref(device);
+		free(job);
+		return GHOSTCAT_ERROR_SYSTEM;
+	}
+
+	return GHOSTCAT_SUCCESS;
+}
+
+static void
+ghostcat_job_complete(struct ghostcat_job *job)
+{
+	struct ghostcat_device *device = job->device;
+
+	pthread_join(job->thread, NULL);
+	device->busy = false;
+	ghostcat_job_flush_log(job);
+
+	switch (job->type) {
+	case GHOSTCAT_JOB_PROBE:
+		/* another device may have taken the same nodes while we
+		 * were probing */
+		if (job->result == GHOSTCAT_SUCCESS &&
+		    ghostcat_device_hidraw_claimed(device)) {
+			log_debug(job->ratbag, "%s: hidraw node in use by another device\n",
+				  device->name);
+			job->result = GHOSTCAT_ERROR_DEVICE;
+		}
+
+		if (job->result != GHOSTCAT_SUCCESS) {
+			device = ghostcat_device_unref(device);
+			job->callback.probe(job->ratbag, NULL, job->result, job->userdata);
+		} else {
+			/* the job's reference goes to the caller */
+			job->callback.probe(job->ratbag, device, job->result, job->userdata);
+		}
+		break;
+	case GHOSTCAT_JOB_COMMIT:
+	case GHOSTCAT_JOB_REFRESH:
+		job->callback.device(device, job->result, job->userdata);
+		ghostcat_device_unref(device);
+		break;
+	}
+
+	free(job);
+}
+
+static struct ghostcat_job *
+ghostcat_job_next_done(struct ghostcat *ratbag)
+{
+	struct ghostcat_job *job = NULL;
+
+	pthread_mutex_lock(&ratbag->job_lock);
+	if (!list_empty(&ratbag->jobs_done)) {
+		job = container_of(ratbag->jobs_done.next, job, link);
+		list_remove(&job->link);
+	}
+	pthread_mutex_unlock(&ratbag->job_lock);
+
+	return job;
+}
+
+LIBGHOSTCAT_EXPORT int
+ghostcat_get_fd(struct ghostcat *ratbag)
+{
+	return ratbag->job_fd;
+}
+
+LIBGHOSTCAT_EXPORT enum ghostcat_error_code
+ghostcat_dispatch(struct ghostcat *ratbag)
+{
+	struct ghostcat_job *job;
+	uint64_t count;
+
+	/* drain the counter first, a job finishing after this will make
+	 * the fd readable again */
+	if (read(ratbag->job_fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+		log_error(ratbag, "failed to read the job fd: %s\n", strerror(errno));
+		return GHOSTCAT_ERROR_SYSTEM;
+	}
+
+	/* a callback may drop the last reference to the context */
+	ghostcat_ref(ratbag);
+	while ((job = ghostcat_job_next_done(ratbag)))
+		ghostcat_job_complete(job);
+	ghostcat_unref(ratbag);
+
+	return GHOSTCAT_SUCCESS;
+}
+
+LIBGHOSTCAT_EXPORT enum ghostcat_error_code
+ghostcat_device_new_from_udev_device_async(struct ghostcat *ratbag,
+					   struct udev_device *udev_device,
+					   ghostcat_device_probe_callback callback,
+					   void *userdata)
+{
+	struct ghostcat_device *device;
+
+	assert(ratbag != NULL);
+	assert(udev_device != NULL);
+	assert(callback != NULL);
+
+	device = ghostcat_device_new_unprobed(ratbag, udev_device);
+	if (!device)
+		return GHOSTCAT_ERROR_DEVICE;
+
+	return ghostcat_job_start(device, GHOSTCAT_JOB_PROBE, callback, userdata);
+}
+
+LIBGHOSTCAT_EXPORT enum ghostcat_error_code
+ghostcat_device_commit_async(struct ghostcat_device *device,
+			     ghostcat_device_callback callback,
+			     void *userdata)
+{
+	assert(callback != NULL);
+
+	return ghostcat_job_start(ghostcat_device_ref(device),
+				  GHOSTCAT_JOB_COMMIT, callback, userdata);
+}
+
+LIBGHOSTCAT_EXPORT enum ghostcat_error_code
+ghostcat_device_refresh_active_resolution_async(struct ghostcat_device *device,
+						ghostcat_device_callback callback,
+						void *userdata)
+{
+	assert(callback != NULL);
+
+	return ghostcat_job_start(ghostcat_device_ref(device),
+				  GHOSTCAT_JOB_REFRESH, callback, userdata);
+}
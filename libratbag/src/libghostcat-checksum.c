@@ -0,0 +1,117 @@
+/*
+ * libghostcat checksums
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#include "libghostcat-checksum.h"
+
+#define CRC_CCITT_POLY	0x1021
+#define CRC_CCITT_SEED	0xffff
+#define CRC_SLICES	8
+
+/* crc_ccitt_table[n][b] is the CRC of byte b followed by n zero bytes,
+ * this allows to process CRC_SLICES bytes with one lookup each */
+static uint16_t crc_ccitt_table[CRC_SLICES][256];
+static pthread_once_t crc_ccitt_table_once = PTHREAD_ONCE_INIT;
+
+static void
+crc_ccitt_init_table(void)
+{
+	unsigned int i, n, bit;
+	uint16_t crc;
+
+	for (i = 0; i < 256; i++) {
+		crc = i << 8;
+		for (bit = 0; bit < 8; bit++)
+			crc = (crc & 0x8000) ? (crc << 1) ^ CRC_CCITT_POLY : crc << 1;
+		crc_ccitt_table[0][i] = crc;
+	}
+
+	for (n = 1; n < CRC_SLICES; n++) {
+		for (i = 0; i < 256; i++) {
+			crc = crc_ccitt_table[n - 1][i];
+			crc_ccitt_table[n][i] = (crc << 8) ^ crc_ccitt_table[0][crc >> 8];
+		}
+	}
+}
+
+uint16_t
+ghostcat_crc_ccitt(const uint8_t *data, size_t len)
+{
+	uint16_t (*t)[256] = crc_ccitt_table;
+	uint16_t crc = CRC_CCITT_SEED;
+
+	/* asynchronous jobs may get here from several threads at once */
+	pthread_once(&crc_ccitt_table_once, crc_ccitt_init_table);
+
+	/* only the first two bytes of each slice depend on the current crc */
+	while (len >= CRC_SLICES) {
+		crc = t[7][(crc >> 8) ^ data[0]] ^ t[6][(crc & 0xff) ^ data[1]] ^
+		      t[5][data[2]] ^ t[4][data[3]] ^
+		      t[3][data[4]] ^ t[2][data[5]] ^
+		      t[1][data[6]] ^ t[0][data[7]];
+		data += CRC_SLICES;
+		len -= CRC_SLICES;
+	}
+
+	while (len--)
+		crc = (crc << 8) ^ t[0][(crc >> 8) ^ *data++];
+
+	return crc;
+}
+
+uint32_t
+ghostcat_checksum_sum(const uint8_t *data, size_t len)
+{
+	const uint64_t mask = 0x00ff00ff00ff00ffULL;
+	uint32_t sum = 0;
+
+	/* Add 8 bytes at a time into four 16-bit lanes. Each word adds at
+	 * most 2 * 0xff to a lane, so the lanes are folded every 128 words
+	 * before they can overflow. */
+	while (len >= sizeof(uint64_t)) {
+		uint64_t lanes = 0, word;
+		size_t n = len / sizeof(word);
+
+		if (n > 128)
+			n = 128;
+		len -= n * sizeof(word);
+
+		while (n--) {
+			memcpy(&word, data, sizeof(word));
+			lanes += (word & mask) + ((word >> 8) & mask);
+			data += sizeof(word);
+		}
+
+		sum += (lanes & 0xffff) + ((lanes >> 16) & 0xffff) +
+		       ((lanes >> 32) & 0xffff) + (lanes >> 48);
+	}
+
+	while (len--)
+		sum += *data++;
+
+	return sum;
+}
@@ -0,0 +1,47 @@
+/*
+ * libghostcat checksums
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Checksums used by the device protocols. All of them process several
+ * bytes per step, the results are identical to the naive byte-by-byte
+ * versions.
+ */
+
+/**
+ * CRC-16/CCITT-FALSE (polynomial 0x1021, seed 0xffff), as used by the
+ * HID++ onboard memory pages and sectors.
+ */
+uint16_t
+ghostcat_crc_ccitt(const uint8_t *data, size_t len);
+
+/**
+ * The sum of all bytes in data. Roccat devices use the lower 16 bits as
+ * their checksum, G.Skill devices the two's complement of the lower 8 bits.
+ */
+uint32_t
+ghostcat_checksum_sum(const uint8_t *data, size_t len);
@@ -297,6 +297,15 @@ init_data_sinowealth(struct ghostcat *ratbag,
 		} else {
 			device->profile_count = -1;
 		}
+		g_clear_error(&error);
+
+		rc = g_key_file_get_integer(keyfile, device_group, "MaxReportRate", &error);
+		if (rc != 0 && !error) {
+			device->max_report_rate = rc;
+		} else {
+			device->max_report_rate = -1;
+		}
+		g_clear_error(&error);
 
 		list_insert(&data->sinowealth.supported_devices, &device->link);
 	}
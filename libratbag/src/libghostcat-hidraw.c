@@ -30,6 +30,7 @@
 #include <linux/hidraw.h>
 #include <string.h>
 
+#include "hidpp-generic.h"
 #include "libghostcat-hidraw.h"
 #include "libghostcat-private.h"
 
@@ -1219,33 +1220,185 @@ ghostcat_hidraw_get_consumer_usage_from_keycode(const struct ghostcat_device *de
 	return 0;
 }
 
+static inline bool
+ghostcat_hidraw_is_replay(const struct ghostcat_device *device)
+{
+	return device->trace && ghostcat_trace_is_replay(device->trace);
+}
+
+static inline bool
+ghostcat_hidraw_is_recording(const struct ghostcat_device *device)
+{
+	return device->trace && !ghostcat_trace_is_replay(device->trace);
+}
+
 static int
-ghostcat_hidraw_parse_report_descriptor(struct ghostcat_device *device)
+ghostcat_hidraw_replay(struct ghostcat_device *device,
+		       enum ghostcat_trace_event type, int idx,
+		       const uint8_t *data, size_t len,
+		       uint8_t *buf, size_t size)
 {
-	int rc, desc_size = 0;
-	struct ghostcat_hidraw *hidraw = &device->hidraw[0];
-	struct hidraw_report_descriptor report_desc = {0};
-	unsigned int i, j;
-	unsigned int usage_page, usage;
+	bool diverged = ghostcat_trace_has_diverged(device->trace);
+	int rc;
 
-	hidraw->num_reports = 0;
+	rc = ghostcat_trace_replay(device->trace, type, idx, data, len, buf, size);
+	if (!diverged && ghostcat_trace_has_diverged(device->trace))
+		log_error(device->ratbag,
+			  "%s: transfer diverges from the recording at event %u\n",
+			  device->name,
+			  ghostcat_trace_get_position(device->trace));
+
+	return rc;
+}
+
+static void
+ghostcat_hidraw_record(struct ghostcat_device *device,
+		       enum ghostcat_trace_event type, int idx, int rc,
+		       uint64_t start, const uint8_t *data, size_t len)
+{
+	if (!ghostcat_hidraw_is_recording(device))
+		return;
+
+	ghostcat_trace_record(device->trace, type, idx, rc,
+			      (now(CLOCK_MONOTONIC) - start) / 1000,
+			      data, len);
+}
+
+/*
+ * The primitives below are the only places that touch the hidraw nodes
+ * once they are open, so a recording holds everything that was
+ * exchanged with the device and a replay never reaches a device node.
+ * They log nothing and count nothing, that is left to their callers.
+ */
+
+static int
+ghostcat_hidraw_write(struct ghostcat_device *device, int idx,
+		      const uint8_t *buf, size_t len)
+{
+	uint64_t start = now(CLOCK_MONOTONIC);
+	int rc;
+
+	if (ghostcat_hidraw_is_replay(device))
+		return ghostcat_hidraw_replay(device, GHOSTCAT_TRACE_WRITE, idx,
+					      buf, len, NULL, 0);
 
-	rc = ioctl(hidraw->fd, HIDIOCGRDESCSIZE, &desc_size);
+	rc = write(device->hidraw[idx].fd, buf, len);
 	if (rc < 0)
-		return rc;
+		rc = -errno;
 
-	report_desc.size = desc_size;
-	rc = ioctl(hidraw->fd, HIDIOCGRDESC, &report_desc);
+	ghostcat_hidraw_record(device, GHOSTCAT_TRACE_WRITE, idx, rc, start, buf, len);
+
+	return rc;
+}
+
+/**
+ * Wait up to timeout_ms for a report and read it.
+ *
+ * @return the length of the report, -ETIMEDOUT or a negative errno
+ */
+static int
+ghostcat_hidraw_read(struct ghostcat_device *device, int idx,
+		     uint8_t *buf, size_t len, int timeout_ms)
+{
+	uint64_t start = now(CLOCK_MONOTONIC);
+	struct pollfd fds;
+	int rc;
+
+	if (ghostcat_hidraw_is_replay(device))
+		return ghostcat_hidraw_replay(device, GHOSTCAT_TRACE_READ, idx,
+					      NULL, 0, buf, len);
+
+	fds.fd = device->hidraw[idx].fd;
+	fds.events = POLLIN;
+
+	rc = poll(&fds, 1, timeout_ms);
+	if (rc == 0)
+		rc = -ETIMEDOUT;
+	else if (rc > 0)
+		rc = read(device->hidraw[idx].fd, buf, len);
+
+	if (rc == -1)
+		rc = -errno;
+
+	ghostcat_hidraw_record(device, GHOSTCAT_TRACE_READ, idx, rc, start,
+			       buf, max(rc, 0));
+
+	return rc;
+}
+
+static int
+ghostcat_hidraw_feature(struct ghostcat_device *device, int reqtype,
+			uint8_t *buf, size_t len)
+{
+	enum ghostcat_trace_event type;
+	uint64_t start = now(CLOCK_MONOTONIC);
+	int rc;
+
+	type = reqtype == HID_REQ_GET_REPORT ? GHOSTCAT_TRACE_GET_FEATURE
+					     : GHOSTCAT_TRACE_SET_FEATURE;
+
+	if (ghostcat_hidraw_is_replay(device))
+		return ghostcat_hidraw_replay(device, type, 0, buf, len, buf, len);
+
+	if (reqtype == HID_REQ_GET_REPORT)
+		rc = ioctl(device->hidraw[0].fd, HIDIOCGFEATURE(len), buf);
+	else
+		rc = ioctl(device->hidraw[0].fd, HIDIOCSFEATURE(len), buf);
 	if (rc < 0)
-		return rc;
+		rc = -errno;
+
+	if (type == GHOSTCAT_TRACE_GET_FEATURE)
+		ghostcat_hidraw_record(device, type, 0, rc, start, buf, max(rc, 1));
+	else
+		ghostcat_hidraw_record(device, type, 0, rc, start, buf, len);
+
+	return rc;
+}
+
+static int
+ghostcat_hidraw_hidpp_write(void *userdata, const uint8_t *buf, size_t len)
+{
+	return ghostcat_hidraw_write(userdata, 0, buf, len);
+}
+
+static int
+ghostcat_hidraw_hidpp_read(void *userdata, uint8_t *buf, size_t len,
+			   int timeout_ms)
+{
+	return ghostcat_hidraw_read(userdata, 0, buf, len, timeout_ms);
+}
+
+static const struct hidpp_transport ghostcat_hidraw_hidpp_transport = {
+	.write = ghostcat_hidraw_hidpp_write,
+	.read = ghostcat_hidraw_hidpp_read,
+};
+
+void
+ghostcat_hidraw_init_hidpp_device(struct ghostcat_device *device,
+				  struct hidpp_device *base)
+{
+	hidpp_device_init(base, device->hidraw[0].fd);
+	base->transport = &ghostcat_hidraw_hidpp_transport;
+	base->transport_data = device;
+}
+
+static int
+ghostcat_hidraw_parse_report_descriptor(struct ghostcat_device *device, int idx,
+					const uint8_t *desc, unsigned int desc_size)
+{
+	struct ghostcat_hidraw *hidraw = &device->hidraw[idx];
+	unsigned int i, j;
+	unsigned int usage_page, usage;
+
+	hidraw->num_reports = 0;
 
 	log_debug(device->ratbag, "Parsing HID report descriptor\n");
 
 	i = 0;
 	usage_page = 0;
 	usage = 0;
-	while (i < report_desc.size) {
-		uint8_t value = report_desc.value[i];
+	while (i < desc_size) {
+		uint8_t value = desc[i];
 		uint8_t hid = value & 0xfc;
 		uint8_t size = value & 0x3;
 		unsigned content = 0;
@@ -1253,11 +1406,11 @@ ghostcat_hidraw_parse_report_descriptor(struct ghostcat_device *device)
 		if (size == 3)
 			size = 4;
 
-		if (i + size >= report_desc.size)
+		if (i + size >= desc_size)
 			return -EPROTO;
 
 		for (j = 0; j < size; j++)
-			content |= report_desc.value[i + j + 1] << (j * 8);
+			content |= desc[i + j + 1] << (j * 8);
 
 		switch (hid) {
 		case HID_REPORT_ID:
@@ -1292,33 +1445,59 @@ ghostcat_hidraw_parse_report_descriptor(struct ghostcat_device *device)
 	return 0;
 }
 
+/**
+ * Take over fd as hidraw node idx and parse its report descriptor.
+ */
 static int
-ghostcat_open_hidraw_node(struct ghostcat_device *device, struct udev_device *hidraw_udev, int idx)
+ghostcat_hidraw_init_node(struct ghostcat_device *device, int idx, int fd,
+			  const char *sysname, const uint8_t *desc,
+			  unsigned int desc_size)
 {
-	struct hidraw_devinfo info;
-	struct ghostcat_device *tmp_device;
-	int fd, res;
-	const char *devnode;
-	const char *sysname;
 	size_t reports_size;
+	int res;
+
+	device->hidraw[idx].fd = fd;
+
+	/* parse first to count the number of reports */
+	res = ghostcat_hidraw_parse_report_descriptor(device, idx, desc, desc_size);
+	if (res) {
+		log_error(device->ratbag,
+			  "Error while parsing the report descriptor: '%s' (%d)\n",
+			  strerror(-res),
+			  res);
+		device->hidraw[idx].fd = -1;
+		return res;
+	}
+
+	if (device->hidraw[idx].num_reports)
+		reports_size = device->hidraw[idx].num_reports * sizeof(struct ghostcat_hid_report);
+	else
+		reports_size = sizeof(struct ghostcat_hid_report);
+
+	device->hidraw[idx].reports = zalloc(reports_size);
+	ghostcat_hidraw_parse_report_descriptor(device, idx, desc, desc_size);
+
+	device->hidraw[idx].sysname = strdup_safe(sysname);
+	return 0;
+}
+
+static int
+ghostcat_open_hidraw_node(struct ghostcat_device *device,
+			  const struct ghostcat_hidraw_node *node, int idx)
+{
+	struct hidraw_devinfo info;
+	struct hidraw_report_descriptor report_desc = {0};
+	int fd, res, desc_size = 0;
+	uint64_t start;
 
 	assert(idx >= 0 && idx < MAX_HIDRAW);
 
 	device->hidraw[idx].fd = -1;
 
-	sysname = udev_device_get_sysname(hidraw_udev);
-	if (!strneq("hidraw", sysname, 6))
+	if (node->claimed & (1 << idx))
 		return -ENODEV;
 
-	list_for_each(tmp_device, &device->ratbag->devices, link) {
-		if (tmp_device->hidraw[idx].sysname &&
-		    streq(tmp_device->hidraw[idx].sysname, sysname)) {
-			return -ENODEV;
-		}
-	}
-
-	devnode = udev_device_get_devnode(hidraw_udev);
-	fd = ghostcat_open_path(device, devnode, O_RDWR);
+	fd = ghostcat_open_path(device, node->devnode, O_RDWR);
 	if (fd < 0)
 		goto err;
 
@@ -1345,30 +1524,26 @@ ghostcat_open_hidraw_node(struct ghostcat_device *device, struct udev_device *hi
 	log_debug(device->ratbag,
 		  "%s is device '%s'.\n",
 		  device->name,
-		  udev_device_get_devnode(hidraw_udev));
+		  node->devnode);
 
-	device->hidraw[idx].fd = fd;
+	start = now(CLOCK_MONOTONIC);
+	if (ioctl(fd, HIDIOCGRDESCSIZE, &desc_size) < 0)
+		goto err;
 
-	/* parse first to count the number of reports */
-	res = ghostcat_hidraw_parse_report_descriptor(device);
-	if (res) {
-		log_error(device->ratbag,
-			  "Error while parsing the report descriptor: '%s' (%d)\n",
-			  strerror(-res),
-			  res);
-		device->hidraw[idx].fd = -1;
+	report_desc.size = desc_size;
+	if (ioctl(fd, HIDIOCGRDESC, &report_desc) < 0)
 		goto err;
-	}
 
-	if (device->hidraw[idx].num_reports)
-		reports_size = device->hidraw[idx].num_reports * sizeof(struct ghostcat_hid_report);
-	else
-		reports_size = sizeof(struct ghostcat_hid_report);
+	ghostcat_hidraw_record(device, GHOSTCAT_TRACE_OPEN, idx, report_desc.size,
+			       start, report_desc.value, report_desc.size);
 
-	device->hidraw[idx].reports = zalloc(reports_size);
-	ghostcat_hidraw_parse_report_descriptor(device);
+	res = ghostcat_hidraw_init_node(device, idx, fd, node->sysname,
+					report_desc.value, report_desc.size);
+	if (res) {
+		errno = -res;
+		goto err;
+	}
 
-	device->hidraw[idx].sysname = strdup_safe(sysname);
 	return 0;
 
 err:
@@ -1377,41 +1552,61 @@ err:
 	return -errno;
 }
 
+/**
+ * Like ghostcat_find_hidraw_node() for a device created from a
+ * recording. The nodes are the ones the recording opened, each replaced
+ * by /dev/null so nothing reaches a real device.
+ */
 static int
-ghostcat_find_hidraw_node(struct ghostcat_device *device,
-			int (*match)(struct ghostcat_device *device),
-			int use_usb_parent,
-			int match_index, int hidraw_index)
+ghostcat_replay_hidraw_node(struct ghostcat_device *device,
+			    int (*match)(struct ghostcat_device *device),
+			    int hidraw_index)
 {
-	struct ghostcat *ratbag = device->ratbag;
-	_cleanup_(udev_enumerate_unrefp) struct udev_enumerate *e = NULL;
-	struct udev_list_entry *entry;
-	const char *path;
-	struct udev_device *hid_udev;
-	struct udev_device *parent_udev;
-	struct udev *udev = ratbag->udev;
-	int rc = -ENODEV;
-	int matched, endpoint_index = 0;
-
-	assert(match);
+	uint8_t desc[HID_MAX_DESCRIPTOR_SIZE];
+	int rc, fd, matched;
+
+	while ((rc = ghostcat_hidraw_replay(device, GHOSTCAT_TRACE_OPEN,
+					    hidraw_index, NULL, 0,
+					    desc, sizeof(desc))) >= 0) {
+		fd = ghostcat_open_path(device, "/dev/null", O_RDWR);
+		if (fd < 0)
+			return -errno;
 
-	hid_udev = udev_device_get_parent_with_subsystem_devtype(device->udev_device, "hid", NULL);
+		rc = ghostcat_hidraw_init_node(device, hidraw_index, fd, NULL,
+					       desc, min(rc, (int)sizeof(desc)));
+		if (rc) {
+			ghostcat_close_fd(device, fd);
+			return rc;
+		}
 
-	if (!hid_udev)
-		return -ENODEV;
+		matched = match(device);
+		rc = matched ? 0 : -ENODEV;
+		if (matched == 1)
+			return rc;
 
-	if (use_usb_parent && device->ids.bustype == BUS_USB) {
-		/* using the parent usb_device to match siblings */
-		parent_udev = udev_device_get_parent(hid_udev);
-		if (!streq("uhid", udev_device_get_sysname(parent_udev)))
-			parent_udev = udev_device_get_parent_with_subsystem_devtype(hid_udev,
-										    "usb",
-										    "usb_device");
-	} else {
-		parent_udev = hid_udev;
+		ghostcat_close_hidraw_index(device, hidraw_index);
 	}
 
+	return rc;
+}
+
+static int
+ghostcat_scan_hidraw_nodes(struct ghostcat_device *device,
+			   struct udev_device *parent_udev,
+			   struct ghostcat_hidraw_nodes *nodes)
+{
+	struct udev *udev = device->ratbag->udev;
+	_cleanup_(udev_enumerate_unrefp) struct udev_enumerate *e = NULL;
+	struct udev_list_entry *entry;
+	struct ghostcat_device *other;
+	const char *path, *sysname, *devnode;
+	struct ghostcat_hidraw_node *node, *tmp;
+	unsigned int idx;
+
 	e = udev_enumerate_new(udev);
+	if (!e)
+		return -ENOMEM;
+
 	udev_enumerate_add_match_subsystem(e, "hidraw");
 	udev_enumerate_add_match_parent(e, parent_udev);
 	udev_enumerate_scan_devices(e);
@@ -1423,10 +1618,148 @@ ghostcat_find_hidraw_node(struct ghostcat_device *device,
 		if (!udev_device)
 			continue;
 
+		sysname = udev_device_get_sysname(udev_device);
+		devnode = udev_device_get_devnode(udev_device);
+		if (!strneq("hidraw", sysname, 6) || !devnode)
+			continue;
+
+		tmp = realloc(nodes->nodes,
+			      (nodes->count + 1) * sizeof(*nodes->nodes));
+		if (!tmp)
+			return -ENOMEM;
+
+		nodes->nodes = tmp;
+		node = &nodes->nodes[nodes->count++];
+		node->sysname = strdup_safe(sysname);
+		node->devnode = strdup_safe(devnode);
+		node->claimed = 0;
+
+		/* a device with a job running may change its nodes
+		 * under us, ghostcat_device_hidraw_claimed() catches
+		 * those once the job is done */
+		list_for_each(other, &device->ratbag->devices, link) {
+			if (other == device || other->busy)
+				continue;
+
+			for (idx = 0; idx < MAX_HIDRAW; idx++) {
+				if (other->hidraw[idx].sysname &&
+				    streq(other->hidraw[idx].sysname, sysname))
+					node->claimed |= 1 << idx;
+			}
+		}
+	}
+
+	return 0;
+}
+
+int
+ghostcat_device_scan_hidraw(struct ghostcat_device *device)
+{
+	struct udev_device *hid_udev;
+	struct udev_device *parent_udev;
+	int rc;
+
+	ghostcat_device_free_hidraw_nodes(device);
+
+	hid_udev = udev_device_get_parent_with_subsystem_devtype(device->udev_device, "hid", NULL);
+	if (!hid_udev)
+		return 0;
+
+	rc = ghostcat_scan_hidraw_nodes(device, hid_udev, &device->hid_nodes);
+	if (rc)
+		return rc;
+
+	if (device->ids.bustype != BUS_USB)
+		return 0;
+
+	/* using the parent usb_device to match siblings */
+	parent_udev = udev_device_get_parent(hid_udev);
+	if (!streq("uhid", udev_device_get_sysname(parent_udev)))
+		parent_udev = udev_device_get_parent_with_subsystem_devtype(hid_udev,
+									    "usb",
+									    "usb_device");
+	if (!parent_udev)
+		return 0;
+
+	return ghostcat_scan_hidraw_nodes(device, parent_udev, &device->usb_nodes);
+}
+
+static void
+ghostcat_free_hidraw_nodes(struct ghostcat_hidraw_nodes *nodes)
+{
+	unsigned int i;
+
+	for (i = 0; i < nodes->count; i++) {
+		free(nodes->nodes[i].sysname);
+		free(nodes->nodes[i].devnode);
+	}
+	free(nodes->nodes);
+	nodes->nodes = NULL;
+	nodes->count = 0;
+}
+
+void
+ghostcat_device_free_hidraw_nodes(struct ghostcat_device *device)
+{
+	ghostcat_free_hidraw_nodes(&device->hid_nodes);
+	ghostcat_free_hidraw_nodes(&device->usb_nodes);
+}
+
+bool
+ghostcat_device_hidraw_claimed(struct ghostcat_device *device)
+{
+	struct ghostcat_device *other;
+	unsigned int idx;
+
+	for (idx = 0; idx < MAX_HIDRAW; idx++) {
+		if (!device->hidraw[idx].sysname)
+			continue;
+
+		list_for_each(other, &device->ratbag->devices, link) {
+			if (other == device || other->busy)
+				continue;
+
+			if (other->hidraw[idx].sysname &&
+			    streq(other->hidraw[idx].sysname,
+				  device->hidraw[idx].sysname))
+				return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * Try the nodes collected by ghostcat_device_scan_hidraw() until the
+ * match function accepts one. This runs in a job's thread for
+ * asynchronous probes and must not touch udev or the context.
+ */
+static int
+ghostcat_find_hidraw_node(struct ghostcat_device *device,
+			int (*match)(struct ghostcat_device *device),
+			int use_usb_parent,
+			int match_index, int hidraw_index)
+{
+	const struct ghostcat_hidraw_nodes *nodes;
+	int rc = -ENODEV;
+	int matched, endpoint_index = 0;
+	unsigned int i;
+
+	assert(match);
+
+	if (ghostcat_hidraw_is_replay(device))
+		return ghostcat_replay_hidraw_node(device, match, hidraw_index);
+
+	if (use_usb_parent && device->ids.bustype == BUS_USB)
+		nodes = &device->usb_nodes;
+	else
+		nodes = &device->hid_nodes;
+
+	for (i = 0; i < nodes->count; i++) {
 		if (match_index > 0 && match_index != endpoint_index++)
 			continue;
 
-		rc = ghostcat_open_hidraw_node(device, udev_device, hidraw_index);
+		rc = ghostcat_open_hidraw_node(device, &nodes->nodes[i], hidraw_index);
 		if (rc)
 			goto skip;
 
@@ -1549,6 +1882,12 @@ ghostcat_close_hidraw_index(struct ghostcat_device *device, int idx)
 	if (device->hidraw[idx].fd < 0)
 		return;
 
+	if (ghostcat_hidraw_is_replay(device))
+		ghostcat_hidraw_replay(device, GHOSTCAT_TRACE_CLOSE, idx, NULL, 0, NULL, 0);
+	else
+		ghostcat_hidraw_record(device, GHOSTCAT_TRACE_CLOSE, idx, 0,
+				       now(CLOCK_MONOTONIC), NULL, 0);
+
 	if (device->hidraw[idx].sysname) {
 		free(device->hidraw[idx].sysname);
 		device->hidraw[idx].sysname = NULL;
@@ -1568,6 +1907,7 @@ ghostcat_hidraw_raw_request(struct ghostcat_device *device, unsigned char report
 			  uint8_t *buf, size_t len, unsigned char rtype, int reqtype)
 {
 	uint8_t tmp_buf[HID_MAX_BUFFER_SIZE];
+	uint64_t start;
 	int rc;
 
 	if (len < 1 || len > HID_MAX_BUFFER_SIZE || !buf || device->hidraw[0].fd < 0)
@@ -1576,14 +1916,21 @@ ghostcat_hidraw_raw_request(struct ghostcat_device *device, unsigned char report
 	if (rtype != HID_FEATURE_REPORT)
 		return -ENOTSUP;
 
+	start = now(CLOCK_MONOTONIC);
+
 	switch (reqtype) {
 	case HID_REQ_GET_REPORT:
 		memset(tmp_buf, 0, len);
 		tmp_buf[0] = reportnum;
 
-		rc = ioctl(device->hidraw[0].fd, HIDIOCGFEATURE(len), tmp_buf);
+		rc = ghostcat_hidraw_feature(device, reqtype, tmp_buf, len);
+
+		ghostcat_stats_add_transfer(&device->stats, 1, max(rc, 0), rc);
 		if (rc < 0)
-			return -errno;
+			return rc;
+
+		ghostcat_stats_add_latency(&device->stats,
+					   ghostcat_rtt_update(&device->rtt, start));
 
 		log_buf_raw(device->ratbag, "feature get:   ", tmp_buf, (unsigned)rc);
 
@@ -1593,9 +1940,14 @@ ghostcat_hidraw_raw_request(struct ghostcat_device *device, unsigned char report
 		buf[0] = reportnum;
 
 		log_buf_raw(device->ratbag, "feature set:   ", buf, len);
-		rc = ioctl(device->hidraw[0].fd, HIDIOCSFEATURE(len), buf);
+		rc = ghostcat_hidraw_feature(device, reqtype, buf, len);
+
+		ghostcat_stats_add_transfer(&device->stats, len, 0, rc);
 		if (rc < 0)
-			return -errno;
+			return rc;
+
+		ghostcat_stats_add_latency(&device->stats,
+					   ghostcat_rtt_update(&device->rtt, start));
 
 		return rc;
 	}
@@ -1630,10 +1982,11 @@ ghostcat_hidraw_output_report(struct ghostcat_device *device, uint8_t *buf, size
 
 	log_buf_raw(device->ratbag, "output report: ", buf, len);
 
-	rc = write(device->hidraw[0].fd, buf, len);
+	rc = ghostcat_hidraw_write(device, 0, buf, len);
 
+	ghostcat_stats_add_transfer(&device->stats, max(rc, 0), 0, rc);
 	if (rc < 0)
-		return -errno;
+		return rc;
 
 	if (rc != (int)len)
 		return -EIO;
@@ -1642,18 +1995,17 @@ ghostcat_hidraw_output_report(struct ghostcat_device *device, uint8_t *buf, size
 }
 
 int
-ghostcat_hidraw_read_input_report(const struct ghostcat_device *device, uint8_t *buf, size_t len,
+ghostcat_hidraw_read_input_report(struct ghostcat_device *device, uint8_t *buf, size_t len,
 				 ghostcatd_hidraw_filter_t filter)
 {
 	return ghostcat_hidraw_read_input_report_index(device, buf, len, 0, filter);
 }
 
 int
-ghostcat_hidraw_read_input_report_index(const struct ghostcat_device *device, uint8_t *buf, size_t len, int hidrawno,
+ghostcat_hidraw_read_input_report_index(struct ghostcat_device *device, uint8_t *buf, size_t len, int hidrawno,
 				 ghostcatd_hidraw_filter_t filter)
 {
-	int rc, nfds;
-	struct pollfd fds;
+	int rc;
 	int ts, ts_end;
 
 	assert(hidrawno >= 0 && hidrawno < MAX_HIDRAW);
@@ -1661,35 +2013,33 @@ ghostcat_hidraw_read_input_report_index(const struct ghostcat_device *device, ui
 	if (len < 1 || !buf || device->hidraw[hidrawno].fd < 0)
 		return -EINVAL;
 
-	fds.fd = device->hidraw[hidrawno].fd;
-	fds.events = POLLIN;
-
 	/* convert to ms */
 	ts = now(CLOCK_MONOTONIC_RAW) / 1000 / 1000;
 	ts_end = ts + 1000; /* end in now + 1000ms */
 
 	while (ts < ts_end) {
-		nfds = poll(&fds, 1, ts_end - ts); /* poll for the remainder of timeout */
-
-		if (nfds < 0)
-			return -errno;
-
-		if (nfds > 0) {
-			rc = read(device->hidraw[hidrawno].fd, buf, len);
+		/* wait for the remainder of timeout */
+		rc = ghostcat_hidraw_read(device, hidrawno, buf, len, ts_end - ts);
+		if (rc == -ETIMEDOUT)
+			break;
 
-			if (rc < 0)
-  				return -errno;
+		if (rc < 0) {
+			ghostcat_stats_add(&device->stats, errors, 1);
+			return rc;
+		}
 
-			if (rc > 0) {
-				if(!filter || (filter && filter(buf, rc))) {
-					log_buf_raw(device->ratbag, "input report:  ", buf, rc);
-					return rc;
-				}
+		if (rc > 0) {
+			ghostcat_stats_add(&device->stats, bytes_received, rc);
+			if(!filter || (filter && filter(buf, rc))) {
+				log_buf_raw(device->ratbag, "input report:  ", buf, rc);
+				return rc;
 			}
 		}
 
 		ts = now(CLOCK_MONOTONIC_RAW) / 1000 / 1000;
 	}
 
+	ghostcat_stats_add(&device->stats, timeouts, 1);
+
 	return -ETIMEDOUT;
 }
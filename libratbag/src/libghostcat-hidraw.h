@@ -47,8 +47,53 @@ struct ghostcat_hidraw {
 	char *sysname;
 };
 
+/**
+ * A hidraw node next to the device, see ghostcat_device_scan_hidraw().
+ */
+struct ghostcat_hidraw_node {
+	char *sysname;
+	char *devnode;
+	unsigned int claimed; /**< bit n is set if another device opened it as hidraw[n] */
+};
+
+struct ghostcat_hidraw_nodes {
+	struct ghostcat_hidraw_node *nodes;
+	unsigned int count;
+};
+
 typedef bool (*ghostcatd_hidraw_filter_t)(uint8_t *buf, size_t len);
 
+/**
+ * Collect the hidraw nodes the drivers may open for the device, both
+ * the ones below its hid device and the ones below its usb device.
+ * The drivers' probe only looks at these, so a probe never touches
+ * udev and may run in a thread of its own, see libghostcat-async.c.
+ * Must be called on the thread that owns the context.
+ *
+ * @param device the ratbag device
+ *
+ * @return 0 on success or a negative errno on error
+ */
+int ghostcat_device_scan_hidraw(struct ghostcat_device *device);
+
+/**
+ * Free the nodes collected by ghostcat_device_scan_hidraw().
+ *
+ * @param device the ratbag device
+ */
+void ghostcat_device_free_hidraw_nodes(struct ghostcat_device *device);
+
+/**
+ * Check whether another device opened one of the device's hidraw nodes
+ * at the same index. Devices with a job running are not considered.
+ * Must be called on the thread that owns the context.
+ *
+ * @param device the ratbag device
+ *
+ * @return true if one of the nodes is in use by another device
+ */
+bool ghostcat_device_hidraw_claimed(struct ghostcat_device *device);
+
 /**
  * Open the hidraw device associated with the device.
  *
@@ -173,7 +218,7 @@ int ghostcat_hidraw_output_report(struct ghostcat_device *device, uint8_t *buf,
  *
  * @return count of data transferred, or a negative errno on error
  */
-int ghostcat_hidraw_read_input_report(const struct ghostcat_device *device, uint8_t *buf, size_t len,
+int ghostcat_hidraw_read_input_report(struct ghostcat_device *device, uint8_t *buf, size_t len,
 				 ghostcatd_hidraw_filter_t filter);
 
 /**
@@ -188,9 +233,22 @@ int ghostcat_hidraw_read_input_report(const struct ghostcat_device *device, uint
  *
  * @return count of data transferred, or a negative errno on error
  */
-int ghostcat_hidraw_read_input_report_index(const struct ghostcat_device *device, uint8_t *buf, size_t len, int hidrawno,
+int ghostcat_hidraw_read_input_report_index(struct ghostcat_device *device, uint8_t *buf, size_t len, int hidrawno,
 				 ghostcatd_hidraw_filter_t filter);
 
+struct hidpp_device;
+
+/**
+ * Initialize a HID++ device on the first hidraw node. Its reports go
+ * through the hidraw layer, so they are recorded and replayed like those
+ * of every other driver.
+ *
+ * @param device the ratbag device which hidraw node is opened
+ * @param base the HID++ device to initialize
+ */
+void ghostcat_hidraw_init_hidpp_device(struct ghostcat_device *device,
+				       struct hidpp_device *base);
+
 /**
  * Tells if a given device has the specified report ID.
  *
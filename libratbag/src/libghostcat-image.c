@@ -0,0 +1,184 @@
+/*
+ * libghostcat device images
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libghostcat-image.h"
+#include "libghostcat-private.h"
+
+#define GHOSTCAT_IMAGE_MAGIC "GHOSTCAT"
+#define GHOSTCAT_IMAGE_MAGIC_LEN 8
+#define GHOSTCAT_IMAGE_BLOB_HEADER_LEN 6
+
+static void
+ghostcat_image_append(struct ghostcat_image *image, const void *data, size_t size)
+{
+	if (image->size + size > image->allocated) {
+		size_t allocated = max(image->allocated * 2, image->size + size);
+		uint8_t *tmp = zalloc(allocated);
+
+		if (image->data)
+			memcpy(tmp, image->data, image->size);
+		free(image->data);
+		image->data = tmp;
+		image->allocated = allocated;
+	}
+
+	memcpy(image->data + image->size, data, size);
+	image->size += size;
+}
+
+static void
+ghostcat_image_append_u16(struct ghostcat_image *image, uint16_t value)
+{
+	uint8_t buf[2];
+
+	set_unaligned_le_u16(buf, value);
+	ghostcat_image_append(image, buf, sizeof(buf));
+}
+
+/**
+ * Start a new image for the given device. The image is built in memory,
+ * image->data and image->size are valid after ghostcat_image_finish().
+ * The caller must free() image->data.
+ */
+void
+ghostcat_image_init_writer(struct ghostcat_image *image,
+			   const struct ghostcat_device *device)
+{
+	const char *driver = device->driver->id;
+	uint8_t driver_len = min(strlen(driver), 0xff);
+
+	memset(image, 0, sizeof(*image));
+
+	ghostcat_image_append(image, GHOSTCAT_IMAGE_MAGIC, GHOSTCAT_IMAGE_MAGIC_LEN);
+	ghostcat_image_append_u16(image, GHOSTCAT_IMAGE_VERSION);
+	ghostcat_image_append_u16(image, device->ids.bustype);
+	ghostcat_image_append_u16(image, device->ids.vendor);
+	ghostcat_image_append_u16(image, device->ids.product);
+	ghostcat_image_append(image, &driver_len, 1);
+	ghostcat_image_append(image, driver, driver_len);
+}
+
+/**
+ * Set up image to read the blobs in data. data must remain valid while
+ * the image is in use.
+ *
+ * @return 0 on success, -EINVAL if data is not an image, -ENOTSUP if the
+ * image version is unsupported or -ENODEV if the image was taken from a
+ * different device or driver
+ */
+int
+ghostcat_image_init_reader(struct ghostcat_image *image,
+			   const struct ghostcat_device *device,
+			   const uint8_t *data, size_t size)
+{
+	const char *driver = device->driver->id;
+	size_t header_len = GHOSTCAT_IMAGE_MAGIC_LEN + 4 * 2 + 1;
+	const uint8_t *p = data + GHOSTCAT_IMAGE_MAGIC_LEN;
+	uint8_t driver_len;
+
+	memset(image, 0, sizeof(*image));
+
+	if (size < header_len ||
+	    memcmp(data, GHOSTCAT_IMAGE_MAGIC, GHOSTCAT_IMAGE_MAGIC_LEN) != 0)
+		return -EINVAL;
+
+	if (get_unaligned_le_u16(p) != GHOSTCAT_IMAGE_VERSION)
+		return -ENOTSUP;
+
+	driver_len = p[8];
+	if (size < header_len + driver_len)
+		return -EINVAL;
+
+	if (get_unaligned_le_u16(p + 2) != device->ids.bustype ||
+	    get_unaligned_le_u16(p + 4) != device->ids.vendor ||
+	    get_unaligned_le_u16(p + 6) != device->ids.product ||
+	    driver_len != strlen(driver) ||
+	    memcmp(p + 9, driver, driver_len) != 0)
+		return -ENODEV;
+
+	image->rdata = data;
+	image->size = size;
+	image->offset = header_len + driver_len;
+
+	return 0;
+}
+
+void
+ghostcat_image_add_blob(struct ghostcat_image *image,
+			enum ghostcat_image_blob_type type,
+			uint16_t id, const void *data, uint16_t size)
+{
+	ghostcat_image_append_u16(image, type);
+	ghostcat_image_append_u16(image, id);
+	ghostcat_image_append_u16(image, size);
+	if (size)
+		ghostcat_image_append(image, data, size);
+}
+
+/**
+ * Read the next blob of the image. blob->data points into the image.
+ *
+ * @return 1 if a blob was read, 0 at the end of the image or -EINVAL if
+ * the image is truncated
+ */
+int
+ghostcat_image_next_blob(struct ghostcat_image *image,
+			 struct ghostcat_image_blob *blob)
+{
+	const uint8_t *p = image->rdata + image->offset;
+
+	if (image->end)
+		return 0;
+
+	if (image->size - image->offset < GHOSTCAT_IMAGE_BLOB_HEADER_LEN)
+		return -EINVAL;
+
+	blob->type = get_unaligned_le_u16(p);
+	blob->id = get_unaligned_le_u16(p + 2);
+	blob->size = get_unaligned_le_u16(p + 4);
+	blob->data = p + GHOSTCAT_IMAGE_BLOB_HEADER_LEN;
+
+	if (image->size - image->offset - GHOSTCAT_IMAGE_BLOB_HEADER_LEN < blob->size)
+		return -EINVAL;
+
+	image->offset += GHOSTCAT_IMAGE_BLOB_HEADER_LEN + blob->size;
+
+	if (blob->type == GHOSTCAT_IMAGE_BLOB_END) {
+		image->end = true;
+		return 0;
+	}
+
+	return 1;
+}
+
+void
+ghostcat_image_finish(struct ghostcat_image *image)
+{
+	ghostcat_image_add_blob(image, GHOSTCAT_IMAGE_BLOB_END, 0, NULL, 0);
+}
@@ -0,0 +1,100 @@
+/*
+ * libghostcat device images
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A device image holds the raw onboard memory of a device, as the
+ * driver writes it. It is tied to the driver and the VID/PID of the
+ * device it was taken from.
+ *
+ * Layout, all values little endian:
+ *
+ *   char     magic[8]       "GHOSTCAT"
+ *   uint16_t version        GHOSTCAT_IMAGE_VERSION
+ *   uint16_t bustype
+ *   uint16_t vendor
+ *   uint16_t product
+ *   uint8_t  driver_len
+ *   char     driver[driver_len]
+ *
+ * followed by a sequence of blobs, terminated by a blob of type
+ * GHOSTCAT_IMAGE_BLOB_END:
+ *
+ *   uint16_t type           enum ghostcat_image_blob_type
+ *   uint16_t id             driver-specific, e.g. the sector
+ *   uint16_t size
+ *   uint8_t  data[size]
+ */
+
+#define GHOSTCAT_IMAGE_VERSION 1
+
+enum ghostcat_image_blob_type {
+	GHOSTCAT_IMAGE_BLOB_END = 0,
+	GHOSTCAT_IMAGE_BLOB_HIDPP20_SECTOR = 1,
+	GHOSTCAT_IMAGE_BLOB_SINOWEALTH_CONFIG = 2,
+	GHOSTCAT_IMAGE_BLOB_SINOWEALTH_BUTTONS = 3,
+};
+
+struct ghostcat_image_blob {
+	uint16_t type;
+	uint16_t id;
+	uint16_t size;
+	const uint8_t *data;
+};
+
+struct ghostcat_image {
+	uint8_t *data;		/* writer only */
+	size_t allocated;
+	const uint8_t *rdata;	/* reader only */
+	size_t offset;
+	bool end;		/* the terminating blob was read */
+	size_t size;
+};
+
+struct ghostcat_device;
+
+void
+ghostcat_image_init_writer(struct ghostcat_image *image,
+			   const struct ghostcat_device *device);
+
+int
+ghostcat_image_init_reader(struct ghostcat_image *image,
+			   const struct ghostcat_device *device,
+			   const uint8_t *data, size_t size);
+
+void
+ghostcat_image_add_blob(struct ghostcat_image *image,
+			enum ghostcat_image_blob_type type,
+			uint16_t id, const void *data, uint16_t size);
+
+int
+ghostcat_image_next_blob(struct ghostcat_image *image,
+			 struct ghostcat_image_blob *blob);
+
+void
+ghostcat_image_finish(struct ghostcat_image *image);
@@ -28,10 +28,14 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include "libghostcat.h"
 #include "libghostcat-util.h"
 #include "libghostcat-hidraw.h"
+#include "libghostcat-trace.h"
+
+struct ghostcat_image;
 
 #ifdef NDEBUG
 #error "libratbag relies on assert(). Do not define NDEBUG"
@@ -111,6 +115,7 @@ struct ghostcat_test_device;
 
 struct ghostcat_driver;
 struct ghostcat_button_action;
+struct ghostcat_key_color;
 
 struct ghostcat {
 	const struct ghostcat_interface *interface;
@@ -123,6 +128,11 @@ struct ghostcat {
 	int refcount;
 	ghostcat_log_handler log_handler;
 	enum ghostcat_log_priority log_priority;
+
+	/* asynchronous jobs, see libghostcat-async.c */
+	int job_fd;
+	pthread_mutex_t job_lock;
+	struct list jobs_done;
 };
 
 #define MAX_CAP 1000
@@ -134,6 +144,8 @@ struct ghostcat_device {
 
 	struct udev_device *udev_device;
 	struct ghostcat_hidraw hidraw[MAX_HIDRAW];
+	struct ghostcat_hidraw_nodes hid_nodes; /**< hidraw nodes below the hid device */
+	struct ghostcat_hidraw_nodes usb_nodes; /**< hidraw nodes below the usb device */
 	int refcount;
 	struct input_id ids;
 	struct ghostcat_driver *driver;
@@ -142,12 +154,33 @@ struct ghostcat_device {
 
 	unsigned num_profiles;
 	struct list profiles;
+	/**
+	 * The profiles indexed by profile index. This is the start of the
+	 * one allocation that also holds every resolution, button and
+	 * LED, see ghostcat_device_init_profiles().
+	 */
+	struct ghostcat_profile *profile_array;
 
 	unsigned num_buttons;
 	unsigned num_leds;
 
 	char* firmware_version;
 
+	bool commit_pending; /**< device was offline during the last commit */
+
+	struct ghostcat_rtt rtt; /**< round-trip times, kept across probes */
+	struct ghostcat_stats stats; /**< transfer counters, see ghostcat_device_get_stats() */
+	bool busy; /**< an asynchronous job is running on the device */
+	struct ghostcat_trace *trace; /**< hidraw recording or replay, may be NULL */
+
+	/**
+	 * The colors last written by ghostcat_device_show_leds(), NULL
+	 * while the LEDs show the active profile
+	 */
+	struct ghostcat_color *shown_leds;
+
+	struct ghostcat_keys *keys; /**< per-key lighting, NULL if the device has none */
+
 	void *drv_data;
 
 	struct list link;
@@ -190,11 +223,17 @@ struct ghostcat_driver {
 	 * Callback called when the driver should write any profiles that
 	 * were modified back to the device.
 	 *
-	 * Both profile and button structs have a dirty variable that can
-	 * be used to tell whether or not they've actually changed since
-	 * the last commit. In order to reduce the amount of time
-	 * committing takes, drivers should use this information to avoid
-	 * writing back profiles and buttons that haven't actually changed.
+	 * Profiles, resolutions, buttons and LEDs have a dirty bitmask
+	 * that tells which of their fields changed since the last
+	 * commit, see enum ghostcat_profile_dirty and friends. In order
+	 * to reduce the amount of time committing takes, drivers should
+	 * use this information to avoid writing back anything that
+	 * hasn't actually changed.
+	 *
+	 * A driver returns -ENOTCONN if the device is currently
+	 * unreachable, e.g. a wireless device that is asleep. The dirty
+	 * state is kept and the commit is retried from
+	 * .refresh_active_resolution() once the device is back.
 	 */
 	int (*commit)(struct ghostcat_device *device);
 
@@ -211,15 +250,118 @@ struct ghostcat_driver {
 	 * hardware. Called periodically by ratbagd to detect physical
 	 * DPI button presses. Returns 1 if state changed, 0 if unchanged,
 	 * or a negative error code.
+	 *
+	 * Drivers for wireless devices should also pick up link changes
+	 * here, see .commit().
 	 */
 	int (*refresh_active_resolution)(struct ghostcat_device *device);
 
+	/**
+	 * Optional callback to read a profile the driver deferred at
+	 * probe time. Drivers that only read the active profile in
+	 * .probe() set needs_load on the other profiles, this is then
+	 * called the first time one of the profile's values is accessed.
+	 */
+	int (*load_profile)(struct ghostcat_profile *profile);
+
+	/**
+	 * Optional callback to read the macro of a button that has
+	 * macro_needs_load set, called on the first
+	 * ghostcat_button_get_macro() for that button.
+	 */
+	int (*load_macro)(struct ghostcat_button *button);
+
+	/**
+	 * Optional callback to show colors on the LEDs without storing
+	 * them in the profile or the device's onboard memory, for
+	 * animations driven by the host.
+	 *
+	 * colors holds one color per LED and changed is the mask of the
+	 * LED indices whose color differs from what the device shows,
+	 * only those need to be written. With colors NULL, the driver
+	 * shows the LEDs of the active profile again.
+	 */
+	int (*show_leds)(struct ghostcat_device *device,
+			 const struct ghostcat_color *colors,
+			 uint32_t changed);
+
+	/**
+	 * Callback to write the colors of individual keys, required if
+	 * the driver calls ghostcat_device_init_keys(). Only the keys
+	 * whose color changed are passed, in no particular order. Like
+	 * show_leds, the colors are not stored on the device.
+	 */
+	int (*write_keys)(struct ghostcat_device *device,
+			  const struct ghostcat_key_color *keys,
+			  unsigned int num_keys);
+
+	/**
+	 * Optional callback to serialize the device's onboard memory
+	 * into image, see libghostcat-image.h. The driver only adds
+	 * blobs, the image header and end marker are handled by the
+	 * caller.
+	 */
+	int (*save_image)(struct ghostcat_device *device,
+			  struct ghostcat_image *image);
+
+	/**
+	 * Optional callback to write the blobs of an image created by
+	 * .save_image() to the device. Drivers should skip blobs that
+	 * already match the device and resynchronize their profiles
+	 * with the device afterwards. Return -EINVAL if a blob does not
+	 * fit this device.
+	 */
+	int (*apply_image)(struct ghostcat_device *device,
+			   struct ghostcat_image *image);
+
 	/* private */
 	int (*test_probe)(struct ghostcat_device *device, const void *data);
 
 	struct list link;
 };
 
+/**
+ * Bits of ghostcat_profile.dirty. The RESOLUTIONS, BUTTONS and LEDS
+ * bits are set whenever one of the profile's resolutions, buttons or
+ * LEDs has a bit set in its own dirty mask.
+ */
+enum ghostcat_profile_dirty {
+	GHOSTCAT_PROFILE_DIRTY_RATE = (1 << 0),
+	GHOSTCAT_PROFILE_DIRTY_ANGLE_SNAPPING = (1 << 1),
+	GHOSTCAT_PROFILE_DIRTY_DEBOUNCE = (1 << 2),
+	GHOSTCAT_PROFILE_DIRTY_ACTIVE = (1 << 3),
+	GHOSTCAT_PROFILE_DIRTY_ENABLED = (1 << 4),
+	GHOSTCAT_PROFILE_DIRTY_NAME = (1 << 5),
+	GHOSTCAT_PROFILE_DIRTY_RESOLUTIONS = (1 << 6),
+	GHOSTCAT_PROFILE_DIRTY_BUTTONS = (1 << 7),
+	GHOSTCAT_PROFILE_DIRTY_LEDS = (1 << 8),
+
+	GHOSTCAT_PROFILE_DIRTY_ALL = (1 << 9) - 1,
+};
+
+/* Bits of ghostcat_resolution.dirty */
+enum ghostcat_resolution_dirty {
+	GHOSTCAT_RESOLUTION_DIRTY_DPI = (1 << 0),
+	GHOSTCAT_RESOLUTION_DIRTY_ACTIVE = (1 << 1),
+	GHOSTCAT_RESOLUTION_DIRTY_DEFAULT = (1 << 2),
+	GHOSTCAT_RESOLUTION_DIRTY_DISABLED = (1 << 3),
+	GHOSTCAT_RESOLUTION_DIRTY_DPI_SHIFT_TARGET = (1 << 4),
+};
+
+/* Bits of ghostcat_button.dirty */
+enum ghostcat_button_dirty {
+	GHOSTCAT_BUTTON_DIRTY_ACTION = (1 << 0),
+	GHOSTCAT_BUTTON_DIRTY_MACRO = (1 << 1),
+};
+
+/* Bits of ghostcat_led.dirty */
+enum ghostcat_led_dirty {
+	GHOSTCAT_LED_DIRTY_MODE = (1 << 0),
+	GHOSTCAT_LED_DIRTY_COLOR = (1 << 1),
+	GHOSTCAT_LED_DIRTY_DURATION = (1 << 2),
+	GHOSTCAT_LED_DIRTY_BRIGHTNESS = (1 << 3),
+};
+
 struct ghostcat_resolution {
 	struct ghostcat_profile *profile;
 	int refcount;
@@ -238,7 +380,7 @@ struct ghostcat_resolution {
 	bool is_default;
 	bool is_disabled;
 	bool is_dpi_shift_target;
-	bool dirty;
+	uint32_t dirty;		/**< enum ghostcat_resolution_dirty */
 	uint32_t capabilities;
 };
 
@@ -254,7 +396,7 @@ struct ghostcat_led {
 	enum ghostcat_led_colordepth colordepth;
 	unsigned int ms;              /**< duration of action in ms */
 	unsigned int brightness;      /**< brightness of the LED */
-	bool dirty;
+	uint32_t dirty;               /**< enum ghostcat_led_dirty */
 };
 
 struct ghostcat_profile {
@@ -271,29 +413,46 @@ struct ghostcat_profile {
 	struct list resolutions;
 	struct list leds;
 
+	/* indexed by the resolution/button/led index, owned by the device */
+	struct ghostcat_resolution *resolution_array;
+	struct ghostcat_button *button_array;
+	struct ghostcat_led *led_array;
+
 	unsigned int hz;	/**< report rate in Hz */
 	unsigned int rates[8];	/**< report rates available */
 	size_t nrates;		/**< number of entries in rates */
-	bool rate_dirty;
 
 	int angle_snapping;
-	bool angle_snapping_dirty;
 
 	int debounce;	/**< debounce time in ms */
-	bool debounce_dirty;
 	unsigned int debounces[8];	/**< debounce times available */
 	size_t ndebounces;		/**< number of entries in debounces */
 
 	unsigned int num_resolutions;
 
 	bool is_active;		/**< profile is the currently active one */
-	bool is_active_dirty;
 
 	bool is_enabled;
-	bool dirty;       /**< profile changed since last commit */
+	uint32_t dirty;   /**< enum ghostcat_profile_dirty, changes since last commit */
+	bool needs_load;  /**< values not read from the device yet */
 	unsigned long capabilities[NLONGS(MAX_CAP)];
 };
 
+static inline void
+ghostcat_resolution_mark_dirty(struct ghostcat_resolution *resolution,
+			       uint32_t fields)
+{
+	resolution->dirty |= fields;
+	resolution->profile->dirty |= GHOSTCAT_PROFILE_DIRTY_RESOLUTIONS;
+}
+
+static inline void
+ghostcat_led_mark_dirty(struct ghostcat_led *led, uint32_t fields)
+{
+	led->dirty |= fields;
+	led->profile->dirty |= GHOSTCAT_PROFILE_DIRTY_LEDS;
+}
+
 #define ghostcat_device_for_each_profile(device_, profile_) \
 	list_for_each(profile_, &(device_)->profiles, link)
 
@@ -306,6 +465,28 @@ struct ghostcat_profile {
 #define ghostcat_profile_for_each_resolution(profile_, resolution_) \
 	list_for_each(resolution_, &(profile_)->resolutions, link)
 
+/**
+ * Whether the profile has changes other than switching the active profile
+ * or resolution. Drivers that keep those two in a register and everything
+ * else in the profile's flash page use this to skip the page write.
+ */
+static inline bool
+ghostcat_profile_has_stored_changes(struct ghostcat_profile *profile)
+{
+	struct ghostcat_resolution *resolution;
+
+	if (profile->dirty & ~(GHOSTCAT_PROFILE_DIRTY_ACTIVE |
+			       GHOSTCAT_PROFILE_DIRTY_RESOLUTIONS))
+		return true;
+
+	ghostcat_profile_for_each_resolution(profile, resolution) {
+		if (resolution->dirty & ~GHOSTCAT_RESOLUTION_DIRTY_ACTIVE)
+			return true;
+	}
+
+	return false;
+}
+
 #define BUTTON_ACTION_NONE \
  { .type = GHOSTCAT_BUTTON_ACTION_TYPE_NONE }
 #define BUTTON_ACTION_UNKNOWN \
@@ -370,13 +551,21 @@ struct ghostcat_button {
 	unsigned index;
 	struct ghostcat_button_action action;
 	uint32_t action_caps;
-	bool dirty; /* changed since last commit to device */
+	uint32_t dirty; /* enum ghostcat_button_dirty, changed since last commit to device */
+	bool macro_needs_load; /* macro events not read from the device yet */
 };
 
 void
 ghostcat_button_set_action(struct ghostcat_button *button,
 			 const struct ghostcat_button_action *action);
 
+static inline void
+ghostcat_button_mark_dirty(struct ghostcat_button *button, uint32_t fields)
+{
+	button->dirty |= fields;
+	button->profile->dirty |= GHOSTCAT_PROFILE_DIRTY_BUTTONS;
+}
+
 static inline void
 ghostcat_button_enable_action_type(struct ghostcat_button *button,
 				 enum ghostcat_button_action_type type)
@@ -412,6 +601,37 @@ ghostcat_get_drv_data(const struct ghostcat_device *device)
 	return device->drv_data;
 }
 
+/**
+ * The per-key framebuffer of a keyboard: a grid of cells laid out like
+ * the keys, each holding the driver's id of the key in that place.
+ */
+struct ghostcat_keys {
+	unsigned int width;
+	unsigned int height;
+	uint16_t *layout;		/**< key id per cell, 0 if there is no key */
+	struct ghostcat_color *frame;	/**< colors set by the client */
+	struct ghostcat_color *shown;	/**< colors on the device */
+	bool *dirty;			/**< frame and shown differ */
+	unsigned int num_dirty;
+	struct ghostcat_key_color *updates; /**< scratch space for write_keys */
+};
+
+struct ghostcat_key_color {
+	uint16_t key;
+	struct ghostcat_color color;
+};
+
+/**
+ * Give the device a per-key framebuffer of width x height cells.
+ * layout holds the driver's key id of each cell, row by row, 0 for
+ * cells without a key. The driver must implement write_keys.
+ */
+void
+ghostcat_device_init_keys(struct ghostcat_device *device,
+			  unsigned int width,
+			  unsigned int height,
+			  const uint16_t *layout);
+
 int
 ghostcat_device_init_profiles(struct ghostcat_device *device,
 			    unsigned int num_profiles,
@@ -613,6 +833,21 @@ ghostcat_device_new(struct ghostcat *ratbag, struct udev_device *udev_device,
 		  const char *name, const struct input_id *id);
 void
 ghostcat_device_destroy(struct ghostcat_device *device);
+struct ghostcat_device *
+ghostcat_device_new_unprobed(struct ghostcat *ratbag,
+			     struct udev_device *udev_device);
+
+int
+ghostcat_jobs_init(struct ghostcat *ratbag);
+void
+ghostcat_jobs_release(struct ghostcat *ratbag);
+bool
+ghostcat_job_log_enabled(enum ghostcat_log_priority priority, bool *enabled);
+bool
+ghostcat_job_log(enum ghostcat_log_priority priority,
+		 const char *format, va_list args);
+bool
+ghostcat_device_is_busy(struct ghostcat_device *device);
 
 const char *
 ghostcat_device_get_udev_property(const struct ghostcat_device* device,
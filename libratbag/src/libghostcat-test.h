@@ -33,6 +33,8 @@
 #define GHOSTCAT_TEST_MAX_RESOLUTIONS 8
 #define GHOSTCAT_TEST_MAX_LEDS 8
 
+struct ghostcat_key_color;
+
 struct ghostcat_test_macro_event {
 	enum ghostcat_macro_event_type type;
 	unsigned int value;
@@ -93,6 +95,24 @@ struct ghostcat_test_device {
 	struct ghostcat_test_profile profiles[GHOSTCAT_TEST_MAX_PROFILES];
 	void (*destroyed)(struct ghostcat_device *device, void *data);
 	void *destroyed_data;
+	/* called by ghostcat_device_show_leds/restore_leds, may be NULL */
+	void (*leds_shown)(struct ghostcat_device *device,
+			   const struct ghostcat_color *colors,
+			   uint32_t changed,
+			   void *data);
+	void *leds_shown_data;
+	/* per-key lighting, key_width * key_height key ids, 0 for no key */
+	unsigned int key_width;
+	unsigned int key_height;
+	const uint16_t *key_layout;
+	/* called by ghostcat_device_show_keys, may be NULL */
+	void (*keys_written)(struct ghostcat_device *device,
+			     const struct ghostcat_key_color *keys,
+			     unsigned int num_keys,
+			     void *data);
+	void *keys_written_data;
+	/* time a commit takes, to catch requests during a commit */
+	unsigned int commit_delay_ms;
 };
 
 struct ghostcat_device* ghostcat_device_new_test_device(struct ghostcat *ratbag,
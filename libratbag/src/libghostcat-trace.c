@@ -0,0 +1,331 @@
+/*
+ * libghostcat hidraw traffic recording and replay
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libghostcat-trace.h"
+#include "libghostcat-util.h"
+
+#define TRACE_MAGIC		"GCTRACE"
+#define TRACE_VERSION		1
+#define TRACE_HEADER_SIZE	18	/* magic, version, bus, vendor, product, name length */
+#define TRACE_EVENT_SIZE	12	/* type, idx, length, rc, duration */
+
+struct ghostcat_trace {
+	struct input_id id;
+	char *name;
+
+	/* recording */
+	FILE *file;
+
+	/* replay */
+	uint8_t *data;
+	size_t size;
+	size_t offset;		/**< of the next event */
+	unsigned int position;	/**< index of the next event */
+	bool realtime;
+	bool diverged;
+};
+
+struct trace_event {
+	enum ghostcat_trace_event type;
+	unsigned int idx;
+	int rc;
+	uint32_t duration_us;
+	const uint8_t *payload;
+	size_t len;
+};
+
+static inline void
+put_le16(uint8_t *buf, uint16_t v)
+{
+	buf[0] = v & 0xff;
+	buf[1] = v >> 8;
+}
+
+static inline void
+put_le32(uint8_t *buf, uint32_t v)
+{
+	put_le16(buf, v & 0xffff);
+	put_le16(buf + 2, v >> 16);
+}
+
+static inline uint16_t
+get_le16(const uint8_t *buf)
+{
+	return buf[0] | buf[1] << 8;
+}
+
+static inline uint32_t
+get_le32(const uint8_t *buf)
+{
+	return get_le16(buf) | (uint32_t)get_le16(buf + 2) << 16;
+}
+
+struct ghostcat_trace *
+ghostcat_trace_new_recording(const char *path, const struct input_id *id,
+			     const char *name)
+{
+	struct ghostcat_trace *trace;
+	uint8_t header[TRACE_HEADER_SIZE];
+	size_t name_len = min(strlen(name), 0xffffU);
+	FILE *file;
+
+	file = fopen(path, "we");
+	if (!file)
+		return NULL;
+
+	memcpy(header, TRACE_MAGIC, 8);
+	put_le16(header + 8, TRACE_VERSION);
+	put_le16(header + 10, id->bustype);
+	put_le16(header + 12, id->vendor);
+	put_le16(header + 14, id->product);
+	put_le16(header + 16, name_len);
+
+	if (fwrite(header, sizeof(header), 1, file) != 1 ||
+	    fwrite(name, 1, name_len, file) != name_len ||
+	    fflush(file) != 0) {
+		fclose(file);
+		errno = EIO;
+		return NULL;
+	}
+
+	trace = zalloc(sizeof(*trace));
+	trace->file = file;
+	trace->id = *id;
+	trace->name = strdup_safe(name);
+
+	return trace;
+}
+
+static bool
+trace_read_event(const struct ghostcat_trace *trace, size_t offset,
+		 struct trace_event *event)
+{
+	const uint8_t *p = trace->data + offset;
+
+	if (trace->size - offset < TRACE_EVENT_SIZE)
+		return false;
+
+	event->type = p[0];
+	event->idx = p[1];
+	event->len = get_le16(p + 2);
+	event->rc = (int32_t)get_le32(p + 4);
+	event->duration_us = get_le32(p + 8);
+	event->payload = p + TRACE_EVENT_SIZE;
+
+	return trace->size - offset - TRACE_EVENT_SIZE >= event->len;
+}
+
+struct ghostcat_trace *
+ghostcat_trace_new_replay(const char *path, bool realtime)
+{
+	struct ghostcat_trace *trace;
+	struct trace_event event;
+	FILE *file;
+	long size;
+	size_t name_len, offset;
+
+	file = fopen(path, "re");
+	if (!file)
+		return NULL;
+
+	trace = zalloc(sizeof(*trace));
+	trace->realtime = realtime;
+
+	if (fseek(file, 0, SEEK_END) != 0 || (size = ftell(file)) < 0)
+		goto err;
+	rewind(file);
+
+	trace->size = size;
+	trace->data = zalloc(max(trace->size, 1U));
+	if (fread(trace->data, 1, trace->size, file) != trace->size)
+		goto err;
+
+	if (trace->size < TRACE_HEADER_SIZE ||
+	    memcmp(trace->data, TRACE_MAGIC, 8) != 0 ||
+	    get_le16(trace->data + 8) != TRACE_VERSION)
+		goto err;
+
+	trace->id.bustype = get_le16(trace->data + 10);
+	trace->id.vendor = get_le16(trace->data + 12);
+	trace->id.product = get_le16(trace->data + 14);
+	name_len = get_le16(trace->data + 16);
+	if (trace->size - TRACE_HEADER_SIZE < name_len)
+		goto err;
+
+	trace->name = zalloc(name_len + 1);
+	memcpy(trace->name, trace->data + TRACE_HEADER_SIZE, name_len);
+	trace->offset = TRACE_HEADER_SIZE + name_len;
+
+	/* validate once so the replay can trust every event */
+	offset = trace->offset;
+	while (offset < trace->size) {
+		if (!trace_read_event(trace, offset, &event))
+			goto err;
+		offset += TRACE_EVENT_SIZE + event.len;
+	}
+
+	fclose(file);
+	return trace;
+
+err:
+	fclose(file);
+	ghostcat_trace_destroy(trace);
+	errno = EINVAL;
+	return NULL;
+}
+
+void
+ghostcat_trace_destroy(struct ghostcat_trace *trace)
+{
+	if (!trace)
+		return;
+
+	if (trace->file)
+		fclose(trace->file);
+	free(trace->data);
+	free(trace->name);
+	free(trace);
+}
+
+bool
+ghostcat_trace_is_replay(const struct ghostcat_trace *trace)
+{
+	return trace->file == NULL;
+}
+
+const char *
+ghostcat_trace_get_name(const struct ghostcat_trace *trace)
+{
+	return trace->name;
+}
+
+const struct input_id *
+ghostcat_trace_get_id(const struct ghostcat_trace *trace)
+{
+	return &trace->id;
+}
+
+bool
+ghostcat_trace_has_diverged(const struct ghostcat_trace *trace)
+{
+	return trace->diverged;
+}
+
+unsigned int
+ghostcat_trace_get_position(const struct ghostcat_trace *trace)
+{
+	return trace->position;
+}
+
+void
+ghostcat_trace_record(struct ghostcat_trace *trace,
+		      enum ghostcat_trace_event type, unsigned int idx,
+		      int rc, uint64_t duration_us,
+		      const uint8_t *data, size_t len)
+{
+	uint8_t header[TRACE_EVENT_SIZE];
+
+	if (!data)
+		len = 0;
+	len = min(len, 0xffffU);
+
+	header[0] = type;
+	header[1] = idx;
+	put_le16(header + 2, len);
+	put_le32(header + 4, (uint32_t)rc);
+	put_le32(header + 8, min(duration_us, (uint64_t)UINT32_MAX));
+
+	/* flushed per event, a recording is most useful when the
+	 * process does not get to close it */
+	fwrite(header, sizeof(header), 1, trace->file);
+	if (len)
+		fwrite(data, 1, len, trace->file);
+	fflush(trace->file);
+}
+
+int
+ghostcat_trace_replay(struct ghostcat_trace *trace,
+		      enum ghostcat_trace_event type, unsigned int idx,
+		      const uint8_t *data, size_t len,
+		      uint8_t *buf, size_t size)
+{
+	struct trace_event event;
+	bool match;
+
+	if (trace->diverged)
+		return -EIO;
+
+	match = trace_read_event(trace, trace->offset, &event) &&
+		event.type == type && event.idx == idx;
+
+	if (!match) {
+		switch (type) {
+		case GHOSTCAT_TRACE_READ:
+			return -ETIMEDOUT;
+		case GHOSTCAT_TRACE_OPEN:
+			return -ENODEV;
+		case GHOSTCAT_TRACE_CLOSE:
+			return 0;
+		default:
+			trace->diverged = true;
+			return -EIO;
+		}
+	}
+
+	switch (type) {
+	case GHOSTCAT_TRACE_WRITE:
+	case GHOSTCAT_TRACE_SET_FEATURE:
+		match = len == event.len && memcmp(data, event.payload, len) == 0;
+		break;
+	case GHOSTCAT_TRACE_GET_FEATURE:
+		match = len > 0 && event.len > 0 && data[0] == event.payload[0];
+		break;
+	default:
+		break;
+	}
+
+	if (!match) {
+		trace->diverged = true;
+		return -EIO;
+	}
+
+	if (buf && event.len)
+		memcpy(buf, event.payload, min(event.len, size));
+
+	trace->offset += TRACE_EVENT_SIZE + event.len;
+	trace->position++;
+
+	if (trace->realtime && event.duration_us)
+		usleep(event.duration_us);
+
+	return event.rc;
+}
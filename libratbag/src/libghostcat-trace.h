@@ -0,0 +1,124 @@
+/*
+ * libghostcat hidraw traffic recording and replay
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <linux/input.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A trace is the sequence of hidraw operations of one device, from the
+ * first node opened during the probe until the device is removed. The
+ * hidraw layer appends every operation to a recording and, when the
+ * device was created from a trace, answers every operation from it
+ * instead of a device node.
+ *
+ * The file starts with a header holding the device ids and name, each
+ * operation follows as a 12 byte event header and its payload, all
+ * integers little endian.
+ */
+
+struct ghostcat_trace;
+
+enum ghostcat_trace_event {
+	GHOSTCAT_TRACE_OPEN = 1,	/**< payload: the report descriptor */
+	GHOSTCAT_TRACE_CLOSE,
+	GHOSTCAT_TRACE_WRITE,		/**< payload: the output report */
+	GHOSTCAT_TRACE_READ,		/**< payload: the input report */
+	GHOSTCAT_TRACE_GET_FEATURE,	/**< payload: the report, or its id on error */
+	GHOSTCAT_TRACE_SET_FEATURE,	/**< payload: the report */
+};
+
+/**
+ * Create the file at path and start recording to it.
+ *
+ * @return the trace or NULL on error, errno is set
+ */
+struct ghostcat_trace *
+ghostcat_trace_new_recording(const char *path, const struct input_id *id,
+			     const char *name);
+
+/**
+ * Load the recording at path for replay. With realtime set, every
+ * operation takes as long as it took while recording, otherwise the
+ * replay runs as fast as possible.
+ *
+ * @return the trace or NULL on error, errno is set
+ */
+struct ghostcat_trace *
+ghostcat_trace_new_replay(const char *path, bool realtime);
+
+void
+ghostcat_trace_destroy(struct ghostcat_trace *trace);
+
+bool
+ghostcat_trace_is_replay(const struct ghostcat_trace *trace);
+
+const char *
+ghostcat_trace_get_name(const struct ghostcat_trace *trace);
+
+const struct input_id *
+ghostcat_trace_get_id(const struct ghostcat_trace *trace);
+
+/**
+ * True once an operation differed from the recording.
+ */
+bool
+ghostcat_trace_has_diverged(const struct ghostcat_trace *trace);
+
+/**
+ * The index of the next event to be replayed, for error messages.
+ */
+unsigned int
+ghostcat_trace_get_position(const struct ghostcat_trace *trace);
+
+/**
+ * Append an operation on hidraw node idx to a recording. rc is the
+ * result of the operation, duration_us the time it took.
+ */
+void
+ghostcat_trace_record(struct ghostcat_trace *trace,
+		      enum ghostcat_trace_event type, unsigned int idx,
+		      int rc, uint64_t duration_us,
+		      const uint8_t *data, size_t len);
+
+/**
+ * Replay an operation on hidraw node idx. data is what the caller
+ * writes, for GHOSTCAT_TRACE_GET_FEATURE only its first byte, the report
+ * id, is compared. The recorded payload of operations that read is
+ * copied into buf.
+ *
+ * A read the recording has no report for times out and an open it has
+ * no node for fails with -ENODEV, neither consumes an event. Any other
+ * operation that differs from the recording fails with -EIO, as does
+ * every operation after it.
+ *
+ * @return the recorded result of the operation
+ */
+int
+ghostcat_trace_replay(struct ghostcat_trace *trace,
+		      enum ghostcat_trace_event type, unsigned int idx,
+		      const uint8_t *data, size_t len,
+		      uint8_t *buf, size_t size);
@@ -205,3 +205,71 @@ int mkdir_p(const char *dir, mode_t mode)
 
     return mkdir(dir, mode);
 }
+
+uint64_t
+ghostcat_rtt_update(struct ghostcat_rtt *rtt, uint64_t start_ns)
+{
+	uint64_t sample = (now(CLOCK_MONOTONIC) - start_ns) / 1000;
+	unsigned int r, delta;
+
+	/* anything above the maximum timeout is a stall, not a sample */
+	r = min(sample, GHOSTCAT_RTT_TIMEOUT_MAX_MS * 1000ULL);
+
+	if (rtt->samples++ == 0) {
+		rtt->srtt_us = r;
+		rtt->rttvar_us = r / 2;
+		return sample;
+	}
+
+	delta = r > rtt->srtt_us ? r - rtt->srtt_us : rtt->srtt_us - r;
+	rtt->rttvar_us = (3 * rtt->rttvar_us + delta) / 4;
+	rtt->srtt_us = (7 * rtt->srtt_us + r) / 8;
+
+	return sample;
+}
+
+void
+ghostcat_stats_add_latency(struct ghostcat_stats *stats, uint64_t latency_us)
+{
+	unsigned int bucket = 0;
+
+	/* bucket n starts at FIRST_US << (n - 1) */
+	if (latency_us >= GHOSTCAT_STATS_LATENCY_FIRST_US) {
+		bucket = 63 - __builtin_clzll(latency_us / GHOSTCAT_STATS_LATENCY_FIRST_US) + 1;
+		bucket = min(bucket, GHOSTCAT_STATS_LATENCY_BUCKETS - 1U);
+	}
+
+	ghostcat_stats_add(stats, latency[bucket], 1);
+}
+
+static unsigned int
+rtt_backoff(unsigned int ms, unsigned int attempt, unsigned int lo, unsigned int hi)
+{
+	uint64_t value = (uint64_t)max(ms, lo) << min(attempt, 16U);
+
+	return min(value, (uint64_t)hi);
+}
+
+unsigned int
+ghostcat_rtt_timeout_ms(const struct ghostcat_rtt *rtt, unsigned int attempt)
+{
+	unsigned int rto = GHOSTCAT_RTT_TIMEOUT_INITIAL_MS;
+
+	if (rtt && rtt->samples > 0)
+		rto = (rtt->srtt_us + 4 * rtt->rttvar_us + 999) / 1000;
+
+	return rtt_backoff(rto, attempt,
+			   GHOSTCAT_RTT_TIMEOUT_MIN_MS,
+			   GHOSTCAT_RTT_TIMEOUT_MAX_MS);
+}
+
+unsigned int
+ghostcat_rtt_delay_ms(const struct ghostcat_rtt *rtt, unsigned int attempt)
+{
+	unsigned int base = 10;
+
+	if (rtt && rtt->samples > 0)
+		base = (rtt->srtt_us + 999) / 1000;
+
+	return rtt_backoff(base, attempt, 1, GHOSTCAT_RTT_DELAY_MAX_MS);
+}
@@ -232,6 +232,87 @@ xasprintf(char **strp, const char *fmt, ...)
 	return rc;
 }
 
+/**
+ * Round-trip time estimate of a device, following RFC 6298. Timeouts and
+ * retry delays are derived from it instead of using fixed values.
+ */
+struct ghostcat_rtt {
+	unsigned int srtt_us;		/**< smoothed round-trip time */
+	unsigned int rttvar_us;		/**< round-trip time variation */
+	unsigned int samples;
+};
+
+#define GHOSTCAT_RTT_TIMEOUT_INITIAL_MS	200
+#define GHOSTCAT_RTT_TIMEOUT_MIN_MS	20
+#define GHOSTCAT_RTT_TIMEOUT_MAX_MS	1000
+#define GHOSTCAT_RTT_DELAY_MAX_MS	100
+
+/* Add the round-trip time of a request started at start_ns, see now().
+ * Returns the round-trip time in us */
+uint64_t
+ghostcat_rtt_update(struct ghostcat_rtt *rtt, uint64_t start_ns);
+
+/* How long to wait for a response, doubled for every retry */
+unsigned int
+ghostcat_rtt_timeout_ms(const struct ghostcat_rtt *rtt, unsigned int attempt);
+
+/* How long to sleep before polling a busy device again, doubled for
+ * every retry */
+unsigned int
+ghostcat_rtt_delay_ms(const struct ghostcat_rtt *rtt, unsigned int attempt);
+
+#define GHOSTCAT_STATS_LATENCY_BUCKETS		16
+#define GHOSTCAT_STATS_LATENCY_FIRST_US		128
+
+/**
+ * Runtime counters of a device. They are updated on every transfer, so
+ * they are plain relaxed atomic adds; readers may see a transfer counted
+ * before its bytes but never a torn value.
+ */
+struct ghostcat_stats {
+	uint64_t transfers;		/**< reports written or requested */
+	uint64_t bytes_sent;
+	uint64_t bytes_received;
+	uint64_t retries;		/**< reads repeated after a timeout */
+	uint64_t timeouts;		/**< reads that got no response */
+	uint64_t errors;		/**< failed reads and writes */
+	uint64_t probe_us;		/**< duration of the driver probe */
+	uint64_t commits;
+	uint64_t commit_us;		/**< duration of the last commit */
+	uint64_t commit_total_us;
+	/* Round-trip times, bucket 0 counts anything below
+	 * GHOSTCAT_STATS_LATENCY_FIRST_US, each further bucket up to twice
+	 * the previous bound, the last one everything above */
+	uint64_t latency[GHOSTCAT_STATS_LATENCY_BUCKETS];
+};
+
+#define ghostcat_stats_add(stats_, field_, n_) \
+	__atomic_fetch_add(&(stats_)->field_, (n_), __ATOMIC_RELAXED)
+
+#define ghostcat_stats_get(stats_, field_) \
+	__atomic_load_n(&(stats_)->field_, __ATOMIC_RELAXED)
+
+#define ghostcat_stats_clear(stats_, field_) \
+	__atomic_store_n(&(stats_)->field_, 0, __ATOMIC_RELAXED)
+
+/* Count a round-trip time of latency_us in the histogram */
+void
+ghostcat_stats_add_latency(struct ghostcat_stats *stats, uint64_t latency_us);
+
+/* Count a transfer of the given size, rc is the result of the transfer */
+static inline void
+ghostcat_stats_add_transfer(struct ghostcat_stats *stats,
+			    size_t sent, size_t received, int rc)
+{
+	ghostcat_stats_add(stats, transfers, 1);
+	if (rc < 0) {
+		ghostcat_stats_add(stats, errors, 1);
+		return;
+	}
+	ghostcat_stats_add(stats, bytes_sent, sent);
+	ghostcat_stats_add(stats, bytes_received, received);
+}
+
 struct dpi_range {
 	unsigned int min;
 	unsigned int max;
@@ -38,6 +38,7 @@
 #include "libghostcat-private.h"
 #include "libghostcat-util.h"
 #include "libghostcat-data.h"
+#include "libghostcat-image.h"
 
 static enum ghostcat_error_code
 error_code(enum ghostcat_error_code code)
@@ -60,10 +61,6 @@ static void
 ghostcat_profile_destroy(struct ghostcat_profile *profile);
 static void
 ghostcat_button_destroy(struct ghostcat_button *button);
-static void
-ghostcat_led_destroy(struct ghostcat_led *led);
-static void
-ghostcat_resolution_destroy(struct ghostcat_resolution *resolution);
 
 static void
 ghostcat_default_log_func(struct ghostcat *ratbag,
@@ -96,15 +93,31 @@ ghostcat_default_log_func(struct ghostcat *ratbag,
 	vfprintf(out, format, args);
 }
 
+static bool
+log_enabled(struct ghostcat *ratbag, enum ghostcat_log_priority priority)
+{
+	bool enabled;
+
+	if (ghostcat_job_log_enabled(priority, &enabled))
+		return enabled;
+
+	return ratbag->log_handler && ratbag->log_priority <= priority;
+}
+
 void
 log_msg_va(struct ghostcat *ratbag,
 	   enum ghostcat_log_priority priority,
 	   const char *format,
 	   va_list args)
 {
-	if (ratbag->log_handler &&
-	    ratbag->log_priority <= priority)
-		ratbag->log_handler(ratbag, priority, format, args);
+	if (!log_enabled(ratbag, priority))
+		return;
+
+	/* asynchronous jobs keep their messages until they are done */
+	if (ghostcat_job_log(priority, format, args))
+		return;
+
+	ratbag->log_handler(ratbag, priority, format, args);
 }
 
 void
@@ -130,8 +143,7 @@ log_buffer(struct ghostcat *ratbag,
 	unsigned int i, n;
 	unsigned int buf_len;
 
-	if (ratbag->log_handler &&
-	    ratbag->log_priority > priority)
+	if (!log_enabled(ratbag, priority))
 		return;
 
 	buf_len = header ? strlen(header) : 0;
@@ -207,6 +219,20 @@ ghostcat_device_new(struct ghostcat *ratbag, struct udev_device *udev_device,
 	return device;
 }
 
+static void
+ghostcat_keys_destroy(struct ghostcat_keys *keys)
+{
+	if (!keys)
+		return;
+
+	free(keys->layout);
+	free(keys->frame);
+	free(keys->shown);
+	free(keys->dirty);
+	free(keys->updates);
+	free(keys);
+}
+
 void
 ghostcat_device_destroy(struct ghostcat_device *device)
 {
@@ -221,11 +247,15 @@ ghostcat_device_destroy(struct ghostcat_device *device)
 	if (device->driver && device->driver->remove)
 		device->driver->remove(device);
 
+	ghostcat_trace_destroy(device->trace);
+
 	list_for_each_safe(profile, next, &device->profiles, link)
 		ghostcat_profile_destroy(profile);
+	free(device->profile_array);
 
 	if (device->udev_device)
 		udev_device_unref(device->udev_device);
+	ghostcat_device_free_hidraw_nodes(device);
 
 	list_remove(&device->link);
 
@@ -233,6 +263,8 @@ ghostcat_device_destroy(struct ghostcat_device *device)
 	ghostcat_device_data_unref(device->data);
 	free(device->name);
 	free(device->firmware_version);
+	free(device->shown_leds);
+	ghostcat_keys_destroy(device->keys);
 	free(device);
 }
 
@@ -330,6 +362,7 @@ ghostcat_try_driver(struct ghostcat_device *device,
 {
 	struct ghostcat *ratbag = device->ratbag;
 	struct ghostcat_driver *driver;
+	uint64_t start;
 	int rc;
 
 	list_for_each(driver, &ratbag->drivers, link) {
@@ -345,11 +378,14 @@ ghostcat_try_driver(struct ghostcat_device *device,
 		goto error;
 	}
 
+	start = now(CLOCK_MONOTONIC);
 	if (test_device)
 		rc = device->driver->test_probe(device, test_device);
 	else
 		rc = device->driver->probe(device);
 	if (rc == 0) {
+		device->stats.probe_us = (now(CLOCK_MONOTONIC) - start) / 1000;
+
 		if (!ghostcat_sanity_check_device(device)) {
 			goto error;
 		} else {
@@ -416,45 +452,120 @@ get_product_id(struct udev_device *device, struct input_id *id)
 	return 0;
 }
 
+/**
+ * Record the hidraw traffic of the device if GHOSTCAT_RECORD_DIR is set,
+ * see ghostcat_device_new_from_recording().
+ */
+static void
+ghostcat_device_start_recording(struct ghostcat_device *device)
+{
+	const char *dir = getenv("GHOSTCAT_RECORD_DIR");
+	_cleanup_free_ char *path = NULL;
+
+	if (!dir || !*dir)
+		return;
+
+	path = asprintf_safe("%s/%s.trace", dir,
+			     udev_device_get_sysname(device->udev_device));
+	device->trace = ghostcat_trace_new_recording(path, &device->ids,
+						     device->name);
+	if (!device->trace)
+		log_error(device->ratbag, "%s: cannot record to %s (%s)\n",
+			  device->name, path, strerror(errno));
+	else
+		log_info(device->ratbag, "%s: recording to %s\n",
+			 device->name, path);
+}
+
+/**
+ * Create the device for a udev device we have a data file for, without
+ * probing it yet.
+ */
+struct ghostcat_device *
+ghostcat_device_new_unprobed(struct ghostcat *ratbag,
+			     struct udev_device *udev_device)
+{
+	struct ghostcat_device *device;
+	_cleanup_free_ char *name = NULL;
+	struct input_id id;
+
+	if (get_product_id(udev_device, &id) != 0)
+		return NULL;
+
+	if ((name = get_device_name(udev_device)) == 0)
+		return NULL;
+
+	log_debug(ratbag, "New device: %s\n", name);
+
+	device = ghostcat_device_new(ratbag, udev_device, name, &id);
+	if (!device->data || ghostcat_device_scan_hidraw(device) != 0) {
+		ghostcat_device_destroy(device);
+		return NULL;
+	}
+
+	ghostcat_device_start_recording(device);
+
+	return device;
+}
+
 LIBGHOSTCAT_EXPORT enum ghostcat_error_code
 ghostcat_device_new_from_udev_device(struct ghostcat *ratbag,
 				   struct udev_device *udev_device,
 				   struct ghostcat_device **device_out)
 {
-	struct ghostcat_device *device = NULL;
-	enum ghostcat_error_code error = GHOSTCAT_ERROR_DEVICE;
-	_cleanup_free_ char *name = NULL;
-	struct input_id id;
+	struct ghostcat_device *device;
 
 	assert(ratbag != NULL);
 	assert(udev_device != NULL);
 	assert(device_out != NULL);
 
-	if (get_product_id(udev_device, &id) != 0)
-		goto out_err;
+	device = ghostcat_device_new_unprobed(ratbag, udev_device);
+	if (!device)
+		return error_code(GHOSTCAT_ERROR_DEVICE);
 
-	if ((name = get_device_name(udev_device)) == 0)
-		goto out_err;
+	if (!ghostcat_assign_driver(device, &device->ids, NULL)) {
+		ghostcat_device_destroy(device);
+		return error_code(GHOSTCAT_ERROR_DEVICE);
+	}
 
-	log_debug(ratbag, "New device: %s\n", name);
+	*device_out = device;
 
-	device = ghostcat_device_new(ratbag, udev_device, name, &id);
-	if (!device || !device->data)
-		goto out_err;
+	return error_code(GHOSTCAT_SUCCESS);
+}
 
-	if (!ghostcat_assign_driver(device, &device->ids, NULL))
-		goto out_err;
+LIBGHOSTCAT_EXPORT enum ghostcat_error_code
+ghostcat_device_new_from_recording(struct ghostcat *ratbag,
+				   const char *path,
+				   uint32_t flags,
+				   struct ghostcat_device **device_out)
+{
+	struct ghostcat_device *device;
+	struct ghostcat_trace *trace;
+
+	assert(ratbag != NULL);
+	assert(path != NULL);
+	assert(device_out != NULL);
 
-	error = GHOSTCAT_SUCCESS;
+	trace = ghostcat_trace_new_replay(path, flags & GHOSTCAT_REPLAY_REALTIME);
+	if (!trace) {
+		log_error(ratbag, "%s: cannot load recording (%s)\n",
+			  path, strerror(errno));
+		return error_code(GHOSTCAT_ERROR_VALUE);
+	}
 
-out_err:
+	device = ghostcat_device_new(ratbag, NULL, ghostcat_trace_get_name(trace),
+				     ghostcat_trace_get_id(trace));
+	device->trace = trace;
 
-	if (error != GHOSTCAT_SUCCESS)
+	if (!device->data ||
+	    !ghostcat_assign_driver(device, &device->ids, NULL)) {
 		ghostcat_device_destroy(device);
-	else
-		*device_out = device;
+		return error_code(GHOSTCAT_ERROR_DEVICE);
+	}
+
+	*device_out = device;
 
-	return error_code(error);
+	return error_code(GHOSTCAT_SUCCESS);
 }
 
 LIBGHOSTCAT_EXPORT struct ghostcat_device *
@@ -563,6 +674,12 @@ ghostcat_create_context(const struct ghostcat_interface *interface,
 		return NULL;
 	}
 
+	if (ghostcat_jobs_init(ratbag) != 0) {
+		udev_unref(ratbag->udev);
+		free(ratbag);
+		return NULL;
+	}
+
 	ratbag->log_handler = ghostcat_default_log_func;
 	ratbag->log_priority = GHOSTCAT_LOG_PRIORITY_INFO;
 
@@ -601,6 +718,7 @@ ghostcat_unref(struct ghostcat *ratbag)
 	assert(ratbag->refcount > 0);
 	ratbag->refcount--;
 	if (ratbag->refcount == 0) {
+		ghostcat_jobs_release(ratbag);
 		ratbag->udev = udev_unref(ratbag->udev);
 		free(ratbag);
 	}
@@ -611,9 +729,8 @@ ghostcat_unref(struct ghostcat *ratbag)
 static struct ghostcat_button *
 ghostcat_create_button(struct ghostcat_profile *profile, unsigned int index)
 {
-	struct ghostcat_button *button;
+	struct ghostcat_button *button = &profile->button_array[index];
 
-	button = zalloc(sizeof(*button));
 	button->refcount = 0;
 	button->profile = profile;
 	button->index = index;
@@ -626,9 +743,8 @@ ghostcat_create_button(struct ghostcat_profile *profile, unsigned int index)
 static struct ghostcat_led *
 ghostcat_create_led(struct ghostcat_profile *profile, unsigned int index)
 {
-	struct ghostcat_led *led;
+	struct ghostcat_led *led = &profile->led_array[index];
 
-	led = zalloc(sizeof(*led));
 	led->refcount = 0;
 	led->profile = profile;
 	led->index = index;
@@ -639,6 +755,43 @@ ghostcat_create_led(struct ghostcat_profile *profile, unsigned int index)
 	return led;
 }
 
+/**
+ * Read a profile the driver deferred at probe time. Called from every
+ * getter and setter that touches a profile value, the const getters cast
+ * the const away since loading doesn't change the client-visible state.
+ */
+static void
+ghostcat_profile_load(struct ghostcat_profile *profile)
+{
+	struct ghostcat_device *device = profile->device;
+	int rc;
+
+	if (!profile->needs_load)
+		return;
+
+	/* the values stay unset rather than racing the job for the device */
+	if (ghostcat_device_is_busy(device))
+		return;
+
+	assert(device->driver->load_profile != NULL);
+
+	/* cleared first so a failing device isn't queried on every
+	 * subsequent getter */
+	profile->needs_load = false;
+
+	rc = device->driver->load_profile(profile);
+	if (rc == -ENOTCONN) {
+		/* device is asleep, try again next time */
+		profile->needs_load = true;
+		log_debug(device->ratbag,
+			  "%s: device offline, profile %d not loaded\n",
+			  device->name, profile->index);
+	} else if (rc)
+		log_error(device->ratbag,
+			  "%s: failed to load profile %d (%s)\n",
+			  device->name, profile->index, strerror(-rc));
+}
+
 LIBGHOSTCAT_EXPORT bool
 ghostcat_profile_has_capability(const struct ghostcat_profile *profile,
 			      enum ghostcat_profile_capability cap)
@@ -652,9 +805,8 @@ ghostcat_profile_has_capability(const struct ghostcat_profile *profile,
 static inline void
 ghostcat_create_resolution(struct ghostcat_profile *profile, int index)
 {
-	struct ghostcat_resolution *res;
+	struct ghostcat_resolution *res = &profile->resolution_array[index];
 
-	res = zalloc(sizeof(*res));
 	res->refcount = 0;
 	res->profile = profile;
 	res->index = index;
@@ -672,10 +824,9 @@ ghostcat_create_profile(struct ghostcat_device *device,
 		      unsigned int num_buttons,
 		      unsigned int num_leds)
 {
-	struct ghostcat_profile *profile;
+	struct ghostcat_profile *profile = &device->profile_array[index];
 	unsigned i;
 
-	profile = zalloc(sizeof(*profile));
 	profile->refcount = 0;
 	profile->device = device;
 	profile->index = index;
@@ -705,6 +856,17 @@ ghostcat_create_profile(struct ghostcat_device *device,
 	return profile;
 }
 
+/**
+ * All profiles and their resolutions, buttons and LEDs live in one
+ * allocation owned by the device, each kind in an array indexed by
+ * profile and object index:
+ *
+ *   [profiles][resolutions of profile 0][resolutions of profile 1]...
+ *   [buttons of profile 0]...[leds of profile 0]...
+ *
+ * The objects are refcounted but a reference also holds the device, so
+ * nothing outlives the allocation. It is freed with the device.
+ */
 int
 ghostcat_device_init_profiles(struct ghostcat_device *device,
 			    unsigned int num_profiles,
@@ -712,9 +874,42 @@ ghostcat_device_init_profiles(struct ghostcat_device *device,
 			    unsigned int num_buttons,
 			    unsigned int num_leds)
 {
+	struct ghostcat_profile *profiles;
+	struct ghostcat_resolution *resolutions;
+	struct ghostcat_button *buttons;
+	struct ghostcat_led *leds;
+	size_t size;
 	unsigned int i;
 
+	/* every struct holds pointers, so one array can follow the other
+	 * without padding */
+	_Static_assert(_Alignof(struct ghostcat_resolution) <= _Alignof(struct ghostcat_profile) &&
+		      _Alignof(struct ghostcat_button) <= _Alignof(struct ghostcat_resolution) &&
+		      _Alignof(struct ghostcat_led) <= _Alignof(struct ghostcat_button),
+		      "arena layout needs padding");
+
+	assert(device->profile_array == NULL);
+
+	if (num_profiles == 0)
+		return 0;
+
+	size = num_profiles * (sizeof(*profiles) +
+			       num_resolutions * sizeof(*resolutions) +
+			       num_buttons * sizeof(*buttons) +
+			       num_leds * sizeof(*leds));
+
+	profiles = zalloc(size);
+	resolutions = (struct ghostcat_resolution *)(profiles + num_profiles);
+	buttons = (struct ghostcat_button *)(resolutions + num_profiles * num_resolutions);
+	leds = (struct ghostcat_led *)(buttons + num_profiles * num_buttons);
+
+	device->profile_array = profiles;
+
 	for (i = 0; i < num_profiles; i++) {
+		profiles[i].resolution_array = resolutions + i * num_resolutions;
+		profiles[i].button_array = buttons + i * num_buttons;
+		profiles[i].led_array = leds + i * num_leds;
+
 		ghostcat_create_profile(device, i, num_resolutions, num_buttons, num_leds);
 	}
 
@@ -736,26 +931,17 @@ ghostcat_profile_ref(struct ghostcat_profile *profile)
 static void
 ghostcat_profile_destroy(struct ghostcat_profile *profile)
 {
-	struct ghostcat_button *button, *b_next;
-	struct ghostcat_led *led, *l_next;
-	struct ghostcat_resolution *res, *r_next;
+	struct ghostcat_button *button;
 
 	/* if we get to the point where the profile is destroyed, buttons,
-	 * resolutions , etc. are at a refcount of 0, so we can destroy
-	 * everything */
-	list_for_each_safe(button, b_next, &profile->buttons, link)
+	 * resolutions , etc. are at a refcount of 0. Their memory belongs
+	 * to the device, only what they point to is freed here. */
+	list_for_each(button, &profile->buttons, link)
 		ghostcat_button_destroy(button);
 
-	list_for_each_safe(led, l_next, &profile->leds, link)
-		ghostcat_led_destroy(led);
-
-	list_for_each_safe(res, r_next, &profile->resolutions, link)
-		ghostcat_resolution_destroy(res);
-
 	free(profile->name);
 
 	list_remove(&profile->link);
-	free(profile);
 }
 
 LIBGHOSTCAT_EXPORT struct ghostcat_profile *
@@ -782,19 +968,19 @@ ghostcat_device_get_profile(struct ghostcat_device *device, unsigned int index)
 		return NULL;
 	}
 
-	list_for_each(profile, &device->profiles, link) {
-		if (profile->index == index)
-			return ghostcat_profile_ref(profile);
-	}
-
-	log_bug_libratbag(device->ratbag, "Profile %d not found\n", index);
+	profile = &device->profile_array[index];
 
-	return NULL;
+	return ghostcat_profile_ref(profile);
 }
 
 LIBGHOSTCAT_EXPORT enum ghostcat_error_code
 ghostcat_profile_set_enabled(struct ghostcat_profile *profile, bool enabled)
 {
+	if (ghostcat_device_is_busy(profile->device))
+		return GHOSTCAT_ERROR_IMPLEMENTATION;
+
+	ghostcat_profile_load(profile);
+
 	if (!ghostcat_profile_has_capability(profile, GHOSTCAT_PROFILE_CAP_DISABLE))
 		return GHOSTCAT_ERROR_CAPABILITY;
 
@@ -802,7 +988,7 @@ ghostcat_profile_set_enabled(struct ghostcat_profile *profile, bool enabled)
 		return GHOSTCAT_ERROR_VALUE;
 
 	profile->is_enabled = enabled;
-	profile->dirty = true;
+	profile->dirty |= GHOSTCAT_PROFILE_DIRTY_ENABLED;
 
 	return GHOSTCAT_SUCCESS;
 }
@@ -843,6 +1029,319 @@ ghostcat_device_get_num_leds(const struct ghostcat_device *device)
 	return device->num_leds;
 }
 
+LIBGHOSTCAT_EXPORT uint64_t
+ghostcat_device_get_stat(const struct ghostcat_device *device,
+			 enum ghostcat_device_stat stat)
+{
+	const struct ghostcat_stats *stats = &device->stats;
+
+	switch (stat) {
+	case GHOSTCAT_DEVICE_STAT_TRANSFERS: return ghostcat_stats_get(stats, transfers);
+	case GHOSTCAT_DEVICE_STAT_BYTES_SENT: return ghostcat_stats_get(stats, bytes_sent);
+	case GHOSTCAT_DEVICE_STAT_BYTES_RECEIVED: return ghostcat_stats_get(stats, bytes_received);
+	case GHOSTCAT_DEVICE_STAT_RETRIES: return ghostcat_stats_get(stats, retries);
+	case GHOSTCAT_DEVICE_STAT_TIMEOUTS: return ghostcat_stats_get(stats, timeouts);
+	case GHOSTCAT_DEVICE_STAT_ERRORS: return ghostcat_stats_get(stats, errors);
+	case GHOSTCAT_DEVICE_STAT_PROBE_TIME_US: return ghostcat_stats_get(stats, probe_us);
+	case GHOSTCAT_DEVICE_STAT_COMMITS: return ghostcat_stats_get(stats, commits);
+	case GHOSTCAT_DEVICE_STAT_COMMIT_TIME_US: return ghostcat_stats_get(stats, commit_us);
+	case GHOSTCAT_DEVICE_STAT_COMMIT_TIME_TOTAL_US: return ghostcat_stats_get(stats, commit_total_us);
+	}
+
+	return 0;
+}
+
+LIBGHOSTCAT_EXPORT uint64_t
+ghostcat_device_get_latency_histogram(const struct ghostcat_device *device,
+				      unsigned int bucket,
+				      uint64_t *limit_us)
+{
+	_Static_assert(GHOSTCAT_DEVICE_LATENCY_BUCKETS == GHOSTCAT_STATS_LATENCY_BUCKETS,
+		       "public and internal histogram size differ");
+
+	if (limit_us)
+		*limit_us = 0;
+
+	if (bucket >= GHOSTCAT_STATS_LATENCY_BUCKETS)
+		return 0;
+
+	if (limit_us && bucket < GHOSTCAT_STATS_LATENCY_BUCKETS - 1)
+		*limit_us = (uint64_t)GHOSTCAT_STATS_LATENCY_FIRST_US << bucket;
+
+	return ghostcat_stats_get(&device->stats, latency[bucket]);
+}
+
+LIBGHOSTCAT_EXPORT void
+ghostcat_device_reset_stats(struct ghostcat_device *device)
+{
+	struct ghostcat_stats *stats = &device->stats;
+
+	/* a job may be counting transfers right now, so every counter is
+	 * cleared on its own. The probe happens once, its duration is not a
+	 * counter. */
+	ghostcat_stats_clear(stats, transfers);
+	ghostcat_stats_clear(stats, bytes_sent);
+	ghostcat_stats_clear(stats, bytes_received);
+	ghostcat_stats_clear(stats, retries);
+	ghostcat_stats_clear(stats, timeouts);
+	ghostcat_stats_clear(stats, errors);
+	ghostcat_stats_clear(stats, commits);
+	ghostcat_stats_clear(stats, commit_us);
+	ghostcat_stats_clear(stats, commit_total_us);
+	for (unsigned int i = 0; i < GHOSTCAT_STATS_LATENCY_BUCKETS; i++)
+		ghostcat_stats_clear(stats, latency[i]);
+}
+
+/* Make the next ghostcat_device_show_leds() write every LED */
+static void
+ghostcat_device_invalidate_shown_leds(struct ghostcat_device *device)
+{
+	if (!device->shown_leds)
+		return;
+
+	/* outside of the color range, every color differs from this */
+	for (unsigned int i = 0; i < device->num_leds; i++)
+		device->shown_leds[i] = (struct ghostcat_color){ UINT_MAX, UINT_MAX, UINT_MAX };
+}
+
+LIBGHOSTCAT_EXPORT enum ghostcat_error_code
+ghostcat_device_show_leds(struct ghostcat_device *device,
+			  const struct ghostcat_color *colors,
+			  unsigned int num_colors)
+{
+	uint32_t changed = 0;
+	int rc;
+
+	if (ghostcat_device_is_busy(device))
+		return GHOSTCAT_ERROR_IMPLEMENTATION;
+
+	if (device->driver->show_leds == NULL)
+		return GHOSTCAT_ERROR_CAPABILITY;
+
+	if (num_colors != device->num_leds || num_colors == 0 || num_colors > 32)
+		return GHOSTCAT_ERROR_VALUE;
+
+	if (!device->shown_leds) {
+		device->shown_leds = zalloc(num_colors * sizeof(*device->shown_leds));
+		ghostcat_device_invalidate_shown_leds(device);
+	}
+
+	for (unsigned int i = 0; i < num_colors; i++) {
+		if (colors[i].red != device->shown_leds[i].red ||
+		    colors[i].green != device->shown_leds[i].green ||
+		    colors[i].blue != device->shown_leds[i].blue)
+			changed |= 1U << i;
+	}
+
+	if (!changed)
+		return GHOSTCAT_SUCCESS;
+
+	rc = device->driver->show_leds(device, colors, changed);
+	if (rc) {
+		/* some LEDs may have been written, don't trust any */
+		ghostcat_device_invalidate_shown_leds(device);
+		return GHOSTCAT_ERROR_DEVICE;
+	}
+
+	memcpy(device->shown_leds, colors, num_colors * sizeof(*colors));
+
+	return GHOSTCAT_SUCCESS;
+}
+
+LIBGHOSTCAT_EXPORT enum ghostcat_error_code
+ghostcat_device_restore_leds(struct ghostcat_device *device)
+{
+	int rc;
+
+	if (ghostcat_device_is_busy(device))
+		return GHOSTCAT_ERROR_IMPLEMENTATION;
+
+	if (!device->shown_leds)
+		return GHOSTCAT_SUCCESS;
+
+	free(device->shown_leds);
+	device->shown_leds = NULL;
+
+	rc = device->driver->show_leds(device, NULL, 0);
+	if (rc)
+		return GHOSTCAT_ERROR_DEVICE;
+
+	return GHOSTCAT_SUCCESS;
+}
+
+/* Make the next ghostcat_device_show_keys() write every key */
+static void
+ghostcat_device_invalidate_shown_keys(struct ghostcat_device *device)
+{
+	struct ghostcat_keys *keys = device->keys;
+
+	if (!keys)
+		return;
+
+	keys->num_dirty = 0;
+	for (unsigned int i = 0; i < keys->width * keys->height; i++) {
+		keys->shown[i] = (struct ghostcat_color){ UINT_MAX, UINT_MAX, UINT_MAX };
+		keys->dirty[i] = keys->layout[i] != 0;
+		if (keys->dirty[i])
+			keys->num_dirty++;
+	}
+}
+
+void
+ghostcat_device_init_keys(struct ghostcat_device *device,
+			  unsigned int width,
+			  unsigned int height,
+			  const uint16_t *layout)
+{
+	struct ghostcat_keys *keys;
+	unsigned int num_cells = width * height;
+
+	assert(device->driver->write_keys);
+	assert(num_cells > 0);
+
+	ghostcat_keys_destroy(device->keys);
+
+	keys = zalloc(sizeof(*keys));
+	keys->width = width;
+	keys->height = height;
+	keys->layout = zalloc(num_cells * sizeof(*keys->layout));
+	keys->frame = zalloc(num_cells * sizeof(*keys->frame));
+	keys->shown = zalloc(num_cells * sizeof(*keys->shown));
+	keys->dirty = zalloc(num_cells * sizeof(*keys->dirty));
+	keys->updates = zalloc(num_cells * sizeof(*keys->updates));
+	memcpy(keys->layout, layout, num_cells * sizeof(*layout));
+
+	device->keys = keys;
+
+	/* we don't know what the keys show, the first frame writes all */
+	ghostcat_device_invalidate_shown_keys(device);
+}
+
+LIBGHOSTCAT_EXPORT unsigned int
+ghostcat_device_get_key_frame_width(const struct ghostcat_device *device)
+{
+	return device->keys ? device->keys->width : 0;
+}
+
+LIBGHOSTCAT_EXPORT unsigned int
+ghostcat_device_get_key_frame_height(const struct ghostcat_device *device)
+{
+	return device->keys ? device->keys->height : 0;
+}
+
+LIBGHOSTCAT_EXPORT bool
+ghostcat_device_has_key(const struct ghostcat_device *device,
+			unsigned int x, unsigned int y)
+{
+	const struct ghostcat_keys *keys = device->keys;
+
+	if (!keys || x >= keys->width || y >= keys->height)
+		return false;
+
+	return keys->layout[y * keys->width + x] != 0;
+}
+
+static inline bool
+ghostcat_color_equal(struct ghostcat_color a, struct ghostcat_color b)
+{
+	return a.red == b.red && a.green == b.green && a.blue == b.blue;
+}
+
+LIBGHOSTCAT_EXPORT enum ghostcat_error_code
+ghostcat_device_set_key_colors(struct ghostcat_device *device,
+			       unsigned int x, unsigned int y,
+			       unsigned int width, unsigned int height,
+			       const struct ghostcat_color *colors)
+{
+	struct ghostcat_keys *keys = device->keys;
+
+	if (ghostcat_device_is_busy(device))
+		return GHOSTCAT_ERROR_IMPLEMENTATION;
+
+	if (!keys)
+		return GHOSTCAT_ERROR_CAPABILITY;
+
+	if (width == 0 || height == 0 ||
+	    x >= keys->width || width > keys->width - x ||
+	    y >= keys->height || height > keys->height - y)
+		return GHOSTCAT_ERROR_VALUE;
+
+	for (unsigned int i = 0; i < width * height; i++) {
+		if (colors[i].red > 255 || colors[i].green > 255 || colors[i].blue > 255)
+			return GHOSTCAT_ERROR_VALUE;
+	}
+
+	for (unsigned int row = 0; row < height; row++) {
+		unsigned int cell = (y + row) * keys->width + x;
+		const struct ghostcat_color *c = &colors[row * width];
+
+		for (unsigned int col = 0; col < width; col++, cell++, c++) {
+			bool dirty;
+
+			if (keys->layout[cell] == 0)
+				continue;
+
+			keys->frame[cell] = *c;
+
+			/* a key set back to what the device shows is clean again */
+			dirty = !ghostcat_color_equal(*c, keys->shown[cell]);
+			if (dirty != keys->dirty[cell]) {
+				keys->dirty[cell] = dirty;
+				if (dirty)
+					keys->num_dirty++;
+				else
+					keys->num_dirty--;
+			}
+		}
+	}
+
+	return GHOSTCAT_SUCCESS;
+}
+
+LIBGHOSTCAT_EXPORT enum ghostcat_error_code
+ghostcat_device_show_keys(struct ghostcat_device *device)
+{
+	struct ghostcat_keys *keys = device->keys;
+	unsigned int num_updates = 0;
+	int rc;
+
+	if (ghostcat_device_is_busy(device))
+		return GHOSTCAT_ERROR_IMPLEMENTATION;
+
+	if (!keys)
+		return GHOSTCAT_ERROR_CAPABILITY;
+
+	if (keys->num_dirty == 0)
+		return GHOSTCAT_SUCCESS;
+
+	for (unsigned int i = 0; i < keys->width * keys->height; i++) {
+		if (!keys->dirty[i])
+			continue;
+
+		keys->updates[num_updates++] = (struct ghostcat_key_color) {
+			.key = keys->layout[i],
+			.color = keys->frame[i],
+		};
+	}
+
+	rc = device->driver->write_keys(device, keys->updates, num_updates);
+	if (rc) {
+		/* some keys may have been written, don't trust any */
+		ghostcat_device_invalidate_shown_keys(device);
+		return GHOSTCAT_ERROR_DEVICE;
+	}
+
+	for (unsigned int i = 0; i < keys->width * keys->height; i++) {
+		if (keys->dirty[i]) {
+			keys->shown[i] = keys->frame[i];
+			keys->dirty[i] = false;
+		}
+	}
+	keys->num_dirty = 0;
+
+	return GHOSTCAT_SUCCESS;
+}
+
 LIBGHOSTCAT_EXPORT enum ghostcat_error_code
 ghostcat_device_commit(struct ghostcat_device *device)
 {
@@ -850,36 +1349,63 @@ ghostcat_device_commit(struct ghostcat_device *device)
 	struct ghostcat_button *button;
 	struct ghostcat_led *led;
 	struct ghostcat_resolution *resolution;
+	uint64_t start, elapsed;
 	int rc;
 
+	if (ghostcat_device_is_busy(device))
+		return GHOSTCAT_ERROR_IMPLEMENTATION;
+
 	if (device->driver->commit == NULL) {
 		log_error(device->ratbag,
 			  "Trying to commit with a driver that doesn't support committing\n");
 		return GHOSTCAT_ERROR_CAPABILITY;
 	}
 
+	start = now(CLOCK_MONOTONIC);
 	rc = device->driver->commit(device);
+	elapsed = (now(CLOCK_MONOTONIC) - start) / 1000;
+	ghostcat_stats_add(&device->stats, commits, 1);
+	ghostcat_stats_add(&device->stats, commit_total_us, elapsed);
+	__atomic_store_n(&device->stats.commit_us, elapsed, __ATOMIC_RELAXED);
+	if (rc == -ENOTCONN) {
+		/* keep everything dirty, the changes are written once the
+		 * device is back, see ghostcat_device_refresh_active_resolution() */
+		if (!device->commit_pending)
+			log_info(device->ratbag,
+				 "%s: device is offline, changes will be written when it reconnects\n",
+				 device->name);
+		device->commit_pending = true;
+		return GHOSTCAT_SUCCESS;
+	}
+
+	device->commit_pending = false;
 	if (rc)
 		return GHOSTCAT_ERROR_DEVICE;
 
 	list_for_each(profile, &device->profiles, link) {
-		profile->dirty = false;
+		bool active_dirty = profile->dirty & GHOSTCAT_PROFILE_DIRTY_ACTIVE;
+
+		/* the driver overwrote whatever ghostcat_device_show_leds()
+		 * put on the LEDs */
+		if (profile->is_active &&
+		    (profile->dirty & (GHOSTCAT_PROFILE_DIRTY_LEDS | GHOSTCAT_PROFILE_DIRTY_ACTIVE))) {
+			ghostcat_device_invalidate_shown_leds(device);
+			ghostcat_device_invalidate_shown_keys(device);
+		}
 
-		profile->angle_snapping_dirty = false;
-		profile->debounce_dirty = false;
-		profile->rate_dirty = false;
+		profile->dirty = 0;
 
 		list_for_each(button, &profile->buttons, link)
-			button->dirty = false;
+			button->dirty = 0;
 
 		list_for_each(led, &profile->leds, link)
-			led->dirty = false;
+			led->dirty = 0;
 
 		list_for_each(resolution, &profile->resolutions, link)
-			resolution->dirty = false;
+			resolution->dirty = 0;
 
 		/* TODO: think if this should be moved into `driver-commit`. */
-		if (profile->is_active_dirty && profile->is_active) {
+		if (active_dirty && profile->is_active) {
 			if (device->driver->set_active_profile == NULL)
 				return GHOSTCAT_ERROR_IMPLEMENTATION;
 
@@ -887,7 +1413,95 @@ ghostcat_device_commit(struct ghostcat_device *device)
 			if (rc)
 				return GHOSTCAT_ERROR_DEVICE;
 		}
-		profile->is_active_dirty = false;
+	}
+
+	return GHOSTCAT_SUCCESS;
+}
+
+LIBGHOSTCAT_EXPORT enum ghostcat_error_code
+ghostcat_device_save_image(struct ghostcat_device *device,
+			   uint8_t **data, size_t *size)
+{
+	struct ghostcat_image image;
+	int rc;
+
+	if (ghostcat_device_is_busy(device))
+		return GHOSTCAT_ERROR_IMPLEMENTATION;
+
+	if (device->driver->save_image == NULL)
+		return GHOSTCAT_ERROR_CAPABILITY;
+
+	ghostcat_image_init_writer(&image, device);
+
+	rc = device->driver->save_image(device, &image);
+	if (rc) {
+		free(image.data);
+		return rc == -ENOTSUP ? GHOSTCAT_ERROR_CAPABILITY : GHOSTCAT_ERROR_DEVICE;
+	}
+
+	ghostcat_image_finish(&image);
+
+	*data = image.data;
+	*size = image.size;
+
+	return GHOSTCAT_SUCCESS;
+}
+
+LIBGHOSTCAT_EXPORT enum ghostcat_error_code
+ghostcat_device_apply_image(struct ghostcat_device *device,
+			    const uint8_t *data, size_t size)
+{
+	struct ghostcat_image image;
+	struct ghostcat_image_blob blob;
+	struct ghostcat_profile *profile;
+	struct ghostcat_button *button;
+	struct ghostcat_led *led;
+	struct ghostcat_resolution *resolution;
+	int rc;
+
+	if (ghostcat_device_is_busy(device))
+		return GHOSTCAT_ERROR_IMPLEMENTATION;
+
+	if (device->driver->apply_image == NULL)
+		return GHOSTCAT_ERROR_CAPABILITY;
+
+	rc = ghostcat_image_init_reader(&image, device, data, size);
+	if (rc) {
+		log_error(device->ratbag, "%s: image does not match this device\n",
+			  device->name);
+		return GHOSTCAT_ERROR_VALUE;
+	}
+
+	/* walk the image once so a truncated one never gets half-written */
+	while ((rc = ghostcat_image_next_blob(&image, &blob)) > 0)
+		;
+	if (rc < 0 || !image.end) {
+		log_error(device->ratbag, "%s: image is truncated\n", device->name);
+		return GHOSTCAT_ERROR_VALUE;
+	}
+
+	ghostcat_image_init_reader(&image, device, data, size);
+	rc = device->driver->apply_image(device, &image);
+	if (rc == -EINVAL)
+		return GHOSTCAT_ERROR_VALUE;
+	if (rc == -ENOTSUP)
+		return GHOSTCAT_ERROR_CAPABILITY;
+	if (rc)
+		return GHOSTCAT_ERROR_DEVICE;
+
+	/* the driver re-read the profiles, nothing is left to commit */
+	device->commit_pending = false;
+	list_for_each(profile, &device->profiles, link) {
+		profile->dirty = 0;
+
+		list_for_each(button, &profile->buttons, link)
+			button->dirty = 0;
+
+		list_for_each(led, &profile->leds, link)
+			led->dirty = 0;
+
+		list_for_each(resolution, &profile->resolutions, link)
+			resolution->dirty = 0;
 	}
 
 	return GHOSTCAT_SUCCESS;
@@ -899,6 +1513,11 @@ ghostcat_profile_set_active(struct ghostcat_profile *profile)
 	struct ghostcat_device *device = profile->device;
 	struct ghostcat_profile *p;
 
+	if (ghostcat_device_is_busy(device))
+		return GHOSTCAT_ERROR_IMPLEMENTATION;
+
+	ghostcat_profile_load(profile);
+
 	if (!profile->is_enabled)
 		return GHOSTCAT_ERROR_VALUE;
 
@@ -908,14 +1527,12 @@ ghostcat_profile_set_active(struct ghostcat_profile *profile)
 	list_for_each(p, &device->profiles, link) {
 		if (p->is_active) {
 			p->is_active = false;
-			p->is_active_dirty = true;
-			p->dirty = true;
+			p->dirty |= GHOSTCAT_PROFILE_DIRTY_ACTIVE;
 		}
 	}
 
 	profile->is_active = true;
-	profile->is_active_dirty = true;
-	profile->dirty = true;
+	profile->dirty |= GHOSTCAT_PROFILE_DIRTY_ACTIVE;
 	return GHOSTCAT_SUCCESS;
 }
 
@@ -928,8 +1545,6 @@ ghostcat_profile_get_num_resolutions(const struct ghostcat_profile *profile)
 LIBGHOSTCAT_EXPORT struct ghostcat_resolution *
 ghostcat_profile_get_resolution(struct ghostcat_profile *profile, unsigned int idx)
 {
-	struct ghostcat_device *device = profile->device;
-	struct ghostcat_resolution *res;
 	unsigned max = ghostcat_profile_get_num_resolutions(profile);
 
 	if (idx >= max) {
@@ -938,15 +1553,7 @@ ghostcat_profile_get_resolution(struct ghostcat_profile *profile, unsigned int i
 		return NULL;
 	}
 
-	ghostcat_profile_for_each_resolution(profile, res) {
-		if (res->index == idx)
-			return ghostcat_resolution_ref(res);
-	}
-
-	log_bug_libratbag(device->ratbag, "Resolution %d, profile %d not found\n",
-			  idx, profile->index);
-
-	return NULL;
+	return ghostcat_resolution_ref(&profile->resolution_array[idx]);
 }
 
 LIBGHOSTCAT_EXPORT struct ghostcat_resolution *
@@ -1000,14 +1607,19 @@ ghostcat_resolution_set_dpi(struct ghostcat_resolution *resolution,
 {
 	struct ghostcat_profile *profile = resolution->profile;
 
+	if (ghostcat_device_is_busy(profile->device))
+		return GHOSTCAT_ERROR_IMPLEMENTATION;
+
+	ghostcat_profile_load(profile);
+
 	if (!resolution_has_dpi(resolution, dpi))
 		return GHOSTCAT_ERROR_VALUE;
 
 	if (resolution->dpi_x != dpi || resolution->dpi_y != dpi) {
 		resolution->dpi_x = dpi;
 		resolution->dpi_y = dpi;
-		resolution->dirty = true;
-		profile->dirty = true;
+		ghostcat_resolution_mark_dirty(resolution,
+					       GHOSTCAT_RESOLUTION_DIRTY_DPI);
 	}
 
 	return GHOSTCAT_SUCCESS;
@@ -1019,6 +1631,11 @@ ghostcat_resolution_set_dpi_xy(struct ghostcat_resolution *resolution,
 {
 	struct ghostcat_profile *profile = resolution->profile;
 
+	if (ghostcat_device_is_busy(profile->device))
+		return GHOSTCAT_ERROR_IMPLEMENTATION;
+
+	ghostcat_profile_load(profile);
+
 	if (!ghostcat_resolution_has_capability(resolution,
 					      GHOSTCAT_RESOLUTION_CAP_SEPARATE_XY_RESOLUTION))
 		return GHOSTCAT_ERROR_CAPABILITY;
@@ -1032,8 +1649,8 @@ ghostcat_resolution_set_dpi_xy(struct ghostcat_resolution *resolution,
 	if (resolution->dpi_x != x || resolution->dpi_y != y) {
 		resolution->dpi_x = x;
 		resolution->dpi_y = y;
-		resolution->dirty = true;
-		profile->dirty = true;
+		ghostcat_resolution_mark_dirty(resolution,
+					       GHOSTCAT_RESOLUTION_DIRTY_DPI);
 	}
 
 	return GHOSTCAT_SUCCESS;
@@ -1043,10 +1660,14 @@ LIBGHOSTCAT_EXPORT enum ghostcat_error_code
 ghostcat_profile_set_report_rate(struct ghostcat_profile *profile,
 			       unsigned int hz)
 {
+	if (ghostcat_device_is_busy(profile->device))
+		return GHOSTCAT_ERROR_IMPLEMENTATION;
+
+	ghostcat_profile_load(profile);
+
 	if (profile->hz != hz) {
 		profile->hz = hz;
-		profile->dirty = true;
-		profile->rate_dirty = true;
+		profile->dirty |= GHOSTCAT_PROFILE_DIRTY_RATE;
 	}
 
 	return GHOSTCAT_SUCCESS;
@@ -1056,10 +1677,14 @@ LIBGHOSTCAT_EXPORT enum ghostcat_error_code
 ghostcat_profile_set_angle_snapping(struct ghostcat_profile *profile,
 				  int value)
 {
+	if (ghostcat_device_is_busy(profile->device))
+		return GHOSTCAT_ERROR_IMPLEMENTATION;
+
+	ghostcat_profile_load(profile);
+
 	if (profile->angle_snapping != value) {
 		profile->angle_snapping = value;
-		profile->dirty = true;
-		profile->angle_snapping_dirty = true;
+		profile->dirty |= GHOSTCAT_PROFILE_DIRTY_ANGLE_SNAPPING;
 	}
 
 	return GHOSTCAT_SUCCESS;
@@ -1069,10 +1694,14 @@ LIBGHOSTCAT_EXPORT enum ghostcat_error_code
 ghostcat_profile_set_debounce(struct ghostcat_profile *profile,
 			    int value)
 {
+	if (ghostcat_device_is_busy(profile->device))
+		return GHOSTCAT_ERROR_IMPLEMENTATION;
+
+	ghostcat_profile_load(profile);
+
 	if (profile->debounce != value) {
 		profile->debounce = value;
-		profile->dirty = true;
-		profile->debounce_dirty = true;
+		profile->dirty |= GHOSTCAT_PROFILE_DIRTY_DEBOUNCE;
 	}
 
 	return GHOSTCAT_SUCCESS;
@@ -1081,6 +1710,8 @@ ghostcat_profile_set_debounce(struct ghostcat_profile *profile,
 LIBGHOSTCAT_EXPORT int
 ghostcat_resolution_get_dpi(const struct ghostcat_resolution *resolution)
 {
+	ghostcat_profile_load(resolution->profile);
+
 	return resolution->dpi_x;
 }
 
@@ -1105,30 +1736,40 @@ ghostcat_resolution_get_dpi_list(const struct ghostcat_resolution *resolution,
 LIBGHOSTCAT_EXPORT int
 ghostcat_resolution_get_dpi_x(const struct ghostcat_resolution *resolution)
 {
+	ghostcat_profile_load(resolution->profile);
+
 	return resolution->dpi_x;
 }
 
 LIBGHOSTCAT_EXPORT int
 ghostcat_resolution_get_dpi_y(const struct ghostcat_resolution *resolution)
 {
+	ghostcat_profile_load(resolution->profile);
+
 	return resolution->dpi_y;
 }
 
 LIBGHOSTCAT_EXPORT int
 ghostcat_profile_get_report_rate(const struct ghostcat_profile *profile)
 {
+	ghostcat_profile_load((struct ghostcat_profile *)profile);
+
 	return profile->hz;
 }
 
 LIBGHOSTCAT_EXPORT int
 ghostcat_profile_get_angle_snapping(const struct ghostcat_profile *profile)
 {
+	ghostcat_profile_load((struct ghostcat_profile *)profile);
+
 	return profile->angle_snapping;
 }
 
 LIBGHOSTCAT_EXPORT int
 ghostcat_profile_get_debounce(const struct ghostcat_profile *profile)
 {
+	ghostcat_profile_load((struct ghostcat_profile *)profile);
+
 	return profile->debounce;
 }
 
@@ -1171,6 +1812,8 @@ ghostcat_profile_get_report_rate_list(const struct ghostcat_profile *profile,
 LIBGHOSTCAT_EXPORT bool
 ghostcat_resolution_is_active(const struct ghostcat_resolution *resolution)
 {
+	ghostcat_profile_load(resolution->profile);
+
 	return !!resolution->is_active;
 }
 
@@ -1180,23 +1823,34 @@ ghostcat_resolution_set_active(struct ghostcat_resolution *resolution)
 	struct ghostcat_profile *profile = resolution->profile;
 	struct ghostcat_resolution *res;
 
+	if (ghostcat_device_is_busy(profile->device))
+		return GHOSTCAT_ERROR_IMPLEMENTATION;
+
+	ghostcat_profile_load(profile);
+
 	if (resolution->is_disabled) {
 		log_error(profile->device->ratbag, "%s: setting the active resolution to a disabled resolution is not allowed\n", profile->device->name);
 		return GHOSTCAT_ERROR_VALUE;
 	}
 
-	ghostcat_profile_for_each_resolution(profile, res)
+	ghostcat_profile_for_each_resolution(profile, res) {
+		if (res->is_active && res != resolution)
+			ghostcat_resolution_mark_dirty(res,
+						       GHOSTCAT_RESOLUTION_DIRTY_ACTIVE);
 		res->is_active = false;
+	}
 
 	resolution->is_active = true;
-	resolution->dirty = true;
-	profile->dirty = true;
+	ghostcat_resolution_mark_dirty(resolution,
+				       GHOSTCAT_RESOLUTION_DIRTY_ACTIVE);
 	return GHOSTCAT_SUCCESS;
 }
 
 LIBGHOSTCAT_EXPORT bool
 ghostcat_resolution_is_default(const struct ghostcat_resolution *resolution)
 {
+	ghostcat_profile_load(resolution->profile);
+
 	return !!resolution->is_default;
 }
 
@@ -1206,6 +1860,11 @@ ghostcat_resolution_set_default(struct ghostcat_resolution *resolution)
 	struct ghostcat_profile *profile = resolution->profile;
 	struct ghostcat_resolution *other;
 
+	if (ghostcat_device_is_busy(profile->device))
+		return GHOSTCAT_ERROR_IMPLEMENTATION;
+
+	ghostcat_profile_load(profile);
+
 	if (resolution->is_disabled) {
 		log_error(profile->device->ratbag, "%s: setting the default resolution to a disabled resolution is not allowed\n", profile->device->name);
 		return GHOSTCAT_ERROR_VALUE;
@@ -1217,14 +1876,14 @@ ghostcat_resolution_set_default(struct ghostcat_resolution *resolution)
 			continue;
 
 		other->is_default = false;
-		resolution->dirty = true;
-		profile->dirty = true;
+		ghostcat_resolution_mark_dirty(other,
+					       GHOSTCAT_RESOLUTION_DIRTY_DEFAULT);
 	}
 
 	if (!resolution->is_default) {
 		resolution->is_default = true;
-		resolution->dirty = true;
-		profile->dirty = true;
+		ghostcat_resolution_mark_dirty(resolution,
+					       GHOSTCAT_RESOLUTION_DIRTY_DEFAULT);
 	}
 
 	return GHOSTCAT_SUCCESS;
@@ -1233,6 +1892,8 @@ ghostcat_resolution_set_default(struct ghostcat_resolution *resolution)
 LIBGHOSTCAT_EXPORT bool
 ghostcat_resolution_is_dpi_shift_target(const struct ghostcat_resolution *resolution)
 {
+	ghostcat_profile_load(resolution->profile);
+
 	return !!resolution->is_dpi_shift_target;
 }
 
@@ -1242,6 +1903,11 @@ ghostcat_resolution_set_dpi_shift_target(struct ghostcat_resolution *resolution)
 	struct ghostcat_profile *profile = resolution->profile;
 	struct ghostcat_resolution *other;
 
+	if (ghostcat_device_is_busy(profile->device))
+		return GHOSTCAT_ERROR_IMPLEMENTATION;
+
+	ghostcat_profile_load(profile);
+
 	if (resolution->is_disabled) {
 		log_error(profile->device->ratbag, "%s: setting the DPI shift target to a disabled resolution is not allowed\n", profile->device->name);
 		return GHOSTCAT_ERROR_VALUE;
@@ -1253,14 +1919,14 @@ ghostcat_resolution_set_dpi_shift_target(struct ghostcat_resolution *resolution)
 			continue;
 
 		other->is_dpi_shift_target = false;
-		other->dirty = true;
-		profile->dirty = true;
+		ghostcat_resolution_mark_dirty(other,
+					       GHOSTCAT_RESOLUTION_DIRTY_DPI_SHIFT_TARGET);
 	}
 
 	if (!resolution->is_dpi_shift_target) {
 		resolution->is_dpi_shift_target = true;
-		resolution->dirty = true;
-		profile->dirty = true;
+		ghostcat_resolution_mark_dirty(resolution,
+					       GHOSTCAT_RESOLUTION_DIRTY_DPI_SHIFT_TARGET);
 	}
 
 	return GHOSTCAT_SUCCESS;
@@ -1269,6 +1935,8 @@ ghostcat_resolution_set_dpi_shift_target(struct ghostcat_resolution *resolution)
 LIBGHOSTCAT_EXPORT bool
 ghostcat_resolution_is_disabled(const struct ghostcat_resolution *resolution)
 {
+	ghostcat_profile_load(resolution->profile);
+
 	return !!resolution->is_disabled;
 }
 
@@ -1277,6 +1945,11 @@ ghostcat_resolution_set_disabled(struct ghostcat_resolution *resolution, bool di
 {
 	struct ghostcat_profile *profile = resolution->profile;
 
+	if (ghostcat_device_is_busy(profile->device))
+		return GHOSTCAT_ERROR_IMPLEMENTATION;
+
+	ghostcat_profile_load(profile);
+
 	if (!ghostcat_resolution_has_capability(resolution, GHOSTCAT_RESOLUTION_CAP_DISABLE))
 		return GHOSTCAT_ERROR_CAPABILITY;
 
@@ -1292,8 +1965,8 @@ ghostcat_resolution_set_disabled(struct ghostcat_resolution *resolution, bool di
 	}
 
 	resolution->is_disabled = disable;
-	resolution->dirty = true;
-	profile->dirty = true;
+	ghostcat_resolution_mark_dirty(resolution,
+				       GHOSTCAT_RESOLUTION_DIRTY_DISABLED);
 
 	return GHOSTCAT_SUCCESS;
 }
@@ -1303,27 +1976,20 @@ ghostcat_profile_get_button(struct ghostcat_profile *profile,
 				   unsigned int index)
 {
 	struct ghostcat_device *device = profile->device;
-	struct ghostcat_button *button;
 
 	if (index >= ghostcat_device_get_num_buttons(device)) {
 		log_bug_client(device->ratbag, "Requested invalid button %d\n", index);
 		return NULL;
 	}
 
-	list_for_each(button, &profile->buttons, link) {
-		if (button->index == index)
-			return ghostcat_button_ref(button);
-	}
-
-	log_bug_libratbag(device->ratbag, "Button %d, profile %d not found\n",
-			  index, profile->index);
-
-	return NULL;
+	return ghostcat_button_ref(&profile->button_array[index]);
 }
 
 LIBGHOSTCAT_EXPORT enum ghostcat_button_action_type
 ghostcat_button_get_action_type(const struct ghostcat_button *button)
 {
+	ghostcat_profile_load(button->profile);
+
 	return button->action.type;
 }
 
@@ -1348,6 +2014,8 @@ ghostcat_button_has_action_type(const struct ghostcat_button *button,
 LIBGHOSTCAT_EXPORT unsigned int
 ghostcat_button_get_button(const struct ghostcat_button *button)
 {
+	ghostcat_profile_load(button->profile);
+
 	if (button->action.type != GHOSTCAT_BUTTON_ACTION_TYPE_BUTTON)
 		return 0;
 
@@ -1370,6 +2038,11 @@ ghostcat_button_set_button(struct ghostcat_button *button, unsigned int btn)
 {
 	struct ghostcat_button_action action = {0};
 
+	if (ghostcat_device_is_busy(button->profile->device))
+		return GHOSTCAT_ERROR_IMPLEMENTATION;
+
+	ghostcat_profile_load(button->profile);
+
 	if (!ghostcat_button_has_action_type(button,
 					   GHOSTCAT_BUTTON_ACTION_TYPE_BUTTON))
 		return GHOSTCAT_ERROR_CAPABILITY;
@@ -1378,8 +2051,7 @@ ghostcat_button_set_button(struct ghostcat_button *button, unsigned int btn)
 	action.action.button = btn;
 
 	ghostcat_button_set_action(button, &action);
-	button->dirty = true;
-	button->profile->dirty = true;
+	ghostcat_button_mark_dirty(button, GHOSTCAT_BUTTON_DIRTY_ACTION);
 
 	return GHOSTCAT_SUCCESS;
 }
@@ -1387,6 +2059,8 @@ ghostcat_button_set_button(struct ghostcat_button *button, unsigned int btn)
 LIBGHOSTCAT_EXPORT enum ghostcat_button_action_special
 ghostcat_button_get_special(const struct ghostcat_button *button)
 {
+	ghostcat_profile_load(button->profile);
+
 	if (button->action.type != GHOSTCAT_BUTTON_ACTION_TYPE_SPECIAL)
 		return GHOSTCAT_BUTTON_ACTION_SPECIAL_INVALID;
 
@@ -1399,6 +2073,11 @@ ghostcat_button_set_special(struct ghostcat_button *button,
 {
 	struct ghostcat_button_action action = {0};
 
+	if (ghostcat_device_is_busy(button->profile->device))
+		return GHOSTCAT_ERROR_IMPLEMENTATION;
+
+	ghostcat_profile_load(button->profile);
+
 	/* FIXME: range checks */
 
 	if (!ghostcat_button_has_action_type(button,
@@ -1409,8 +2088,7 @@ ghostcat_button_set_special(struct ghostcat_button *button,
 	action.action.special = act;
 
 	ghostcat_button_set_action(button, &action);
-	button->dirty = true;
-	button->profile->dirty = true;
+	ghostcat_button_mark_dirty(button, GHOSTCAT_BUTTON_DIRTY_ACTION);
 
 	return GHOSTCAT_SUCCESS;
 }
@@ -1418,6 +2096,8 @@ ghostcat_button_set_special(struct ghostcat_button *button,
 LIBGHOSTCAT_EXPORT unsigned int
 ghostcat_button_get_key(const struct ghostcat_button *button)
 {
+	ghostcat_profile_load(button->profile);
+
 	if (button->action.type != GHOSTCAT_BUTTON_ACTION_TYPE_KEY)
 		return 0;
 
@@ -1429,6 +2109,11 @@ ghostcat_button_set_key(struct ghostcat_button *button, unsigned int key)
 {
 	struct ghostcat_button_action action = {0};
 
+	if (ghostcat_device_is_busy(button->profile->device))
+		return GHOSTCAT_ERROR_IMPLEMENTATION;
+
+	ghostcat_profile_load(button->profile);
+
 	/* FIXME: range checks */
 
 	if (!ghostcat_button_has_action_type(button,
@@ -1439,8 +2124,7 @@ ghostcat_button_set_key(struct ghostcat_button *button, unsigned int key)
 	action.action.key = key;
 
 	ghostcat_button_set_action(button, &action);
-	button->dirty = true;
-	button->profile->dirty = true;
+	ghostcat_button_mark_dirty(button, GHOSTCAT_BUTTON_DIRTY_ACTION);
 
 	return GHOSTCAT_SUCCESS;
 }
@@ -1448,6 +2132,11 @@ ghostcat_button_set_key(struct ghostcat_button *button, unsigned int key)
 LIBGHOSTCAT_EXPORT enum ghostcat_error_code
 ghostcat_button_disable(struct ghostcat_button *button)
 {
+	if (ghostcat_device_is_busy(button->profile->device))
+		return GHOSTCAT_ERROR_IMPLEMENTATION;
+
+	ghostcat_profile_load(button->profile);
+
 	if (!ghostcat_button_has_action_type(button,
 					   GHOSTCAT_BUTTON_ACTION_TYPE_NONE))
 		return GHOSTCAT_ERROR_CAPABILITY;
@@ -1457,8 +2146,7 @@ ghostcat_button_disable(struct ghostcat_button *button)
 	action.type = GHOSTCAT_BUTTON_ACTION_TYPE_NONE;
 
 	ghostcat_button_set_action(button, &action);
-	button->dirty = true;
-	button->profile->dirty = true;
+	ghostcat_button_mark_dirty(button, GHOSTCAT_BUTTON_DIRTY_ACTION);
 
 	return GHOSTCAT_SUCCESS;
 }
@@ -1486,27 +2174,11 @@ ghostcat_led_ref(struct ghostcat_led *led)
 static void
 ghostcat_button_destroy(struct ghostcat_button *button)
 {
-	list_remove(&button->link);
 	if (button->action.macro) {
 		free(button->action.macro->name);
 		free(button->action.macro->group);
 		free(button->action.macro);
 	}
-	free(button);
-}
-
-static void
-ghostcat_led_destroy(struct ghostcat_led *led)
-{
-	list_remove(&led->link);
-	free(led);
-}
-
-static void
-ghostcat_resolution_destroy(struct ghostcat_resolution *res)
-{
-	list_remove(&res->link);
-	free(res);
 }
 
 LIBGHOSTCAT_EXPORT struct ghostcat_button *
@@ -1540,6 +2212,8 @@ ghostcat_led_unref(struct ghostcat_led *led)
 LIBGHOSTCAT_EXPORT enum ghostcat_led_mode
 ghostcat_led_get_mode(const struct ghostcat_led *led)
 {
+	ghostcat_profile_load(led->profile);
+
 	return led->mode;
 }
 
@@ -1558,36 +2232,50 @@ ghostcat_led_has_mode(const struct ghostcat_led *led,
 LIBGHOSTCAT_EXPORT struct ghostcat_color
 ghostcat_led_get_color(const struct ghostcat_led *led)
 {
+	ghostcat_profile_load(led->profile);
+
 	return led->color;
 }
 
 LIBGHOSTCAT_EXPORT int
 ghostcat_led_get_effect_duration(const struct ghostcat_led *led)
 {
+	ghostcat_profile_load(led->profile);
+
 	return led->ms;
 }
 
 LIBGHOSTCAT_EXPORT unsigned int
 ghostcat_led_get_brightness(const struct ghostcat_led *led)
 {
+	ghostcat_profile_load(led->profile);
+
 	return led->brightness;
 }
 
 LIBGHOSTCAT_EXPORT enum ghostcat_error_code
 ghostcat_led_set_mode(struct ghostcat_led *led, enum ghostcat_led_mode mode)
 {
+	if (ghostcat_device_is_busy(led->profile->device))
+		return GHOSTCAT_ERROR_IMPLEMENTATION;
+
+	ghostcat_profile_load(led->profile);
+
 	led->mode = mode;
-	led->dirty = true;
-	led->profile->dirty = true;
+	ghostcat_led_mark_dirty(led, GHOSTCAT_LED_DIRTY_MODE);
 	return GHOSTCAT_SUCCESS;
 }
 
 LIBGHOSTCAT_EXPORT enum ghostcat_error_code
 ghostcat_led_set_color(struct ghostcat_led *led, struct ghostcat_color color)
 {
+	if (ghostcat_device_is_busy(led->profile->device))
+		return GHOSTCAT_ERROR_IMPLEMENTATION;
+
+	ghostcat_profile_load(led->profile);
+
 	led->color = color;
-	led->dirty = true;
-	led->profile->dirty = true;
+	ghostcat_led_mark_dirty(led, GHOSTCAT_LED_DIRTY_COLOR);
 	return GHOSTCAT_SUCCESS;
 }
 
@@ -1600,18 +2288,26 @@ ghostcat_led_get_colordepth(const struct ghostcat_led *led)
 LIBGHOSTCAT_EXPORT enum ghostcat_error_code
 ghostcat_led_set_effect_duration(struct ghostcat_led *led, unsigned int ms)
 {
+	if (ghostcat_device_is_busy(led->profile->device))
+		return GHOSTCAT_ERROR_IMPLEMENTATION;
+
+	ghostcat_profile_load(led->profile);
+
 	led->ms = ms;
-	led->dirty = true;
-	led->profile->dirty = true;
+	ghostcat_led_mark_dirty(led, GHOSTCAT_LED_DIRTY_DURATION);
 	return GHOSTCAT_SUCCESS;
 }
 
 LIBGHOSTCAT_EXPORT enum ghostcat_error_code
 ghostcat_led_set_brightness(struct ghostcat_led *led, unsigned int brightness)
 {
+	if (ghostcat_device_is_busy(led->profile->device))
+		return GHOSTCAT_ERROR_IMPLEMENTATION;
+
+	ghostcat_profile_load(led->profile);
+
 	led->brightness = brightness;
-	led->dirty = true;
-	led->profile->dirty = true;
+	ghostcat_led_mark_dirty(led, GHOSTCAT_LED_DIRTY_BRIGHTNESS);
 	return GHOSTCAT_SUCCESS;
 }
 
@@ -1620,27 +2316,20 @@ ghostcat_profile_get_led(struct ghostcat_profile *profile,
 		       unsigned int index)
 {
 	struct ghostcat_device *device = profile->device;
-	struct ghostcat_led *led;
 
 	if (index >= ghostcat_device_get_num_leds(device)) {
 		log_bug_client(device->ratbag, "Requested invalid led %d\n", index);
 		return NULL;
 	}
 
-	list_for_each(led, &profile->leds, link) {
-		if (led->index == index)
-			return ghostcat_led_ref(led);
-	}
-
-	log_bug_libratbag(device->ratbag, "Led %d, profile %d not found\n",
-			  index, profile->index);
-
-	return NULL;
+	return ghostcat_led_ref(&profile->led_array[index]);
 }
 
 LIBGHOSTCAT_EXPORT const char *
 ghostcat_profile_get_name(const struct ghostcat_profile *profile)
 {
+	ghostcat_profile_load((struct ghostcat_profile *)profile);
+
 	return profile->name;
 }
 
@@ -1650,6 +2339,11 @@ ghostcat_profile_set_name(struct ghostcat_profile *profile,
 {
 	char *name_copy;
 
+	if (ghostcat_device_is_busy(profile->device))
+		return GHOSTCAT_ERROR_IMPLEMENTATION;
+
+	ghostcat_profile_load(profile);
+
 	if (!profile->name)
 		return GHOSTCAT_ERROR_CAPABILITY;
 
@@ -1658,7 +2352,7 @@ ghostcat_profile_set_name(struct ghostcat_profile *profile,
 		free(profile->name);
 
 	profile->name = name_copy;
-	profile->dirty = true;
+	profile->dirty |= GHOSTCAT_PROFILE_DIRTY_NAME;
 
 	return 0;
 }
@@ -1708,10 +2402,22 @@ ghostcat_device_get_user_data(const struct ghostcat_device *ghostcat_device)
 LIBGHOSTCAT_EXPORT int
 ghostcat_device_refresh_active_resolution(struct ghostcat_device *device)
 {
+	int changed;
+
+	if (ghostcat_device_is_busy(device))
+		return -EBUSY;
+
 	if (!device->driver || !device->driver->refresh_active_resolution)
 		return 0;
 
-	return device->driver->refresh_active_resolution(device);
+	changed = device->driver->refresh_active_resolution(device);
+
+	/* the driver noticed the device reconnecting during the refresh,
+	 * replay the changes queued while it was offline */
+	if (device->commit_pending)
+		ghostcat_device_commit(device);
+
+	return changed;
 }
 
 LIBGHOSTCAT_EXPORT const char*
@@ -1748,11 +2454,31 @@ ghostcat_resolution_get_user_data(const struct ghostcat_resolution *ghostcat_res
 LIBGHOSTCAT_EXPORT struct ghostcat_button_macro *
 ghostcat_button_get_macro(struct ghostcat_button *button)
 {
+	struct ghostcat_device *device = button->profile->device;
 	struct ghostcat_button_macro *macro;
+	int rc;
+
+	ghostcat_profile_load(button->profile);
 
 	if (button->action.type != GHOSTCAT_BUTTON_ACTION_TYPE_MACRO)
 		return NULL;
 
+	if (button->macro_needs_load) {
+		assert(device->driver->load_macro != NULL);
+
+		button->macro_needs_load = false;
+		rc = device->driver->load_macro(button);
+		if (rc == -ENOTCONN)
+			button->macro_needs_load = true;
+		else if (rc)
+			log_error(device->ratbag,
+				  "%s: failed to load macro for button %d (%s)\n",
+				  device->name, button->index, strerror(-rc));
+	}
+
+	if (!button->action.macro)
+		return NULL;
+
 	macro = ghostcat_button_macro_new(button->action.macro->name);
 	memcpy(macro->macro.events,
 	       button->action.macro->events,
@@ -1774,6 +2500,7 @@ ghostcat_button_copy_macro(struct ghostcat_button *button,
 	}
 
 	button->action.type = GHOSTCAT_BUTTON_ACTION_TYPE_MACRO;
+	button->macro_needs_load = false;
 	memcpy(button->action.macro->events,
 	       macro->macro.events,
 	       sizeof(macro->macro.events));
@@ -1785,13 +2512,19 @@ LIBGHOSTCAT_EXPORT enum ghostcat_error_code
 ghostcat_button_set_macro(struct ghostcat_button *button,
 			const struct ghostcat_button_macro *macro)
 {
+	if (ghostcat_device_is_busy(button->profile->device))
+		return GHOSTCAT_ERROR_IMPLEMENTATION;
+
+	ghostcat_profile_load(button->profile);
+
 	if (!ghostcat_button_has_action_type(button,
 					   GHOSTCAT_BUTTON_ACTION_TYPE_MACRO))
 		return GHOSTCAT_ERROR_CAPABILITY;
 
 	ghostcat_button_copy_macro(button, macro);
-	button->dirty = true;
-	button->profile->dirty = true;
+	ghostcat_button_mark_dirty(button,
+				   GHOSTCAT_BUTTON_DIRTY_ACTION |
+				   GHOSTCAT_BUTTON_DIRTY_MACRO);
 
 	return GHOSTCAT_SUCCESS;
 }
@@ -238,6 +238,10 @@ ghostcat_log_get_priority(const struct ghostcat *ratbag);
  *
  * The default log handler prints to stderr.
  *
+ * The log handler is only called from the caller's thread. Messages of
+ * an asynchronous job are passed on when ghostcat_dispatch() completes
+ * the job.
+ *
  * @param ratbag A previously initialized ratbag context
  * @param log_handler The log handler for library messages.
  *
@@ -349,6 +353,46 @@ ghostcat_ref(struct ghostcat *ratbag);
 struct ghostcat *
 ghostcat_unref(struct ghostcat *ratbag);
 
+/**
+ * @ingroup base
+ *
+ * Get the file descriptor that becomes readable when an asynchronous job
+ * finished, e.g. one started by ghostcat_device_commit_async(). Add it to
+ * the caller's event loop and call ghostcat_dispatch() when it is
+ * readable.
+ *
+ * The file descriptor is owned by the context and must not be closed by
+ * the caller.
+ *
+ * @param ratbag A previously initialized ratbag context
+ * @return A file descriptor to poll for reading
+ */
+int
+ghostcat_get_fd(struct ghostcat *ratbag);
+
+/**
+ * @ingroup base
+ *
+ * Invoke the completion callbacks of all finished asynchronous jobs. The
+ * callbacks are called from within this function, in the order the jobs
+ * finished. This function does not block. Log messages of a job are
+ * passed to the log handler right before its callback.
+ *
+ * Asynchronous jobs run in threads of their own but only touch their
+ * device, never udev or the context. The udev device passed to
+ * ghostcat_device_new_from_udev_device_async() is only used before that
+ * function returns.
+ *
+ * A context cannot be released while jobs are pending, call this function
+ * until all callbacks have been invoked before dropping the last
+ * reference.
+ *
+ * @param ratbag A previously initialized ratbag context
+ * @return 0 on success or an error code otherwise
+ */
+enum ghostcat_error_code
+ghostcat_dispatch(struct ghostcat *ratbag);
+
 /**
  * @ingroup base
  *
@@ -370,6 +414,47 @@ ghostcat_device_new_from_udev_device(struct ghostcat *ratbag,
 				   struct udev_device *udev_device,
 				   struct ghostcat_device **device);
 
+/**
+ * @ingroup base
+ *
+ * Flags for ghostcat_device_new_from_recording().
+ */
+enum ghostcat_replay_flags {
+	/**
+	 * Every transfer takes as long as it took while recording. By
+	 * default the recording is replayed as fast as possible.
+	 */
+	GHOSTCAT_REPLAY_REALTIME = (1 << 0),
+};
+
+/**
+ * @ingroup base
+ *
+ * Create a new device from a recording of its hidraw traffic. Devices
+ * are recorded when the environment variable GHOSTCAT_RECORD_DIR names a
+ * directory, one file per device.
+ *
+ * The device is probed like the recorded one and every transfer is
+ * answered from the recording, no device node is accessed. A transfer
+ * the recording does not contain fails with an I/O error, as does every
+ * transfer after it.
+ *
+ * @param ratbag A previously initialized ratbag context
+ * @param path The recording
+ * @param flags A bitmask of @ref ghostcat_replay_flags
+ * @param device Set to the new device
+ *
+ * @return 0 on success or the error.
+ * @retval GHOSTCAT_ERROR_VALUE The file is not a valid recording.
+ * @retval GHOSTCAT_ERROR_DEVICE The recorded device is not supported by
+ * libratbag or the probe diverged from the recording.
+ */
+enum ghostcat_error_code
+ghostcat_device_new_from_recording(struct ghostcat *ratbag,
+				   const char *path,
+				   uint32_t flags,
+				   struct ghostcat_device **device);
+
 /**
  * @ingroup device
  *
@@ -382,6 +467,58 @@ ghostcat_device_new_from_udev_device(struct ghostcat *ratbag,
 struct ghostcat_device *
 ghostcat_device_ref(struct ghostcat_device *device);
 
+/**
+ * @ingroup device
+ *
+ * Completion callback for ghostcat_device_new_from_udev_device_async().
+ *
+ * @param ratbag The ratbag context
+ * @param device The new device with a refcount of 1 owned by the caller,
+ * or NULL on error
+ * @param error 0 on success or an error code otherwise
+ * @param userdata The data passed when the job was started
+ */
+typedef void (*ghostcat_device_probe_callback)(struct ghostcat *ratbag,
+					       struct ghostcat_device *device,
+					       enum ghostcat_error_code error,
+					       void *userdata);
+
+/**
+ * @ingroup device
+ *
+ * Completion callback for asynchronous device jobs.
+ *
+ * @param device The device the job ran on
+ * @param result The return value of the synchronous version of the job
+ * @param userdata The data passed when the job was started
+ */
+typedef void (*ghostcat_device_callback)(struct ghostcat_device *device,
+					 int result,
+					 void *userdata);
+
+/**
+ * @ingroup device
+ *
+ * Like ghostcat_device_new_from_udev_device() but returns immediately.
+ * The device is probed in the background and the callback is invoked from
+ * ghostcat_dispatch() once it is done.
+ *
+ * @param ratbag A previously initialized ratbag context
+ * @param udev_device The udev device that points at the device
+ * @param callback Invoked with the new device or an error
+ * @param userdata Passed to the callback
+ *
+ * @return 0 if the job was started or an error code otherwise. If an
+ * error is returned, the callback is never invoked.
+ * @retval GHOSTCAT_ERROR_DEVICE The given device is not supported by
+ * libratbag.
+ */
+enum ghostcat_error_code
+ghostcat_device_new_from_udev_device_async(struct ghostcat *ratbag,
+					   struct udev_device *udev_device,
+					   ghostcat_device_probe_callback callback,
+					   void *userdata);
+
 /**
  * @ingroup device
  *
@@ -427,6 +564,10 @@ ghostcat_device_get_user_data(const struct ghostcat_device *device);
  * Refresh the active resolution state by re-reading from hardware.
  * This detects changes from physical DPI button presses on the device.
  *
+ * This does not block on a wireless device that is asleep. Changes that
+ * were committed while the device was asleep are written here once the
+ * device has reconnected.
+ *
  * @param device A previously initialized ratbag device
  *
  * @return 1 if state changed, 0 if unchanged, or negative error code
@@ -434,6 +575,25 @@ ghostcat_device_get_user_data(const struct ghostcat_device *device);
 int
 ghostcat_device_refresh_active_resolution(struct ghostcat_device *device);
 
+/**
+ * @ingroup device
+ *
+ * Like ghostcat_device_refresh_active_resolution() but returns
+ * immediately. The callback is invoked from ghostcat_dispatch() with the
+ * result of ghostcat_device_refresh_active_resolution().
+ *
+ * The same restrictions as for ghostcat_device_commit_async() apply.
+ *
+ * @param device A previously initialized ratbag device
+ * @param callback Invoked once the refresh finished
+ * @param userdata Passed to the callback
+ * @return 0 if the job was started or an error code otherwise
+ */
+enum ghostcat_error_code
+ghostcat_device_refresh_active_resolution_async(struct ghostcat_device *device,
+						ghostcat_device_callback callback,
+						void *userdata);
+
 /**
  * @ingroup device
  *
@@ -519,12 +679,191 @@ ghostcat_device_get_product_version(const struct ghostcat_device *device);
  * Write any changes to the device. Depending on the device, this may take
  * a couple of seconds.
  *
+ * If a wireless device is currently asleep, the changes are kept and
+ * written when the device reconnects. This function returns success in
+ * that case, see ghostcat_device_refresh_active_resolution().
+ *
  * @param device A previously initialized ratbag device
  * @return 0 on success or an error code otherwise
  */
 enum ghostcat_error_code
 ghostcat_device_commit(struct ghostcat_device *device);
 
+/**
+ * @ingroup device
+ *
+ * Show the given colors on the device's LEDs without changing any
+ * profile, neither in libghostcat nor in the device's onboard memory. This
+ * is meant for animations driven by the caller that update the LEDs many
+ * times a second. Only the LEDs whose color differs from the previous
+ * call are written to the device.
+ *
+ * The colors are shown until ghostcat_device_restore_leds() or until the
+ * LEDs are written by ghostcat_device_commit().
+ *
+ * @param device A previously initialized ratbag device
+ * @param colors One color per LED, indexed by the LED index
+ * @param num_colors The number of colors, must be
+ * ghostcat_device_get_num_leds()
+ * @return 0 on success or an error code otherwise
+ * @retval GHOSTCAT_ERROR_CAPABILITY The device does not support showing
+ * colors without storing them
+ */
+enum ghostcat_error_code
+ghostcat_device_show_leds(struct ghostcat_device *device,
+			  const struct ghostcat_color *colors,
+			  unsigned int num_colors);
+
+/**
+ * @ingroup device
+ *
+ * Show the LEDs of the active profile again after
+ * ghostcat_device_show_leds(). Does nothing if no colors are shown.
+ *
+ * @param device A previously initialized ratbag device
+ * @return 0 on success or an error code otherwise
+ */
+enum ghostcat_error_code
+ghostcat_device_restore_leds(struct ghostcat_device *device);
+
+/**
+ * @ingroup device
+ *
+ * Keyboards with per-key lighting have a framebuffer of keys: a grid of
+ * cells laid out like the keyboard, where some cells are keys. This
+ * returns the width of the grid, or 0 if the device has no per-key
+ * lighting.
+ *
+ * @param device A previously initialized ratbag device
+ * @return The number of cells per row
+ */
+unsigned int
+ghostcat_device_get_key_frame_width(const struct ghostcat_device *device);
+
+/**
+ * @ingroup device
+ *
+ * @param device A previously initialized ratbag device
+ * @return The number of rows of the key framebuffer, 0 if the device has
+ * no per-key lighting
+ *
+ * @see ghostcat_device_get_key_frame_width
+ */
+unsigned int
+ghostcat_device_get_key_frame_height(const struct ghostcat_device *device);
+
+/**
+ * @ingroup device
+ *
+ * @param device A previously initialized ratbag device
+ * @param x The column of the cell
+ * @param y The row of the cell
+ * @return true if the cell of the key framebuffer is a key
+ */
+bool
+ghostcat_device_has_key(const struct ghostcat_device *device,
+			unsigned int x, unsigned int y);
+
+/**
+ * @ingroup device
+ *
+ * Set the colors of a rectangle of the key framebuffer. Nothing is
+ * written to the device until ghostcat_device_show_keys(), so a frame
+ * may be put together from several rectangles. Cells that are not keys
+ * are ignored.
+ *
+ * @param device A previously initialized ratbag device
+ * @param x The column of the rectangle's top left cell
+ * @param y The row of the rectangle's top left cell
+ * @param width The number of columns of the rectangle
+ * @param height The number of rows of the rectangle
+ * @param colors width * height colors, row by row
+ * @return 0 on success or an error code otherwise
+ * @retval GHOSTCAT_ERROR_CAPABILITY The device has no per-key lighting
+ * @retval GHOSTCAT_ERROR_VALUE The rectangle is not inside the framebuffer
+ */
+enum ghostcat_error_code
+ghostcat_device_set_key_colors(struct ghostcat_device *device,
+			       unsigned int x, unsigned int y,
+			       unsigned int width, unsigned int height,
+			       const struct ghostcat_color *colors);
+
+/**
+ * @ingroup device
+ *
+ * Write the keys whose color changed since the last call to the device.
+ * Like ghostcat_device_show_leds(), the colors are not stored in the
+ * device's onboard memory.
+ *
+ * @param device A previously initialized ratbag device
+ * @return 0 on success or an error code otherwise
+ * @retval GHOSTCAT_ERROR_CAPABILITY The device has no per-key lighting
+ */
+enum ghostcat_error_code
+ghostcat_device_show_keys(struct ghostcat_device *device);
+
+/**
+ * @ingroup device
+ *
+ * Like ghostcat_device_commit() but returns immediately. The changes are
+ * written in the background and the callback is invoked from
+ * ghostcat_dispatch() with the result of ghostcat_device_commit().
+ *
+ * Until the callback was invoked, the device must not be used other than
+ * with ghostcat_device_ref() and ghostcat_device_unref(). Only one
+ * asynchronous job may run on a device at a time. Meanwhile the setters,
+ * ghostcat_device_commit(), ghostcat_device_show_leds() and the like fail
+ * with GHOSTCAT_ERROR_IMPLEMENTATION, and profiles that are not loaded yet
+ * stay unloaded.
+ *
+ * @param device A previously initialized ratbag device
+ * @param callback Invoked once the commit finished
+ * @param userdata Passed to the callback
+ * @return 0 if the job was started or an error code otherwise. If an
+ * error is returned, the callback is never invoked.
+ * @retval GHOSTCAT_ERROR_IMPLEMENTATION Another job is running on the
+ * device
+ */
+enum ghostcat_error_code
+ghostcat_device_commit_async(struct ghostcat_device *device,
+			     ghostcat_device_callback callback,
+			     void *userdata);
+
+/**
+ * @ingroup device
+ *
+ * Read the device's onboard memory into an image that can be written to
+ * other devices of the same model with ghostcat_device_apply_image().
+ * Uncommitted changes are not part of the image.
+ *
+ * @param device A previously initialized ratbag device
+ * @param[out] data Set to the image on success, use free() to release it
+ * @param[out] size Set to the size of the image in bytes
+ * @return 0 on success or an error code otherwise
+ */
+enum ghostcat_error_code
+ghostcat_device_save_image(struct ghostcat_device *device,
+			   uint8_t **data, size_t *size);
+
+/**
+ * @ingroup device
+ *
+ * Write an image created with ghostcat_device_save_image() to the device.
+ * Only the parts of the onboard memory that differ from the image are
+ * written. Afterwards the profiles are resynchronized with the device and
+ * any uncommitted changes are discarded.
+ *
+ * @param device A previously initialized ratbag device
+ * @param data The image
+ * @param size The size of the image in bytes
+ * @return 0 on success or an error code otherwise
+ * @retval GHOSTCAT_ERROR_VALUE The image is invalid or was taken from a
+ * different device model
+ */
+enum ghostcat_error_code
+ghostcat_device_apply_image(struct ghostcat_device *device,
+			    const uint8_t *data, size_t size);
+
 /**
  * @ingroup device
  *
@@ -565,6 +904,89 @@ ghostcat_device_get_num_buttons(const struct ghostcat_device *device);
 unsigned int
 ghostcat_device_get_num_leds(const struct ghostcat_device *device);
 
+/**
+ * @ingroup device
+ *
+ * Runtime counters of a device, see ghostcat_device_get_stat().
+ */
+enum ghostcat_device_stat {
+	/** HID reports written to or requested from the device */
+	GHOSTCAT_DEVICE_STAT_TRANSFERS,
+	GHOSTCAT_DEVICE_STAT_BYTES_SENT,
+	GHOSTCAT_DEVICE_STAT_BYTES_RECEIVED,
+	/** Reads repeated because the response was late */
+	GHOSTCAT_DEVICE_STAT_RETRIES,
+	/** Reads that got no response in time */
+	GHOSTCAT_DEVICE_STAT_TIMEOUTS,
+	/** Reads and writes that failed */
+	GHOSTCAT_DEVICE_STAT_ERRORS,
+	/** Duration of the driver probe in microseconds */
+	GHOSTCAT_DEVICE_STAT_PROBE_TIME_US,
+	GHOSTCAT_DEVICE_STAT_COMMITS,
+	/** Duration of the last commit in microseconds */
+	GHOSTCAT_DEVICE_STAT_COMMIT_TIME_US,
+	/** Duration of all commits in microseconds */
+	GHOSTCAT_DEVICE_STAT_COMMIT_TIME_TOTAL_US,
+};
+
+/**
+ * @ingroup device
+ *
+ * The number of buckets of the round-trip time histogram, see
+ * ghostcat_device_get_latency_histogram().
+ */
+#define GHOSTCAT_DEVICE_LATENCY_BUCKETS 16
+
+/**
+ * @ingroup device
+ *
+ * Return a runtime counter of the device. The counters are kept for as
+ * long as the device exists and are cheap enough to be always on.
+ *
+ * Unlike the other device functions, this function may be called while
+ * an asynchronous job runs on the device.
+ *
+ * @param device A previously initialized ratbag device
+ * @param stat The counter to return
+ * @return The value of the counter, or 0 for an invalid counter
+ */
+uint64_t
+ghostcat_device_get_stat(const struct ghostcat_device *device,
+			 enum ghostcat_device_stat stat);
+
+/**
+ * @ingroup device
+ *
+ * Return the number of request round trips of the device that fell into
+ * the given bucket of the latency histogram. Bucket 0 holds all round
+ * trips below 128us, every following bucket those below twice the
+ * previous limit and the last bucket everything else.
+ *
+ * Like ghostcat_device_get_stat(), this function may be called while an
+ * asynchronous job runs on the device.
+ *
+ * @param device A previously initialized ratbag device
+ * @param bucket The bucket index, less than GHOSTCAT_DEVICE_LATENCY_BUCKETS
+ * @param[out] limit_us If not NULL, set to the exclusive upper limit of
+ * the bucket in microseconds, or 0 for the last bucket
+ * @return The number of round trips in this bucket
+ */
+uint64_t
+ghostcat_device_get_latency_histogram(const struct ghostcat_device *device,
+				      unsigned int bucket,
+				      uint64_t *limit_us);
+
+/**
+ * @ingroup device
+ *
+ * Reset all runtime counters and the latency histogram of the device to
+ * zero.
+ *
+ * @param device A previously initialized ratbag device
+ */
+void
+ghostcat_device_reset_stats(struct ghostcat_device *device);
+
 /**
  * @ingroup profile
  *
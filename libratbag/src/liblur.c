@@ -28,6 +28,7 @@
 #include <assert.h>
 #include <errno.h>
 #include <stdbool.h>
+#include <poll.h>
 #include <stdlib.h>
 #include <sys/ioctl.h>
 #include <linux/hidraw.h>
@@ -40,21 +41,16 @@
 #define _EXPORT_ __attribute__ ((visibility("default")))
 #define MAX_DEVICES 6
 
-static inline void
-cleanup_hidpp10_device_destroy(struct hidpp10_device **hidpp10_device) {
-	if (*hidpp10_device)
-		hidpp10_device_destroy(*hidpp10_device);
-}
-#define _cleanup_hidpp10_device_destroy_ _cleanup_(cleanup_hidpp10_device_destroy)
-
 struct lur_receiver {
 	int refcount;
 	int fd;
 	void *userdata;
 
 	struct hidpp10_device *hidppdev;
+	struct ghostcat_rtt rtt;
 
 	struct list devices;
+	bool notifications; /* devices list is kept up-to-date by dispatch */
 };
 
 struct lur_device {
@@ -141,11 +137,12 @@ hidraw_is_receiver(int fd)
 }
 
 static int
-hidpp10_init(int fd, struct hidpp10_device **out)
+hidpp10_init(int fd, struct ghostcat_rtt *rtt, struct hidpp10_device **out)
 {
 	struct hidpp_device base;
 
 	hidpp_device_init(&base, fd);
+	base.rtt = rtt;
 
 	return hidpp10_device_new(&base, HIDPP_RECEIVER_IDX,
 				  HIDPP10_PROFILE_UNKNOWN, 1, out);
@@ -166,7 +163,7 @@ lur_receiver_new_from_hidraw(int fd, void *userdata, struct lur_receiver **out)
 	receiver->userdata = userdata;
 	list_init(&receiver->devices);
 
-	rc = hidpp10_init(fd, &receiver->hidppdev);
+	rc = hidpp10_init(fd, &receiver->rtt, &receiver->hidppdev);
 	if (rc)
 		goto error;
 
@@ -178,44 +175,202 @@ error:
 	return rc;
 }
 
+static struct lur_device *
+lur_receiver_add_device(struct lur_receiver *lur, int idx, const char *name,
+			uint16_t wpid, uint8_t type, uint32_t serial)
+{
+	struct lur_device *dev;
+
+	dev = zalloc(sizeof *dev);
+	dev->receiver = lur;
+	lur_receiver_ref(lur);
+	dev->refcount = 1;
+	dev->name = strdup_safe(name);
+	dev->vid = USB_VENDOR_ID_LOGITECH;
+	dev->pid = wpid;
+	dev->type = type;
+	dev->serial = serial;
+	dev->hidppidx = idx;
+	dev->present = true;
+	list_insert(&lur->devices, &dev->node);
+
+	return dev;
+}
+
+static void
+lur_receiver_drop_device(struct lur_device *dev)
+{
+	list_remove(&dev->node);
+	list_init(&dev->node);
+	lur_device_unref(dev);
+}
+
+/* Pairing information is stored on the receiver, reading it doesn't
+ * need the device to be awake. */
+static int
+lur_receiver_read_pairing(struct lur_receiver *lur, int idx,
+			  char *name, size_t name_size,
+			  uint16_t *wpid, uint8_t *type, uint32_t *serial)
+{
+	struct hidpp10_device slot = {
+		.base = lur->hidppdev->base,
+		.index = idx,
+	};
+	uint8_t interval;
+	int rc;
+
+	rc = hidpp10_get_pairing_information_device_name(&slot, name, &name_size);
+	if (rc)
+		return rc;
+
+	if (wpid) {
+		rc = hidpp10_get_pairing_information(&slot, &interval, wpid, type);
+		if (rc)
+			return rc;
+	}
+
+	return hidpp10_get_extended_pairing_information(&slot, serial);
+}
+
+static int
+lur_receiver_handle_connection(struct lur_receiver *lur,
+			       const struct hidpp10_connection_event *event)
+{
+	struct lur_device *dev, *tmp;
+	char name[64];
+	uint32_t serial;
+	int changed = 0;
+	int rc;
+
+	list_for_each_safe(dev, tmp, &lur->devices, node) {
+		if (dev->hidppidx != (int)event->index)
+			continue;
+
+		/* a device waking up or going to sleep, nothing changed */
+		if (event->paired && dev->pid == event->wpid)
+			return 0;
+
+		lur_receiver_drop_device(dev);
+		changed++;
+	}
+
+	if (!event->paired)
+		return changed;
+
+	rc = lur_receiver_read_pairing(lur, event->index, name, sizeof(name),
+				       NULL, NULL, &serial);
+	if (rc)
+		return changed;
+
+	lur_receiver_add_device(lur, event->index, name, event->wpid,
+				event->device_type, serial);
+
+	return changed + 1;
+}
+
+_EXPORT_ int
+lur_receiver_enable_notifications(struct lur_receiver *lur)
+{
+	struct hidpp10_connection_event event;
+	uint8_t buf[LONG_MESSAGE_LENGTH];
+	uint32_t flags;
+	int count, rc;
+
+	if (lur->notifications)
+		return 0;
+
+	rc = hidpp10_get_hidpp_notifications(lur->hidppdev, &flags);
+	if (rc)
+		return rc > 0 ? -EIO : rc;
+
+	rc = hidpp10_set_hidpp_notifications(lur->hidppdev,
+					     flags | HIDPP10_NOTIFICATIONS_WIRELESS_NOTIFICATIONS);
+	if (rc)
+		return rc > 0 ? -EIO : rc;
+
+	count = hidpp10_get_connection_state(lur->hidppdev);
+	if (count < 0)
+		return count;
+
+	/* The receiver reports every paired device once, this gives us the
+	 * initial list in a single request instead of polling each slot */
+	rc = hidpp10_trigger_device_arrival(lur->hidppdev);
+	if (rc)
+		return rc > 0 ? -EIO : rc;
+
+	lur->notifications = true;
+
+	while (count > 0) {
+		/* the receiver takes its time to report all devices */
+		rc = hidpp_read_response_timeout(&lur->hidppdev->base, buf, sizeof(buf),
+						 GHOSTCAT_RTT_TIMEOUT_MAX_MS);
+		if (rc < 0)
+			break;
+
+		if (hidpp10_parse_connection_notification(buf, rc, &event) == 0) {
+			lur_receiver_handle_connection(lur, &event);
+			count--;
+		}
+	}
+
+	return 0;
+}
+
+_EXPORT_ int
+lur_receiver_dispatch(struct lur_receiver *lur)
+{
+	struct hidpp10_connection_event event;
+	uint8_t buf[LONG_MESSAGE_LENGTH];
+	struct pollfd fds = {
+		.fd = lur->fd,
+		.events = POLLIN,
+	};
+	int changed = 0;
+	int rc;
+
+	if (!lur->notifications)
+		return -EINVAL;
+
+	while (poll(&fds, 1, 0) > 0) {
+		rc = hidpp_read_response(&lur->hidppdev->base, buf, sizeof(buf), 0);
+		if (rc < 0)
+			return rc;
+
+		if (hidpp10_parse_connection_notification(buf, rc, &event) == 0)
+			changed += lur_receiver_handle_connection(lur, &event);
+	}
+
+	return changed;
+}
+
 _EXPORT_ int
 lur_receiver_enumerate(struct lur_receiver *lur,
 		       struct lur_device ***devices_out)
 {
 	int i;
 	int ndevices = 0;
-	struct hidpp_device base;
 	struct lur_device *dev, *tmp;
 	int rc;
 	struct lur_device **devices;
 
-	hidpp_device_init(&base, lur->fd);
+	if (lur->notifications) {
+		lur_receiver_dispatch(lur);
+		goto out;
+	}
 
 	list_for_each(dev, &lur->devices, node)
 		dev->present = false;
 
-	for (i = 0; i < MAX_DEVICES; i++) {
-		_cleanup_hidpp10_device_destroy_ struct hidpp10_device *d = NULL;
+	for (i = 1; i <= MAX_DEVICES; i++) {
 		size_t name_size = 64;
 		char name[name_size];
-		uint8_t interval, type;
+		uint8_t type;
 		uint16_t wpid;
 		uint32_t serial;
 		bool is_new_device = true;
 
-		rc = hidpp10_device_new(&base, i, HIDPP10_PROFILE_UNKNOWN, 1, &d);
-		if (rc)
-			continue;
-
-		rc = hidpp10_get_pairing_information_device_name(d, name, &name_size);
-		if (rc)
-			continue;
-
-		rc = hidpp10_get_pairing_information(d, &interval, &wpid, &type);
-		if (rc)
-			continue;
-
-		rc = hidpp10_get_extended_pairing_information(d, &serial);
+		rc = lur_receiver_read_pairing(lur, i, name, name_size,
+					       &wpid, &type, &serial);
 		if (rc)
 			continue;
 
@@ -234,33 +389,22 @@ lur_receiver_enumerate(struct lur_receiver *lur,
 			}
 		}
 
-		if (is_new_device) {
-			dev = zalloc(sizeof *dev);
-			dev->receiver = lur;
-			lur_receiver_ref(lur);
-			dev->refcount = 1;
-			dev->name = strdup_safe(name);
-			dev->vid = USB_VENDOR_ID_LOGITECH;
-			dev->pid = wpid;
-			dev->type = type;
-			dev->serial = serial;
-			dev->hidppidx = i;
-			dev->present = true;
-			list_insert(&lur->devices, &dev->node);
-		}
+		if (is_new_device)
+			lur_receiver_add_device(lur, i, name, wpid, type, serial);
 	}
 
-	devices = zalloc(MAX_DEVICES * sizeof(*devices));
-
 	/* Now drop all devices that disappeared */
 	list_for_each_safe(dev, tmp, &lur->devices, node) {
-		if (dev->present) {
+		if (!dev->present)
+			lur_receiver_drop_device(dev);
+	}
+
+out:
+	devices = zalloc(MAX_DEVICES * sizeof(*devices));
+
+	list_for_each(dev, &lur->devices, node) {
+		if (ndevices < MAX_DEVICES)
 			devices[ndevices++] = dev;
-		} else {
-			list_remove(&dev->node);
-			list_init(&dev->node);
-			lur_device_unref(dev);
-		}
 	}
 
 	*devices_out = devices;
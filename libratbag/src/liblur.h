@@ -128,6 +128,10 @@ lur_receiver_new_from_hidraw(int fd, void *userdata, struct lur_receiver **lur);
  * lur_receiver_enumerate(). Otherwise, the diff between the two lists
  * indicate the set of newly added and/or removed devices.
  *
+ * If notifications are enabled with lur_receiver_enable_notifications(),
+ * this function does not query the receiver and returns the list
+ * maintained from the pairing notifications.
+ *
  * The devices returned have a refcount of at least 1, use
  * lur_device_unref(). Repeated calls to this function do not increase the
  * devices' refcount.
@@ -142,6 +146,30 @@ int
 lur_receiver_enumerate(struct lur_receiver *lur,
 		       struct lur_device ***devices);
 
+/**
+ * Subscribe to the receiver's pairing notifications. Once enabled, the
+ * list of paired devices is updated whenever the receiver reports a
+ * device being paired or unpaired, see lur_receiver_dispatch().
+ *
+ * @param lur A valid receiver object
+ * @return 0 on success or a negative errno on error
+ */
+int
+lur_receiver_enable_notifications(struct lur_receiver *lur);
+
+/**
+ * Process all notifications pending on the receiver's fd. Call this
+ * function whenever the fd returned by lur_receiver_get_fd() becomes
+ * readable. This function does not block.
+ *
+ * @param lur A valid receiver object
+ * @return The number of devices added to or removed from the list of
+ * paired devices, or a negative errno on error
+ * @retval -EINVAL Notifications are not enabled on this receiver
+ */
+int
+lur_receiver_dispatch(struct lur_receiver *lur);
+
 /**
  * Allow devices to be paired with this receiver for the given timeout.
  * Once 'open', the receiver will pair with a currently disconnected
@@ -169,6 +197,8 @@ lur_receiver_close(struct lur_receiver *lur);
 
 /**
  * Return the file descriptor used to initialize this receiver.
+ * If notifications are enabled, the caller should add this fd to its
+ * event loop and call lur_receiver_dispatch() when it is readable.
  *
  * @param lur A valid receiver object
  * @return The file descriptor passed into lur_receiver_new_from_hidraw
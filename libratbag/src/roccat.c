@@ -0,0 +1,819 @@
+/*
+ * Copyright © 2015 Red Hat, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "config.h"
+#include <assert.h>
+#include <errno.h>
+#include <libevdev/libevdev.h>
+#include <linux/input.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "roccat.h"
+
+#include "libghostcat-checksum.h"
+#include "libghostcat-hidraw.h"
+
+#define ROCCAT_MAX_RETRY_READY			20
+
+/* the second byte of the ROCCAT_REPORT_ID_CONFIGURE_PROFILE report */
+#define ROCCAT_STATUS_READY			0x01
+#define ROCCAT_STATUS_ERROR			0x02
+#define ROCCAT_STATUS_BUSY			0x03
+
+/* the second argument of a profile selection, or a button index to
+ * select its macro */
+#define ROCCAT_CONFIG_SETTINGS			0x80
+#define ROCCAT_CONFIG_KEY_MAPPING		0x90
+
+/* macros in banks are selected with the bank added to the profile */
+#define ROCCAT_BANK_SELECT_1			0x10
+#define ROCCAT_BANK_SELECT_2			0x20
+
+#define ROCCAT_MACRO_SIZE_SINGLE		2082
+#define ROCCAT_MACRO_SIZE_BANK			1026
+#define ROCCAT_MACRO_MAX_KEYS_SINGLE		500
+#define ROCCAT_MACRO_MAX_KEYS_BANKED		480
+
+#define ROCCAT_MACRO_KEY_PRESSED		0x01
+#define ROCCAT_MACRO_KEY_RELEASED		0x02
+
+struct roccat_macro_key {
+	uint8_t keycode;
+	uint8_t flag;
+	uint16_t time;
+} __attribute__((packed));
+
+struct roccat_macro_single {
+	uint8_t report_id;
+	uint16_t report_length;
+	uint8_t profile;
+	uint8_t button_index;
+	uint8_t active;
+	uint8_t padding[24];
+	char group[24];
+	char name[24];
+	uint16_t length;
+	struct roccat_macro_key keys[ROCCAT_MACRO_MAX_KEYS_SINGLE];
+	uint16_t checksum;
+} __attribute__((packed));
+_Static_assert(sizeof(struct roccat_macro_single) == ROCCAT_MACRO_SIZE_SINGLE,
+	       "The size of `roccat_macro_single` is wrong.");
+
+/* split in two banks, the second one starts with its report id and bank
+ * number followed by the rest of the structure */
+struct roccat_macro_banked {
+	uint8_t report_id;
+	uint8_t bank;
+	uint8_t profile;
+	uint8_t button_index;
+	uint8_t repeats;
+	char group[40];
+	char name[32];
+	uint16_t length;
+	struct roccat_macro_key keys[ROCCAT_MACRO_MAX_KEYS_BANKED];
+} __attribute__((packed));
+
+/* a macro in either format */
+struct roccat_macro {
+	char group[41];
+	char name[33];
+	unsigned int length;
+	struct roccat_macro_key keys[ROCCAT_MACRO_MAX_KEYS_SINGLE];
+};
+
+static inline struct roccat_data *
+roccat_get_data(struct ghostcat_device *device)
+{
+	return ghostcat_get_drv_data(device);
+}
+
+static inline uint16_t
+roccat_get_unaligned_u16(const uint8_t *buf)
+{
+	return (buf[1] << 8) | buf[0];
+}
+
+static inline void
+roccat_set_unaligned_u16(uint8_t *buf, uint16_t value)
+{
+	buf[0] = value & 0xff;
+	buf[1] = value >> 8;
+}
+
+/**
+ * The checksum of buf, len includes the two bytes of the checksum at
+ * the end of buf.
+ */
+static inline uint16_t
+roccat_compute_crc(const uint8_t *buf, unsigned int len)
+{
+	if (len < 3)
+		return 0;
+
+	return ghostcat_checksum_sum(buf, len - 2);
+}
+
+static inline void
+roccat_set_crc(uint8_t *buf, unsigned int len)
+{
+	roccat_set_unaligned_u16(&buf[len - 2], roccat_compute_crc(buf, len));
+}
+
+static inline bool
+roccat_crc_is_valid(struct ghostcat_device *device, const uint8_t *buf,
+		    unsigned int len)
+{
+	uint16_t crc;
+	uint16_t given_crc;
+
+	if (len < 3)
+		return false;
+
+	crc = roccat_compute_crc(buf, len);
+	given_crc = roccat_get_unaligned_u16(&buf[len - 2]);
+
+	log_raw(device->ratbag,
+		"checksum computed: 0x%04x, checksum given: 0x%04x\n",
+		crc,
+		given_crc);
+
+	return crc == given_crc;
+}
+
+/**
+ * Wait until the device processed the last request, as told by its status
+ * report. The status is polled right away, a busy device is polled again
+ * at the pace of its round trips.
+ */
+static int
+roccat_wait_ready(struct ghostcat_device *device)
+{
+	uint8_t buf[3];
+	unsigned int attempt;
+	int rc;
+
+	for (attempt = 0; attempt < ROCCAT_MAX_RETRY_READY; attempt++) {
+		rc = ghostcat_hidraw_get_feature_report(device,
+							ROCCAT_REPORT_ID_CONFIGURE_PROFILE,
+							buf, sizeof(buf));
+		if (rc < 0)
+			return rc;
+		if (rc != sizeof(buf))
+			return -EIO;
+
+		switch (buf[1]) {
+		case ROCCAT_STATUS_READY:
+			return 0;
+		case ROCCAT_STATUS_ERROR:
+			return -EIO;
+		default:
+			msleep(ghostcat_rtt_delay_ms(&device->rtt, attempt));
+			break;
+		}
+	}
+
+	return -ETIMEDOUT;
+}
+
+static int
+roccat_set_feature_report(struct ghostcat_device *device, uint8_t *buf,
+			  size_t len)
+{
+	int rc;
+
+	rc = ghostcat_hidraw_set_feature_report(device, buf[0], buf, len);
+	if (rc < 0)
+		return rc;
+	if ((size_t)rc != len)
+		return -EIO;
+
+	rc = roccat_wait_ready(device);
+	if (rc)
+		log_error(device->ratbag,
+			  "Error while waiting for the device to be ready: %s (%d)\n",
+			  strerror(-rc), rc);
+
+	return rc;
+}
+
+static int
+roccat_get_feature_report(struct ghostcat_device *device, uint8_t report_id,
+			  uint8_t *buf, size_t len)
+{
+	int rc;
+
+	buf[0] = report_id;
+	rc = ghostcat_hidraw_get_feature_report(device, report_id, buf, len);
+	if (rc < 0)
+		return rc;
+	if ((size_t)rc != len || buf[0] != report_id)
+		return -EIO;
+
+	return 0;
+}
+
+/**
+ * Select what the next read returns: the settings or key mapping of a
+ * profile, or with a button index as type, the macro of that button.
+ */
+static int
+roccat_select(struct ghostcat_device *device, uint8_t profile, uint8_t type)
+{
+	uint8_t buf[] = { ROCCAT_REPORT_ID_CONFIGURE_PROFILE, profile, type };
+
+	return roccat_set_feature_report(device, buf, sizeof(buf));
+}
+
+static int
+roccat_current_profile(struct ghostcat_device *device)
+{
+	uint8_t buf[3];
+	int rc;
+
+	rc = roccat_get_feature_report(device, ROCCAT_REPORT_ID_PROFILE,
+				       buf, sizeof(buf));
+	if (rc < 0)
+		return rc;
+
+	return buf[2];
+}
+
+int
+roccat_set_active_profile(struct ghostcat_device *device, unsigned int index)
+{
+	struct roccat_data *drv_data = roccat_get_data(device);
+	uint8_t buf[] = { ROCCAT_REPORT_ID_PROFILE, 0x03, index };
+
+	if (index >= drv_data->model->num_profiles)
+		return -EINVAL;
+
+	return roccat_set_feature_report(device, buf, sizeof(buf));
+}
+
+static const struct ghostcat_button_action *
+roccat_raw_to_button_action(const struct roccat_model *model, uint8_t raw)
+{
+	for (size_t i = 0; i < model->num_button_mapping; i++) {
+		if (model->button_mapping[i].raw == raw)
+			return &model->button_mapping[i].action;
+	}
+
+	return NULL;
+}
+
+static int
+roccat_button_action_to_raw(const struct roccat_model *model,
+			    const struct ghostcat_button_action *action)
+{
+	for (size_t i = 0; i < model->num_button_mapping; i++) {
+		if (ghostcat_button_action_match(&model->button_mapping[i].action,
+					       action))
+			return model->button_mapping[i].raw;
+	}
+
+	return -EINVAL;
+}
+
+static int
+roccat_read_macro_single(struct ghostcat_button *button,
+			 struct roccat_macro *macro)
+{
+	struct ghostcat_device *device = button->profile->device;
+	struct roccat_macro_single report;
+	uint8_t *buf = (uint8_t *)&report;
+	int rc;
+
+	roccat_select(device, button->profile->index, 0);
+	roccat_select(device, button->profile->index, button->index);
+	rc = roccat_get_feature_report(device, ROCCAT_REPORT_ID_MACRO,
+				       buf, sizeof(report));
+	if (rc)
+		return rc;
+
+	if (!roccat_crc_is_valid(device, buf, sizeof(report)))
+		return -EIO;
+
+	memcpy(macro->group, report.group, sizeof(report.group));
+	memcpy(macro->name, report.name, sizeof(report.name));
+	macro->length = min(report.length, ROCCAT_MACRO_MAX_KEYS_SINGLE);
+	memcpy(macro->keys, report.keys, macro->length * sizeof(macro->keys[0]));
+
+	return 0;
+}
+
+static int
+roccat_read_macro_banked(struct ghostcat_button *button,
+			 struct roccat_macro *macro)
+{
+	struct ghostcat_device *device = button->profile->device;
+	struct roccat_macro_banked report;
+	uint8_t *buf = (uint8_t *)&report;
+	uint8_t bank[ROCCAT_MACRO_SIZE_BANK];
+	int rc;
+
+	roccat_select(device, button->profile->index, 0);
+
+	/* the second bank continues the structure after its two byte
+	 * header, and does not even fill the bank */
+	roccat_select(device, button->profile->index + ROCCAT_BANK_SELECT_2,
+		      button->index);
+	rc = roccat_get_feature_report(device, ROCCAT_REPORT_ID_MACRO,
+				       bank, sizeof(bank));
+	if (rc)
+		return rc;
+	memcpy(buf + ROCCAT_MACRO_SIZE_BANK, bank + 2,
+	       sizeof(report) - ROCCAT_MACRO_SIZE_BANK);
+
+	roccat_select(device, button->profile->index + ROCCAT_BANK_SELECT_1,
+		      button->index);
+	rc = roccat_get_feature_report(device, ROCCAT_REPORT_ID_MACRO,
+				       buf, ROCCAT_MACRO_SIZE_BANK);
+	if (rc)
+		return rc;
+
+	memcpy(macro->group, report.group, sizeof(report.group));
+	memcpy(macro->name, report.name, sizeof(report.name));
+	macro->length = min(report.length, ROCCAT_MACRO_MAX_KEYS_BANKED);
+	memcpy(macro->keys, report.keys, macro->length * sizeof(macro->keys[0]));
+
+	return 0;
+}
+
+int
+roccat_load_macro(struct ghostcat_button *button)
+{
+	struct ghostcat_device *device = button->profile->device;
+	struct roccat_data *drv_data = roccat_get_data(device);
+	struct ghostcat_button_macro *m;
+	struct roccat_macro macro = {0};
+	unsigned int j;
+	int rc;
+
+	if (drv_data->model->macro_format == ROCCAT_MACRO_FORMAT_BANKED)
+		rc = roccat_read_macro_banked(button, &macro);
+	else
+		rc = roccat_read_macro_single(button, &macro);
+	if (rc) {
+		log_error(device->ratbag,
+			  "Unable to retrieve the macro for button %d of profile %d: %s (%d)\n",
+			  button->index, button->profile->index,
+			  strerror(-rc), rc);
+		return rc;
+	}
+
+	m = ghostcat_button_macro_new(macro.name);
+	if (macro.group[0])
+		m->macro.group = strdup_safe(macro.group);
+
+	log_raw(device->ratbag,
+		"macro on button %d of profile %d is named '%s', and contains %d events:\n",
+		button->index, button->profile->index,
+		macro.name, macro.length);
+
+	/* every key is a press or release followed by a wait */
+	for (j = 0; j < macro.length && j < MAX_MACRO_EVENTS / 2; j++) {
+		bool pressed = macro.keys[j].flag & ROCCAT_MACRO_KEY_PRESSED;
+		unsigned int keycode, time;
+
+		keycode = ghostcat_hidraw_get_keycode_from_keyboard_usage(device,
+									macro.keys[j].keycode);
+		ghostcat_button_macro_set_event(m,
+					      j * 2,
+					      pressed ? GHOSTCAT_MACRO_EVENT_KEY_PRESSED : GHOSTCAT_MACRO_EVENT_KEY_RELEASED,
+					      keycode);
+		if (macro.keys[j].time)
+			time = macro.keys[j].time;
+		else
+			time = pressed ? 10 : 50;
+		ghostcat_button_macro_set_event(m,
+					      j * 2 + 1,
+					      GHOSTCAT_MACRO_EVENT_WAIT,
+					      time);
+
+		log_raw(device->ratbag,
+			"    - %s %s\n",
+			libevdev_event_code_get_name(EV_KEY, keycode),
+			pressed ? "pressed" : "released");
+	}
+
+	ghostcat_button_copy_macro(button, m);
+	ghostcat_button_macro_unref(m);
+
+	return 0;
+}
+
+static int
+roccat_macro_from_action(struct ghostcat_device *device,
+			 const struct ghostcat_button_action *action,
+			 struct roccat_macro *macro, unsigned int max_keys)
+{
+	const struct ghostcat_macro_event *event;
+	unsigned int i, count = 0;
+
+	if (!action->macro)
+		return -EINVAL;
+
+	for (i = 0; i < MAX_MACRO_EVENTS && count < max_keys; i++) {
+		event = &action->macro->events[i];
+
+		if (event->type == GHOSTCAT_MACRO_EVENT_INVALID)
+			return -EINVAL; /* should not happen, ever */
+
+		if (event->type == GHOSTCAT_MACRO_EVENT_NONE)
+			break;
+
+		/* waits are stored with the key before them, ignore
+		 * the first wait */
+		if (event->type == GHOSTCAT_MACRO_EVENT_WAIT) {
+			if (count)
+				macro->keys[count - 1].time = event->event.timeout;
+			continue;
+		}
+
+		macro->keys[count].keycode =
+			ghostcat_hidraw_get_keyboard_usage_from_keycode(device,
+								      event->event.key);
+		macro->keys[count].flag = event->type == GHOSTCAT_MACRO_EVENT_KEY_PRESSED ?
+			ROCCAT_MACRO_KEY_PRESSED : ROCCAT_MACRO_KEY_RELEASED;
+		count++;
+	}
+
+	if (action->macro->group)
+		snprintf(macro->group, sizeof(macro->group), "%s", action->macro->group);
+	if (action->macro->name)
+		snprintf(macro->name, sizeof(macro->name), "%s", action->macro->name);
+	macro->length = count;
+
+	return 0;
+}
+
+static int
+roccat_write_macro_single(struct ghostcat_button *button,
+			  const struct roccat_macro *macro)
+{
+	struct ghostcat_device *device = button->profile->device;
+	struct roccat_macro_single report = {0};
+	uint8_t *buf = (uint8_t *)&report;
+
+	report.report_id = ROCCAT_REPORT_ID_MACRO;
+	report.report_length = ROCCAT_MACRO_SIZE_SINGLE;
+	report.profile = button->profile->index;
+	report.button_index = button->index;
+	report.active = 0x01;
+	strcpy(report.group, "g0");
+	memcpy(report.name, macro->name, sizeof(report.name) - 1);
+	report.length = macro->length;
+	memcpy(report.keys, macro->keys, macro->length * sizeof(report.keys[0]));
+	roccat_set_crc(buf, sizeof(report));
+
+	return roccat_set_feature_report(device, buf, sizeof(report));
+}
+
+static int
+roccat_write_macro_banked(struct ghostcat_button *button,
+			  const struct roccat_macro *macro)
+{
+	struct ghostcat_device *device = button->profile->device;
+	struct roccat_macro_banked report = {0};
+	static const char default_group[sizeof(report.group)] = "libratbag macros";
+	uint8_t *buf = (uint8_t *)&report;
+	uint8_t bank[ROCCAT_MACRO_SIZE_BANK] = {0};
+	int rc;
+
+	report.report_id = ROCCAT_REPORT_ID_MACRO;
+	report.bank = 1;
+	report.profile = button->profile->index;
+	report.button_index = button->index;
+	report.repeats = 0;
+	memcpy(report.group,
+	       macro->group[0] ? macro->group : default_group,
+	       sizeof(report.group));
+	memcpy(report.name, macro->name, sizeof(report.name));
+	report.length = macro->length;
+	memcpy(report.keys, macro->keys, macro->length * sizeof(report.keys[0]));
+
+	rc = roccat_set_feature_report(device, buf, ROCCAT_MACRO_SIZE_BANK);
+	if (rc)
+		return rc;
+
+	bank[0] = ROCCAT_REPORT_ID_MACRO;
+	bank[1] = 2;
+	memcpy(bank + 2, buf + ROCCAT_MACRO_SIZE_BANK,
+	       sizeof(report) - ROCCAT_MACRO_SIZE_BANK);
+
+	return roccat_set_feature_report(device, bank, sizeof(bank));
+}
+
+static int
+roccat_write_macro(struct ghostcat_button *button)
+{
+	struct ghostcat_device *device = button->profile->device;
+	const struct roccat_model *model = roccat_get_data(device)->model;
+	struct roccat_macro macro = {0};
+	int rc;
+
+	if (model->macro_format == ROCCAT_MACRO_FORMAT_BANKED) {
+		rc = roccat_macro_from_action(device, &button->action, &macro,
+					      ROCCAT_MACRO_MAX_KEYS_BANKED);
+		if (rc == 0)
+			rc = roccat_write_macro_banked(button, &macro);
+	} else {
+		rc = roccat_macro_from_action(device, &button->action, &macro,
+					      ROCCAT_MACRO_MAX_KEYS_SINGLE);
+		if (rc == 0)
+			rc = roccat_write_macro_single(button, &macro);
+	}
+
+	if (rc)
+		log_error(device->ratbag,
+			  "unable to write the macro of button %d to the device: '%s' (%d)\n",
+			  button->index, strerror(-rc), rc);
+
+	return rc;
+}
+
+static void
+roccat_read_buttons(struct ghostcat_profile *profile)
+{
+	struct ghostcat_device *device = profile->device;
+	struct roccat_data *drv_data = roccat_get_data(device);
+	const uint8_t *report = drv_data->key_mapping[profile->index];
+	const struct ghostcat_button_action *action;
+	struct ghostcat_button *button;
+
+	ghostcat_profile_for_each_button(profile, button) {
+		action = roccat_raw_to_button_action(drv_data->model,
+						     report[3 + button->index * 3]);
+		if (action) {
+			ghostcat_button_set_action(button, action);
+			/* read by roccat_load_macro() when first needed */
+			if (action->type == GHOSTCAT_BUTTON_ACTION_TYPE_MACRO)
+				button->macro_needs_load = true;
+		}
+
+		ghostcat_button_enable_action_type(button, GHOSTCAT_BUTTON_ACTION_TYPE_BUTTON);
+		ghostcat_button_enable_action_type(button, GHOSTCAT_BUTTON_ACTION_TYPE_SPECIAL);
+		ghostcat_button_enable_action_type(button, GHOSTCAT_BUTTON_ACTION_TYPE_MACRO);
+	}
+}
+
+static void
+roccat_read_profile(struct ghostcat_profile *profile)
+{
+	struct ghostcat_device *device = profile->device;
+	struct roccat_data *drv_data = roccat_get_data(device);
+	const struct roccat_model *model = drv_data->model;
+	uint8_t *settings = drv_data->settings[profile->index];
+	uint8_t *key_mapping = drv_data->key_mapping[profile->index];
+	unsigned int key_mapping_size = ROCCAT_KEY_MAPPING_SIZE(model->num_buttons);
+	int rc;
+
+	roccat_select(device, profile->index, ROCCAT_CONFIG_SETTINGS);
+	rc = roccat_get_feature_report(device, ROCCAT_REPORT_ID_SETTINGS,
+				       settings, model->settings_size);
+	if (rc) {
+		log_error(device->ratbag,
+			  "Error while reading the settings of profile %d: %s (%d)\n",
+			  profile->index, strerror(-rc), rc);
+	} else {
+		if (model->settings_checksum &&
+		    !roccat_crc_is_valid(device, settings, model->settings_size))
+			log_error(device->ratbag,
+				  "Invalid checksum in the settings of profile %d, continuing...\n",
+				  profile->index);
+
+		model->read_settings(profile, settings);
+	}
+
+	roccat_select(device, profile->index, ROCCAT_CONFIG_KEY_MAPPING);
+	rc = roccat_get_feature_report(device, ROCCAT_REPORT_ID_KEY_MAPPING,
+				       key_mapping, key_mapping_size);
+	if (rc) {
+		log_error(device->ratbag,
+			  "Error while reading the key mapping of profile %d: %s (%d)\n",
+			  profile->index, strerror(-rc), rc);
+		return;
+	}
+
+	if (!roccat_crc_is_valid(device, key_mapping, key_mapping_size))
+		log_error(device->ratbag,
+			  "Invalid checksum in the key mapping of profile %d, continuing...\n",
+			  profile->index);
+
+	roccat_read_buttons(profile);
+}
+
+static int
+roccat_write_settings(struct ghostcat_profile *profile)
+{
+	struct ghostcat_device *device = profile->device;
+	struct roccat_data *drv_data = roccat_get_data(device);
+	const struct roccat_model *model = drv_data->model;
+	uint8_t *report = drv_data->settings[profile->index];
+	int rc;
+
+	rc = model->write_settings(profile, report);
+	if (rc)
+		return rc;
+
+	/* the second byte is a per-model magic number, keep what the
+	 * device sent us */
+	report[0] = ROCCAT_REPORT_ID_SETTINGS;
+	if (!report[1])
+		report[1] = model->settings_size;
+	report[2] = profile->index;
+	if (model->settings_checksum)
+		roccat_set_crc(report, model->settings_size);
+
+	return roccat_set_feature_report(device, report, model->settings_size);
+}
+
+static int
+roccat_write_key_mapping(struct ghostcat_profile *profile)
+{
+	struct ghostcat_device *device = profile->device;
+	struct roccat_data *drv_data = roccat_get_data(device);
+	const struct roccat_model *model = drv_data->model;
+	uint8_t *report = drv_data->key_mapping[profile->index];
+	unsigned int size = ROCCAT_KEY_MAPPING_SIZE(model->num_buttons);
+	struct ghostcat_button *button;
+	int raw, rc;
+
+	ghostcat_profile_for_each_button(profile, button) {
+		raw = roccat_button_action_to_raw(model, &button->action);
+		if (raw < 0)
+			return raw;
+
+		report[3 + button->index * 3] = raw;
+	}
+
+	report[0] = ROCCAT_REPORT_ID_KEY_MAPPING;
+	if (!report[1])
+		report[1] = size;
+	report[2] = profile->index;
+	roccat_set_crc(report, size);
+
+	rc = roccat_select(device, profile->index, ROCCAT_CONFIG_KEY_MAPPING);
+	if (rc)
+		return rc;
+
+	return roccat_set_feature_report(device, report, size);
+}
+
+static int
+roccat_write_profile(struct ghostcat_profile *profile)
+{
+	struct ghostcat_device *device = profile->device;
+	struct ghostcat_button *button;
+	int rc;
+
+	/* all changed macros first, so the key mapping never points to a
+	 * button whose macro is not written yet */
+	ghostcat_profile_for_each_button(profile, button) {
+		if (!button->dirty ||
+		    button->action.type != GHOSTCAT_BUTTON_ACTION_TYPE_MACRO)
+			continue;
+
+		rc = roccat_write_macro(button);
+		if (rc)
+			return rc;
+	}
+
+	if (profile->dirty & (GHOSTCAT_PROFILE_DIRTY_RATE |
+			      GHOSTCAT_PROFILE_DIRTY_RESOLUTIONS |
+			      GHOSTCAT_PROFILE_DIRTY_LEDS)) {
+		rc = roccat_write_settings(profile);
+		if (rc) {
+			log_error(device->ratbag,
+				  "unable to write the settings of profile %d: '%s' (%d)\n",
+				  profile->index, strerror(-rc), rc);
+			return rc;
+		}
+	}
+
+	if (profile->dirty & GHOSTCAT_PROFILE_DIRTY_BUTTONS) {
+		rc = roccat_write_key_mapping(profile);
+		if (rc) {
+			log_error(device->ratbag,
+				  "unable to write the key mapping of profile %d: '%s' (%d)\n",
+				  profile->index, strerror(-rc), rc);
+			return rc;
+		}
+	}
+
+	log_raw(device->ratbag, "profile: %d written\n", profile->index);
+
+	return 0;
+}
+
+int
+roccat_commit(struct ghostcat_device *device)
+{
+	struct ghostcat_profile *profile;
+	int rc;
+
+	ghostcat_device_for_each_profile(device, profile) {
+		if (!profile->dirty)
+			continue;
+
+		rc = roccat_write_profile(profile);
+		if (rc)
+			return rc;
+	}
+
+	return 0;
+}
+
+int
+roccat_probe(struct ghostcat_device *device, const struct roccat_model *model)
+{
+	struct ghostcat_profile *profile;
+	struct roccat_data *drv_data;
+	int active_idx;
+	int rc;
+
+	assert(model->num_profiles <= ROCCAT_MAX_PROFILES);
+	assert(model->num_buttons <= ROCCAT_MAX_BUTTONS);
+	assert(model->settings_size <= ROCCAT_MAX_SETTINGS_SIZE);
+
+	rc = ghostcat_open_hidraw(device);
+	if (rc)
+		return rc;
+
+	if (!ghostcat_hidraw_has_report(device, ROCCAT_REPORT_ID_KEY_MAPPING)) {
+		ghostcat_close_hidraw(device);
+		return -ENODEV;
+	}
+
+	drv_data = zalloc(sizeof(*drv_data));
+	drv_data->model = model;
+	ghostcat_set_drv_data(device, drv_data);
+
+	ghostcat_device_init_profiles(device,
+				    model->num_profiles,
+				    model->num_resolutions,
+				    model->num_buttons,
+				    model->num_leds);
+
+	ghostcat_device_for_each_profile(device, profile)
+		roccat_read_profile(profile);
+
+	active_idx = roccat_current_profile(device);
+	if (active_idx < 0) {
+		log_error(device->ratbag,
+			  "Can't talk to the mouse: '%s' (%d)\n",
+			  strerror(-active_idx),
+			  active_idx);
+		rc = -ENODEV;
+		goto err;
+	}
+
+	ghostcat_device_for_each_profile(device, profile) {
+		if (profile->index == (unsigned int)active_idx) {
+			profile->is_active = true;
+			break;
+		}
+	}
+
+	log_raw(device->ratbag,
+		"'%s' is in profile %d\n",
+		ghostcat_device_get_name(device),
+		active_idx);
+
+	return 0;
+
+err:
+	free(drv_data);
+	ghostcat_set_drv_data(device, NULL);
+	ghostcat_close_hidraw(device);
+	return rc;
+}
+
+void
+roccat_remove(struct ghostcat_device *device)
+{
+	ghostcat_close_hidraw(device);
+	free(ghostcat_get_drv_data(device));
+}
@@ -0,0 +1,124 @@
+/*
+ * Copyright © 2015 Red Hat, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "libghostcat-private.h"
+
+/*
+ * The protocol shared by the Roccat Kone mice. Every model has the same
+ * reports: a status/selector report, the active profile, and per profile
+ * a settings report, a key mapping report and one macro per button. The
+ * models differ in the number of profiles and buttons, the layout of the
+ * settings report and the way macros are transferred, which is described
+ * by a struct roccat_model. The drivers only parse and fill the settings
+ * report.
+ */
+
+#define ROCCAT_REPORT_ID_CONFIGURE_PROFILE	4
+#define ROCCAT_REPORT_ID_PROFILE		5
+#define ROCCAT_REPORT_ID_SETTINGS		6
+#define ROCCAT_REPORT_ID_KEY_MAPPING		7
+#define ROCCAT_REPORT_ID_MACRO			8
+
+/* the largest values of all models */
+#define ROCCAT_MAX_PROFILES			5
+#define ROCCAT_MAX_BUTTONS			24
+#define ROCCAT_MAX_SETTINGS_SIZE		43
+
+/* key mapping: id, length, profile, 3 bytes per button, checksum */
+#define ROCCAT_KEY_MAPPING_SIZE(num_buttons_)	(3 + (num_buttons_) * 3 + 2)
+
+struct roccat_button_mapping {
+	uint8_t raw;
+	struct ghostcat_button_action action;
+};
+
+enum roccat_macro_format {
+	/* one 2082 byte report with a checksum, Kone XTD and Kone Pure */
+	ROCCAT_MACRO_FORMAT_SINGLE,
+	/* two 1026 byte banks without a checksum, Kone EMP */
+	ROCCAT_MACRO_FORMAT_BANKED,
+};
+
+struct roccat_model {
+	unsigned int num_profiles;
+	unsigned int num_buttons;
+	unsigned int num_resolutions;
+	unsigned int num_leds;
+
+	/* including the checksum, if the model has one */
+	unsigned int settings_size;
+	bool settings_checksum;
+
+	enum roccat_macro_format macro_format;
+
+	const struct roccat_button_mapping *button_mapping;
+	size_t num_button_mapping;
+
+	/**
+	 * Fill the profile's report rate, resolutions and LEDs from its
+	 * settings report.
+	 */
+	void (*read_settings)(struct ghostcat_profile *profile,
+			      const uint8_t *report);
+
+	/**
+	 * Update the profile's settings report from the profile. The report
+	 * id, length, profile and checksum are filled in by the caller.
+	 *
+	 * @return 0 or -EINVAL if a value is out of range
+	 */
+	int (*write_settings)(struct ghostcat_profile *profile,
+			      uint8_t *report);
+};
+
+/* The drv_data of every Roccat driver */
+struct roccat_data {
+	const struct roccat_model *model;
+	uint8_t settings[ROCCAT_MAX_PROFILES][ROCCAT_MAX_SETTINGS_SIZE];
+	uint8_t key_mapping[ROCCAT_MAX_PROFILES][ROCCAT_KEY_MAPPING_SIZE(ROCCAT_MAX_BUTTONS)];
+};
+
+/**
+ * Probe a device of the given model: read the settings and key mapping of
+ * every profile. Macros are only read when first requested, see
+ * roccat_load_macro().
+ */
+int
+roccat_probe(struct ghostcat_device *device, const struct roccat_model *model);
+
+void
+roccat_remove(struct ghostcat_device *device);
+
+int
+roccat_commit(struct ghostcat_device *device);
+
+int
+roccat_set_active_profile(struct ghostcat_device *device, unsigned int index);
+
+int
+roccat_load_macro(struct ghostcat_button *button);
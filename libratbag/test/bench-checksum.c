@@ -0,0 +1,121 @@
+/*
+ * libghostcat checksum benchmark
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Throughput of the shared checksums compared to the byte-by-byte
+ * versions the drivers used before. Run with "meson test --benchmark".
+ */
+
+#include <config.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "libghostcat-checksum.h"
+
+#define BUFFER_SIZE (1024 * 1024)
+#define ROUNDS 64
+
+static uint16_t
+crc_ccitt_bytewise(const uint8_t *data, size_t len)
+{
+	uint16_t crc = 0xffff;
+
+	for (size_t i = 0; i < len; i++) {
+		uint16_t temp = (crc >> 8) ^ data[i];
+
+		crc <<= 8;
+		uint16_t quick = temp ^ (temp >> 4);
+		crc ^= quick;
+		quick <<= 5;
+		crc ^= quick;
+		quick <<= 7;
+		crc ^= quick;
+	}
+
+	return crc;
+}
+
+static uint32_t
+checksum_sum_bytewise(const uint8_t *data, size_t len)
+{
+	uint32_t sum = 0;
+
+	for (size_t i = 0; i < len; i++)
+		sum += data[i];
+
+	return sum;
+}
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* volatile so the compiler keeps every round */
+static volatile uint32_t sink;
+
+#define BENCH(name_, fn_, buf_) do { \
+	double start_ = now(); \
+	for (int r_ = 0; r_ < ROUNDS; r_++) \
+		sink += fn_(buf_, BUFFER_SIZE); \
+	double secs_ = now() - start_; \
+	printf("%-24s %8.1f MiB/s\n", name_, ROUNDS / secs_); \
+} while (0)
+
+int main(void)
+{
+	uint8_t *buf;
+	uint32_t seed = 1;
+
+	buf = malloc(BUFFER_SIZE);
+	if (!buf)
+		return EXIT_FAILURE;
+
+	for (size_t i = 0; i < BUFFER_SIZE; i++) {
+		seed = seed * 1103515245 + 12345;
+		buf[i] = seed >> 16;
+	}
+
+	if (ghostcat_crc_ccitt(buf, BUFFER_SIZE) != crc_ccitt_bytewise(buf, BUFFER_SIZE) ||
+	    ghostcat_checksum_sum(buf, BUFFER_SIZE) != checksum_sum_bytewise(buf, BUFFER_SIZE)) {
+		fprintf(stderr, "checksum mismatch\n");
+		free(buf);
+		return EXIT_FAILURE;
+	}
+
+	BENCH("crc-ccitt (bytewise)", crc_ccitt_bytewise, buf);
+	BENCH("crc-ccitt (slice-by-8)", ghostcat_crc_ccitt, buf);
+	BENCH("sum (bytewise)", checksum_sum_bytewise, buf);
+	BENCH("sum (word-wise)", ghostcat_checksum_sum, buf);
+
+	free(buf);
+
+	return EXIT_SUCCESS;
+}
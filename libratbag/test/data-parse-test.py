@@ -302,6 +302,7 @@ SINOWEALTH_REQUIRED_KEYS = (
 SINOWEALTH_PERMITTED_KEYS = (
     *SINOWEALTH_REQUIRED_KEYS,
     "Buttons",
+    "MaxReportRate",
     "Profiles",
     "SensorType",
 )
@@ -336,6 +337,8 @@ def parse_data_file(path: str):
                 assert key in device_section
             for key in device_section:
                 assert key in SINOWEALTH_PERMITTED_KEYS
+            if "MaxReportRate" in device_section:
+                assert int(device_section["MaxReportRate"]) in (1000, 2000, 4000, 8000)
     else:
         for s in data.sections():
             assert s in permitted_sections
@@ -29,10 +29,13 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <limits.h>
+#include <poll.h>
 #include <sys/resource.h>
 
+#include "libghostcat-image.h"
 #include "libghostcat-private.h"
 #include "libghostcat.h"
 #include "libghostcat-util.h"
@@ -396,6 +399,53 @@ START_TEST(device_profiles_get_invalid)
 }
 END_TEST
 
+START_TEST(device_profiles_indexed)
+{
+	struct ghostcat *r;
+	struct ghostcat_device *d;
+	struct ghostcat_profile *profile;
+	struct ghostcat_resolution *resolution;
+	struct ghostcat_button *button;
+	struct ghostcat_led *led;
+	int device_freed_count = 0;
+
+	struct ghostcat_test_device td = sane_device;
+
+	td.destroyed_data = &device_freed_count;
+
+	r = ghostcat_create_context(&abort_iface, NULL);
+	d = ghostcat_device_new_test_device(r, &td);
+
+	/* The index accessors and the list iteration must hand out
+	 * the same objects */
+	ghostcat_device_for_each_profile(d, profile) {
+		ck_assert_ptr_eq(profile, &d->profile_array[profile->index]);
+		ck_assert_ptr_eq(profile, ghostcat_device_get_profile(d, profile->index));
+		ghostcat_profile_unref(profile);
+
+		ghostcat_profile_for_each_resolution(profile, resolution) {
+			ck_assert_ptr_eq(resolution,
+					 ghostcat_profile_get_resolution(profile, resolution->index));
+			ghostcat_resolution_unref(resolution);
+		}
+		ghostcat_profile_for_each_button(profile, button) {
+			ck_assert_ptr_eq(button,
+					 ghostcat_profile_get_button(profile, button->index));
+			ghostcat_button_unref(button);
+		}
+		ghostcat_profile_for_each_led(profile, led) {
+			ck_assert_ptr_eq(led,
+					 ghostcat_profile_get_led(profile, led->index));
+			ghostcat_led_unref(led);
+		}
+	}
+
+	ghostcat_device_unref(d);
+	ghostcat_unref(r);
+	ck_assert_int_eq(device_freed_count, 1);
+}
+END_TEST
+
 START_TEST(device_resolutions)
 {
 	struct ghostcat *r;
@@ -964,6 +1014,514 @@ START_TEST(device_leds_set)
 }
 END_TEST
 
+static void
+leds_shown(struct ghostcat_device *device,
+	   const struct ghostcat_color *colors,
+	   uint32_t changed,
+	   void *data)
+{
+	uint32_t *mask = data;
+
+	/* restoring the profile's LEDs is reported as all LEDs changed */
+	*mask = colors ? changed : ~0U;
+}
+
+START_TEST(device_leds_show)
+{
+	struct ghostcat *r;
+	struct ghostcat_device *d;
+	struct ghostcat_profile *p;
+	struct ghostcat_led *l;
+	enum ghostcat_error_code rc;
+	uint32_t changed = 0;
+	struct ghostcat_test_device td = sane_device;
+	struct ghostcat_color colors[2] = {
+		{ .red = 10, .green = 20, .blue = 30 },
+		{ .red = 40, .green = 50, .blue = 60 },
+	};
+
+	td.leds_shown = leds_shown;
+	td.leds_shown_data = &changed;
+
+	r = ghostcat_create_context(&abort_iface, NULL);
+	d = ghostcat_device_new_test_device(r, &td);
+	ck_assert_int_eq(ghostcat_device_get_num_leds(d), 2);
+
+	rc = ghostcat_device_show_leds(d, colors, 1);
+	ck_assert_int_eq(rc, GHOSTCAT_ERROR_VALUE);
+	ck_assert_int_eq(changed, 0);
+
+	/* nothing shown yet, every LED is written */
+	rc = ghostcat_device_show_leds(d, colors, 2);
+	ck_assert_int_eq(rc, GHOSTCAT_SUCCESS);
+	ck_assert_int_eq(changed, 0x3);
+
+	/* the same frame again is not written at all */
+	changed = 0;
+	rc = ghostcat_device_show_leds(d, colors, 2);
+	ck_assert_int_eq(rc, GHOSTCAT_SUCCESS);
+	ck_assert_int_eq(changed, 0);
+
+	colors[1].blue = 61;
+	rc = ghostcat_device_show_leds(d, colors, 2);
+	ck_assert_int_eq(rc, GHOSTCAT_SUCCESS);
+	ck_assert_int_eq(changed, 0x2);
+
+	/* a commit of the active profile's LEDs overwrites the frame */
+	p = ghostcat_device_get_profile(d, 0);
+	l = ghostcat_profile_get_led(p, 0);
+	ghostcat_led_set_mode(l, GHOSTCAT_LED_ON);
+	rc = ghostcat_device_commit(d);
+	ck_assert_int_eq(rc, GHOSTCAT_SUCCESS);
+
+	changed = 0;
+	rc = ghostcat_device_show_leds(d, colors, 2);
+	ck_assert_int_eq(rc, GHOSTCAT_SUCCESS);
+	ck_assert_int_eq(changed, 0x3);
+
+	changed = 0;
+	rc = ghostcat_device_restore_leds(d);
+	ck_assert_int_eq(rc, GHOSTCAT_SUCCESS);
+	ck_assert_int_eq(changed, ~0U);
+
+	/* nothing to restore a second time */
+	changed = 0;
+	rc = ghostcat_device_restore_leds(d);
+	ck_assert_int_eq(rc, GHOSTCAT_SUCCESS);
+	ck_assert_int_eq(changed, 0);
+
+	ghostcat_led_unref(l);
+	ghostcat_profile_unref(p);
+	ghostcat_device_unref(d);
+	ghostcat_unref(r);
+}
+END_TEST
+
+static void
+keys_written(struct ghostcat_device *device,
+	     const struct ghostcat_key_color *keys,
+	     unsigned int num_keys,
+	     void *data)
+{
+	uint32_t *mask = data;
+
+	for (unsigned int i = 0; i < num_keys; i++)
+		*mask |= 1U << keys[i].key;
+}
+
+START_TEST(device_keys)
+{
+	struct ghostcat *r;
+	struct ghostcat_device *d;
+	struct ghostcat_profile *p;
+	struct ghostcat_led *l;
+	enum ghostcat_error_code rc;
+	uint32_t written = 0;
+	struct ghostcat_test_device td = sane_device;
+	/* a 3x2 keyboard with a hole in the middle of the bottom row */
+	static const uint16_t layout[] = {
+		1, 2, 3,
+		4, 0, 5,
+	};
+	struct ghostcat_color frame[6] = {0};
+	struct ghostcat_color c = { .red = 255, .green = 0, .blue = 0 };
+
+	r = ghostcat_create_context(&abort_iface, NULL);
+
+	/* no per-key lighting */
+	d = ghostcat_device_new_test_device(r, &td);
+	ck_assert_int_eq(ghostcat_device_get_key_frame_width(d), 0);
+	ck_assert_int_eq(ghostcat_device_get_key_frame_height(d), 0);
+	rc = ghostcat_device_set_key_colors(d, 0, 0, 1, 1, &c);
+	ck_assert_int_eq(rc, GHOSTCAT_ERROR_CAPABILITY);
+	rc = ghostcat_device_show_keys(d);
+	ck_assert_int_eq(rc, GHOSTCAT_ERROR_CAPABILITY);
+	ghostcat_device_unref(d);
+
+	td.key_width = 3;
+	td.key_height = 2;
+	td.key_layout = layout;
+	td.keys_written = keys_written;
+	td.keys_written_data = &written;
+
+	d = ghostcat_device_new_test_device(r, &td);
+	ck_assert_int_eq(ghostcat_device_get_key_frame_width(d), 3);
+	ck_assert_int_eq(ghostcat_device_get_key_frame_height(d), 2);
+	ck_assert(ghostcat_device_has_key(d, 0, 1));
+	ck_assert(!ghostcat_device_has_key(d, 1, 1));
+	ck_assert(!ghostcat_device_has_key(d, 3, 0));
+
+	/* nothing shown yet, every key is written */
+	rc = ghostcat_device_set_key_colors(d, 0, 0, 3, 2, frame);
+	ck_assert_int_eq(rc, GHOSTCAT_SUCCESS);
+	rc = ghostcat_device_show_keys(d);
+	ck_assert_int_eq(rc, GHOSTCAT_SUCCESS);
+	ck_assert_int_eq(written, 0x3e);
+
+	/* the same frame again is not written at all */
+	written = 0;
+	rc = ghostcat_device_set_key_colors(d, 0, 0, 3, 2, frame);
+	ck_assert_int_eq(rc, GHOSTCAT_SUCCESS);
+	rc = ghostcat_device_show_keys(d);
+	ck_assert_int_eq(rc, GHOSTCAT_SUCCESS);
+	ck_assert_int_eq(written, 0);
+
+	/* a rectangle only writes its keys, the hole is skipped */
+	rc = ghostcat_device_set_key_colors(d, 1, 0, 1, 2, (struct ghostcat_color[]){ c, c });
+	ck_assert_int_eq(rc, GHOSTCAT_SUCCESS);
+	rc = ghostcat_device_show_keys(d);
+	ck_assert_int_eq(rc, GHOSTCAT_SUCCESS);
+	ck_assert_int_eq(written, 1U << 2);
+
+	/* a key set back before it was shown is not written */
+	written = 0;
+	rc = ghostcat_device_set_key_colors(d, 2, 1, 1, 1, &c);
+	ck_assert_int_eq(rc, GHOSTCAT_SUCCESS);
+	rc = ghostcat_device_set_key_colors(d, 2, 1, 1, 1, &frame[5]);
+	ck_assert_int_eq(rc, GHOSTCAT_SUCCESS);
+	rc = ghostcat_device_show_keys(d);
+	ck_assert_int_eq(rc, GHOSTCAT_SUCCESS);
+	ck_assert_int_eq(written, 0);
+
+	rc = ghostcat_device_set_key_colors(d, 2, 0, 2, 1, frame);
+	ck_assert_int_eq(rc, GHOSTCAT_ERROR_VALUE);
+	rc = ghostcat_device_set_key_colors(d, 0, 2, 1, 1, frame);
+	ck_assert_int_eq(rc, GHOSTCAT_ERROR_VALUE);
+	rc = ghostcat_device_set_key_colors(d, 0, 0, 0, 1, frame);
+	ck_assert_int_eq(rc, GHOSTCAT_ERROR_VALUE);
+	rc = ghostcat_device_set_key_colors(d, 0, 0, 1, 1,
+					    &(struct ghostcat_color){ .red = 256 });
+	ck_assert_int_eq(rc, GHOSTCAT_ERROR_VALUE);
+
+	/* a commit of the active profile's LEDs may overwrite the keys */
+	p = ghostcat_device_get_profile(d, 0);
+	l = ghostcat_profile_get_led(p, 0);
+	ghostcat_led_set_mode(l, GHOSTCAT_LED_ON);
+	rc = ghostcat_device_commit(d);
+	ck_assert_int_eq(rc, GHOSTCAT_SUCCESS);
+
+	written = 0;
+	rc = ghostcat_device_show_keys(d);
+	ck_assert_int_eq(rc, GHOSTCAT_SUCCESS);
+	ck_assert_int_eq(written, 0x3e);
+
+	ghostcat_led_unref(l);
+	ghostcat_profile_unref(p);
+	ghostcat_device_unref(d);
+	ghostcat_unref(r);
+}
+END_TEST
+
+START_TEST(device_dirty_fields)
+{
+	struct ghostcat *r;
+	struct ghostcat_device *d;
+	struct ghostcat_profile *p;
+	struct ghostcat_led *l0, *l1;
+	struct ghostcat_resolution *res1, *res2;
+	struct ghostcat_color c = { .red = 1, .green = 2, .blue = 3 };
+	int device_freed_count = 0;
+	enum ghostcat_error_code rc;
+
+	struct ghostcat_test_device td = sane_device;
+
+	td.destroyed_data = &device_freed_count;
+
+	r = ghostcat_create_context(&abort_iface, NULL);
+	d = ghostcat_device_new_test_device(r, &td);
+
+	p = ghostcat_device_get_profile(d, 0);
+	ck_assert(p != NULL);
+	ck_assert_int_eq(p->dirty, 0);
+
+	l0 = ghostcat_profile_get_led(p, 0);
+	l1 = ghostcat_profile_get_led(p, 1);
+
+	ghostcat_led_set_color(l0, c);
+	ck_assert_int_eq(l0->dirty, GHOSTCAT_LED_DIRTY_COLOR);
+	ck_assert_int_eq(l1->dirty, 0);
+	ck_assert_int_eq(p->dirty, GHOSTCAT_PROFILE_DIRTY_LEDS);
+	ck_assert(ghostcat_profile_is_dirty(p));
+
+	ghostcat_led_set_brightness(l0, 10);
+	ck_assert_int_eq(l0->dirty, GHOSTCAT_LED_DIRTY_COLOR | GHOSTCAT_LED_DIRTY_BRIGHTNESS);
+
+	rc = ghostcat_device_commit(d);
+	ck_assert_int_eq(rc, GHOSTCAT_SUCCESS);
+	ck_assert_int_eq(l0->dirty, 0);
+	ck_assert_int_eq(p->dirty, 0);
+	ck_assert(!ghostcat_profile_is_dirty(p));
+
+	res1 = ghostcat_profile_get_resolution(p, 1);
+	res2 = ghostcat_profile_get_resolution(p, 2);
+
+	rc = ghostcat_resolution_set_active(res1);
+	ck_assert_int_eq(rc, GHOSTCAT_SUCCESS);
+	rc = ghostcat_device_commit(d);
+	ck_assert_int_eq(rc, GHOSTCAT_SUCCESS);
+
+	/* the previously active resolution changes too */
+	rc = ghostcat_resolution_set_active(res2);
+	ck_assert_int_eq(rc, GHOSTCAT_SUCCESS);
+	ck_assert_int_eq(res1->dirty, GHOSTCAT_RESOLUTION_DIRTY_ACTIVE);
+	ck_assert_int_eq(res2->dirty, GHOSTCAT_RESOLUTION_DIRTY_ACTIVE);
+	ck_assert_int_eq(p->dirty, GHOSTCAT_PROFILE_DIRTY_RESOLUTIONS);
+
+	rc = ghostcat_profile_set_report_rate(p, 500);
+	ck_assert_int_eq(rc, GHOSTCAT_SUCCESS);
+	ck_assert_int_eq(p->dirty, GHOSTCAT_PROFILE_DIRTY_RESOLUTIONS |
+				   GHOSTCAT_PROFILE_DIRTY_RATE);
+
+	ghostcat_resolution_unref(res1);
+	ghostcat_resolution_unref(res2);
+	ghostcat_led_unref(l0);
+	ghostcat_led_unref(l1);
+	ghostcat_profile_unref(p);
+	ghostcat_device_unref(d);
+	ghostcat_unref(r);
+	ck_assert_int_eq(device_freed_count, 1);
+}
+END_TEST
+
+START_TEST(device_stats)
+{
+	struct ghostcat *r;
+	struct ghostcat_device *d;
+	uint64_t limit, total = 0;
+	int device_freed_count = 0;
+	enum ghostcat_error_code rc;
+
+	struct ghostcat_test_device td = sane_device;
+
+	td.destroyed_data = &device_freed_count;
+
+	r = ghostcat_create_context(&abort_iface, NULL);
+	d = ghostcat_device_new_test_device(r, &td);
+
+	ck_assert_int_eq(ghostcat_device_get_stat(d, GHOSTCAT_DEVICE_STAT_COMMITS), 0);
+	ck_assert_int_eq(ghostcat_device_get_stat(d, GHOSTCAT_DEVICE_STAT_TRANSFERS), 0);
+
+	rc = ghostcat_device_commit(d);
+	ck_assert_int_eq(rc, GHOSTCAT_SUCCESS);
+	rc = ghostcat_device_commit(d);
+	ck_assert_int_eq(rc, GHOSTCAT_SUCCESS);
+	ck_assert_int_eq(ghostcat_device_get_stat(d, GHOSTCAT_DEVICE_STAT_COMMITS), 2);
+	ck_assert_int_ge(ghostcat_device_get_stat(d, GHOSTCAT_DEVICE_STAT_COMMIT_TIME_TOTAL_US),
+			 ghostcat_device_get_stat(d, GHOSTCAT_DEVICE_STAT_COMMIT_TIME_US));
+
+	for (unsigned int i = 0; i < GHOSTCAT_DEVICE_LATENCY_BUCKETS; i++)
+		total += ghostcat_device_get_latency_histogram(d, i, NULL);
+	ck_assert_int_eq(total, 0);
+
+	ghostcat_device_get_latency_histogram(d, 0, &limit);
+	ck_assert_int_eq(limit, 128);
+	ghostcat_device_get_latency_histogram(d, 1, &limit);
+	ck_assert_int_eq(limit, 256);
+	ghostcat_device_get_latency_histogram(d, GHOSTCAT_DEVICE_LATENCY_BUCKETS - 1, &limit);
+	ck_assert_int_eq(limit, 0);
+	ck_assert_int_eq(ghostcat_device_get_latency_histogram(d, GHOSTCAT_DEVICE_LATENCY_BUCKETS, &limit), 0);
+
+	ghostcat_device_reset_stats(d);
+	ck_assert_int_eq(ghostcat_device_get_stat(d, GHOSTCAT_DEVICE_STAT_COMMITS), 0);
+
+	ghostcat_device_unref(d);
+	ghostcat_unref(r);
+	ck_assert_int_eq(device_freed_count, 1);
+}
+END_TEST
+
+START_TEST(device_image)
+{
+	struct ghostcat *r;
+	struct ghostcat_device *d;
+	struct ghostcat_image image, reader;
+	struct ghostcat_image_blob blob;
+	const uint8_t sector[] = { 0x01, 0x02, 0x03, 0x04 };
+	uint8_t *data;
+	size_t size;
+	int rc;
+
+	r = ghostcat_create_context(&abort_iface, NULL);
+	d = ghostcat_device_new_test_device(r, &sane_device);
+
+	/* the test driver can't save or apply images */
+	rc = ghostcat_device_save_image(d, &data, &size);
+	ck_assert_int_eq(rc, GHOSTCAT_ERROR_CAPABILITY);
+
+	ghostcat_image_init_writer(&image, d);
+	ghostcat_image_add_blob(&image, GHOSTCAT_IMAGE_BLOB_HIDPP20_SECTOR,
+				0x0001, sector, sizeof(sector));
+	ghostcat_image_add_blob(&image, GHOSTCAT_IMAGE_BLOB_HIDPP20_SECTOR,
+				0x0000, sector, 2);
+	ghostcat_image_finish(&image);
+
+	rc = ghostcat_image_init_reader(&reader, d, image.data, image.size);
+	ck_assert_int_eq(rc, 0);
+
+	rc = ghostcat_image_next_blob(&reader, &blob);
+	ck_assert_int_eq(rc, 1);
+	ck_assert_int_eq(blob.type, GHOSTCAT_IMAGE_BLOB_HIDPP20_SECTOR);
+	ck_assert_int_eq(blob.id, 0x0001);
+	ck_assert_int_eq(blob.size, sizeof(sector));
+	ck_assert_int_eq(memcmp(blob.data, sector, sizeof(sector)), 0);
+
+	rc = ghostcat_image_next_blob(&reader, &blob);
+	ck_assert_int_eq(rc, 1);
+	ck_assert_int_eq(blob.id, 0x0000);
+	ck_assert_int_eq(blob.size, 2);
+
+	rc = ghostcat_image_next_blob(&reader, &blob);
+	ck_assert_int_eq(rc, 0);
+	ck_assert(reader.end);
+	ck_assert_int_eq(reader.offset, image.size);
+
+	/* truncated in the middle of the last blob */
+	rc = ghostcat_image_init_reader(&reader, d, image.data, image.size - 8);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(ghostcat_image_next_blob(&reader, &blob), 1);
+	ck_assert_int_eq(ghostcat_image_next_blob(&reader, &blob), -EINVAL);
+
+	/* not an image */
+	rc = ghostcat_image_init_reader(&reader, d, sector, sizeof(sector));
+	ck_assert_int_eq(rc, -EINVAL);
+
+	/* taken from a different device */
+	image.data[12]++;
+	rc = ghostcat_image_init_reader(&reader, d, image.data, image.size);
+	ck_assert_int_eq(rc, -ENODEV);
+
+	free(image.data);
+	ghostcat_device_unref(d);
+	ghostcat_unref(r);
+}
+END_TEST
+
+struct job_result {
+	struct ghostcat_device *device;
+	int result;
+	int count;
+};
+
+static void
+job_done(struct ghostcat_device *device, int result, void *data)
+{
+	struct job_result *r = data;
+
+	r->device = device;
+	r->result = result;
+	r->count++;
+}
+
+static void
+dispatch_until(struct ghostcat *r, const int *count, int expected)
+{
+	struct pollfd fds = {
+		.fd = ghostcat_get_fd(r),
+		.events = POLLIN,
+	};
+
+	while (*count < expected) {
+		ck_assert_int_eq(poll(&fds, 1, 5000), 1);
+		ck_assert_int_eq(ghostcat_dispatch(r), GHOSTCAT_SUCCESS);
+	}
+}
+
+START_TEST(device_async)
+{
+	struct ghostcat *r;
+	struct ghostcat_device *d;
+	struct ghostcat_test_device td = sane_device;
+	struct job_result commit = {0}, refresh = {0}, busy = {0};
+	int device_freed_count = 0;
+	int rc;
+
+	td.destroyed_data = &device_freed_count;
+
+	r = ghostcat_create_context(&abort_iface, NULL);
+	d = ghostcat_device_new_test_device(r, &td);
+
+	/* nothing finished yet */
+	ck_assert_int_ge(ghostcat_get_fd(r), 0);
+	ck_assert_int_eq(ghostcat_dispatch(r), GHOSTCAT_SUCCESS);
+
+	rc = ghostcat_device_commit_async(d, job_done, &commit);
+	ck_assert_int_eq(rc, GHOSTCAT_SUCCESS);
+
+	/* one job per device at a time */
+	rc = ghostcat_device_refresh_active_resolution_async(d, job_done, &busy);
+	ck_assert_int_eq(rc, GHOSTCAT_ERROR_IMPLEMENTATION);
+
+	/* the job keeps the device alive */
+	ghostcat_device_unref(d);
+	ck_assert_int_eq(device_freed_count, 0);
+
+	dispatch_until(r, &commit.count, 1);
+	ck_assert_int_eq(commit.count, 1);
+	ck_assert(commit.device == d);
+	ck_assert_int_eq(commit.result, GHOSTCAT_SUCCESS);
+	ck_assert_int_eq(busy.count, 0);
+	ck_assert_int_eq(device_freed_count, 1);
+
+	d = ghostcat_device_new_test_device(r, &td);
+	rc = ghostcat_device_refresh_active_resolution_async(d, job_done, &refresh);
+	ck_assert_int_eq(rc, GHOSTCAT_SUCCESS);
+	dispatch_until(r, &refresh.count, 1);
+	ck_assert_int_eq(refresh.result, 0);
+
+	ghostcat_device_unref(d);
+	ghostcat_unref(r);
+}
+END_TEST
+
+START_TEST(device_async_busy)
+{
+	struct ghostcat *r;
+	struct ghostcat_device *d;
+	struct ghostcat_profile *p;
+	struct ghostcat_resolution *res;
+	struct ghostcat_test_device td = sane_device;
+	struct job_result commit = {0};
+	unsigned int dpi;
+	int rc;
+
+	/* long enough for the calls below to run while the job does */
+	td.commit_delay_ms = 200;
+
+	r = ghostcat_create_context(&abort_iface, NULL);
+	d = ghostcat_device_new_test_device(r, &td);
+	p = ghostcat_device_get_profile(d, 0);
+	res = ghostcat_profile_get_resolution(p, 0);
+	dpi = ghostcat_resolution_get_dpi(res);
+
+	rc = ghostcat_device_commit_async(d, job_done, &commit);
+	ck_assert_int_eq(rc, GHOSTCAT_SUCCESS);
+
+	/* the device is off limits until the callback */
+	rc = ghostcat_resolution_set_dpi(res, dpi);
+	ck_assert_int_eq(rc, GHOSTCAT_ERROR_IMPLEMENTATION);
+	rc = ghostcat_profile_set_report_rate(p, 1000);
+	ck_assert_int_eq(rc, GHOSTCAT_ERROR_IMPLEMENTATION);
+	rc = ghostcat_device_commit(d);
+	ck_assert_int_eq(rc, GHOSTCAT_ERROR_IMPLEMENTATION);
+	rc = ghostcat_device_refresh_active_resolution(d);
+	ck_assert_int_eq(rc, -EBUSY);
+	ck_assert_int_eq(commit.count, 0);
+
+	dispatch_until(r, &commit.count, 1);
+	ck_assert_int_eq(commit.result, GHOSTCAT_SUCCESS);
+
+	rc = ghostcat_resolution_set_dpi(res, dpi);
+	ck_assert_int_eq(rc, GHOSTCAT_SUCCESS);
+	rc = ghostcat_device_commit(d);
+	ck_assert_int_eq(rc, GHOSTCAT_SUCCESS);
+
+	ghostcat_resolution_unref(res);
+	ghostcat_profile_unref(p);
+	ghostcat_device_unref(d);
+	ghostcat_unref(r);
+}
+END_TEST
+
 static Suite *
 test_context_suite(void)
 {
@@ -985,6 +1543,7 @@ test_context_suite(void)
 	tcase_add_test(tc, device_profiles_num_0);
 	tcase_add_test(tc, device_profiles_multiple_active);
 	tcase_add_test(tc, device_profiles_get_invalid);
+	tcase_add_test(tc, device_profiles_indexed);
 	tcase_add_test(tc, device_freed_before_profile);
 	tcase_add_test(tc, device_and_profile_freed_before_button);
 	tcase_add_test(tc, device_and_profile_freed_before_resolution);
@@ -1007,6 +1566,25 @@ test_context_suite(void)
 	tc = tcase_create("led");
 	tcase_add_test(tc, device_leds);
 	tcase_add_test(tc, device_leds_set);
+	tcase_add_test(tc, device_leds_show);
+	tcase_add_test(tc, device_keys);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("dirty");
+	tcase_add_test(tc, device_dirty_fields);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("stats");
+	tcase_add_test(tc, device_stats);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("image");
+	tcase_add_test(tc, device_image);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("async");
+	tcase_add_test(tc, device_async);
+	tcase_add_test(tc, device_async_busy);
 	suite_add_tcase(s, tc);
 
 	return s;
@@ -30,10 +30,13 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <sys/resource.h>
 
 #include "libghostcat-util.h"
+#include "libghostcat-checksum.h"
+#include "libghostcat-trace.h"
 
 START_TEST(dpi_range_parser)
 {
@@ -122,6 +125,225 @@ START_TEST(dpi_list_parser)
 }
 END_TEST
 
+/* The byte-by-byte CRC the HID++ drivers used before the table version */
+static uint16_t
+crc_ccitt_reference(const uint8_t *data, size_t len)
+{
+	uint16_t crc = 0xffff;
+
+	for (size_t i = 0; i < len; i++) {
+		uint16_t temp = (crc >> 8) ^ data[i];
+
+		crc <<= 8;
+		uint16_t quick = temp ^ (temp >> 4);
+		crc ^= quick;
+		quick <<= 5;
+		crc ^= quick;
+		quick <<= 7;
+		crc ^= quick;
+	}
+
+	return crc;
+}
+
+static uint32_t
+checksum_sum_reference(const uint8_t *data, size_t len)
+{
+	uint32_t sum = 0;
+
+	for (size_t i = 0; i < len; i++)
+		sum += data[i];
+
+	return sum;
+}
+
+START_TEST(checksum_known_answers)
+{
+	const uint8_t check[] = "123456789";
+	uint8_t ones[4096];
+
+	ck_assert_int_eq(ghostcat_crc_ccitt(check, 9), 0x29b1);
+	ck_assert_int_eq(ghostcat_crc_ccitt(check, 0), 0xffff);
+	ck_assert_int_eq(ghostcat_checksum_sum(check, 9), 477);
+	ck_assert_int_eq(ghostcat_checksum_sum(check, 0), 0);
+
+	/* every 16-bit lane of the word-wise sum must not overflow */
+	memset(ones, 0xff, sizeof(ones));
+	ck_assert_int_eq(ghostcat_checksum_sum(ones, sizeof(ones)),
+			 0xff * sizeof(ones));
+	ck_assert_int_eq(ghostcat_crc_ccitt(ones, sizeof(ones)),
+			 crc_ccitt_reference(ones, sizeof(ones)));
+}
+END_TEST
+
+START_TEST(checksum_reference)
+{
+	uint8_t data[1100];
+	uint8_t *b;
+	uint32_t seed = 0x12345678;
+
+	ARRAY_FOR_EACH(data, b) {
+		seed = seed * 1103515245 + 12345;
+		*b = seed >> 16;
+	}
+
+	/* all alignments and the lengths around the 8-byte steps */
+	for (size_t offset = 0; offset < 8; offset++) {
+		for (size_t len = 0; len + offset <= sizeof(data); len++) {
+			const uint8_t *p = data + offset;
+
+			ck_assert_int_eq(ghostcat_crc_ccitt(p, len),
+					 crc_ccitt_reference(p, len));
+			ck_assert_int_eq(ghostcat_checksum_sum(p, len),
+					 checksum_sum_reference(p, len));
+		}
+	}
+}
+END_TEST
+
+START_TEST(rtt_timeouts)
+{
+	struct ghostcat_rtt rtt = {0};
+
+	/* without samples, start conservative and back off */
+	ck_assert_int_eq(ghostcat_rtt_timeout_ms(NULL, 0), GHOSTCAT_RTT_TIMEOUT_INITIAL_MS);
+	ck_assert_int_eq(ghostcat_rtt_timeout_ms(&rtt, 0), GHOSTCAT_RTT_TIMEOUT_INITIAL_MS);
+	ck_assert_int_eq(ghostcat_rtt_timeout_ms(&rtt, 1), 2 * GHOSTCAT_RTT_TIMEOUT_INITIAL_MS);
+	ck_assert_int_eq(ghostcat_rtt_timeout_ms(&rtt, 10), GHOSTCAT_RTT_TIMEOUT_MAX_MS);
+	ck_assert_int_eq(ghostcat_rtt_delay_ms(&rtt, 0), 10);
+
+	/* a fast device gets the minimum timeout and short delays */
+	for (int i = 0; i < 8; i++)
+		ghostcat_rtt_update(&rtt, now(CLOCK_MONOTONIC));
+
+	ck_assert_int_eq(rtt.samples, 8);
+	ck_assert_int_eq(ghostcat_rtt_timeout_ms(&rtt, 0), GHOSTCAT_RTT_TIMEOUT_MIN_MS);
+	ck_assert_int_eq(ghostcat_rtt_timeout_ms(&rtt, 1), 2 * GHOSTCAT_RTT_TIMEOUT_MIN_MS);
+	ck_assert_int_eq(ghostcat_rtt_timeout_ms(&rtt, 100), GHOSTCAT_RTT_TIMEOUT_MAX_MS);
+	ck_assert_int_eq(ghostcat_rtt_delay_ms(&rtt, 0), 1);
+	ck_assert_int_eq(ghostcat_rtt_delay_ms(&rtt, 3), 8);
+	ck_assert_int_eq(ghostcat_rtt_delay_ms(&rtt, 100), GHOSTCAT_RTT_DELAY_MAX_MS);
+
+	/* a stall is clamped instead of poisoning the estimate */
+	ghostcat_rtt_update(&rtt, 0);
+	ck_assert_int_le(rtt.srtt_us, GHOSTCAT_RTT_TIMEOUT_MAX_MS * 1000 / 8 + 1000);
+	ck_assert_int_eq(ghostcat_rtt_timeout_ms(&rtt, 0), GHOSTCAT_RTT_TIMEOUT_MAX_MS);
+}
+END_TEST
+
+START_TEST(stats_latency_buckets)
+{
+	struct ghostcat_stats stats = {0};
+
+	ghostcat_stats_add_latency(&stats, 0);
+	ghostcat_stats_add_latency(&stats, GHOSTCAT_STATS_LATENCY_FIRST_US - 1);
+	ck_assert_int_eq(stats.latency[0], 2);
+
+	ghostcat_stats_add_latency(&stats, GHOSTCAT_STATS_LATENCY_FIRST_US);
+	ghostcat_stats_add_latency(&stats, 2 * GHOSTCAT_STATS_LATENCY_FIRST_US - 1);
+	ck_assert_int_eq(stats.latency[1], 2);
+
+	ghostcat_stats_add_latency(&stats, 2 * GHOSTCAT_STATS_LATENCY_FIRST_US);
+	ck_assert_int_eq(stats.latency[2], 1);
+
+	/* anything slower ends up in the last bucket */
+	ghostcat_stats_add_latency(&stats, 60ULL * 1000 * 1000);
+	ghostcat_stats_add_latency(&stats, UINT64_MAX);
+	ck_assert_int_eq(stats.latency[GHOSTCAT_STATS_LATENCY_BUCKETS - 1], 2);
+
+	ghostcat_stats_add_transfer(&stats, 20, 7, 0);
+	ghostcat_stats_add_transfer(&stats, 20, 0, -EIO);
+	ck_assert_int_eq(stats.transfers, 2);
+	ck_assert_int_eq(stats.bytes_sent, 20);
+	ck_assert_int_eq(stats.bytes_received, 7);
+	ck_assert_int_eq(stats.errors, 1);
+}
+END_TEST
+
+START_TEST(trace_replay)
+{
+	char path[] = "/tmp/ghostcat-trace-XXXXXX";
+	struct input_id id = { BUS_USB, 0x046d, 0xc539, 0 };
+	struct ghostcat_trace *trace;
+	const uint8_t desc[] = { 0x05, 0x01, 0x09, 0x02 };
+	uint8_t cmd[] = { 0x10, 0xff, 0x00, 0x10, 0x00, 0x00, 0x00 };
+	uint8_t reply[] = { 0x11, 0xff, 0x00, 0x10, 0x04, 0x02 };
+	uint8_t feature[] = { 0x05, 0x00, 0x00 };
+	uint8_t buf[16] = {0};
+	int fd, rc;
+
+	fd = mkstemp(path);
+	ck_assert_int_ge(fd, 0);
+	close(fd);
+
+	trace = ghostcat_trace_new_recording(path, &id, "Test mouse");
+	ck_assert_ptr_nonnull(trace);
+	ck_assert(!ghostcat_trace_is_replay(trace));
+	ghostcat_trace_record(trace, GHOSTCAT_TRACE_OPEN, 0, sizeof(desc), 10,
+			      desc, sizeof(desc));
+	ghostcat_trace_record(trace, GHOSTCAT_TRACE_WRITE, 0, sizeof(cmd), 20,
+			      cmd, sizeof(cmd));
+	ghostcat_trace_record(trace, GHOSTCAT_TRACE_READ, 0, -ETIMEDOUT, 30,
+			      NULL, 0);
+	ghostcat_trace_record(trace, GHOSTCAT_TRACE_READ, 0, sizeof(reply), 40,
+			      reply, sizeof(reply));
+	ghostcat_trace_record(trace, GHOSTCAT_TRACE_GET_FEATURE, 0, sizeof(feature), 50,
+			      feature, sizeof(feature));
+	ghostcat_trace_record(trace, GHOSTCAT_TRACE_WRITE, 0, sizeof(cmd), 60,
+			      cmd, sizeof(cmd));
+	ghostcat_trace_destroy(trace);
+
+	trace = ghostcat_trace_new_replay(path, false);
+	ck_assert_ptr_nonnull(trace);
+	ck_assert(ghostcat_trace_is_replay(trace));
+	ck_assert_str_eq(ghostcat_trace_get_name(trace), "Test mouse");
+	ck_assert_int_eq(ghostcat_trace_get_id(trace)->vendor, 0x046d);
+	ck_assert_int_eq(ghostcat_trace_get_id(trace)->product, 0xc539);
+
+	/* only the first node was recorded */
+	rc = ghostcat_trace_replay(trace, GHOSTCAT_TRACE_OPEN, 1, NULL, 0, buf, sizeof(buf));
+	ck_assert_int_eq(rc, -ENODEV);
+	rc = ghostcat_trace_replay(trace, GHOSTCAT_TRACE_OPEN, 0, NULL, 0, buf, sizeof(buf));
+	ck_assert_int_eq(rc, sizeof(desc));
+	ck_assert_mem_eq(buf, desc, sizeof(desc));
+
+	/* nothing to read before the request went out */
+	rc = ghostcat_trace_replay(trace, GHOSTCAT_TRACE_READ, 0, NULL, 0, buf, sizeof(buf));
+	ck_assert_int_eq(rc, -ETIMEDOUT);
+	ck_assert_int_eq(ghostcat_trace_get_position(trace), 1);
+
+	rc = ghostcat_trace_replay(trace, GHOSTCAT_TRACE_WRITE, 0, cmd, sizeof(cmd), NULL, 0);
+	ck_assert_int_eq(rc, sizeof(cmd));
+	rc = ghostcat_trace_replay(trace, GHOSTCAT_TRACE_READ, 0, NULL, 0, buf, sizeof(buf));
+	ck_assert_int_eq(rc, -ETIMEDOUT);
+	rc = ghostcat_trace_replay(trace, GHOSTCAT_TRACE_READ, 0, NULL, 0, buf, sizeof(buf));
+	ck_assert_int_eq(rc, sizeof(reply));
+	ck_assert_mem_eq(buf, reply, sizeof(reply));
+
+	buf[0] = 0x05;
+	rc = ghostcat_trace_replay(trace, GHOSTCAT_TRACE_GET_FEATURE, 0, buf, 3, buf, 3);
+	ck_assert_int_eq(rc, sizeof(feature));
+	ck_assert_mem_eq(buf, feature, sizeof(feature));
+
+	/* a different request diverges for good */
+	cmd[4] = 0x01;
+	rc = ghostcat_trace_replay(trace, GHOSTCAT_TRACE_WRITE, 0, cmd, sizeof(cmd), NULL, 0);
+	ck_assert_int_eq(rc, -EIO);
+	ck_assert(ghostcat_trace_has_diverged(trace));
+	cmd[4] = 0x00;
+	rc = ghostcat_trace_replay(trace, GHOSTCAT_TRACE_WRITE, 0, cmd, sizeof(cmd), NULL, 0);
+	ck_assert_int_eq(rc, -EIO);
+
+	ghostcat_trace_destroy(trace);
+
+	/* a truncated recording is rejected */
+	ck_assert_int_eq(truncate(path, 20), 0);
+	ck_assert_ptr_null(ghostcat_trace_new_replay(path, false));
+
+	unlink(path);
+}
+END_TEST
+
 static Suite *
 test_context_suite(void)
 {
@@ -132,6 +354,11 @@ test_context_suite(void)
 	tc = tcase_create("util");
 	tcase_add_test(tc, dpi_range_parser);
 	tcase_add_test(tc, dpi_list_parser);
+	tcase_add_test(tc, checksum_known_answers);
+	tcase_add_test(tc, checksum_reference);
+	tcase_add_test(tc, rtt_timeouts);
+	tcase_add_test(tc, stats_latency_buckets);
+	tcase_add_test(tc, trace_replay);
 
 	suite_add_tcase(s, tc);
 	return s;
@@ -0,0 +1,364 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Measures how many LED frames per second a device can show, the way
+ * ghostcatd's LED animations show them: every frame goes through
+ * ghostcat_device_show_leds(), which only writes the LEDs that changed.
+ * The LEDs show the active profile again when the benchmark is done.
+ *
+ * Keyboards with per-key lighting are also measured with key frames
+ * through ghostcat_device_show_keys(). Their keys keep the last frame.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <getopt.h>
+#include <glob.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libghostcat.h>
+
+#include "shared-macro.h"
+#include "shared.h"
+
+#define MAX_DEVICES 32
+
+enum key_pattern {
+	KEYS_DISTINCT,	/* every key its own color */
+	KEYS_SOLID,	/* all keys the same color */
+	KEYS_ONE,	/* one key changes */
+};
+
+enum options {
+	OPT_HELP,
+	OPT_FRAMES,
+	OPT_VERBOSE,
+};
+
+struct bench_result {
+	uint64_t usec;
+	uint64_t transfers;
+};
+
+/* Shows num_frames frames. A frame changes every LED in mask, the other
+ * LEDs keep their color */
+static int
+bench_frames(struct ghostcat_device *device, unsigned int num_frames,
+	     uint32_t mask, struct bench_result *result)
+{
+	unsigned int num_leds = ghostcat_device_get_num_leds(device);
+	struct ghostcat_color colors[32] = {0};
+	uint64_t start, transfers;
+	enum ghostcat_error_code rc;
+
+	transfers = ghostcat_device_get_stat(device, GHOSTCAT_DEVICE_STAT_TRANSFERS);
+	start = now(CLOCK_MONOTONIC);
+
+	for (unsigned int frame = 0; frame < num_frames; frame++) {
+		for (unsigned int i = 0; i < num_leds; i++) {
+			if (!(mask & (1U << i)))
+				continue;
+
+			colors[i].red = (frame * 37 + i * 85) % 256;
+			colors[i].green = (frame * 59 + i * 85) % 256;
+			colors[i].blue = (frame * 83 + i * 85) % 256;
+		}
+
+		rc = ghostcat_device_show_leds(device, colors, num_leds);
+		if (rc != GHOSTCAT_SUCCESS)
+			return rc;
+	}
+
+	result->usec = (now(CLOCK_MONOTONIC) - start) / 1000;
+	result->transfers = ghostcat_device_get_stat(device, GHOSTCAT_DEVICE_STAT_TRANSFERS) - transfers;
+
+	return GHOSTCAT_SUCCESS;
+}
+
+/* Shows num_frames key frames, every frame changes the keys in the given
+ * pattern */
+static int
+bench_key_frames(struct ghostcat_device *device, unsigned int num_frames,
+		 enum key_pattern pattern, struct bench_result *result)
+{
+	unsigned int width = ghostcat_device_get_key_frame_width(device);
+	unsigned int height = ghostcat_device_get_key_frame_height(device);
+	struct ghostcat_color *colors;
+	uint64_t start, transfers;
+	enum ghostcat_error_code rc = GHOSTCAT_SUCCESS;
+
+	colors = calloc(width * height, sizeof(*colors));
+	if (!colors)
+		return GHOSTCAT_ERROR_DEVICE;
+
+	transfers = ghostcat_device_get_stat(device, GHOSTCAT_DEVICE_STAT_TRANSFERS);
+	start = now(CLOCK_MONOTONIC);
+
+	for (unsigned int frame = 0; frame < num_frames; frame++) {
+		for (unsigned int i = 0; i < width * height; i++) {
+			unsigned int seed = pattern == KEYS_DISTINCT ? i * 7 : 0;
+
+			if (pattern == KEYS_ONE && i > 0)
+				break;
+
+			colors[i].red = (frame * 37 + seed) % 256;
+			colors[i].green = (frame * 59 + seed) % 256;
+			colors[i].blue = (frame * 83 + seed) % 256;
+		}
+
+		rc = ghostcat_device_set_key_colors(device, 0, 0, width, height, colors);
+		if (rc == GHOSTCAT_SUCCESS)
+			rc = ghostcat_device_show_keys(device);
+		if (rc != GHOSTCAT_SUCCESS)
+			break;
+	}
+
+	result->usec = (now(CLOCK_MONOTONIC) - start) / 1000;
+	result->transfers = ghostcat_device_get_stat(device, GHOSTCAT_DEVICE_STAT_TRANSFERS) - transfers;
+
+	free(colors);
+
+	return rc;
+}
+
+static void
+print_result(const char *name, const char *what, unsigned int num_frames,
+	     const struct bench_result *result)
+{
+	double usec = (double)result->usec / num_frames;
+
+	printf("%s: %-13s %8.1f fps %8.0f us/frame %6.1f transfers/frame\n",
+	       name, what,
+	       usec > 0 ? 1000000.0 / usec : 0.0,
+	       usec,
+	       (double)result->transfers / num_frames);
+}
+
+static bool
+bench_keys(struct ghostcat_device *device, unsigned int num_frames)
+{
+	const char *name = ghostcat_device_get_name(device);
+	unsigned int width = ghostcat_device_get_key_frame_width(device);
+	unsigned int height = ghostcat_device_get_key_frame_height(device);
+	unsigned int num_keys = 0;
+	struct bench_result result;
+	enum ghostcat_error_code rc;
+
+	if (width == 0)
+		return true;
+
+	for (unsigned int y = 0; y < height; y++) {
+		for (unsigned int x = 0; x < width; x++)
+			num_keys += ghostcat_device_has_key(device, x, y);
+	}
+	printf("%s: %u keys in a %ux%u frame\n", name, num_keys, width, height);
+
+	rc = bench_key_frames(device, num_frames, KEYS_DISTINCT, &result);
+	if (rc != GHOSTCAT_SUCCESS)
+		goto out;
+	print_result(name, "keys distinct", num_frames, &result);
+
+	rc = bench_key_frames(device, num_frames, KEYS_SOLID, &result);
+	if (rc != GHOSTCAT_SUCCESS)
+		goto out;
+	print_result(name, "keys solid", num_frames, &result);
+
+	rc = bench_key_frames(device, num_frames, KEYS_ONE, &result);
+	if (rc != GHOSTCAT_SUCCESS)
+		goto out;
+	print_result(name, "one key", num_frames, &result);
+
+out:
+	if (rc != GHOSTCAT_SUCCESS)
+		fprintf(stderr, "%s: failed to show a key frame (%d)\n", name, rc);
+
+	return rc == GHOSTCAT_SUCCESS;
+}
+
+static bool
+bench(struct ghostcat_device *device, unsigned int num_frames)
+{
+	const char *name = ghostcat_device_get_name(device);
+	unsigned int num_leds = ghostcat_device_get_num_leds(device);
+	uint32_t all = num_leds >= 32 ? ~0U : (1U << num_leds) - 1;
+	struct bench_result result;
+	enum ghostcat_error_code rc;
+
+	if (num_leds == 0) {
+		printf("%s: no LEDs\n", name);
+		return true;
+	}
+
+	rc = bench_frames(device, num_frames, all, &result);
+	if (rc == GHOSTCAT_ERROR_CAPABILITY) {
+		printf("%s: can't show LED frames\n", name);
+		return true;
+	}
+	if (rc != GHOSTCAT_SUCCESS)
+		goto out;
+
+	printf("%s: %u LEDs\n", name, num_leds);
+	print_result(name, "all LEDs", num_frames, &result);
+
+	rc = bench_frames(device, num_frames, 0x1, &result);
+	if (rc != GHOSTCAT_SUCCESS)
+		goto out;
+	print_result(name, "one LED", num_frames, &result);
+
+	rc = bench_frames(device, num_frames, 0, &result);
+	if (rc != GHOSTCAT_SUCCESS)
+		goto out;
+	print_result(name, "no change", num_frames, &result);
+
+out:
+	if (rc != GHOSTCAT_SUCCESS)
+		fprintf(stderr, "%s: failed to show a frame (%d)\n", name, rc);
+
+	ghostcat_device_restore_leds(device);
+
+	return rc == GHOSTCAT_SUCCESS;
+}
+
+static bool
+is_duplicate(struct ghostcat_device **devices, unsigned int num_devices,
+	     struct ghostcat_device *device)
+{
+	for (unsigned int i = 0; i < num_devices; i++) {
+		if (streq(ghostcat_device_get_name(devices[i]),
+			  ghostcat_device_get_name(device)))
+			return true;
+	}
+
+	return false;
+}
+
+static void
+usage(void)
+{
+	printf("Usage: %s [--frames N] [--verbose] [/dev/hidrawN...]\n"
+	       "\n"
+	       "Measure the LED frame rate of the given devices, or of all\n"
+	       "supported devices if none is given.\n"
+	       "\n"
+	       "Options:\n"
+	       "  --frames N ....... number of frames per test, default 200\n"
+	       "  --verbose ........ print the transfers\n",
+	       program_invocation_short_name);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct ghostcat *ratbag;
+	struct ghostcat_device *devices[MAX_DEVICES];
+	struct ghostcat_device *device;
+	unsigned int num_devices = 0;
+	unsigned int num_frames = 200;
+	glob_t paths = {0};
+	bool verbose = false;
+	bool success = true;
+
+	while (1) {
+		int c;
+		int option_index = 0;
+		static struct option opts[] = {
+			{ "help", 0, 0, OPT_HELP },
+			{ "frames", 1, 0, OPT_FRAMES },
+			{ "verbose", 0, 0, OPT_VERBOSE },
+			{ 0, 0, 0, 0 },
+		};
+
+		c = getopt_long(argc, argv, "+h", opts, &option_index);
+		if (c == -1)
+			break;
+		switch(c) {
+		case 'h':
+		case OPT_HELP:
+			usage();
+			return EXIT_SUCCESS;
+		case OPT_FRAMES:
+			if (safe_atou(optarg, &num_frames) < 0 || num_frames == 0) {
+				usage();
+				return EXIT_FAILURE;
+			}
+			break;
+		case OPT_VERBOSE:
+			verbose = true;
+			break;
+		default:
+			usage();
+			return EXIT_FAILURE;
+		}
+	}
+
+	ratbag = ghostcat_create_context(&interface, NULL);
+	if (!ratbag) {
+		fprintf(stderr, "Failed to create the context\n");
+		return EXIT_FAILURE;
+	}
+
+	if (verbose)
+		ghostcat_log_set_priority(ratbag, GHOSTCAT_LOG_PRIORITY_RAW);
+
+	if (optind >= argc) {
+		glob("/dev/hidraw*", 0, NULL, &paths);
+		argv = paths.gl_pathv;
+		argc = paths.gl_pathc;
+		optind = 0;
+	}
+
+	/* A device usually has several hidraw nodes and each of them may
+	 * open the same device */
+	for (int i = optind; i < argc && num_devices < MAX_DEVICES; i++) {
+		device = ghostcat_cmd_open_device(ratbag, argv[i]);
+		if (!device)
+			continue;
+
+		if (is_duplicate(devices, num_devices, device)) {
+			ghostcat_device_unref(device);
+			continue;
+		}
+
+		devices[num_devices++] = device;
+	}
+
+	if (num_devices == 0) {
+		fprintf(stderr, "No supported devices found\n");
+		success = false;
+	}
+
+	for (unsigned int i = 0; i < num_devices; i++) {
+		success &= bench(devices[i], num_frames);
+		success &= bench_keys(devices[i], num_frames);
+		ghostcat_device_unref(devices[i]);
+	}
+
+	globfree(&paths);
+	ghostcat_unref(ratbag);
+
+	return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,168 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Probes devices from recordings of their hidraw traffic, as written by
+ * libghostcat when GHOSTCAT_RECORD_DIR is set. A recording that still
+ * replays after a driver change means the driver still talks to the
+ * device the same way.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <libghostcat.h>
+
+enum options {
+	OPT_HELP,
+	OPT_REALTIME,
+	OPT_VERBOSE,
+};
+
+static int
+open_restricted(const char *path, int flags, void *user_data)
+{
+	int fd = open(path, flags);
+
+	return fd < 0 ? -errno : fd;
+}
+
+static void
+close_restricted(int fd, void *user_data)
+{
+	close(fd);
+}
+
+static const struct ghostcat_interface interface = {
+	.open_restricted = open_restricted,
+	.close_restricted = close_restricted,
+};
+
+static bool
+replay(struct ghostcat *ratbag, const char *path, uint32_t flags)
+{
+	struct ghostcat_device *device;
+	enum ghostcat_error_code rc;
+
+	rc = ghostcat_device_new_from_recording(ratbag, path, flags, &device);
+	if (rc != GHOSTCAT_SUCCESS) {
+		fprintf(stderr, "%s: replay failed (%d)\n", path, rc);
+		return false;
+	}
+
+	printf("%s: %s, %u profiles, %u buttons, %u LEDs\n",
+	       path,
+	       ghostcat_device_get_name(device),
+	       ghostcat_device_get_num_profiles(device),
+	       ghostcat_device_get_num_buttons(device),
+	       ghostcat_device_get_num_leds(device));
+	printf("%s: %llu transfers, %llu retries, %llu timeouts, probed in %llu us\n",
+	       path,
+	       (unsigned long long)ghostcat_device_get_stat(device, GHOSTCAT_DEVICE_STAT_TRANSFERS),
+	       (unsigned long long)ghostcat_device_get_stat(device, GHOSTCAT_DEVICE_STAT_RETRIES),
+	       (unsigned long long)ghostcat_device_get_stat(device, GHOSTCAT_DEVICE_STAT_TIMEOUTS),
+	       (unsigned long long)ghostcat_device_get_stat(device, GHOSTCAT_DEVICE_STAT_PROBE_TIME_US));
+
+	ghostcat_device_unref(device);
+
+	return true;
+}
+
+static void
+usage(void)
+{
+	printf("Usage: %s [--realtime] [--verbose] RECORDING...\n"
+	       "\n"
+	       "Probe the devices recorded in the given files.\n"
+	       "\n"
+	       "Options:\n"
+	       "  --realtime ....... replay with the recorded timing instead of\n"
+	       "                     as fast as possible\n"
+	       "  --verbose ........ print the transfers\n",
+	       program_invocation_short_name);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct ghostcat *ratbag;
+	uint32_t flags = 0;
+	bool verbose = false;
+	bool success = true;
+
+	while (1) {
+		int c;
+		int option_index = 0;
+		static struct option opts[] = {
+			{ "help", 0, 0, OPT_HELP },
+			{ "realtime", 0, 0, OPT_REALTIME },
+			{ "verbose", 0, 0, OPT_VERBOSE },
+			{ 0, 0, 0, 0 },
+		};
+
+		c = getopt_long(argc, argv, "+h", opts, &option_index);
+		if (c == -1)
+			break;
+		switch(c) {
+		case 'h':
+		case OPT_HELP:
+			usage();
+			return EXIT_SUCCESS;
+		case OPT_REALTIME:
+			flags |= GHOSTCAT_REPLAY_REALTIME;
+			break;
+		case OPT_VERBOSE:
+			verbose = true;
+			break;
+		default:
+			usage();
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (optind >= argc) {
+		usage();
+		return EXIT_FAILURE;
+	}
+
+	ratbag = ghostcat_create_context(&interface, NULL);
+	if (!ratbag) {
+		fprintf(stderr, "Failed to create the context\n");
+		return EXIT_FAILURE;
+	}
+
+	if (verbose)
+		ghostcat_log_set_priority(ratbag, GHOSTCAT_LOG_PRIORITY_RAW);
+
+	for (int i = optind; i < argc; i++)
+		success &= replay(ratbag, argv[i], flags);
+
+	ghostcat_unref(ratbag);
+
+	return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -232,9 +232,9 @@ class _RatbagdDBus(GObject.GObject):
         # update
         self._proxy.set_cached_property(property, val)
 
-    def _dbus_call(self, method, type, *value):
+    def _dbus_call(self, method, type, *value, timeout=2000):
         # Calls a method synchronously on the bus, using the given method name,
-        # type signature and values.
+        # type signature and values. The timeout is in milliseconds.
         #
         # If the result is valid, it is returned. Invalid results raise the
         # appropriate RatbagError* or RatbagdDBus* exception, or GLib.Error if
@@ -243,7 +243,7 @@ class _RatbagdDBus(GObject.GObject):
         val = GLib.Variant(f"({type})", value)
         try:
             res = self._proxy.call_sync(
-                method, val, Gio.DBusCallFlags.NO_AUTO_START, 2000, None
+                method, val, Gio.DBusCallFlags.NO_AUTO_START, timeout, None
             )
             if res in EXCEPTION_TABLE:
                 raise EXCEPTION_TABLE[res]
@@ -426,6 +426,82 @@ class RatbagdDevice(_RatbagdDBus):
         """
         self._dbus_call("Commit", "")
 
+    def save_image(self):
+        """Returns an image of the device's onboard memory as bytes, see
+        apply_image()."""
+        return bytes(self._dbus_call("SaveImage", "", timeout=30000))
+
+    def apply_image(self, image):
+        """Writes an image returned by save_image() to this device. Only the
+        parts that differ are written. This call blocks until the image is
+        written and discards any uncommitted changes."""
+        self._dbus_call("ApplyImage", "ay", image, timeout=60000)
+
+    @GObject.Property
+    def led_animation_rate(self):
+        """The frame rate LED animations aim for, see set_led_animation()."""
+        return self._get_dbus_property("LedAnimationRate")
+
+    @led_animation_rate.setter
+    def led_animation_rate(self, rate):
+        self._set_dbus_property("LedAnimationRate", "u", rate)
+
+    def set_led_animation(self, led, keyframes):
+        """Animates the LED with the given index. keyframes is a list of
+        (duration in ms, (r, g, b)) tuples, the color fades from each
+        keyframe to the next one and the animation repeats. An empty list
+        stops the animation of this LED."""
+        frames = [(ms, r, g, b) for ms, (r, g, b) in keyframes]
+        self._dbus_call("SetLedAnimation", "ua(uuuu)", led, frames)
+
+    @GObject.Property
+    def key_frame_size(self):
+        """The (width, height) of the per-key lighting frame, (0, 0) if the
+        device has no per-key lighting."""
+        return (
+            self._get_dbus_property("KeyFrameWidth"),
+            self._get_dbus_property("KeyFrameHeight"),
+        )
+
+    @GObject.Property
+    def key_cells(self):
+        """A list of booleans, one per cell of the key frame row by row,
+        True if there is a key in that cell."""
+        return self._get_dbus_property("KeyCells")
+
+    def set_key_colors(self, x, y, width, height, colors):
+        """Sets the colors of a rectangle of the key frame. colors is a
+        list of width * height (r, g, b) tuples, row by row. Only the keys
+        that changed are written to the device."""
+        self._dbus_call("SetKeyColors", "uuuua(uuu)", x, y, width, height, list(colors))
+
+    def _stats_interface(self):
+        return self._interface.rsplit(".", 1)[0] + ".Stats"
+
+    def get_stats(self):
+        """Returns the runtime counters of the device as a dict mapping
+        the property names of the Stats interface to their values. The
+        counters do not signal changes, so they are fetched from ghostcatd
+        on every call."""
+        res = self._proxy.call_sync(
+            "org.freedesktop.DBus.Properties.GetAll",
+            GLib.Variant("(s)", (self._stats_interface(),)),
+            Gio.DBusCallFlags.NO_AUTO_START,
+            2000,
+            None,
+        )
+        return res.unpack()[0]
+
+    def reset_stats(self):
+        """Resets the runtime counters of the device to zero."""
+        self._proxy.call_sync(
+            f"{self._stats_interface()}.Reset",
+            None,
+            Gio.DBusCallFlags.NO_AUTO_START,
+            2000,
+            None,
+        )
+
 
 class RatbagdProfile(_RatbagdDBus):
     """Represents a ghostcatd profile."""
@@ -27,6 +27,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
+#include <poll.h>
 #include <unistd.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -61,21 +62,10 @@ open_receiver(const char *path)
 }
 
 static void
-list_connected_devices(struct lur_receiver *receiver)
+print_devices(struct lur_device **devices, int ndevices)
 {
-	_cleanup_free_ struct lur_device **devices = NULL;
-	int ndevices;
 	int i;
 
-	ndevices = lur_receiver_enumerate(receiver, &devices);
-	if (ndevices < 0) {
-		fprintf(stderr, "Failed to enumerate devices\n");
-		return;
-	} else if (ndevices == 0) {
-		fprintf(stderr, "No devices connected to this receiver\n");
-		return;
-	}
-
 	for (i = 0; i < ndevices; i++) {
 		struct lur_device *dev = devices[i];
 		const char *name, *strtype;
@@ -100,9 +90,74 @@ list_connected_devices(struct lur_receiver *receiver)
 		}
 
 		printf("%d: %s (%s) serial %#x\n", i, name, strtype, serial);
+	}
+}
+
+static void
+list_connected_devices(struct lur_receiver *receiver)
+{
+	_cleanup_free_ struct lur_device **devices = NULL;
+	int ndevices;
+	int i;
+
+	ndevices = lur_receiver_enumerate(receiver, &devices);
+	if (ndevices < 0) {
+		fprintf(stderr, "Failed to enumerate devices\n");
+		return;
+	} else if (ndevices == 0) {
+		fprintf(stderr, "No devices connected to this receiver\n");
+		return;
+	}
+
+	print_devices(devices, ndevices);
+
+	for (i = 0; i < ndevices; i++)
+		lur_device_unref(devices[i]);
+}
+
+static int
+monitor_receiver(struct lur_receiver *receiver)
+{
+	struct pollfd fds = {
+		.fd = lur_receiver_get_fd(receiver),
+		.events = POLLIN,
+	};
+	int rc;
 
-		lur_device_unref(dev);
+	rc = lur_receiver_enable_notifications(receiver);
+	if (rc) {
+		fprintf(stderr, "Failed to enable notifications (%s)\n",
+			strerror(-rc));
+		return rc;
 	}
+
+	rc = 1;
+	while (1) {
+		if (rc > 0) {
+			_cleanup_free_ struct lur_device **devices = NULL;
+			int ndevices;
+
+			ndevices = lur_receiver_enumerate(receiver, &devices);
+			if (ndevices < 0)
+				return ndevices;
+
+			printf("%d device(s) paired\n", ndevices);
+			print_devices(devices, ndevices);
+			fflush(stdout);
+		}
+
+		if (poll(&fds, 1, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+
+		rc = lur_receiver_dispatch(receiver);
+		if (rc < 0)
+			return rc;
+	}
+
+	return 0;
 }
 
 static void
@@ -176,6 +231,7 @@ usage(void)
 	       "  open ............. open receiver for pairing (timeout 30s)\n"
 	       "  close ............ close receiver if currently open\n"
 	       "  disconnect N ..... disconnect device N\n"
+	       "  monitor .......... print the paired devices whenever they change\n"
 	       "  find ............. find a receiver amongst the /dev/hidraw devices \n",
 	       program_invocation_short_name);
 }
@@ -233,6 +289,11 @@ main(int argc, char **argv)
 
 	if (streq(command, "list")) {
 		list_connected_devices(receiver);
+	} else if (streq(command, "monitor")) {
+		if (monitor_receiver(receiver) < 0) {
+			lur_receiver_unref(receiver);
+			return EXIT_FAILURE;
+		}
 	} else if (streq(command, "open")) {
 		lur_receiver_open(receiver, 0);
 	} else if (streq(command, "close")) {